@@ -25,6 +25,7 @@
     #include <qlo/config.hpp>
 #endif
 #include <qlo/abcd.hpp>
+#include <qlo/calibrationdiagnostics.hpp>
 #include <ql/termstructures/volatility/abcd.hpp>
 #include <ql/quotes/simplequote.hpp>
 #include <ql/termstructures/volatility/abcdcalibration.hpp>
@@ -57,10 +58,13 @@ namespace QuantLibAddin {
                bool permanent)
     : ObjectHandler::LibraryObject<QuantLib::AbcdCalibration>(properties, permanent) {
 
+        CalibrationDiagnostics::instance().clear(properties->objectId());
         libraryObject_ = boost::shared_ptr<QuantLib::AbcdCalibration>(new
             QuantLib::AbcdCalibration(times, blackVols, a, b, c, d,
                                       aIsFixed, bIsFixed, cIsFixed, dIsFixed,
-                                      vegaWeighted, endCriteria, method));
+                                      vegaWeighted, endCriteria,
+                                      recordingMethod(properties->objectId(),
+                                                      method)));
     }
 
 }
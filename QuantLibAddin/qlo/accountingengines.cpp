@@ -26,8 +26,21 @@
 #endif
 
 #include <qlo/accountingengines.hpp>
+#include <qlo/browniangenerators.hpp>
+#include <qlo/marketmodelevolvers.hpp>
+#include <qlo/parallel.hpp>
+#include <qlo/randomsequencegenerator.hpp>
 
 #include <ql/models/marketmodels/accountingengine.hpp>
+#include <ql/models/marketmodels/curvestate.hpp>
+#include <ql/models/marketmodels/evolutiondescription.hpp>
+#include <ql/models/marketmodels/marketmodel.hpp>
+#include <ql/models/marketmodels/evolvers/lognormalfwdratepc.hpp>
+#include <ql/models/marketmodels/evolvers/lognormalfwdrateipc.hpp>
+#include <ql/models/marketmodels/evolvers/normalfwdratepc.hpp>
+#include <ql/math/statistics/sequencestatistics.hpp>
+
+#include <boost/algorithm/string/case_conv.hpp>
 
 namespace QuantLibAddin {
     
@@ -45,5 +58,215 @@ namespace QuantLibAddin {
                                        initialNumeraireValue));
     }
    
-}
 
+    namespace {
+
+        // Values the paths of one block as QuantLib::AccountingEngine
+        // does, i.e., by converting each cash flow into numeraire bonds.
+        class BlockAccounting {
+          public:
+            BlockAccounting(
+                const ParallelAccountingEngine& engine,
+                std::vector<std::vector<QuantLib::Real> >& values,
+                std::vector<std::vector<QuantLib::Real> >& weights,
+                QuantLib::Size totalPaths,
+                QuantLib::Size pathsPerBlock)
+            : engine_(engine), values_(values), weights_(weights),
+              totalPaths_(totalPaths), pathsPerBlock_(pathsPerBlock) {}
+            void operator()(QuantLib::Size block) {
+                QuantLib::Size first = block*pathsPerBlock_;
+                QuantLib::Size paths =
+                    std::min(pathsPerBlock_, totalPaths_ - first);
+                engine_.blockValues(block, paths,
+                                    values_[block], weights_[block]);
+            }
+          private:
+            const ParallelAccountingEngine& engine_;
+            std::vector<std::vector<QuantLib::Real> >& values_;
+            std::vector<std::vector<QuantLib::Real> >& weights_;
+            QuantLib::Size totalPaths_, pathsPerBlock_;
+        };
+
+    }
+
+    ParallelAccountingEngine::ParallelAccountingEngine(
+        const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
+        const boost::shared_ptr<QuantLib::MarketModel>& marketModel,
+        const std::string& evolverType,
+        const std::vector<QuantLib::Size>& numeraires,
+        const QuantLib::Clone<QuantLib::MarketModelMultiProduct>& product,
+        QuantLib::Real initialNumeraireValue,
+        const boost::shared_ptr<RandomStreamFactory>& streams,
+        QuantLib::Size pathsPerBlock,
+        QuantLib::Size threads,
+        bool permanent)
+    : ObjectHandler::Object(properties, permanent),
+      marketModel_(marketModel), numeraires_(numeraires), product_(product),
+      initialNumeraireValue_(initialNumeraireValue), streams_(streams),
+      pathsPerBlock_(pathsPerBlock), threads_(threads) {
+        std::string type = boost::algorithm::to_upper_copy(evolverType);
+        if (type == "LOGNORMALFWDRATEPC")
+            evolverType_ = LogNormalPc;
+        else if (type == "LOGNORMALFWDRATEIPC")
+            evolverType_ = LogNormalIpc;
+        else if (type == "NORMALFWDRATEPC")
+            evolverType_ = NormalPc;
+        else if (type == "LOGNORMALFWDRATEPCPACKED")
+            evolverType_ = LogNormalPcPacked;
+        else if (type == "LOGNORMALFWDRATEIPCPACKED")
+            evolverType_ = LogNormalIpcPacked;
+        else if (type == "NORMALFWDRATEPCPACKED")
+            evolverType_ = NormalPcPacked;
+        else
+            QL_FAIL("unknown evolver type: " << evolverType);
+
+        QL_REQUIRE(streams_, "null random stream factory");
+        QL_REQUIRE(pathsPerBlock_ > 0, "null number of paths per block");
+        QL_REQUIRE(!streams_->lowDiscrepancy()
+                   || pathsPerBlock_ <= streams_->streamLength(),
+                   "blocks of " << pathsPerBlock_
+                   << " paths exceed Sobol streams of "
+                   << streams_->streamLength() << " points");
+
+        const std::vector<QuantLib::Time>& cashFlowTimes =
+            product_->possibleCashFlowTimes();
+        const std::vector<QuantLib::Time>& rateTimes =
+            product_->evolution().rateTimes();
+        for (QuantLib::Size j=0; j<cashFlowTimes.size(); ++j)
+            discounters_.push_back(
+                QuantLib::MarketModelDiscounter(cashFlowTimes[j], rateTimes));
+
+        // fail early on inconsistent inputs
+        evolver(StreamBrownianGeneratorFactory(streams_, 0));
+    }
+
+    boost::shared_ptr<QuantLib::MarketModelEvolver>
+    ParallelAccountingEngine::evolver(
+                const QuantLib::BrownianGeneratorFactory& generators) const {
+        switch (evolverType_) {
+          case LogNormalPc:
+            return boost::shared_ptr<QuantLib::MarketModelEvolver>(new
+                QuantLib::LogNormalFwdRatePc(marketModel_, generators,
+                                             numeraires_));
+          case LogNormalIpc:
+            return boost::shared_ptr<QuantLib::MarketModelEvolver>(new
+                QuantLib::LogNormalFwdRateIpc(marketModel_, generators,
+                                              numeraires_));
+          case NormalPc:
+            return boost::shared_ptr<QuantLib::MarketModelEvolver>(new
+                QuantLib::NormalFwdRatePc(marketModel_, generators,
+                                          numeraires_));
+          case LogNormalPcPacked:
+            return boost::shared_ptr<QuantLib::MarketModelEvolver>(new
+                PackedFwdRatePc(marketModel_, generators, numeraires_));
+          case LogNormalIpcPacked:
+            return boost::shared_ptr<QuantLib::MarketModelEvolver>(new
+                PackedFwdRateIpc(marketModel_, generators, numeraires_));
+          case NormalPcPacked:
+            return boost::shared_ptr<QuantLib::MarketModelEvolver>(new
+                PackedFwdRatePc(marketModel_, generators, numeraires_, true));
+          default:
+            QL_FAIL("unknown evolver type");
+        }
+    }
+
+    void ParallelAccountingEngine::blockValues(
+                                    QuantLib::Size block,
+                                    QuantLib::Size paths,
+                                    std::vector<QuantLib::Real>& values,
+                                    std::vector<QuantLib::Real>& weights) const {
+        boost::shared_ptr<QuantLib::MarketModelEvolver> evolver =
+            this->evolver(StreamBrownianGeneratorFactory(streams_, block));
+        QuantLib::Clone<QuantLib::MarketModelMultiProduct> product(product_);
+
+        QuantLib::Size numberProducts = product->numberOfProducts();
+        std::vector<QuantLib::Size> numberCashFlowsThisStep(numberProducts);
+        std::vector<std::vector<QuantLib::MarketModelMultiProduct::CashFlow> >
+            cashFlowsGenerated(numberProducts);
+        for (QuantLib::Size i=0; i<numberProducts; ++i)
+            cashFlowsGenerated[i].resize(
+                              product->maxNumberOfCashFlowsPerProductPerStep());
+        const std::vector<QuantLib::Size>& numeraires = evolver->numeraires();
+
+        values.resize(paths*numberProducts);
+        weights.resize(paths);
+        std::vector<QuantLib::Real> numerairesHeld(numberProducts);
+        for (QuantLib::Size k=0; k<paths; ++k) {
+            std::fill(numerairesHeld.begin(), numerairesHeld.end(), 0.0);
+            QuantLib::Real weight = evolver->startNewPath();
+            product->reset();
+            QuantLib::Real principalInNumerairePortfolio = 1.0;
+
+            bool done = false;
+            do {
+                QuantLib::Size thisStep = evolver->currentStep();
+                weight *= evolver->advanceStep();
+                done = product->nextTimeStep(evolver->currentState(),
+                                             numberCashFlowsThisStep,
+                                             cashFlowsGenerated);
+                QuantLib::Size numeraire = numeraires[thisStep];
+
+                for (QuantLib::Size i=0; i<numberProducts; ++i) {
+                    const std::vector<QuantLib::MarketModelMultiProduct::CashFlow>&
+                        cashflows = cashFlowsGenerated[i];
+                    for (QuantLib::Size j=0; j<numberCashFlowsThisStep[i]; ++j) {
+                        const QuantLib::MarketModelDiscounter& discounter =
+                            discounters_[cashflows[j].timeIndex];
+                        QuantLib::Real bonds = cashflows[j].amount *
+                            discounter.numeraireBonds(evolver->currentState(),
+                                                      numeraire);
+                        numerairesHeld[i] += bonds/principalInNumerairePortfolio;
+                    }
+                }
+
+                if (!done) {
+                    QuantLib::Size nextNumeraire = numeraires[thisStep+1];
+                    principalInNumerairePortfolio *=
+                        evolver->currentState().discountRatio(numeraire,
+                                                              nextNumeraire);
+                }
+            } while (!done);
+
+            for (QuantLib::Size i=0; i<numberProducts; ++i)
+                values[k*numberProducts+i] =
+                    numerairesHeld[i] * initialNumeraireValue_;
+            weights[k] = weight;
+        }
+    }
+
+    void ParallelAccountingEngine::multiplePathValues(
+                                    QuantLib::SequenceStatisticsInc& stats,
+                                    QuantLib::Size numberOfPaths) const {
+        QuantLib::Size blocks =
+            (numberOfPaths + pathsPerBlock_ - 1) / pathsPerBlock_;
+        if (streams_->lowDiscrepancy()) {
+            // Sobol streams are limited to 2^32 points overall
+            QL_REQUIRE(blocks <= 4294967296.0/streams_->streamLength(),
+                       numberOfPaths << " paths exceed the Sobol sequence");
+        }
+
+        // the market model caches its covariances on first use; they
+        // are computed here rather than by the evolvers in the workers
+        if (marketModel_->numberOfSteps() > 0) {
+            marketModel_->covariance(0);
+            marketModel_->totalCovariance(0);
+        }
+
+        std::vector<std::vector<QuantLib::Real> > values(blocks), weights(blocks);
+        BlockAccounting accounting(*this, values, weights,
+                                   numberOfPaths, pathsPerBlock_);
+        parallelFor(blocks, threads_, accounting);
+
+        QuantLib::Size numberProducts = product_->numberOfProducts();
+        std::vector<QuantLib::Real> pathValues(numberProducts);
+        for (QuantLib::Size b=0; b<blocks; ++b) {
+            for (QuantLib::Size k=0; k<weights[b].size(); ++k) {
+                std::copy(values[b].begin() + k*numberProducts,
+                          values[b].begin() + (k+1)*numberProducts,
+                          pathValues.begin());
+                stats.add(pathValues, weights[b][k]);
+            }
+        }
+    }
+
+}
@@ -25,16 +25,21 @@
 #define qla_accountingengines_hpp
 
 #include <oh/libraryobject.hpp>
+#include <qlo/sequencestatistics.hpp>
 
 #include <ql/types.hpp>
+#include <ql/utilities/clone.hpp>
+#include <ql/models/marketmodels/multiproduct.hpp>
+#include <ql/models/marketmodels/discounter.hpp>
+
+#include <string>
+#include <vector>
 
 namespace QuantLib {
     class AccountingEngine;
+    class BrownianGeneratorFactory;
+    class MarketModel;
     class MarketModelEvolver;
-    class MarketModelMultiProduct;
-
-    template <class T>
-    class Clone;
 }
 
 namespace QuantLibAddin {
@@ -50,6 +55,57 @@ namespace QuantLibAddin {
             bool permanent);
     };
 
+    class RandomStreamFactory;
+
+    //! Accounting engine simulating blocks of paths over a group of threads
+    /*! Paths are split into consecutive blocks of the given size; block
+        i is simulated by its own evolver, built on stream i of the given
+        factory, and by its own clone of the product.  Path values are
+        added to the statistics in path order once all blocks are done,
+        so that results are bitwise identical for any number of threads.
+
+        The evolvers are rebuilt for each block, as evolvers cannot be
+        copied; the market model is shared and must not be modified
+        during the simulation.  Its covariances, which it caches on
+        first use, are computed before the blocks are distributed.
+    */
+    class ParallelAccountingEngine : public ObjectHandler::Object {
+      public:
+        ParallelAccountingEngine(
+            const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
+            const boost::shared_ptr<QuantLib::MarketModel>& marketModel,
+            const std::string& evolverType,
+            const std::vector<QuantLib::Size>& numeraires,
+            const QuantLib::Clone<QuantLib::MarketModelMultiProduct>& product,
+            QuantLib::Real initialNumeraireValue,
+            const boost::shared_ptr<RandomStreamFactory>& streams,
+            QuantLib::Size pathsPerBlock,
+            QuantLib::Size threads,
+            bool permanent);
+        void multiplePathValues(QuantLib::SequenceStatisticsInc& stats,
+                                QuantLib::Size numberOfPaths) const;
+        //! evolver driven by the given Brownian generators
+        boost::shared_ptr<QuantLib::MarketModelEvolver> evolver(
+                const QuantLib::BrownianGeneratorFactory& generators) const;
+        //! path values of the given block, one row per path
+        void blockValues(QuantLib::Size block,
+                         QuantLib::Size paths,
+                         std::vector<QuantLib::Real>& values,
+                         std::vector<QuantLib::Real>& weights) const;
+      private:
+        enum EvolverType { LogNormalPc, LogNormalIpc, NormalPc,
+                           LogNormalPcPacked, LogNormalIpcPacked,
+                           NormalPcPacked };
+        boost::shared_ptr<QuantLib::MarketModel> marketModel_;
+        EvolverType evolverType_;
+        std::vector<QuantLib::Size> numeraires_;
+        QuantLib::Clone<QuantLib::MarketModelMultiProduct> product_;
+        QuantLib::Real initialNumeraireValue_;
+        boost::shared_ptr<RandomStreamFactory> streams_;
+        QuantLib::Size pathsPerBlock_, threads_;
+        std::vector<QuantLib::MarketModelDiscounter> discounters_;
+    };
+
  }
 
 #endif
@@ -26,13 +26,1052 @@
 #include <ql/experimental/credit/basecorrelationstructure.hpp>
 #include <ql/experimental/credit/basecorrelationlossmodel.hpp>
 #include <ql/experimental/credit/inhomogeneouspooldef.hpp>
+#include <ql/experimental/credit/lossdistribution.hpp>
 #include <ql/experimental/credit/randomdefaultlatentmodel.hpp>
 #include <ql/experimental/credit/randomlosslatentmodel.hpp>
 #include <ql/experimental/credit/saddlepointlossmodel.hpp>
 #include <ql/experimental/credit/recursivelossmodel.hpp>
+#include <ql/experimental/credit/basket.hpp>
+#include <ql/math/distributions/normaldistribution.hpp>
+#include <ql/math/randomnumbers/sobolrsg.hpp>
+#include <ql/patterns/lazyobject.hpp>
+#include <ql/settings.hpp>
+
+#include <qlo/factorintegration.hpp>
+#include <qlo/parallel.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <map>
 
 namespace QuantLibAddin {
 
+    namespace {
+
+        /* Monte Carlo simulation of the default times (and recoveries)
+           of the names in a basket under a Gaussian latent model, over a
+           group of threads.
+
+           As in QuantLib::RandomLM, the variables of each path are the
+           points of a Sobol sequence mapped through the inverse
+           cumulative normal, and the events are stored by path so that
+           any date can be queried after a single simulation.  Paths are
+           simulated in fixed blocks of consecutive points, each block
+           skipping the sequence to its first point; every path is thus
+           the same for any number of threads, and the statistics are
+           accumulated over the paths in order, so that results do not
+           depend on the number of threads either.
+
+           Default times are found by bisection on whole days from the
+           evaluation date, up to the horizon used by QuantLib::RandomLM;
+           defaults on the same day are ordered by name.  Tranche loss
+           measures, n-th event probabilities, loss splits and default
+           correlations are all estimated from the stored paths.
+        */
+        class ParallelRandomLM : public virtual QuantLib::LazyObject,
+                                 public virtual QuantLib::DefaultLossModel {
+          public:
+            ParallelRandomLM(QuantLib::Size numSims,
+                             QuantLib::Size threads,
+                             QuantLib::BigNatural seed)
+            : numSims_(numSims), threads_(threads), seed_(seed) {
+                QL_REQUIRE(numSims > 0, "null number of simulations");
+                QL_REQUIRE(numSims < 4294967295.0,
+                           "too many simulations: " << numSims);
+                // as in QuantLib::RandomLM; the paths are simulated from
+                // the evaluation date
+                registerWith(QuantLib::Settings::instance().evaluationDate());
+                registerWith(basket_);
+            }
+            void simulateBlock(QuantLib::Size block) const;
+            //! \name DefaultLossModel interface
+            //@{
+            QuantLib::Real expectedTrancheLoss(const QuantLib::Date& d) const;
+            QuantLib::Probability probOverLoss(const QuantLib::Date& d,
+                                               QuantLib::Real lossFraction) const;
+            QuantLib::Real percentile(const QuantLib::Date& d,
+                                      QuantLib::Real percentile) const;
+            QuantLib::Real expectedShortfall(const QuantLib::Date& d,
+                                             QuantLib::Probability percentile) const;
+            QuantLib::Probability probAtLeastNEvents(QuantLib::Size n,
+                                                     const QuantLib::Date& d) const;
+            QuantLib::Disposable<std::vector<QuantLib::Probability> >
+            probsBeingNthEvent(QuantLib::Size n,
+                               const QuantLib::Date& d) const;
+            QuantLib::Disposable<std::vector<QuantLib::Real> >
+            splitVaRLevel(const QuantLib::Date& d, QuantLib::Real loss) const;
+            QuantLib::Real defaultCorrelation(const QuantLib::Date& d,
+                                              QuantLib::Size iName,
+                                              QuantLib::Size jName) const;
+            //@}
+          protected:
+            //! number of systemic and idiosyncratic variables per path
+            virtual QuantLib::Size dimension() const = 0;
+            virtual void resetLatentModel() = 0;
+            //! probability matched by the latent variable of the given name
+            virtual QuantLib::Probability defaultProbability(
+                                    const std::vector<QuantLib::Real>& sample,
+                                    QuantLib::Size iName) const = 0;
+            virtual QuantLib::Real recovery(
+                                    const std::vector<QuantLib::Real>& sample,
+                                    QuantLib::Size iName,
+                                    const QuantLib::Date& eventDate) const = 0;
+          private:
+            struct Event {
+                Event(QuantLib::Size name, QuantLib::Size day,
+                      QuantLib::Real recovery)
+                : name(name), day(day), recovery(recovery) {}
+                QuantLib::Size name, day;
+                QuantLib::Real recovery;
+            };
+            void resetModel() {
+                resetLatentModel();
+                update();
+            }
+            void performCalculations() const;
+            QuantLib::Size defaultDay(QuantLib::Size iName,
+                                      QuantLib::Probability p) const;
+            // tranche losses of all paths at the given date
+            std::vector<QuantLib::Real> trancheLosses(
+                                            const QuantLib::Date& d) const;
+            static const QuantLib::Size horizon_ = 4050;
+            static const QuantLib::Size blockSize_ = 1024;
+            QuantLib::Size numSims_, threads_;
+            QuantLib::BigNatural seed_;
+            mutable QuantLib::Date today_;
+            mutable std::vector<QuantLib::Handle<
+                QuantLib::DefaultProbabilityTermStructure> > curves_;
+            mutable std::vector<QuantLib::Probability> horizonProbabilities_;
+            mutable std::vector<std::vector<Event> > sims_;
+        };
+
+        class SimulationBlocks {
+          public:
+            explicit SimulationBlocks(const ParallelRandomLM& model)
+            : model_(model) {}
+            void operator()(QuantLib::Size block) {
+                model_.simulateBlock(block);
+            }
+          private:
+            const ParallelRandomLM& model_;
+        };
+
+        void ParallelRandomLM::performCalculations() const {
+            today_ = QuantLib::Settings::instance().evaluationDate();
+            const boost::shared_ptr<QuantLib::Pool>& pool = basket_->pool();
+            const std::vector<std::string>& names = basket_->names();
+            std::vector<QuantLib::DefaultProbKey> keys = basket_->defaultKeys();
+            QuantLib::Date horizon =
+                today_ + QuantLib::Period(QuantLib::Integer(horizon_),
+                                          QuantLib::Days);
+            // the default curves are bootstrapped here, before the
+            // simulation is distributed
+            curves_.clear();
+            horizonProbabilities_.clear();
+            for (QuantLib::Size i=0; i<names.size(); ++i) {
+                curves_.push_back(
+                    pool->get(names[i]).defaultProbability(keys[i]));
+                horizonProbabilities_.push_back(
+                    curves_[i]->defaultProbability(horizon, true));
+            }
+
+            sims_.assign(numSims_, std::vector<Event>());
+            SimulationBlocks blocks(*this);
+            parallelFor((numSims_ + blockSize_ - 1)/blockSize_,
+                        threads_, blocks);
+        }
+
+        void ParallelRandomLM::simulateBlock(QuantLib::Size block) const {
+            QuantLib::Size first = block*blockSize_;
+            QuantLib::Size last = std::min(first + blockSize_, numSims_);
+            QuantLib::SobolRsg rsg(dimension(), seed_);
+            if (first > 0)
+                rsg.skipTo(boost::uint32_t(first));
+            QuantLib::InverseCumulativeNormal icn;
+            std::vector<QuantLib::Real> sample(dimension());
+            for (QuantLib::Size s=first; s<last; ++s) {
+                const std::vector<QuantLib::Real>& u =
+                    rsg.nextSequence().value;
+                for (QuantLib::Size k=0; k<sample.size(); ++k)
+                    sample[k] = icn(u[k]);
+                std::vector<Event>& events = sims_[s];
+                for (QuantLib::Size i=0; i<curves_.size(); ++i) {
+                    QuantLib::Probability p = defaultProbability(sample, i);
+                    if (p > horizonProbabilities_[i])
+                        continue;
+                    QuantLib::Size day = defaultDay(i, p);
+                    QuantLib::Date eventDate = today_ +
+                        QuantLib::Period(QuantLib::Integer(day),
+                                         QuantLib::Days);
+                    events.push_back(
+                        Event(i, day, recovery(sample, i, eventDate)));
+                }
+            }
+        }
+
+        QuantLib::Size ParallelRandomLM::defaultDay(
+                                            QuantLib::Size iName,
+                                            QuantLib::Probability p) const {
+            // first day by which the name has defaulted with probability p
+            QuantLib::Size lo = 0, hi = horizon_;
+            while (lo < hi) {
+                QuantLib::Size mid = (lo + hi)/2;
+                QuantLib::Date d = today_ +
+                    QuantLib::Period(QuantLib::Integer(mid), QuantLib::Days);
+                if (curves_[iName]->defaultProbability(d, true) >= p)
+                    hi = mid;
+                else
+                    lo = mid + 1;
+            }
+            return lo;
+        }
+
+        std::vector<QuantLib::Real> ParallelRandomLM::trancheLosses(
+                                            const QuantLib::Date& d) const {
+            calculate();
+            QuantLib::Real attachment = basket_->remainingAttachmentAmount();
+            QuantLib::Real detachment = basket_->remainingDetachmentAmount();
+            const std::vector<QuantLib::Real>& notionals =
+                                                        basket_->notionals();
+            std::vector<QuantLib::Real> losses(numSims_, 0.0);
+            if (d < today_)
+                return losses;
+            QuantLib::Size days = QuantLib::Size(d - today_);
+            for (QuantLib::Size s=0; s<numSims_; ++s) {
+                QuantLib::Real loss = 0.0;
+                const std::vector<Event>& events = sims_[s];
+                for (QuantLib::Size k=0; k<events.size(); ++k)
+                    if (events[k].day <= days)
+                        loss += notionals[events[k].name]
+                              * (1.0 - events[k].recovery);
+                losses[s] = std::min(std::max(loss - attachment, 0.0),
+                                     detachment - attachment);
+            }
+            return losses;
+        }
+
+        QuantLib::Real ParallelRandomLM::expectedTrancheLoss(
+                                            const QuantLib::Date& d) const {
+            std::vector<QuantLib::Real> losses = trancheLosses(d);
+            QuantLib::Real sum = 0.0;
+            for (QuantLib::Size s=0; s<losses.size(); ++s)
+                sum += losses[s];
+            return sum/numSims_;
+        }
+
+        QuantLib::Probability ParallelRandomLM::probOverLoss(
+                                        const QuantLib::Date& d,
+                                        QuantLib::Real lossFraction) const {
+            QL_REQUIRE(lossFraction >= 0.0 && lossFraction <= 1.0,
+                       "incorrect loss fraction: " << lossFraction);
+            std::vector<QuantLib::Real> losses = trancheLosses(d);
+            QuantLib::Real threshold = lossFraction *
+                (basket_->remainingDetachmentAmount()
+                 - basket_->remainingAttachmentAmount());
+            QuantLib::Size count = 0;
+            for (QuantLib::Size s=0; s<losses.size(); ++s)
+                if (losses[s] >= threshold)
+                    ++count;
+            return QuantLib::Real(count)/numSims_;
+        }
+
+        QuantLib::Real ParallelRandomLM::percentile(
+                                        const QuantLib::Date& d,
+                                        QuantLib::Real percentile) const {
+            QL_REQUIRE(percentile >= 0.0 && percentile <= 1.0,
+                       "incorrect percentile: " << percentile);
+            std::vector<QuantLib::Real> losses = trancheLosses(d);
+            QuantLib::Size position = std::min<QuantLib::Size>(
+                QuantLib::Size(percentile*numSims_), numSims_-1);
+            std::nth_element(losses.begin(), losses.begin()+position,
+                             losses.end());
+            return losses[position];
+        }
+
+        QuantLib::Real ParallelRandomLM::expectedShortfall(
+                                    const QuantLib::Date& d,
+                                    QuantLib::Probability percentile) const {
+            QL_REQUIRE(percentile >= 0.0 && percentile <= 1.0,
+                       "incorrect percentile: " << percentile);
+            std::vector<QuantLib::Real> losses = trancheLosses(d);
+            std::sort(losses.begin(), losses.end());
+            QuantLib::Size position = std::min<QuantLib::Size>(
+                QuantLib::Size(percentile*numSims_), numSims_-1);
+            QuantLib::Real sum = 0.0;
+            for (QuantLib::Size s=position; s<numSims_; ++s)
+                sum += losses[s];
+            return sum/(numSims_ - position);
+        }
+
+        QuantLib::Probability ParallelRandomLM::probAtLeastNEvents(
+                                        QuantLib::Size n,
+                                        const QuantLib::Date& d) const {
+            calculate();
+            if (d < today_)
+                return n == 0 ? 1.0 : 0.0;
+            QuantLib::Size days = QuantLib::Size(d - today_);
+            QuantLib::Size count = 0;
+            for (QuantLib::Size s=0; s<numSims_; ++s) {
+                QuantLib::Size defaults = 0;
+                const std::vector<Event>& events = sims_[s];
+                for (QuantLib::Size k=0; k<events.size(); ++k)
+                    if (events[k].day <= days)
+                        ++defaults;
+                if (defaults >= n)
+                    ++count;
+            }
+            return QuantLib::Real(count)/numSims_;
+        }
+
+        QuantLib::Disposable<std::vector<QuantLib::Probability> >
+        ParallelRandomLM::probsBeingNthEvent(QuantLib::Size n,
+                                             const QuantLib::Date& d) const {
+            QL_REQUIRE(n > 0, "the event order must be positive");
+            calculate();
+            std::vector<QuantLib::Probability> probs(curves_.size(), 0.0);
+            if (d < today_)
+                return probs;
+            QuantLib::Size days = QuantLib::Size(d - today_);
+            std::vector<std::pair<QuantLib::Size, QuantLib::Size> > defaults;
+            for (QuantLib::Size s=0; s<numSims_; ++s) {
+                // defaults by day, ties broken by name
+                defaults.clear();
+                const std::vector<Event>& events = sims_[s];
+                for (QuantLib::Size k=0; k<events.size(); ++k)
+                    if (events[k].day <= days)
+                        defaults.push_back(
+                            std::make_pair(events[k].day, events[k].name));
+                if (defaults.size() < n)
+                    continue;
+                std::nth_element(defaults.begin(), defaults.begin()+n-1,
+                                 defaults.end());
+                probs[defaults[n-1].second] += 1.0;
+            }
+            for (QuantLib::Size i=0; i<probs.size(); ++i)
+                probs[i] /= numSims_;
+            return probs;
+        }
+
+        QuantLib::Disposable<std::vector<QuantLib::Real> >
+        ParallelRandomLM::splitVaRLevel(const QuantLib::Date& d,
+                                        QuantLib::Real loss) const {
+            // average share of each name in the pool loss over the paths
+            // whose tranche loss reaches the given level
+            calculate();
+            std::vector<QuantLib::Real> split(curves_.size(), 0.0);
+            QuantLib::Real attachment = basket_->remainingAttachmentAmount();
+            QuantLib::Real detachment = basket_->remainingDetachmentAmount();
+            const std::vector<QuantLib::Real>& notionals =
+                                                        basket_->notionals();
+            QuantLib::Size days = d < today_ ? 0 : QuantLib::Size(d - today_);
+            QuantLib::Size paths = 0;
+            std::vector<QuantLib::Real> pathSplit(curves_.size());
+            for (QuantLib::Size s=0; s<numSims_ && d >= today_; ++s) {
+                std::fill(pathSplit.begin(), pathSplit.end(), 0.0);
+                QuantLib::Real poolLoss = 0.0;
+                const std::vector<Event>& events = sims_[s];
+                for (QuantLib::Size k=0; k<events.size(); ++k) {
+                    if (events[k].day <= days) {
+                        QuantLib::Real l = notionals[events[k].name]
+                                         * (1.0 - events[k].recovery);
+                        pathSplit[events[k].name] += l;
+                        poolLoss += l;
+                    }
+                }
+                QuantLib::Real trancheLoss =
+                    std::min(std::max(poolLoss - attachment, 0.0),
+                             detachment - attachment);
+                if (poolLoss > 0.0 && trancheLoss >= loss) {
+                    ++paths;
+                    for (QuantLib::Size i=0; i<split.size(); ++i)
+                        split[i] += pathSplit[i]/poolLoss;
+                }
+            }
+            QL_REQUIRE(paths > 0,
+                       "no simulated tranche loss reaches " << loss);
+            for (QuantLib::Size i=0; i<split.size(); ++i)
+                split[i] *= loss/paths;
+            return split;
+        }
+
+        QuantLib::Real ParallelRandomLM::defaultCorrelation(
+                                            const QuantLib::Date& d,
+                                            QuantLib::Size iName,
+                                            QuantLib::Size jName) const {
+            calculate();
+            QL_REQUIRE(iName < curves_.size() && jName < curves_.size(),
+                       "name index out of range");
+            if (d < today_)
+                return 0.0;
+            QuantLib::Size days = QuantLib::Size(d - today_);
+            QuantLib::Size iDefaults = 0, jDefaults = 0, joint = 0;
+            for (QuantLib::Size s=0; s<numSims_; ++s) {
+                bool iDefault = false, jDefault = false;
+                const std::vector<Event>& events = sims_[s];
+                for (QuantLib::Size k=0; k<events.size(); ++k) {
+                    if (events[k].day <= days) {
+                        iDefault = iDefault || events[k].name == iName;
+                        jDefault = jDefault || events[k].name == jName;
+                    }
+                }
+                if (iDefault)
+                    ++iDefaults;
+                if (jDefault)
+                    ++jDefaults;
+                if (iDefault && jDefault)
+                    ++joint;
+            }
+            QuantLib::Real pi = QuantLib::Real(iDefaults)/numSims_,
+                           pj = QuantLib::Real(jDefaults)/numSims_,
+                           pij = QuantLib::Real(joint)/numSims_;
+            QuantLib::Real variance = pi*(1.0-pi)*pj*(1.0-pj);
+            if (variance == 0.0)
+                return 0.0;
+            return (pij - pi*pj)/std::sqrt(variance);
+        }
+
+        // defaults with constant recoveries
+        class ParallelGaussianRandomDefaultLM : public ParallelRandomLM {
+          public:
+            ParallelGaussianRandomDefaultLM(
+                    const boost::shared_ptr<QuantLib::GaussianConstantLossLM>& model,
+                    const std::vector<QuantLib::Real>& recoveries,
+                    QuantLib::Size numSims,
+                    QuantLib::Size threads,
+                    QuantLib::BigNatural seed)
+            : ParallelRandomLM(numSims, threads, seed),
+              model_(model), recoveries_(recoveries) {}
+          protected:
+            QuantLib::Size dimension() const {
+                return model_->numFactors() + model_->size();
+            }
+            void resetLatentModel() {
+                QL_REQUIRE(basket_->size() == recoveries_.size(),
+                           "basket of " << basket_->size() << " names for "
+                           << recoveries_.size() << " recovery rates");
+                model_->resetBasket(basket_.currentLink());
+            }
+            QuantLib::Probability defaultProbability(
+                                const std::vector<QuantLib::Real>& sample,
+                                QuantLib::Size iName) const {
+                return model_->cumulativeY(
+                            model_->latentVarValue(sample, iName), iName);
+            }
+            QuantLib::Real recovery(const std::vector<QuantLib::Real>&,
+                                    QuantLib::Size iName,
+                                    const QuantLib::Date&) const {
+                return recoveries_[iName];
+            }
+          private:
+            boost::shared_ptr<QuantLib::GaussianConstantLossLM> model_;
+            std::vector<QuantLib::Real> recoveries_;
+        };
+
+        // defaults with recoveries correlated through the spot loss model
+        class ParallelGaussianRandomLossLM : public ParallelRandomLM {
+          public:
+            ParallelGaussianRandomLossLM(
+                    const boost::shared_ptr<QuantLib::GaussianSpotLossLM>& model,
+                    QuantLib::Size numSims,
+                    QuantLib::Size threads,
+                    QuantLib::BigNatural seed)
+            : ParallelRandomLM(numSims, threads, seed), model_(model) {}
+          protected:
+            QuantLib::Size dimension() const {
+                return model_->numFactors() + model_->size();
+            }
+            void resetLatentModel() {
+                model_->resetBasket(basket_.currentLink());
+            }
+            QuantLib::Probability defaultProbability(
+                                const std::vector<QuantLib::Real>& sample,
+                                QuantLib::Size iName) const {
+                return model_->cumulativeY(
+                            model_->latentVarValue(sample, iName), iName);
+            }
+            QuantLib::Real recovery(const std::vector<QuantLib::Real>& sample,
+                                    QuantLib::Size iName,
+                                    const QuantLib::Date& eventDate) const {
+                return std::min(model_->conditionalRecovery(
+                                    model_->latentRRVarValue(sample, iName),
+                                    iName, eventDate),
+                                1.0 - QL_EPSILON);
+            }
+          private:
+            boost::shared_ptr<QuantLib::GaussianSpotLossLM> model_;
+        };
+
+        // seed of the Sobol sequences used by QuantLib::RandomLM
+        const QuantLib::BigNatural randomLMSeed = 2863311530UL;
+
+        /* Loss distributions of a pool conditional on the nodes of the
+           systemic factor, bucketed up to the given maximum loss; the
+           probability of losses beyond it is kept in a last bucket, at
+           the maximum.  Nodes are split into interleaved groups, each
+           with its own bucketing, and results are stored by node. */
+        class NodeLossDistributions {
+          public:
+            NodeLossDistributions(
+                    const std::vector<QuantLib::Real>& volumes,
+                    const std::vector<std::vector<QuantLib::Real> >& probabilities,
+                    QuantLib::Size nBuckets,
+                    QuantLib::Real maximum,
+                    QuantLib::Size groups,
+                    std::vector<std::vector<QuantLib::Real> >& masses,
+                    std::vector<std::vector<QuantLib::Real> >& losses)
+            : volumes_(volumes), probabilities_(probabilities),
+              nBuckets_(nBuckets), maximum_(maximum), groups_(groups),
+              masses_(masses), losses_(losses) {}
+            void operator()(QuantLib::Size g) {
+                QuantLib::LossDistBucketing bucketing(int(nBuckets_),
+                                                      maximum_);
+                for (QuantLib::Size k=g; k<probabilities_.size();
+                     k+=groups_) {
+                    QuantLib::Distribution dist =
+                        bucketing(volumes_, probabilities_[k]);
+                    std::vector<QuantLib::Real>& masses = masses_[k];
+                    std::vector<QuantLib::Real>& losses = losses_[k];
+                    masses.resize(dist.size() + 1);
+                    losses.resize(dist.size() + 1);
+                    QuantLib::Real bucketed = 0.0;
+                    for (QuantLib::Size j=0; j<dist.size(); ++j) {
+                        masses[j] = dist.density(j)*dist.dx(j);
+                        losses[j] = dist.average(j);
+                        bucketed += masses[j];
+                    }
+                    // the bucketing drops the losses beyond the maximum
+                    masses.back() = std::max(1.0 - bucketed, 0.0);
+                    losses.back() = maximum_;
+                }
+            }
+          private:
+            const std::vector<QuantLib::Real>& volumes_;
+            const std::vector<std::vector<QuantLib::Real> >& probabilities_;
+            QuantLib::Size nBuckets_;
+            QuantLib::Real maximum_;
+            QuantLib::Size groups_;
+            std::vector<std::vector<QuantLib::Real> >& masses_;
+            std::vector<std::vector<QuantLib::Real> >& losses_;
+        };
+
+        /* Unconditional loss distribution of a pool under a one-factor
+           latent model: the conditional distributions at the nodes of a
+           midpoint rule on the systemic factor, given the default
+           probabilities of the names at each node, are bucketed up to
+           the given maximum loss and integrated against the factor
+           density over a group of threads.  The nodes are summed in
+           order, so that results do not depend on the number of
+           threads.  Returns the probability and the average pool loss
+           of each bucket; the last bucket holds the losses beyond the
+           maximum, at the maximum itself. */
+        void integratePoolLoss(
+                const std::vector<QuantLib::Real>& volumes,
+                const FactorQuadrature& quadrature,
+                const std::vector<std::vector<QuantLib::Real> >& probabilities,
+                QuantLib::Size nBuckets,
+                QuantLib::Real maximum,
+                QuantLib::Size threads,
+                std::vector<QuantLib::Real>& masses,
+                std::vector<QuantLib::Real>& losses) {
+            QL_REQUIRE(maximum > 0.0, "non-positive maximum loss: " << maximum);
+            QuantLib::Size nSteps = quadrature.nodes.size();
+            std::vector<std::vector<QuantLib::Real> > nodeMasses(nSteps),
+                                                      nodeLosses(nSteps);
+            QuantLib::Size groups = workerThreads(threads, nSteps);
+            NodeLossDistributions bucketing(volumes, probabilities, nBuckets,
+                                            maximum, groups,
+                                            nodeMasses, nodeLosses);
+            parallelFor(groups, groups, bucketing);
+
+            QuantLib::Size n = nodeMasses[0].size();
+            masses.assign(n, 0.0);
+            losses.assign(n, 0.0);
+            for (QuantLib::Size k=0; k<nSteps; ++k) {
+                QuantLib::Real weight = quadrature.weights[k];
+                for (QuantLib::Size j=0; j<n; ++j) {
+                    masses[j] += weight*nodeMasses[k][j];
+                    losses[j] += weight*nodeMasses[k][j]*nodeLosses[k][j];
+                }
+            }
+            for (QuantLib::Size j=0; j<n-1; ++j) {
+                if (masses[j] > 0.0)
+                    losses[j] /= masses[j];
+                else
+                    losses[j] = (j + 0.5)*maximum/(n-1);
+            }
+            losses[n-1] = maximum;
+        }
+
+        /* Loss model of an inhomogeneous pool under a one-factor latent
+           model, as QuantLib::InhomogeneousPoolLossModel: the loss
+           distributions conditional on the nodes of a midpoint rule on
+           the systemic factor are built by bucketing and integrated
+           against the factor density.  The nodes are integrated over a
+           group of threads and summed in node order, so that results do
+           not depend on the number of threads.
+
+           As in QuantLib, the buckets span the tranche up to its
+           detachment.  The expected tranche loss is the difference of
+           the expected losses of the equity tranches up to the
+           detachment and the attachment, each bucketed on its own grid,
+           so that the average loss of each bucket is not cut at the
+           attachment.  The default probabilities of the names at each
+           node are kept by date, together with the losses and
+           probabilities of the names they were computed from, and so
+           are the distributions bucketed for each tranche edge; the
+           tranches of a basket sharing the pool thus only rebucket the
+           conditional distributions for their own edges.
+        */
+        template <class CP>
+        class ParallelPoolLossModel
+            : public virtual QuantLib::DefaultLossModel {
+          public:
+            ParallelPoolLossModel(
+                const boost::shared_ptr<QuantLib::ConstantLossLatentmodel<CP> >& model,
+                QuantLib::Size nBuckets,
+                QuantLib::Real max,
+                QuantLib::Real min,
+                QuantLib::Size nSteps,
+                QuantLib::Size threads)
+            : model_(model), nBuckets_(nBuckets), threads_(threads),
+              quadrature_(factorQuadrature(*model, min, max, nSteps)) {
+                QL_REQUIRE(nBuckets_ > 0, "null number of buckets");
+            }
+            //! \name DefaultLossModel interface
+            //@{
+            QuantLib::Real expectedTrancheLoss(const QuantLib::Date& d) const;
+            QuantLib::Probability probOverLoss(const QuantLib::Date& d,
+                                               QuantLib::Real lossFraction) const;
+            QuantLib::Real percentile(const QuantLib::Date& d,
+                                      QuantLib::Real percentile) const;
+            QuantLib::Real expectedShortfall(const QuantLib::Date& d,
+                                             QuantLib::Probability percentile) const;
+            //@}
+          private:
+            struct LossDistribution {
+                // probability and average pool loss of each bucket
+                std::vector<QuantLib::Real> masses, losses;
+            };
+            struct PoolDistributions {
+                // inputs the distributions were built from
+                std::vector<QuantLib::Real> volumes, probabilities;
+                // default probabilities of the names at each node
+                std::vector<std::vector<QuantLib::Real> > conditional;
+                // by maximum loss bucketed
+                std::map<QuantLib::Real, LossDistribution> distributions;
+            };
+            void resetModel() {
+                model_->resetBasket(basket_.currentLink());
+                cache_.clear();
+            }
+            const LossDistribution& lossDistribution(
+                                            const QuantLib::Date& d,
+                                            QuantLib::Real maximum) const;
+            QuantLib::Real equityTrancheLoss(const QuantLib::Date& d,
+                                             QuantLib::Real detachment) const;
+            QuantLib::Real trancheLoss(QuantLib::Real loss) const {
+                QuantLib::Real attachment =
+                    basket_->remainingAttachmentAmount();
+                QuantLib::Real detachment =
+                    basket_->remainingDetachmentAmount();
+                return std::min(std::max(loss - attachment, 0.0),
+                                detachment - attachment);
+            }
+            boost::shared_ptr<QuantLib::ConstantLossLatentmodel<CP> > model_;
+            QuantLib::Size nBuckets_, threads_;
+            FactorQuadrature quadrature_;
+            mutable std::map<QuantLib::Date, PoolDistributions> cache_;
+        };
+
+        template <class CP>
+        const typename ParallelPoolLossModel<CP>::LossDistribution&
+        ParallelPoolLossModel<CP>::lossDistribution(
+                                            const QuantLib::Date& d,
+                                            QuantLib::Real maximum) const {
+            std::vector<QuantLib::Real> notionals =
+                basket_->remainingNotionals(d);
+            std::vector<QuantLib::Probability> probabilities =
+                basket_->remainingProbabilities(d);
+            const std::vector<QuantLib::Real>& recoveries =
+                model_->recoveries();
+            QL_REQUIRE(notionals.size() == recoveries.size(),
+                       notionals.size() << " live names for "
+                       << recoveries.size() << " recovery rates");
+            std::vector<QuantLib::Real> volumes(notionals.size());
+            for (QuantLib::Size i=0; i<volumes.size(); ++i)
+                volumes[i] = notionals[i]*(1.0 - recoveries[i]);
+
+            PoolDistributions& pool = cache_[d];
+            if (pool.probabilities != probabilities) {
+                std::vector<QuantLib::Real> invProbabilities(
+                                                        probabilities.size());
+                for (QuantLib::Size i=0; i<invProbabilities.size(); ++i)
+                    invProbabilities[i] =
+                        model_->inverseCumulativeY(probabilities[i], i);
+                pool.probabilities.clear();
+                pool.distributions.clear();
+                conditionalDefaultProbabilities(*model_, invProbabilities,
+                                                quadrature_, threads_,
+                                                pool.conditional);
+                pool.probabilities = probabilities;
+            }
+            if (pool.volumes != volumes) {
+                pool.distributions.clear();
+                pool.volumes = volumes;
+            }
+
+            typename std::map<QuantLib::Real, LossDistribution>::const_iterator
+                i = pool.distributions.find(maximum);
+            if (i != pool.distributions.end())
+                return i->second;
+            LossDistribution dist;
+            integratePoolLoss(volumes, quadrature_, pool.conditional,
+                              nBuckets_, maximum, threads_,
+                              dist.masses, dist.losses);
+            return pool.distributions[maximum] = dist;
+        }
+
+        template <class CP>
+        QuantLib::Real ParallelPoolLossModel<CP>::equityTrancheLoss(
+                                        const QuantLib::Date& d,
+                                        QuantLib::Real detachment) const {
+            if (detachment <= 0.0)
+                return 0.0;
+            // the losses of the last bucket are cut at the detachment
+            const LossDistribution& dist = lossDistribution(d, detachment);
+            QuantLib::Real expected = 0.0;
+            for (QuantLib::Size j=0; j<dist.masses.size(); ++j)
+                expected += dist.masses[j]*dist.losses[j];
+            return expected;
+        }
+
+        template <class CP>
+        QuantLib::Real ParallelPoolLossModel<CP>::expectedTrancheLoss(
+                                            const QuantLib::Date& d) const {
+            return equityTrancheLoss(d, basket_->remainingDetachmentAmount())
+                 - equityTrancheLoss(d, basket_->remainingAttachmentAmount());
+        }
+
+        template <class CP>
+        QuantLib::Probability ParallelPoolLossModel<CP>::probOverLoss(
+                                        const QuantLib::Date& d,
+                                        QuantLib::Real lossFraction) const {
+            QL_REQUIRE(lossFraction >= 0.0 && lossFraction <= 1.0,
+                       "incorrect loss fraction: " << lossFraction);
+            const LossDistribution& dist =
+                lossDistribution(d, basket_->remainingDetachmentAmount());
+            QuantLib::Real threshold = lossFraction *
+                (basket_->remainingDetachmentAmount()
+                 - basket_->remainingAttachmentAmount());
+            QuantLib::Probability p = 0.0;
+            for (QuantLib::Size j=0; j<dist.masses.size(); ++j)
+                if (trancheLoss(dist.losses[j]) >= threshold)
+                    p += dist.masses[j];
+            return p;
+        }
+
+        template <class CP>
+        QuantLib::Real ParallelPoolLossModel<CP>::percentile(
+                                        const QuantLib::Date& d,
+                                        QuantLib::Real percentile) const {
+            QL_REQUIRE(percentile >= 0.0 && percentile <= 1.0,
+                       "incorrect percentile: " << percentile);
+            const LossDistribution& dist =
+                lossDistribution(d, basket_->remainingDetachmentAmount());
+            QuantLib::Real cumulative = 0.0;
+            for (QuantLib::Size j=0; j<dist.masses.size(); ++j) {
+                cumulative += dist.masses[j];
+                if (cumulative >= percentile)
+                    return trancheLoss(dist.losses[j]);
+            }
+            return trancheLoss(dist.losses.back());
+        }
+
+        template <class CP>
+        QuantLib::Real ParallelPoolLossModel<CP>::expectedShortfall(
+                                    const QuantLib::Date& d,
+                                    QuantLib::Probability percentile) const {
+            QL_REQUIRE(percentile >= 0.0 && percentile <= 1.0,
+                       "incorrect percentile: " << percentile);
+            const LossDistribution& dist =
+                lossDistribution(d, basket_->remainingDetachmentAmount());
+            QuantLib::Size first = 0;
+            QuantLib::Real cumulative = 0.0;
+            while (first < dist.masses.size()-1 &&
+                   cumulative + dist.masses[first] < percentile)
+                cumulative += dist.masses[first++];
+            QuantLib::Real tail = 0.0, shortfall = 0.0;
+            for (QuantLib::Size j=first; j<dist.masses.size(); ++j) {
+                tail += dist.masses[j];
+                shortfall += dist.masses[j]*trancheLoss(dist.losses[j]);
+            }
+            return tail > 0.0 ? shortfall/tail
+                              : trancheLoss(dist.losses.back());
+        }
+
+        // factor range of QuantLib::InhomogeneousPoolLossModel
+        const QuantLib::Real poolFactorMax = 5.0, poolFactorMin = -5.0;
+
+        /* Binomial loss model whose expected tranche loss integrates the
+           conditional tranche loss of QuantLib::BinomialLossModel over
+           the nodes of a midpoint rule on the systemic factor, over a
+           group of threads; the other measures are those of QuantLib. */
+        template <class LLM>
+        class ParallelBinomialLossModel
+            : public QuantLib::BinomialLossModel<LLM> {
+          public:
+            ParallelBinomialLossModel(const boost::shared_ptr<LLM>& copula,
+                                      QuantLib::Size nSteps,
+                                      QuantLib::Size threads)
+            : QuantLib::BinomialLossModel<LLM>(copula), threads_(threads),
+              quadrature_(factorQuadrature(*copula, poolFactorMin,
+                                           poolFactorMax, nSteps)) {}
+            QuantLib::Real expectedTrancheLoss(const QuantLib::Date& d) const;
+          private:
+            class ConditionalTrancheLoss {
+              public:
+                ConditionalTrancheLoss(
+                        const ParallelBinomialLossModel& model,
+                        const QuantLib::Date& d,
+                        const std::vector<QuantLib::Real>& lossPoints,
+                        const std::vector<QuantLib::Real>& notionals,
+                        const std::vector<QuantLib::Real>& invProbabilities)
+                : model_(model), d_(d), lossPoints_(lossPoints),
+                  notionals_(notionals), invProbabilities_(invProbabilities) {}
+                QuantLib::Real operator()(QuantLib::Real factor) const {
+                    return model_.condTrancheLoss(
+                        d_, lossPoints_, notionals_, invProbabilities_,
+                        std::vector<QuantLib::Real>(1, factor));
+                }
+              private:
+                const ParallelBinomialLossModel& model_;
+                QuantLib::Date d_;
+                const std::vector<QuantLib::Real>& lossPoints_;
+                const std::vector<QuantLib::Real>& notionals_;
+                const std::vector<QuantLib::Real>& invProbabilities_;
+            };
+            QuantLib::Size threads_;
+            FactorQuadrature quadrature_;
+        };
+
+        template <class LLM>
+        QuantLib::Real ParallelBinomialLossModel<LLM>::expectedTrancheLoss(
+                                            const QuantLib::Date& d) const {
+            std::vector<QuantLib::Real> lossPoints = this->lossPoints(d);
+            std::vector<QuantLib::Real> notionals =
+                this->basket_->remainingNotionals(d);
+            std::vector<QuantLib::Real> invProbabilities =
+                this->basket_->remainingProbabilities(d);
+            for (QuantLib::Size i=0; i<invProbabilities.size(); ++i)
+                invProbabilities[i] = this->copula_->inverseCumulativeY(
+                                                    invProbabilities[i], i);
+            // the live names are found before the integrand is shared
+            this->basket_->liveList();
+            ConditionalTrancheLoss integrand(*this, d, lossPoints, notionals,
+                                             invProbabilities);
+            return integrateFactor(quadrature_, threads_, integrand);
+        }
+
+        // nodes and buckets of the coarsest level, and number of levels
+        const QuantLib::Size adaptiveNodes = 16, adaptiveBuckets = 64,
+                             adaptiveLevels = 6;
+
+        /* Base correlation model of a tranche under the one-factor
+           Gaussian copula, integrated with adaptive precision.
+
+           As in QuantLib::BaseCorrelationLossModel, the expected loss of
+           the tranche is the difference of those of the equity tranches
+           up to its detachment and attachment points, each at the
+           correlation the surface gives at its own loss level.  Equity
+           tranches are integrated as inhomogeneous pools at increasing
+           levels of precision, each doubling the nodes on the factor
+           and the loss buckets of the previous one; the difference
+           between the last two levels estimates the error of the
+           tranche loss, and levels are added until it is within the
+           target error, as a fraction of the tranche notional, or the
+           finest level is reached.
+
+           Each equity tranche is bucketed on its own grid, up to its
+           detachment, so that the coarsest level already resolves thin
+           tranches.  The expected losses of the equity tranches are kept
+           by date, correlation and detachment, together with the losses
+           and probabilities of the names they were computed from, so
+           that the equity tranches shared by queries across the surface
+           and by the tranches of a pool are integrated only once for
+           each level.  They are cleared when the surface changes.
+        */
+        class AdaptiveBaseCorrelationLossModel
+            : public virtual QuantLib::DefaultLossModel,
+              public virtual QuantLib::Observer {
+          public:
+            AdaptiveBaseCorrelationLossModel(
+                const QuantLib::Handle<QuantLib::BaseCorrelationTermStructure<
+                    QuantLib::BilinearInterpolation> >& correlations,
+                const std::vector<QuantLib::Real>& recoveries,
+                QuantLib::Real targetError,
+                QuantLib::Size threads)
+            : correlations_(correlations), recoveries_(recoveries),
+              targetError_(targetError), threads_(threads) {
+                QL_REQUIRE(targetError_ > 0.0,
+                           "non-positive target error: " << targetError_);
+                registerWith(correlations_);
+            }
+            void update() {
+                cache_.clear();
+                notifyObservers();
+            }
+            //! expected tranche loss and its estimated error
+            std::pair<QuantLib::Real, QuantLib::Real>
+            expectedTrancheLossAndError(const QuantLib::Date& d) const;
+            //! \name DefaultLossModel interface
+            //@{
+            QuantLib::Real expectedTrancheLoss(const QuantLib::Date& d) const {
+                return expectedTrancheLossAndError(d).first;
+            }
+            //@}
+          private:
+            struct EquityTranche {
+                // inputs the losses were computed from
+                std::vector<QuantLib::Real> volumes, probabilities;
+                // expected loss by level of precision
+                std::vector<QuantLib::Real> losses;
+            };
+            // (date, (correlation, detachment))
+            typedef std::pair<QuantLib::Date,
+                              std::pair<QuantLib::Real, QuantLib::Real> > Key;
+            void resetModel() { cache_.clear(); }
+            EquityTranche& equityTranche(
+                                const QuantLib::Date& d,
+                                QuantLib::Real correlation,
+                                QuantLib::Real detachment,
+                                const std::vector<QuantLib::Real>& volumes,
+                                const std::vector<QuantLib::Real>& probabilities) const;
+            QuantLib::Real equityTrancheLoss(EquityTranche& tranche,
+                                             QuantLib::Real correlation,
+                                             QuantLib::Size level,
+                                             QuantLib::Real detachment) const;
+            QuantLib::Handle<QuantLib::BaseCorrelationTermStructure<
+                QuantLib::BilinearInterpolation> > correlations_;
+            std::vector<QuantLib::Real> recoveries_;
+            QuantLib::Real targetError_;
+            QuantLib::Size threads_;
+            mutable std::map<Key, EquityTranche> cache_;
+        };
+
+        AdaptiveBaseCorrelationLossModel::EquityTranche&
+        AdaptiveBaseCorrelationLossModel::equityTranche(
+                    const QuantLib::Date& d,
+                    QuantLib::Real correlation,
+                    QuantLib::Real detachment,
+                    const std::vector<QuantLib::Real>& volumes,
+                    const std::vector<QuantLib::Real>& probabilities) const {
+            EquityTranche& tranche = cache_[std::make_pair(
+                d, std::make_pair(correlation, detachment))];
+            if (tranche.volumes != volumes ||
+                tranche.probabilities != probabilities) {
+                tranche.volumes = volumes;
+                tranche.probabilities = probabilities;
+                tranche.losses.clear();
+            }
+            return tranche;
+        }
+
+        QuantLib::Real AdaptiveBaseCorrelationLossModel::equityTrancheLoss(
+                                        EquityTranche& tranche,
+                                        QuantLib::Real correlation,
+                                        QuantLib::Size level,
+                                        QuantLib::Real detachment) const {
+            if (detachment <= 0.0)
+                return 0.0;
+            if (tranche.losses.size() <= level) {
+                std::vector<std::vector<QuantLib::Real> > factors(
+                    recoveries_.size(),
+                    std::vector<QuantLib::Real>(1, std::sqrt(correlation)));
+                QuantLib::GaussianConstantLossLM model(factors, recoveries_,
+                    QuantLib::LatentModelIntegrationType::GaussianQuadrature);
+                std::vector<QuantLib::Real> invProbabilities(
+                                                tranche.probabilities.size());
+                for (QuantLib::Size i=0; i<invProbabilities.size(); ++i)
+                    invProbabilities[i] = model.inverseCumulativeY(
+                                            tranche.probabilities[i], i);
+                while (tranche.losses.size() <= level) {
+                    QuantLib::Size scale =
+                        QuantLib::Size(1) << tranche.losses.size();
+                    FactorQuadrature quadrature =
+                        factorQuadrature(model, poolFactorMin, poolFactorMax,
+                                         adaptiveNodes*scale);
+                    std::vector<std::vector<QuantLib::Real> > conditional;
+                    conditionalDefaultProbabilities(model, invProbabilities,
+                                                    quadrature, threads_,
+                                                    conditional);
+                    // the losses of the last bucket are cut at the detachment
+                    std::vector<QuantLib::Real> masses, losses;
+                    integratePoolLoss(tranche.volumes, quadrature,
+                                      conditional, adaptiveBuckets*scale,
+                                      detachment, threads_, masses, losses);
+                    QuantLib::Real expected = 0.0;
+                    for (QuantLib::Size j=0; j<masses.size(); ++j)
+                        expected += masses[j]*losses[j];
+                    tranche.losses.push_back(expected);
+                }
+            }
+            return tranche.losses[level];
+        }
+
+        std::pair<QuantLib::Real, QuantLib::Real>
+        AdaptiveBaseCorrelationLossModel::expectedTrancheLossAndError(
+                                            const QuantLib::Date& d) const {
+            QL_REQUIRE(!basket_.empty(), "no basket set");
+            std::vector<QuantLib::Real> notionals =
+                basket_->remainingNotionals(d);
+            std::vector<QuantLib::Probability> probabilities =
+                basket_->remainingProbabilities(d);
+            QL_REQUIRE(notionals.size() == recoveries_.size(),
+                       notionals.size() << " live names for "
+                       << recoveries_.size() << " recovery rates");
+            std::vector<QuantLib::Real> volumes(notionals.size());
+            for (QuantLib::Size i=0; i<volumes.size(); ++i)
+                volumes[i] = notionals[i]*(1.0 - recoveries_[i]);
+
+            QuantLib::Real attachment = basket_->remainingAttachmentAmount();
+            QuantLib::Real detachment = basket_->remainingDetachmentAmount();
+            QuantLib::Real notional = basket_->remainingNotional();
+            QL_REQUIRE(notional > 0.0, "null remaining notional");
+            QuantLib::Real detachCorrelation = correlations_->correlation(
+                d, std::min(detachment/notional, 1.0), true);
+            EquityTranche& detachTranche = equityTranche(
+                d, detachCorrelation, detachment, volumes, probabilities);
+            // a null attachment leaves an equity tranche
+            QuantLib::Real attachCorrelation = 0.0;
+            EquityTranche* attachTranche = 0;
+            if (attachment > 0.0) {
+                attachCorrelation = correlations_->correlation(
+                    d, std::min(attachment/notional, 1.0), true);
+                attachTranche = &equityTranche(
+                    d, attachCorrelation, attachment, volumes, probabilities);
+            }
+
+            QuantLib::Real tolerance = targetError_*(detachment - attachment);
+            QuantLib::Real value = 0.0, error = QuantLib::Null<QuantLib::Real>();
+            for (QuantLib::Size level=0; level<adaptiveLevels; ++level) {
+                QuantLib::Real previous = value;
+                value = equityTrancheLoss(detachTranche, detachCorrelation,
+                                          level, detachment);
+                if (attachTranche)
+                    value -= equityTrancheLoss(*attachTranche,
+                                               attachCorrelation,
+                                               level, attachment);
+                if (level > 0) {
+                    error = std::fabs(value - previous);
+                    if (error <= tolerance)
+                        break;
+                }
+            }
+            return std::make_pair(value, error);
+        }
+
+    }
+
     GaussianLHPLossModel::GaussianLHPLossModel(
         const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
         QuantLib::Real correl,
@@ -49,6 +1088,8 @@ namespace QuantLibAddin {
         const QuantLib::Real correlation,
         const std::vector<QuantLib::Real>& recoveryRates,
         const QuantLib::Size numBuckets,
+        const QuantLib::Size nodes,
+        const QuantLib::Size threads,
         bool permanent
         )
     : DefaultLossModel(properties, permanent) {
@@ -63,8 +1104,10 @@ namespace QuantLibAddin {
                 QuantLib::LatentModelIntegrationType::GaussianQuadrature));
 
         libraryObject_ = 
-            boost::shared_ptr<QuantLib::IHGaussPoolLossModel>(new 
-                QuantLib::IHGaussPoolLossModel(model, numBuckets));
+            boost::shared_ptr<QuantLib::DefaultLossModel>(new 
+                ParallelPoolLossModel<QuantLib::GaussianCopulaPolicy>(
+                    model, numBuckets, poolFactorMax, poolFactorMin,
+                    nodes, threads));
     }
 
     IHStudentPoolLossModel::IHStudentPoolLossModel(
@@ -73,6 +1116,8 @@ namespace QuantLibAddin {
         const std::vector<QuantLib::Real>& recoveryRates,
         const std::vector<QuantLib::Real>& copulaInitVals,
         const QuantLib::Size numBuckets,
+        const QuantLib::Size nodes,
+        const QuantLib::Size threads,
         bool permanent
         )
     : DefaultLossModel(properties, permanent) {
@@ -93,14 +1138,18 @@ namespace QuantLibAddin {
                 initTT));
 
         libraryObject_ = 
-            boost::shared_ptr<QuantLib::IHStudentPoolLossModel>(new 
-                QuantLib::IHStudentPoolLossModel(model, numBuckets));
+            boost::shared_ptr<QuantLib::DefaultLossModel>(new 
+                ParallelPoolLossModel<QuantLib::TCopulaPolicy>(
+                    model, numBuckets, poolFactorMax, poolFactorMin,
+                    nodes, threads));
     }
 
     GaussianBinomialLossModel::GaussianBinomialLossModel(
         const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
         const std::vector<std::vector<QuantLib::Real> >& factorWeights,
         const std::vector<QuantLib::Real>& recoveryRates,
+        const QuantLib::Size nodes,
+        const QuantLib::Size threads,
         bool permanent
         )
     : DefaultLossModel(properties, permanent) {
@@ -119,9 +1168,15 @@ namespace QuantLibAddin {
             QuantLib::GaussianConstantLossLM(usedFactors, recoveryRates, 
                 QuantLib::LatentModelIntegrationType::GaussianQuadrature));
 
-        libraryObject_ = 
-            boost::shared_ptr<QuantLib::GaussianBinomialLossModel>(new 
-                QuantLib::GaussianBinomialLossModel(model));
+        if (nodes == 0)
+            libraryObject_ = 
+                boost::shared_ptr<QuantLib::GaussianBinomialLossModel>(new 
+                    QuantLib::GaussianBinomialLossModel(model));
+        else
+            libraryObject_ = 
+                boost::shared_ptr<QuantLib::DefaultLossModel>(new 
+                    ParallelBinomialLossModel<QuantLib::GaussianConstantLossLM>(
+                        model, nodes, threads));
     }
 
     TBinomialLossModel::TBinomialLossModel(
@@ -131,6 +1186,8 @@ namespace QuantLibAddin {
         //! \to do Implement a type. By now only initialization traits which 
         //   can be defined by a vector can be used this way
         const std::vector<QuantLib::Real>& copulaInitVals,
+        const QuantLib::Size nodes,
+        const QuantLib::Size threads,
         bool permanent
         )
     : DefaultLossModel(properties, permanent) {
@@ -155,9 +1212,15 @@ namespace QuantLibAddin {
                 QuantLib::LatentModelIntegrationType::Trapezoid,
                 initTT));
 
-        libraryObject_ = 
-            boost::shared_ptr<QuantLib::TBinomialLossModel>(new 
-                QuantLib::TBinomialLossModel(model));
+        if (nodes == 0)
+            libraryObject_ = 
+                boost::shared_ptr<QuantLib::TBinomialLossModel>(new 
+                    QuantLib::TBinomialLossModel(model));
+        else
+            libraryObject_ = 
+                boost::shared_ptr<QuantLib::DefaultLossModel>(new 
+                    ParallelBinomialLossModel<QuantLib::TConstantLossLM>(
+                        model, nodes, threads));
     }
 
     BaseCorrelationLossModel::BaseCorrelationLossModel(
@@ -168,6 +1231,8 @@ namespace QuantLibAddin {
         //! \to do Implement a type. By now only initialization traits which 
         //   can be defined by a vector can be used this way
         const std::vector<QuantLib::Real>& copulaInitVals,
+        QuantLib::Real targetError,
+        QuantLib::Size threads,
         bool permanent)
     : DefaultLossModel(properties, permanent) {
         // eventually write a factory
@@ -257,17 +1322,49 @@ namespace QuantLibAddin {
             }else{
                 QL_FAIL("Can't determine base correlation interpolation.");
             }
+        }else if(baseModelId == std::string("ADAPTIVE")){
+            boost::shared_ptr<QuantLib::BaseCorrelationTermStructure<
+               QuantLib::BilinearInterpolation> > bilin_BCTS = 
+               boost::dynamic_pointer_cast<
+                    QuantLib::BaseCorrelationTermStructure<
+                        QuantLib::BilinearInterpolation> >(addinBC);
+            if(bilin_BCTS) {
+            libraryObject_ = 
+                boost::shared_ptr<QuantLib::DefaultLossModel>(new 
+                    AdaptiveBaseCorrelationLossModel(QuantLib::Handle<
+                        QuantLib::BaseCorrelationTermStructure<
+               QuantLib::BilinearInterpolation> >(bilin_BCTS), 
+                        recoveryRates, targetError, threads));
+            }else{
+                QL_FAIL("Can't determine base correlation interpolation.");
+            }
         // }else if(){ADD OTHER MODELS HERE}
         }else{
             QL_FAIL("Can't determine base correlation model.");
         }    
     }
 
+    std::vector<QuantLib::Real>
+    BaseCorrelationLossModel::expectedTrancheLossAndError(
+                                        const QuantLib::Date& d) const {
+        boost::shared_ptr<AdaptiveBaseCorrelationLossModel> model =
+            boost::dynamic_pointer_cast<AdaptiveBaseCorrelationLossModel>(
+                                                            libraryObject_);
+        QL_REQUIRE(model, "adaptive base correlation model required");
+        std::pair<QuantLib::Real, QuantLib::Real> result =
+            model->expectedTrancheLossAndError(d);
+        std::vector<QuantLib::Real> values(2);
+        values[0] = result.first;
+        values[1] = result.second;
+        return values;
+    }
+
     GaussianRandomDefaultLM::GaussianRandomDefaultLM(
         const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
         const std::vector<std::vector<QuantLib::Real> >& factorWeights,
         const std::vector<QuantLib::Real>& recoveryRates,
         const QuantLib::Size numSims,
+        const QuantLib::Size threads,
         bool permanent
         )
     : DefaultLossModel(properties, permanent) {
@@ -288,8 +1385,9 @@ namespace QuantLibAddin {
                 QuantLib::LatentModelIntegrationType::GaussianQuadrature));
 
         libraryObject_ = 
-            boost::shared_ptr<QuantLib::GaussianRandomDefaultLM>(new 
-                QuantLib::GaussianRandomDefaultLM(model, numSims));
+            boost::shared_ptr<QuantLib::DefaultLossModel>(new 
+                ParallelGaussianRandomDefaultLM(model, recoveryRates, numSims,
+                                                threads, randomLMSeed));
     }
 
     GaussianRandomLossLM::GaussianRandomLossLM(
@@ -298,6 +1396,7 @@ namespace QuantLibAddin {
         const std::vector<QuantLib::Real>& recoveryRates,
         const QuantLib::Real modelA,
         const QuantLib::Size numSims,
+        const QuantLib::Size threads,
         bool permanent
         )
     : DefaultLossModel(properties, permanent) {
@@ -319,8 +1418,9 @@ namespace QuantLibAddin {
                 QuantLib::LatentModelIntegrationType::GaussianQuadrature));
 
         libraryObject_ = 
-            boost::shared_ptr<QuantLib::GaussianRandomLossLM>(new 
-                QuantLib::GaussianRandomLossLM(model, numSims));
+            boost::shared_ptr<QuantLib::DefaultLossModel>(new 
+                ParallelGaussianRandomLossLM(model, numSims, threads,
+                                             randomLMSeed));
     }
 
 
@@ -27,6 +27,7 @@
 namespace QuantLib {
     class DefaultLossModel;
     class CorrelationTermStructure;
+    class Date;
 
     template <class T>
     class Handle;
@@ -55,6 +56,8 @@ namespace QuantLibAddin {
             const QuantLib::Real correlation,
             const std::vector<QuantLib::Real>& recoveryRates,
             const QuantLib::Size numBuckets,
+            const QuantLib::Size nodes,
+            const QuantLib::Size threads,
             bool permanent
             );
     };
@@ -69,6 +72,8 @@ namespace QuantLibAddin {
             //  can be defined by a vector can be used this way
             const std::vector<QuantLib::Real>& copulaInitVals,
             const QuantLib::Size numBuckets,
+            const QuantLib::Size nodes,
+            const QuantLib::Size threads,
             bool permanent
             );
     };
@@ -79,6 +84,9 @@ namespace QuantLibAddin {
             const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
             const std::vector<std::vector<QuantLib::Real> >& factorWeights,
             const std::vector<QuantLib::Real>& recoveryRates,
+            //! 0 for the QuantLib quadrature
+            const QuantLib::Size nodes,
+            const QuantLib::Size threads,
             bool permanent
             );
     };
@@ -92,6 +100,9 @@ namespace QuantLibAddin {
             //! \to do Implement a type. By now only initialization traits which
             //  can be defined by a vector can be used this way
             const std::vector<QuantLib::Real>& copulaInitVals,
+            //! 0 for the QuantLib quadrature
+            const QuantLib::Size nodes,
+            const QuantLib::Size threads,
             bool permanent
             );
     };
@@ -107,9 +118,14 @@ namespace QuantLibAddin {
             //! \to do Implement a type. By now only initialization traits which
             //  can be defined by a vector can be used this way
             const std::vector<QuantLib::Real>& copulaInitVals,
-
+            //! used by the adaptive model only
+            QuantLib::Real targetError,
+            QuantLib::Size threads,
             bool permanent
             );
+        //! expected tranche loss and its estimated error (adaptive model)
+        std::vector<QuantLib::Real> expectedTrancheLossAndError(
+                                            const QuantLib::Date& d) const;
     };
 
     class GaussianRandomDefaultLM : public DefaultLossModel {
@@ -119,6 +135,7 @@ namespace QuantLibAddin {
             const std::vector<std::vector<QuantLib::Real> >& factorWeights,
             const std::vector<QuantLib::Real>& recoveryRates,
             const QuantLib::Size numSims,
+            const QuantLib::Size threads,
             bool permanent
             );
     };
@@ -131,6 +148,7 @@ namespace QuantLibAddin {
             const std::vector<QuantLib::Real>& recoveryRates,
             const QuantLib::Real modelA,
             const QuantLib::Size numSims,
+            const QuantLib::Size threads,
             bool permanent
             );
     };
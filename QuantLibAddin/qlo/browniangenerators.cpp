@@ -25,6 +25,7 @@
     #include <qlo/config.hpp>
 #endif
 #include <qlo/browniangenerators.hpp>
+#include <qlo/randomsequencegenerator.hpp>
 #include <ql/models/marketmodels/browniangenerators/mtbrowniangenerator.hpp>
 
 namespace QuantLibAddin {
@@ -37,6 +38,28 @@ namespace QuantLibAddin {
         libraryObject_ = boost::shared_ptr<QuantLib::BrownianGeneratorFactory>(
             new QuantLib::MTBrownianGeneratorFactory(seed));
     }
+
+    StreamBrownianGeneratorFactory::StreamBrownianGeneratorFactory(
+            const boost::shared_ptr<RandomStreamFactory>& streams,
+            QuantLib::Size stream)
+    : streams_(streams), stream_(stream) {
+        QL_REQUIRE(streams_, "null random stream factory");
+    }
+
+    boost::shared_ptr<QuantLib::BrownianGenerator>
+    StreamBrownianGeneratorFactory::create(QuantLib::Size factors,
+                                           QuantLib::Size steps) const {
+        if (streams_->lowDiscrepancy())
+            return boost::shared_ptr<QuantLib::BrownianGenerator>(
+                new InverseCumulativeBrownianGenerator<QuantLib::SobolRsg>(
+                             factors, steps, streams_->sobolStream(stream_)));
+
+        typedef QuantLib::RandomSequenceGenerator<PhiloxUniformRng> rsg_type;
+        return boost::shared_ptr<QuantLib::BrownianGenerator>(
+            new InverseCumulativeBrownianGenerator<rsg_type>(
+                factors, steps,
+                rsg_type(factors*steps, streams_->uniformStream(stream_))));
+    }
    
 }
 
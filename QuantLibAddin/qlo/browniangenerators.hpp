@@ -27,13 +27,75 @@
 #include <oh/libraryobject.hpp>
 
 #include <ql/types.hpp>
+#include <ql/models/marketmodels/browniangenerator.hpp>
+#include <ql/math/randomnumbers/inversecumulativersg.hpp>
+#include <ql/math/distributions/normaldistribution.hpp>
 
-namespace QuantLib {
-    class BrownianGeneratorFactory;
-}
+#include <algorithm>
 
 namespace QuantLibAddin {
 
+    class RandomStreamFactory;
+
+    //! Brownian generator mapping a uniform sequence generator to normal steps
+    /*! Each path uses one point of the sequence, whose dimension must be
+        the number of factors times the number of steps; the variates are
+        taken step by step, without Brownian bridging.
+    */
+    template <class USG>
+    class InverseCumulativeBrownianGenerator
+        : public QuantLib::BrownianGenerator {
+      public:
+        InverseCumulativeBrownianGenerator(QuantLib::Size factors,
+                                           QuantLib::Size steps,
+                                           const USG& generator)
+        : factors_(factors), steps_(steps), lastStep_(0),
+          generator_(generator, QuantLib::InverseCumulativeNormal()) {
+            QL_REQUIRE(generator.dimension() == factors*steps,
+                       "generator dimension (" << generator.dimension()
+                       << ") different from factors times steps ("
+                       << factors*steps << ")");
+        }
+        QuantLib::Real nextStep(std::vector<QuantLib::Real>& output) {
+            QL_REQUIRE(output.size() == factors_, "size mismatch");
+            QL_REQUIRE(lastStep_ < steps_, "sequence exhausted");
+            std::vector<QuantLib::Real>::const_iterator start =
+                generator_.lastSequence().value.begin() + lastStep_*factors_;
+            std::copy(start, start+factors_, output.begin());
+            ++lastStep_;
+            return 1.0;
+        }
+        QuantLib::Real nextPath() {
+            QuantLib::Real weight = generator_.nextSequence().weight;
+            lastStep_ = 0;
+            return weight;
+        }
+        QuantLib::Size numberOfFactors() const { return factors_; }
+        QuantLib::Size numberOfSteps() const { return steps_; }
+      private:
+        QuantLib::Size factors_, steps_, lastStep_;
+        QuantLib::InverseCumulativeRsg<USG, QuantLib::InverseCumulativeNormal>
+                                                                   generator_;
+    };
+
+    //! Brownian generators drawing from one stream of a RandomStreamFactory
+    /*! Generators created for different streams of the same factory are
+        independent; with Sobol streams, the factory dimension must be
+        the number of factors times the number of steps.
+    */
+    class StreamBrownianGeneratorFactory
+        : public QuantLib::BrownianGeneratorFactory {
+      public:
+        StreamBrownianGeneratorFactory(
+                           const boost::shared_ptr<RandomStreamFactory>& streams,
+                           QuantLib::Size stream);
+        boost::shared_ptr<QuantLib::BrownianGenerator>
+        create(QuantLib::Size factors, QuantLib::Size steps) const;
+      private:
+        boost::shared_ptr<RandomStreamFactory> streams_;
+        QuantLib::Size stream_;
+    };
+
     OH_LIB_CLASS(BrownianGeneratorFactory, QuantLib::BrownianGeneratorFactory);
 
     class MTBrownianGeneratorFactory : public BrownianGeneratorFactory {
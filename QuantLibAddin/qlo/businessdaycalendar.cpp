@@ -0,0 +1,356 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+#if defined(HAVE_CONFIG_H)     // Dynamically created by configure
+    #include <qlo/config.hpp>
+#endif
+#include <qlo/businessdaycalendar.hpp>
+
+#include <ql/patterns/singleton.hpp>
+#include <ql/time/period.hpp>
+
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+using QuantLib::BigInteger;
+using QuantLib::Calendar;
+using QuantLib::Date;
+using QuantLib::Size;
+using QuantLib::Year;
+
+namespace QuantLibAddin {
+
+    namespace {
+
+        Size popcount(boost::uint64_t x) {
+            x = x - ((x >> 1) & boost::uint64_t(0x5555555555555555ULL));
+            x = (x & boost::uint64_t(0x3333333333333333ULL))
+                + ((x >> 2) & boost::uint64_t(0x3333333333333333ULL));
+            x = (x + (x >> 4)) & boost::uint64_t(0x0f0f0f0f0f0f0f0fULL);
+            return Size((x * boost::uint64_t(0x0101010101010101ULL)) >> 56);
+        }
+
+        /* Business days from the first date of a range, one bit per
+           day, and the number of business days before each word. */
+        class BusinessDayBitmap {
+          public:
+            BusinessDayBitmap() : size_(0), counts_(1, 0) {}
+            BusinessDayBitmap(const Date& first, const Date& last)
+            : first_(first), size_(last - first + 1),
+              words_((size_ + 63)/64, 0), counts_(words_.size() + 1, 0) {}
+            bool covers(const Date& d) const {
+                return size_ > 0 && d >= first_ && d - first_ < size_;
+            }
+            bool isBusinessDay(const Date& d) const {
+                BigInteger i = d - first_;
+                return ((words_[i >> 6] >> (i & 63)) & 1) != 0;
+            }
+            // sets the given day, leaving the counts to count()
+            void assign(const Date& d, bool businessDay) {
+                BigInteger i = d - first_;
+                boost::uint64_t bit = boost::uint64_t(1) << (i & 63);
+                if (businessDay)
+                    words_[i >> 6] |= bit;
+                else
+                    words_[i >> 6] &= ~bit;
+            }
+            void count() {
+                for (Size w=0; w<words_.size(); ++w)
+                    counts_[w+1] = counts_[w] + popcount(words_[w]);
+            }
+            // sets the given day and updates the counts after it
+            void set(const Date& d, bool businessDay) {
+                if (isBusinessDay(d) == businessDay)
+                    return;
+                assign(d, businessDay);
+                BigInteger change = businessDay ? 1 : -1;
+                for (Size w=Size((d - first_) >> 6)+1; w<counts_.size(); ++w)
+                    counts_[w] += change;
+            }
+            // business days before the given date, which can be the
+            // day after the last one
+            BigInteger rank(const Date& d) const {
+                BigInteger i = d - first_;
+                BigInteger r = counts_[i >> 6];
+                if ((i & 63) != 0)
+                    r += popcount(words_[i >> 6] &
+                                  ((boost::uint64_t(1) << (i & 63)) - 1));
+                return r;
+            }
+            // the business day preceded by the given number of them
+            Date select(BigInteger rank) const {
+                Size w = Size(std::upper_bound(counts_.begin(),
+                                               counts_.end(), rank)
+                              - counts_.begin()) - 1;
+                BigInteger k = rank - counts_[w];
+                for (Size b=0; b<64; ++b) {
+                    if (((words_[w] >> b) & 1) != 0 && k-- == 0)
+                        return first_ + BigInteger(w*64 + b);
+                }
+                QL_FAIL("business day " << rank << " not found");
+            }
+            BigInteger businessDays() const {
+                return counts_.back();
+            }
+          private:
+            Date first_;
+            BigInteger size_;
+            std::vector<boost::uint64_t> words_;
+            std::vector<BigInteger> counts_;
+        };
+
+    }
+
+    /* The bitmap holds the business days of the wrapped calendar,
+       including the holidays added to and removed from it, and is
+       built on the first lookup.  The holidays are kept by the wrapped
+       calendar, whose implementation is shared with the QuantLib
+       calendars of the same market, so that the holiday sets of the
+       calendar wrapping it stay empty. */
+    class BusinessDayCalendar::Impl : public QuantLib::Calendar::Impl {
+      public:
+        Impl(const Calendar& calendar, Year firstYear, Year lastYear)
+        : calendar_(calendar), firstYear_(firstYear), lastYear_(lastYear),
+          built_(false) {}
+        std::string name() const { return calendar_.name(); }
+        bool isWeekend(QuantLib::Weekday w) const {
+            return calendar_.isWeekend(w);
+        }
+        bool isBusinessDay(const Date& d) const {
+            const BusinessDayBitmap& bitmap = this->bitmap();
+            if (!bitmap.covers(d))
+                return calendar_.isBusinessDay(d);
+            return bitmap.isBusinessDay(d);
+        }
+        const BusinessDayBitmap& bitmap() const {
+            if (!built_.load(boost::memory_order_acquire)) {
+                boost::mutex::scoped_lock lock(mutex_);
+                if (!built_.load(boost::memory_order_relaxed)) {
+                    Date first(1, QuantLib::January, firstYear_);
+                    Date last(31, QuantLib::December, lastYear_);
+                    BusinessDayBitmap bitmap(first, last);
+                    for (Date d=first; d<=last; ++d)
+                        bitmap.assign(d, calendar_.isBusinessDay(d));
+                    bitmap.count();
+                    bitmap_ = bitmap;
+                    built_.store(true, boost::memory_order_release);
+                }
+            }
+            return bitmap_;
+        }
+        void addHoliday(const Date& d) { calendar_.addHoliday(d); }
+        void removeHoliday(const Date& d) { calendar_.removeHoliday(d); }
+        // the following are not to be called during lookups
+        void refresh(const Date& d) {
+            if (built_.load(boost::memory_order_acquire) &&
+                bitmap_.covers(d))
+                bitmap_.set(d, calendar_.isBusinessDay(d));
+        }
+        void setYears(Year first, Year last) {
+            firstYear_ = first;
+            lastYear_ = last;
+            built_.store(false, boost::memory_order_release);
+        }
+      private:
+        Calendar calendar_;
+        Year firstYear_, lastYear_;
+        mutable boost::mutex mutex_;
+        mutable BusinessDayBitmap bitmap_;
+        mutable boost::atomic<bool> built_;
+    };
+
+    class BusinessDayCalendar::Registry
+        : public QuantLib::Singleton<BusinessDayCalendar::Registry> {
+        friend class QuantLib::Singleton<BusinessDayCalendar::Registry>;
+      public:
+        boost::mutex mutex;
+        // by name, as QuantLib compares calendars
+        std::map<std::string, boost::shared_ptr<Impl> > calendars;
+        Year firstYear, lastYear;
+      private:
+        Registry() : firstYear(1980), lastYear(2100) {}
+    };
+
+    BusinessDayCalendar::BusinessDayCalendar(const Calendar& calendar) {
+        QL_REQUIRE(!calendar.empty(), "no calendar implementation provided");
+        Registry& registry = Registry::instance();
+        boost::mutex::scoped_lock lock(registry.mutex);
+        boost::shared_ptr<Impl>& impl = registry.calendars[calendar.name()];
+        if (!impl)
+            impl = boost::shared_ptr<Impl>(new Impl(calendar,
+                                                    registry.firstYear,
+                                                    registry.lastYear));
+        impl_ = impl;
+    }
+
+    boost::shared_ptr<BusinessDayCalendar::Impl>
+    BusinessDayCalendar::cached(const Calendar& calendar) {
+        if (calendar.empty())
+            return boost::shared_ptr<Impl>();
+        Registry& registry = Registry::instance();
+        boost::mutex::scoped_lock lock(registry.mutex);
+        std::map<std::string, boost::shared_ptr<Impl> >::const_iterator i =
+            registry.calendars.find(calendar.name());
+        if (i == registry.calendars.end())
+            return boost::shared_ptr<Impl>();
+        return i->second;
+    }
+
+    BigInteger BusinessDayCalendar::businessDaysBetween(
+                                            const Calendar& calendar,
+                                            const Date& from,
+                                            const Date& to,
+                                            bool includeFirst,
+                                            bool includeLast) {
+        boost::shared_ptr<Impl> impl = cached(calendar);
+        if (!impl || !impl->bitmap().covers(from) ||
+            !impl->bitmap().covers(to))
+            return calendar.businessDaysBetween(from, to,
+                                                includeFirst, includeLast);
+        const BusinessDayBitmap& bitmap = impl->bitmap();
+        if (from == to)
+            return (includeFirst && includeLast &&
+                    bitmap.isBusinessDay(from)) ? 1 : 0;
+        Date first = std::min(from, to), last = std::max(from, to);
+        BigInteger days = bitmap.rank(last + 1) - bitmap.rank(first);
+        if (!includeFirst && bitmap.isBusinessDay(from))
+            --days;
+        if (!includeLast && bitmap.isBusinessDay(to))
+            --days;
+        return from > to ? -days : days;
+    }
+
+    Date BusinessDayCalendar::advance(
+                                const Calendar& calendar,
+                                const Date& d,
+                                const QuantLib::Period& period,
+                                QuantLib::BusinessDayConvention convention,
+                                bool endOfMonth) {
+        QL_REQUIRE(d != Date(), "null date");
+        QuantLib::Integer n = period.length();
+        // other units move on calendar days and then adjust
+        if (period.units() == QuantLib::Days && n != 0) {
+            boost::shared_ptr<Impl> impl = cached(calendar);
+            if (impl && impl->bitmap().covers(d)) {
+                const BusinessDayBitmap& bitmap = impl->bitmap();
+                BigInteger i = n > 0 ? bitmap.rank(d + 1) + n - 1
+                                     : bitmap.rank(d) + n;
+                if (i >= 0 && i < bitmap.businessDays())
+                    return bitmap.select(i);
+            }
+        }
+        return calendar.advance(d, period, convention, endOfMonth);
+    }
+
+    void BusinessDayCalendar::addHoliday(const Calendar& calendar,
+                                         const Date& d) {
+        boost::shared_ptr<Impl> impl = cached(calendar);
+        if (impl) {
+            impl->addHoliday(d);
+        } else {
+            // copies share the holidays of the calendar
+            Calendar c = calendar;
+            c.addHoliday(d);
+        }
+        refresh(d);
+    }
+
+    void BusinessDayCalendar::removeHoliday(const Calendar& calendar,
+                                            const Date& d) {
+        boost::shared_ptr<Impl> impl = cached(calendar);
+        if (impl) {
+            impl->removeHoliday(d);
+        } else {
+            Calendar c = calendar;
+            c.removeHoliday(d);
+        }
+        refresh(d);
+    }
+
+    void BusinessDayCalendar::refresh(const Date& d) {
+        Registry& registry = Registry::instance();
+        boost::mutex::scoped_lock lock(registry.mutex);
+        // joint calendars look up the business days of the calendars
+        // they join, which might be refreshed after them in the first
+        // pass; as the joined calendars do not depend on others, the
+        // second pass leaves all of them up to date
+        std::map<std::string, boost::shared_ptr<Impl> >::iterator i;
+        for (Size pass=0; pass<2; ++pass) {
+            for (i = registry.calendars.begin();
+                 i != registry.calendars.end(); ++i)
+                i->second->refresh(d);
+        }
+    }
+
+    Size BusinessDayCalendar::setYears(Year first, Year last) {
+        QL_REQUIRE(first <= last,
+                   "first year (" << first << ") after last year ("
+                   << last << ")");
+        QL_REQUIRE(first >= Date::minDate().year() &&
+                   last < Date::maxDate().year(),
+                   "years " << first << "-" << last << " out of range ["
+                   << Date::minDate().year() << ", "
+                   << Date::maxDate().year()-1 << "]");
+        Registry& registry = Registry::instance();
+        boost::mutex::scoped_lock lock(registry.mutex);
+        registry.firstYear = first;
+        registry.lastYear = last;
+        // the business days are cached again on the next lookup
+        std::map<std::string, boost::shared_ptr<Impl> >::iterator i;
+        for (i = registry.calendars.begin();
+             i != registry.calendars.end(); ++i)
+            i->second->setYears(first, last);
+        return registry.calendars.size();
+    }
+
+    Date calendarAdvance(const Calendar& calendar,
+                         const Date& d,
+                         const QuantLib::Period& period,
+                         QuantLib::BusinessDayConvention convention,
+                         bool endOfMonth) {
+        return BusinessDayCalendar::advance(calendar, d, period,
+                                            convention, endOfMonth);
+    }
+
+    long calendarBusinessDaysBetween(const Calendar& calendar,
+                                     const Date& from,
+                                     const Date& to,
+                                     bool includeFirst,
+                                     bool includeLast) {
+        return static_cast<long>(BusinessDayCalendar::businessDaysBetween(
+                            calendar, from, to, includeFirst, includeLast));
+    }
+
+    void calendarAddHoliday(const Calendar& calendar, const Date& d) {
+        BusinessDayCalendar::addHoliday(calendar, d);
+    }
+
+    void calendarRemoveHoliday(const Calendar& calendar, const Date& d) {
+        BusinessDayCalendar::removeHoliday(calendar, d);
+    }
+
+    Size calendarCacheYears(long firstYear, long lastYear) {
+        return BusinessDayCalendar::setYears(Year(firstYear),
+                                             Year(lastYear));
+    }
+
+}
@@ -0,0 +1,119 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*! \file
+    \brief Calendars with business days cached over a range of years
+*/
+
+#ifndef qla_businessdaycalendar_hpp
+#define qla_businessdaycalendar_hpp
+
+#include <ql/time/calendar.hpp>
+
+#include <boost/shared_ptr.hpp>
+
+namespace QuantLibAddin {
+
+    //! Calendar whose business days are cached over a range of years
+    /*! The business days of the given calendar are kept in a bitmap,
+        one bit per day, together with the number of business days
+        before each 64-day word of the bitmap.  Business days are then
+        looked up without evaluating the holiday rules of the calendar,
+        which for joint calendars involve those of each calendar
+        joined; the business days between two dates are counted with
+        two lookups and population counts, and the n-th business day
+        after a date is found by bisection on the words.  Dates out of
+        the cached years are passed to the given calendar.  The bitmap
+        of a calendar is built on its first lookup.
+
+        Calendars wrapping calendars of the same name share their
+        implementation.  Their holidays are those of the given
+        calendar, so that holidays added to a cached calendar are seen
+        by the QuantLib calendars of the same market, e.g., by the
+        TARGET calendar of the Euribor indexes, and the other way
+        round.  The calendars of the addin enumerations are cached in
+        this way.
+
+        Holidays must be added and removed through addHoliday() and
+        removeHoliday(), which refresh the cached calendars at the date
+        changed, including the joint calendars depending on it;
+        holidays added to or removed from the QuantLib calendars
+        directly are not seen by the calendars already cached.  As for
+        the holidays themselves, changes to the cache are not to be
+        made while calendars are being used concurrently.
+    */
+    class BusinessDayCalendar : public QuantLib::Calendar {
+      public:
+        explicit BusinessDayCalendar(const QuantLib::Calendar& calendar);
+        //! \name Cached calendars
+        /*! Calendars not cached are passed to QuantLib. */
+        //@{
+        static QuantLib::BigInteger businessDaysBetween(
+                                    const QuantLib::Calendar& calendar,
+                                    const QuantLib::Date& from,
+                                    const QuantLib::Date& to,
+                                    bool includeFirst,
+                                    bool includeLast);
+        static QuantLib::Date advance(
+                                const QuantLib::Calendar& calendar,
+                                const QuantLib::Date& d,
+                                const QuantLib::Period& period,
+                                QuantLib::BusinessDayConvention convention,
+                                bool endOfMonth);
+        //! adds a holiday to the given calendar, refreshing the cache
+        static void addHoliday(const QuantLib::Calendar& calendar,
+                               const QuantLib::Date& d);
+        //! removes a holiday from the given calendar, refreshing the cache
+        static void removeHoliday(const QuantLib::Calendar& calendar,
+                                  const QuantLib::Date& d);
+        //! refreshes the cached business days at the given date
+        static void refresh(const QuantLib::Date& d);
+        //! caches the given years, returning the number of calendars
+        static QuantLib::Size setYears(QuantLib::Year first,
+                                       QuantLib::Year last);
+        //@}
+      private:
+        class Impl;
+        class Registry;
+        static boost::shared_ptr<Impl> cached(
+                                    const QuantLib::Calendar& calendar);
+    };
+
+    QuantLib::Date calendarAdvance(
+                            const QuantLib::Calendar& calendar,
+                            const QuantLib::Date& d,
+                            const QuantLib::Period& period,
+                            QuantLib::BusinessDayConvention convention,
+                            bool endOfMonth);
+
+    long calendarBusinessDaysBetween(const QuantLib::Calendar& calendar,
+                                     const QuantLib::Date& from,
+                                     const QuantLib::Date& to,
+                                     bool includeFirst,
+                                     bool includeLast);
+
+    void calendarAddHoliday(const QuantLib::Calendar& calendar,
+                            const QuantLib::Date& d);
+
+    void calendarRemoveHoliday(const QuantLib::Calendar& calendar,
+                               const QuantLib::Date& d);
+
+    QuantLib::Size calendarCacheYears(long firstYear, long lastYear);
+
+}
+
+#endif
@@ -0,0 +1,285 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+#if defined(HAVE_CONFIG_H)     // Dynamically created by configure
+    #include <qlo/config.hpp>
+#endif
+#include <qlo/calibrationdiagnostics.hpp>
+#include <qlo/optimization.hpp>
+
+#include <ql/math/optimization/costfunction.hpp>
+#include <ql/math/optimization/levenbergmarquardt.hpp>
+#include <ql/math/optimization/problem.hpp>
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include <sstream>
+
+using ObjectHandler::property_t;
+using QuantLib::Real;
+using QuantLib::Size;
+using std::string;
+using std::vector;
+
+namespace QuantLibAddin {
+
+    namespace {
+
+        /* Sampling state of the trace of a run, shared by a recording
+           cost function and its copies. */
+        struct Recording {
+            Recording(CalibrationDiagnostics::Run& run, Size maxTracePoints)
+            : run(run), maxTracePoints(maxTracePoints), stride(1) {}
+            CalibrationDiagnostics::Run& run;
+            Size maxTracePoints, stride;
+            boost::mutex mutex;
+        };
+
+        /* Forwards to the given cost function, counting evaluations and
+           tracing their cost.  It can be copied if the given function
+           can; copies record into the same run, e.g., the concurrent
+           starts of a multi-start method. */
+        class RecordingCostFunction : public CloneableCostFunction {
+          public:
+            RecordingCostFunction(const QuantLib::CostFunction& f,
+                                  Recording& recording)
+            : f_(f), recording_(recording) {}
+            RecordingCostFunction(
+                          const boost::shared_ptr<CloneableCostFunction>& f,
+                          Recording& recording)
+            : f_(*f), copy_(f), recording_(recording) {}
+            boost::shared_ptr<CloneableCostFunction> clone() const {
+                const CloneableCostFunction* f =
+                    dynamic_cast<const CloneableCostFunction*>(&f_);
+                boost::shared_ptr<CloneableCostFunction> copy;
+                if (f != 0)
+                    copy = f->clone();
+                if (!copy)
+                    return boost::shared_ptr<CloneableCostFunction>();
+                return boost::shared_ptr<CloneableCostFunction>(new
+                    RecordingCostFunction(copy, recording_));
+            }
+            Real value(const QuantLib::Array& x) const {
+                Real y = f_.value(x);
+                trace(y);
+                return y;
+            }
+            QuantLib::Disposable<QuantLib::Array>
+            values(const QuantLib::Array& x) const {
+                QuantLib::Array y = f_.values(x);
+                trace(QuantLib::DotProduct(y, y));
+                return y;
+            }
+            void gradient(QuantLib::Array& grad,
+                          const QuantLib::Array& x) const {
+                countGradient();
+                f_.gradient(grad, x);
+            }
+            Real valueAndGradient(QuantLib::Array& grad,
+                                  const QuantLib::Array& x) const {
+                countGradient();
+                Real y = f_.valueAndGradient(grad, x);
+                trace(y);
+                return y;
+            }
+            void jacobian(QuantLib::Matrix& jac,
+                          const QuantLib::Array& x) const {
+                countGradient();
+                f_.jacobian(jac, x);
+            }
+            QuantLib::Disposable<QuantLib::Array>
+            valuesAndJacobian(QuantLib::Matrix& jac,
+                              const QuantLib::Array& x) const {
+                countGradient();
+                QuantLib::Array y = f_.valuesAndJacobian(jac, x);
+                trace(QuantLib::DotProduct(y, y));
+                return y;
+            }
+          private:
+            void countGradient() const {
+                boost::mutex::scoped_lock lock(recording_.mutex);
+                ++recording_.run.gradientEvaluations;
+            }
+            void trace(Real cost) const {
+                boost::mutex::scoped_lock lock(recording_.mutex);
+                CalibrationDiagnostics::Run& run = recording_.run;
+                Size n = ++run.functionEvaluations;
+                Size& stride = recording_.stride;
+                if (recording_.maxTracePoints == 0 || (n-1) % stride != 0)
+                    return;
+                if (run.trace.size() == recording_.maxTracePoints) {
+                    // keeps every other point and halves the sampling
+                    Size kept = 0;
+                    for (Size i=0; i<run.trace.size(); i+=2)
+                        run.trace[kept++] = run.trace[i];
+                    run.trace.resize(kept);
+                    stride *= 2;
+                    if ((n-1) % stride != 0)
+                        return;
+                }
+                run.trace.push_back(std::make_pair(n, cost));
+            }
+            const QuantLib::CostFunction& f_;
+            boost::shared_ptr<CloneableCostFunction> copy_;
+            Recording& recording_;
+        };
+
+    }
+
+    void CalibrationDiagnostics::record(const string& objectId,
+                                        const Run& run) {
+        boost::mutex::scoped_lock lock(mutex_);
+        Entry& entry = entries_[objectId];
+        ++entry.runs;
+        if (!run.error.empty())
+            ++entry.failures;
+        entry.functionEvaluations += run.functionEvaluations;
+        entry.gradientEvaluations += run.gradientEvaluations;
+        entry.seconds += run.seconds;
+        entry.last = run;
+    }
+
+    void CalibrationDiagnostics::clear(const string& objectId) {
+        boost::mutex::scoped_lock lock(mutex_);
+        entries_.erase(objectId);
+    }
+
+    vector<vector<property_t> >
+    CalibrationDiagnostics::report(const string& objectId) const {
+        boost::mutex::scoped_lock lock(mutex_);
+        std::map<string, Entry>::const_iterator i = entries_.find(objectId);
+        QL_REQUIRE(i != entries_.end(),
+                   "no calibration recorded for " << objectId);
+        const Entry& entry = i->second;
+        std::ostringstream endCriteria;
+        endCriteria << entry.last.endCriteria;
+
+        vector<vector<property_t> > result;
+        vector<property_t> row(2);
+        row[0] = string("Runs");
+        row[1] = static_cast<long>(entry.runs);
+        result.push_back(row);
+        row[0] = string("Failures");
+        row[1] = static_cast<long>(entry.failures);
+        result.push_back(row);
+        row[0] = string("Evaluations");
+        row[1] = static_cast<long>(entry.functionEvaluations);
+        result.push_back(row);
+        row[0] = string("Gradient Evaluations");
+        row[1] = static_cast<long>(entry.gradientEvaluations);
+        result.push_back(row);
+        row[0] = string("Seconds");
+        row[1] = entry.seconds;
+        result.push_back(row);
+        row[0] = string("Last Evaluations");
+        row[1] = static_cast<long>(entry.last.functionEvaluations);
+        result.push_back(row);
+        row[0] = string("Last Seconds");
+        row[1] = entry.last.seconds;
+        result.push_back(row);
+        row[0] = string("Last Cost");
+        if (entry.last.error.empty())
+            row[1] = entry.last.cost;
+        else
+            row[1] = string("N/A");
+        result.push_back(row);
+        row[0] = string("Last End Criteria");
+        row[1] = endCriteria.str();
+        result.push_back(row);
+        row[0] = string("Last Failure");
+        row[1] = entry.last.error;
+        result.push_back(row);
+        row[0] = string("Evaluation");
+        row[1] = string("Cost");
+        result.push_back(row);
+        for (Size j=0; j<entry.last.trace.size(); ++j) {
+            row[0] = static_cast<long>(entry.last.trace[j].first);
+            row[1] = entry.last.trace[j].second;
+            result.push_back(row);
+        }
+        return result;
+    }
+
+    Size CalibrationDiagnostics::maxTracePoints() const {
+        boost::mutex::scoped_lock lock(mutex_);
+        return maxTracePoints_;
+    }
+
+    void CalibrationDiagnostics::setMaxTracePoints(Size n) {
+        boost::mutex::scoped_lock lock(mutex_);
+        maxTracePoints_ = n;
+    }
+
+    RecordingOptimizationMethod::RecordingOptimizationMethod(
+            const string& objectId,
+            const boost::shared_ptr<QuantLib::OptimizationMethod>& method)
+    : objectId_(objectId), method_(method) {
+        if (!method_)
+            method_ = boost::shared_ptr<QuantLib::OptimizationMethod>(new
+                QuantLib::LevenbergMarquardt(1.0e-8, 1.0e-8, 1.0e-8));
+    }
+
+    QuantLib::EndCriteria::Type RecordingOptimizationMethod::minimize(
+                                    QuantLib::Problem& P,
+                                    const QuantLib::EndCriteria& endCriteria) {
+        CalibrationDiagnostics& diagnostics =
+            CalibrationDiagnostics::instance();
+        CalibrationDiagnostics::Run run;
+        Recording recording(run, diagnostics.maxTracePoints());
+        RecordingCostFunction costFunction(P.costFunction(), recording);
+        // QuantLib::Problem needs a modifiable reference, although the
+        // constraint is not modified by the methods
+        QuantLib::Problem problem(
+            costFunction,
+            const_cast<QuantLib::Constraint&>(P.constraint()),
+            P.currentValue());
+        boost::posix_time::ptime start =
+            boost::posix_time::microsec_clock::universal_time();
+        try {
+            run.endCriteria = method_->minimize(problem, endCriteria);
+        } catch (std::exception& e) {
+            run.error = e.what();
+            if (run.error.empty())
+                run.error = "unknown error";
+        }
+        run.seconds = (boost::posix_time::microsec_clock::universal_time()
+                       - start).total_microseconds()/1.0e6;
+        if (run.error.empty())
+            run.cost = problem.functionValue();
+        diagnostics.record(objectId_, run);
+        addEvaluations(P, problem.functionEvaluation(),
+                       problem.gradientEvaluation());
+        QL_REQUIRE(run.error.empty(), run.error);
+
+        P.setCurrentValue(problem.currentValue());
+        P.setFunctionValue(problem.functionValue());
+        P.setGradientNormValue(problem.gradientNormValue());
+        return run.endCriteria;
+    }
+
+    boost::shared_ptr<QuantLib::OptimizationMethod> recordingMethod(
+            const string& objectId,
+            const boost::shared_ptr<QuantLib::OptimizationMethod>& method) {
+        return boost::shared_ptr<QuantLib::OptimizationMethod>(new
+            RecordingOptimizationMethod(objectId, method));
+    }
+
+    vector<vector<property_t> > calibrationDiagnostics(const string& objectId) {
+        return CalibrationDiagnostics::instance().report(objectId);
+    }
+
+}
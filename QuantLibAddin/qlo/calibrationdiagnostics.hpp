@@ -0,0 +1,125 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*! \file
+    \brief Evaluation counts, timing and convergence traces of calibrations
+*/
+
+#ifndef qla_calibrationdiagnostics_hpp
+#define qla_calibrationdiagnostics_hpp
+
+#include <oh/property.hpp>
+#include <ql/math/optimization/method.hpp>
+#include <ql/patterns/singleton.hpp>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace QuantLibAddin {
+
+    //! Diagnostics of the calibrations run by each object
+    /*! Calibrating objects pass their optimization method through
+        recordingMethod(), which counts the cost-function and gradient
+        evaluations and times each minimization, and keeps a trace of
+        the cost of the last one.  The trace holds at most the given
+        number of points: when full, every other point is dropped and
+        only every other evaluation is recorded from then on.
+
+        QuantLib optimization methods do not expose their iteration
+        counts, so the cost-function evaluations are the measure of
+        the work done; for least-squares methods, the cost traced is
+        the sum of the squared residuals.
+
+        Diagnostics can be recorded concurrently.
+    */
+    class CalibrationDiagnostics
+        : public QuantLib::Singleton<CalibrationDiagnostics> {
+        friend class QuantLib::Singleton<CalibrationDiagnostics>;
+      public:
+        //! evaluations, timing and trace of a single minimization
+        struct Run {
+            Run()
+            : functionEvaluations(0), gradientEvaluations(0), seconds(0.0),
+              cost(0.0), endCriteria(QuantLib::EndCriteria::None) {}
+            QuantLib::Size functionEvaluations, gradientEvaluations;
+            QuantLib::Real seconds, cost;
+            QuantLib::EndCriteria::Type endCriteria;
+            std::string error;
+            // pairs of evaluation number and cost
+            std::vector<std::pair<QuantLib::Size, QuantLib::Real> > trace;
+        };
+        void record(const std::string& objectId, const Run& run);
+        //! drops the diagnostics of the given object
+        void clear(const std::string& objectId);
+        //! summary of all the runs followed by the trace of the last one
+        std::vector<std::vector<ObjectHandler::property_t> >
+        report(const std::string& objectId) const;
+        //! \name Trace length
+        //@{
+        QuantLib::Size maxTracePoints() const;
+        void setMaxTracePoints(QuantLib::Size n);
+        //@}
+      private:
+        CalibrationDiagnostics() : maxTracePoints_(200) {}
+        struct Entry {
+            Entry()
+            : runs(0), failures(0), functionEvaluations(0),
+              gradientEvaluations(0), seconds(0.0) {}
+            QuantLib::Size runs, failures;
+            QuantLib::Size functionEvaluations, gradientEvaluations;
+            QuantLib::Real seconds;
+            Run last;
+        };
+        mutable boost::mutex mutex_;
+        std::map<std::string, Entry> entries_;
+        QuantLib::Size maxTracePoints_;
+    };
+
+    //! Optimization method recording the diagnostics of its runs
+    /*! A null method is replaced by the Levenberg-Marquardt method
+        that QuantLib calibrations use by default.
+    */
+    class RecordingOptimizationMethod : public QuantLib::OptimizationMethod {
+      public:
+        RecordingOptimizationMethod(
+            const std::string& objectId,
+            const boost::shared_ptr<QuantLib::OptimizationMethod>& method);
+        QuantLib::EndCriteria::Type minimize(
+                                    QuantLib::Problem& P,
+                                    const QuantLib::EndCriteria& endCriteria);
+      private:
+        std::string objectId_;
+        boost::shared_ptr<QuantLib::OptimizationMethod> method_;
+    };
+
+    //! the given method, recording its runs for the given object
+    boost::shared_ptr<QuantLib::OptimizationMethod> recordingMethod(
+            const std::string& objectId,
+            const boost::shared_ptr<QuantLib::OptimizationMethod>& method);
+
+    //! calibration diagnostics of the given object
+    std::vector<std::vector<ObjectHandler::property_t> >
+    calibrationDiagnostics(const std::string& objectId);
+
+}
+
+#endif
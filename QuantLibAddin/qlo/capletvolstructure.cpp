@@ -32,6 +32,18 @@
 #include <ql/termstructures/volatility/optionlet/optionletstripper1.hpp>
 #include <ql/termstructures/volatility/optionlet/optionletstripper2.hpp>
 #include <ql/termstructures/volatility/optionlet/strippedoptionlet.hpp>
+#include <ql/cashflows/floatingratecoupon.hpp>
+#include <ql/instruments/makecapfloor.hpp>
+#include <ql/math/distributions/normaldistribution.hpp>
+#include <ql/pricingengines/blackformula.hpp>
+#include <ql/pricingengines/capfloor/bacheliercapfloorengine.hpp>
+#include <ql/pricingengines/capfloor/blackcapfloorengine.hpp>
+#include <ql/quotes/simplequote.hpp>
+
+#include <qlo/parallel.hpp>
+
+#include <cmath>
+#include <sstream>
 
 using std::vector;
 using QuantLib::Handle;
@@ -43,6 +55,296 @@ using ObjectHandler::LibraryObject;
 
 namespace QuantLibAddin {
 
+    namespace {
+
+        /* Black implied standard deviation by Halley's method, i.e.,
+           the second-order Householder iteration, which converges
+           cubically thanks to the closed-form vega and volga; it
+           starts from the given guess or, if null, from the
+           approximation of QuantLib::blackFormulaImpliedStdDevApproximation.
+           Where the iteration cannot proceed (vanishing vega, negative
+           standard deviation, no convergence) the QuantLib Brent solver
+           is used instead. */
+        QuantLib::Real fastImpliedStdDev(QuantLib::Option::Type type,
+                                         QuantLib::Real strike,
+                                         QuantLib::Real forward,
+                                         QuantLib::Real price,
+                                         QuantLib::Real discount,
+                                         QuantLib::Real displacement,
+                                         QuantLib::Real guess,
+                                         QuantLib::Real accuracy,
+                                         QuantLib::Natural maxIterations) {
+            QuantLib::Real f = forward + displacement;
+            QuantLib::Real k = strike + displacement;
+            if (f > 0.0 && k > 0.0 && price > 0.0 && discount > 0.0) {
+                QuantLib::Real s = guess;
+                if (s == QuantLib::Null<QuantLib::Real>() || s <= 0.0)
+                    s = QuantLib::blackFormulaImpliedStdDevApproximation(
+                        type, strike, forward, price, discount, displacement);
+                QuantLib::NormalDistribution phi;
+                for (QuantLib::Natural n=0; n<maxIterations && s>0.0; ++n) {
+                    QuantLib::Real d1 = std::log(f/k)/s + 0.5*s;
+                    QuantLib::Real d2 = d1 - s;
+                    QuantLib::Real error = QuantLib::blackFormula(
+                        type, strike, forward, s, discount, displacement)
+                        - price;
+                    QuantLib::Real vega = discount*f*phi(d1);
+                    if (vega <= QL_EPSILON)
+                        break;
+                    QuantLib::Real volga = vega*d1*d2/s;
+                    QuantLib::Real newton = error/vega;
+                    QuantLib::Real correction = 1.0 - 0.5*newton*volga/vega;
+                    // falls back to a Newton step far from the root
+                    QuantLib::Real step =
+                        correction > 0.5 ? newton/correction : newton;
+                    s -= step;
+                    if (std::fabs(step) < accuracy && s > 0.0)
+                        return s;
+                }
+            }
+            return QuantLib::blackFormulaImpliedStdDev(
+                type, strike, forward, price, discount, displacement,
+                QuantLib::Null<QuantLib::Real>(), accuracy, maxIterations);
+        }
+
+        /* Optionlet stripping of the strikes, one per task.  Cap/floor
+           instruments, volatility quotes and engines are per strike, and
+           are created beforehand in the calling thread together with the
+           term volatilities and optionlet annuities, so that the shared
+           curves and surface are calculated there. */
+        class OptionletStrikeStripping {
+          public:
+            OptionletStrikeStripping(
+                const std::vector<QuantLib::Rate>& strikes,
+                const std::vector<QuantLib::Rate>& atmRates,
+                const std::vector<QuantLib::Time>& times,
+                const QuantLib::Matrix& termVols,
+                const std::vector<QuantLib::Real>& annuities,
+                const std::vector<QuantLib::Option::Type>& optionletTypes,
+                const std::vector<boost::shared_ptr<QuantLib::SimpleQuote> >& volQuotes,
+                const std::vector<std::vector<boost::shared_ptr<QuantLib::CapFloor> > >& capFloors,
+                QuantLib::VolatilityType type,
+                QuantLib::Real displacement,
+                QuantLib::Real accuracy,
+                QuantLib::Natural maxIterations,
+                bool fastSolver,
+                QuantLib::Matrix& stdDevs)
+            : strikes_(strikes), atmRates_(atmRates), times_(times),
+              termVols_(termVols), annuities_(annuities),
+              optionletTypes_(optionletTypes), volQuotes_(volQuotes),
+              capFloors_(capFloors), type_(type),
+              displacement_(displacement), accuracy_(accuracy),
+              maxIterations_(maxIterations), fastSolver_(fastSolver),
+              stdDevs_(stdDevs), errors(strikes.size()) {}
+            void operator()(QuantLib::Size j) {
+                QuantLib::Real previousPrice = 0.0;
+                for (QuantLib::Size i=0; i<times_.size(); ++i) {
+                    volQuotes_[j]->setValue(termVols_[i][j]);
+                    QuantLib::Real capFloorPrice = capFloors_[j][i]->NPV();
+                    QuantLib::Real price = capFloorPrice - previousPrice;
+                    previousPrice = capFloorPrice;
+                    try {
+                        if (type_ == QuantLib::ShiftedLognormal) {
+                            // the last result is the guess, as in
+                            // QuantLib::OptionletStripper1
+                            if (fastSolver_)
+                                stdDevs_[i][j] = fastImpliedStdDev(
+                                    optionletTypes_[j], strikes_[j],
+                                    atmRates_[i], price, annuities_[i],
+                                    displacement_, stdDevs_[i][j],
+                                    accuracy_, maxIterations_);
+                            else
+                                stdDevs_[i][j] =
+                                    QuantLib::blackFormulaImpliedStdDev(
+                                        optionletTypes_[j], strikes_[j],
+                                        atmRates_[i], price, annuities_[i],
+                                        displacement_,
+                                        stdDevs_[i][j] > 0.0 ?
+                                            stdDevs_[i][j] :
+                                            QuantLib::Null<QuantLib::Real>(),
+                                        accuracy_, maxIterations_);
+                        } else {
+                            stdDevs_[i][j] = std::sqrt(times_[i]) *
+                                QuantLib::bachelierBlackFormulaImpliedVol(
+                                    optionletTypes_[j], strikes_[j],
+                                    atmRates_[i], price, annuities_[i]);
+                        }
+                    } catch (std::exception& e) {
+                        std::ostringstream message;
+                        message << "could not bootstrap optionlet:"
+                                << "\n type:    " << optionletTypes_[j]
+                                << "\n strike:  " << strikes_[j]
+                                << "\n atm:     " << atmRates_[i]
+                                << "\n price:   " << price
+                                << "\n annuity: " << annuities_[i]
+                                << "\n expiry:  " << times_[i]
+                                << "\n error:   " << e.what();
+                        errors[j] = message.str();
+                        return;
+                    }
+                }
+            }
+          private:
+            const std::vector<QuantLib::Rate>& strikes_;
+            const std::vector<QuantLib::Rate>& atmRates_;
+            const std::vector<QuantLib::Time>& times_;
+            const QuantLib::Matrix& termVols_;
+            const std::vector<QuantLib::Real>& annuities_;
+            const std::vector<QuantLib::Option::Type>& optionletTypes_;
+            const std::vector<boost::shared_ptr<QuantLib::SimpleQuote> >& volQuotes_;
+            const std::vector<std::vector<boost::shared_ptr<QuantLib::CapFloor> > >& capFloors_;
+            QuantLib::VolatilityType type_;
+            QuantLib::Real displacement_, accuracy_;
+            QuantLib::Natural maxIterations_;
+            bool fastSolver_;
+            QuantLib::Matrix& stdDevs_;
+          public:
+            // failures, by strike
+            std::vector<std::string> errors;
+        };
+
+        /* QuantLib::OptionletStripper1, with the strikes stripped
+           concurrently and optionally the fast implied-volatility
+           solver. */
+        class ParallelOptionletStripper1 : public QuantLib::OptionletStripper {
+          public:
+            ParallelOptionletStripper1(
+                const boost::shared_ptr<QuantLib::CapFloorTermVolSurface>& s,
+                const boost::shared_ptr<QuantLib::IborIndex>& index,
+                QuantLib::Rate switchStrike,
+                QuantLib::Real accuracy,
+                QuantLib::Natural maxIterations,
+                QuantLib::VolatilityType type,
+                QuantLib::Real displacement,
+                QuantLib::Size threads,
+                bool fastSolver)
+            : QuantLib::OptionletStripper(
+                  s, index, Handle<QuantLib::YieldTermStructure>(),
+                  type, displacement),
+              floatingSwitchStrike_(
+                  switchStrike == QuantLib::Null<QuantLib::Rate>()),
+              switchStrike_(switchStrike), accuracy_(accuracy),
+              maxIterations_(maxIterations), threads_(threads),
+              fastSolver_(fastSolver),
+              stdDevs_(nOptionletTenors_, nStrikes_, 0.0) {}
+            void performCalculations() const;
+          private:
+            bool floatingSwitchStrike_;
+            mutable QuantLib::Rate switchStrike_;
+            QuantLib::Real accuracy_;
+            QuantLib::Natural maxIterations_;
+            QuantLib::Size threads_;
+            bool fastSolver_;
+            mutable QuantLib::Matrix stdDevs_;
+        };
+
+        void ParallelOptionletStripper1::performCalculations() const {
+            const QuantLib::Date& referenceDate =
+                termVolSurface_->referenceDate();
+            const QuantLib::DayCounter& dc = termVolSurface_->dayCounter();
+            boost::shared_ptr<QuantLib::BlackCapFloorEngine> dummy(new
+                QuantLib::BlackCapFloorEngine(
+                    // discounting does not matter here
+                    iborIndex_->forwardingTermStructure(), 0.20, dc));
+            for (QuantLib::Size i=0; i<nOptionletTenors_; ++i) {
+                QuantLib::CapFloor temp =
+                    QuantLib::MakeCapFloor(QuantLib::CapFloor::Cap,
+                                           capFloorLengths_[i],
+                                           iborIndex_,
+                                           0.04, // dummy strike
+                                           0*QuantLib::Days)
+                    .withPricingEngine(dummy);
+                boost::shared_ptr<QuantLib::FloatingRateCoupon> lFRC =
+                    temp.lastFloatingRateCoupon();
+                optionletDates_[i] = lFRC->fixingDate();
+                optionletPaymentDates_[i] = lFRC->date();
+                optionletAccrualPeriods_[i] = lFRC->accrualPeriod();
+                optionletTimes_[i] = dc.yearFraction(referenceDate,
+                                                     optionletDates_[i]);
+                atmOptionletRate_[i] = lFRC->indexFixing();
+            }
+
+            if (floatingSwitchStrike_) {
+                QuantLib::Rate averageAtmOptionletRate = 0.0;
+                for (QuantLib::Size i=0; i<nOptionletTenors_; ++i)
+                    averageAtmOptionletRate += atmOptionletRate_[i];
+                switchStrike_ = averageAtmOptionletRate/nOptionletTenors_;
+            }
+
+            const Handle<QuantLib::YieldTermStructure>& discountCurve =
+                discount_.empty() ? iborIndex_->forwardingTermStructure()
+                                  : discount_;
+            const std::vector<QuantLib::Rate>& strikes =
+                termVolSurface_->strikes();
+
+            // instruments are built again at each calculation, as in
+            // QuantLib::OptionletStripper1, since the switch strike and
+            // the curves may have changed; by strike, then by tenor
+            std::vector<boost::shared_ptr<QuantLib::SimpleQuote> >
+                volQuotes(nStrikes_);
+            std::vector<std::vector<boost::shared_ptr<QuantLib::CapFloor> > >
+                capFloors(nStrikes_);
+            std::vector<QuantLib::Option::Type> optionletTypes(nStrikes_);
+            for (QuantLib::Size j=0; j<nStrikes_; ++j) {
+                // using out-of-the-money options
+                QuantLib::CapFloor::Type capFloorType =
+                    strikes[j] < switchStrike_ ? QuantLib::CapFloor::Floor
+                                               : QuantLib::CapFloor::Cap;
+                optionletTypes[j] =
+                    strikes[j] < switchStrike_ ? QuantLib::Option::Put
+                                               : QuantLib::Option::Call;
+                volQuotes[j] = boost::shared_ptr<QuantLib::SimpleQuote>(
+                                                new QuantLib::SimpleQuote);
+                Handle<Quote> vol(volQuotes[j]);
+                boost::shared_ptr<QuantLib::PricingEngine> engine;
+                if (volatilityType_ == QuantLib::ShiftedLognormal)
+                    engine = boost::shared_ptr<QuantLib::PricingEngine>(new
+                        QuantLib::BlackCapFloorEngine(discountCurve, vol,
+                                                      dc, displacement_));
+                else if (volatilityType_ == QuantLib::Normal)
+                    engine = boost::shared_ptr<QuantLib::PricingEngine>(new
+                        QuantLib::BachelierCapFloorEngine(discountCurve,
+                                                          vol, dc));
+                else
+                    QL_FAIL("unknown volatility type: " << volatilityType_);
+                capFloors[j].resize(nOptionletTenors_);
+                for (QuantLib::Size i=0; i<nOptionletTenors_; ++i)
+                    capFloors[j][i] = QuantLib::MakeCapFloor(
+                                          capFloorType,
+                                          capFloorLengths_[i],
+                                          iborIndex_,
+                                          strikes[j],
+                                          0*QuantLib::Days)
+                                      .withPricingEngine(engine);
+            }
+
+            QuantLib::Matrix termVols(nOptionletTenors_, nStrikes_);
+            std::vector<QuantLib::Real> annuities(nOptionletTenors_);
+            for (QuantLib::Size i=0; i<nOptionletTenors_; ++i) {
+                for (QuantLib::Size j=0; j<nStrikes_; ++j)
+                    termVols[i][j] = termVolSurface_->volatility(
+                                    capFloorLengths_[i], strikes[j], true);
+                annuities[i] = optionletAccrualPeriods_[i] *
+                    discountCurve->discount(optionletPaymentDates_[i]);
+            }
+
+            OptionletStrikeStripping stripping(
+                strikes, atmOptionletRate_, optionletTimes_, termVols,
+                annuities, optionletTypes, volQuotes, capFloors,
+                volatilityType_, displacement_, accuracy_, maxIterations_,
+                fastSolver_, stdDevs_);
+            parallelFor(nStrikes_, threads_, stripping);
+            for (QuantLib::Size j=0; j<nStrikes_; ++j)
+                QL_REQUIRE(stripping.errors[j].empty(), stripping.errors[j]);
+
+            for (QuantLib::Size i=0; i<nOptionletTenors_; ++i)
+                for (QuantLib::Size j=0; j<nStrikes_; ++j)
+                    optionletVolatilities_[i][j] =
+                        stdDevs_[i][j]/std::sqrt(optionletTimes_[i]);
+        }
+
+    }
+
     ConstantOptionletVolatility::ConstantOptionletVolatility(
                                     const shared_ptr<ValueObject>& properties,
                                     QuantLib::Natural settlementDays,
@@ -166,9 +468,24 @@ namespace QuantLibAddin {
                         QuantLib::Natural maxIterations,
                         QuantLib::VolatilityType type,
                         QuantLib::Real shift,
+                        QuantLib::Size threads,
+                        bool fastImpliedVol,
                         bool permanent)
     : OptionletStripper(properties, permanent)
     {
+        if (threads != 1 || fastImpliedVol) {
+            libraryObject_ = shared_ptr<QuantLib::OptionletStripper>(new
+                ParallelOptionletStripper1(s,
+                                           index,
+                                           switchStrike,
+                                           accuracy,
+                                           maxIterations,
+                                           type,
+                                           shift,
+                                           threads,
+                                           fastImpliedVol));
+            return;
+        }
         libraryObject_ = shared_ptr<QuantLib::OptionletStripper1>(new
             QuantLib::OptionletStripper1(s,
                                          index,
@@ -109,6 +109,12 @@ namespace QuantLibAddin {
 
     OH_OBJ_CLASS(OptionletStripper, StrippedOptionletBase);
 
+    /*! Unless a single thread and the QuantLib solver are requested,
+        the strikes are stripped concurrently by an addin stripper
+        that reproduces QuantLib::OptionletStripper1; being a different
+        class, it cannot be passed to OptionletStripper2 nor queried
+        for its cap/floor prices.
+    */
     class OptionletStripper1 : public OptionletStripper {
       public:
         OptionletStripper1(
@@ -120,6 +126,8 @@ namespace QuantLibAddin {
                     QuantLib::Natural maxIterations,
                     QuantLib::VolatilityType type,
                     QuantLib::Real shift,
+                    QuantLib::Size threads,
+                    bool fastImpliedVol,
                     bool permanent);
     };
 
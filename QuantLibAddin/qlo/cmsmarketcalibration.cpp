@@ -22,8 +22,10 @@
 #endif
 
 #include <qlo/cmsmarketcalibration.hpp>
+#include <qlo/calibrationdiagnostics.hpp>
 #include <qlo/cmsmarket.hpp>
 #include <qlo/swaptionvolstructure.hpp>
+#include <qlo/warmstart.hpp>
 
 #include <boost/timer.hpp>
 
@@ -42,7 +44,8 @@ namespace QuantLibAddin {
         QuantLib::CmsMarketCalibration::CalibrationType calibrationType,
         bool permanent)
     : LibraryObject<QuantLib::CmsMarketCalibration>(properties, permanent) {
-        
+
+        CalibrationDiagnostics::instance().clear(properties->objectId());
         libraryObject_ = shared_ptr<QuantLib::CmsMarketCalibration>(new
             QuantLib::CmsMarketCalibration(volCube,
                                            cmsMarket,
@@ -69,11 +72,52 @@ namespace QuantLibAddin {
    CmsMarketCalibration::compute(const shared_ptr<EndCriteria>& endCriteria,
                                  const shared_ptr<OptimizationMethod>& method,
                                  const QuantLib::Array& guess,
-                                 bool isMeanReversionFixed) {
+                                 bool isMeanReversionFixed,
+                                 bool warmStart) {
+        boost::shared_ptr<OptimizationMethod> recorded =
+            recordingMethod(properties()->objectId(), method);
         boost::timer t;
+        if (warmStart) {
+            static const std::string node = "CMS";
+            CalibrationWarmStart& store = CalibrationWarmStart::instance();
+            std::string objectId = properties()->objectId();
+            std::vector<QuantLib::Real> last;
+            if (store.lastParameters(objectId, node, last)
+                && last.size() == guess.size()) {
+                QuantLib::Array warmGuess(last.begin(), last.end());
+                // a fixed mean reversion is always taken from the guess
+                if (isMeanReversionFixed)
+                    warmGuess[guess.size()-1] = guess[guess.size()-1];
+                t.restart();
+                QuantLib::Array result = libraryObject_->compute(endCriteria,
+                                        recorded,
+                                        warmGuess,
+                                        isMeanReversionFixed);
+                elapsed_ = t.elapsed();
+                if (!store.degraded(objectId, node, libraryObject_->error())) {
+                    store.warmFit(objectId, node,
+                                  std::vector<QuantLib::Real>(result.begin(),
+                                                              result.end()),
+                                  libraryObject_->error(), elapsed_);
+                    return result;
+                }
+                store.fallback(objectId, node);
+            }
+            t.restart();
+            QuantLib::Array result = libraryObject_->compute(endCriteria,
+                                    recorded,
+                                    guess,
+                                    isMeanReversionFixed);
+            elapsed_ = t.elapsed();
+            store.coldFit(objectId, node,
+                          std::vector<QuantLib::Real>(result.begin(),
+                                                      result.end()),
+                          libraryObject_->error(), elapsed_);
+            return result;
+        }
         t.restart();
         QuantLib::Array result = libraryObject_->compute(endCriteria,
-                                method,
+                                recorded,
                                 guess,
                                 isMeanReversionFixed);
         elapsed_ = t.elapsed();
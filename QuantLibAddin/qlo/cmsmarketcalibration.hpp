@@ -60,10 +60,20 @@ namespace QuantLibAddin {
         std::vector<std::vector<ObjectHandler::property_t> > getDenseSabrParameters();
         std::vector<std::vector<ObjectHandler::property_t> > getCmsMarket();
         QuantLib::Real elapsed() {return elapsed_ ; }
+        /*! The cost function is the private one of
+            QuantLib::CmsMarketCalibration, which cannot be copied; a
+            concurrent Levenberg-Marquardt or multi-start method runs
+            its evaluations one after the other.  Nor can a single
+            evaluation be split among threads: the conundrum pricers
+            build the underlying swap of each coupon while pricing it,
+            and the coupons of that swap register with the global
+            evaluation date.
+        */
         QuantLib::Array compute(const boost::shared_ptr<QuantLib::EndCriteria>& endCriteria,
                                 const boost::shared_ptr<QuantLib::OptimizationMethod>& method,
                                 const QuantLib::Array& guess,
-                                bool isMeanReversionFixed);
+                                bool isMeanReversionFixed,
+                                bool warmStart = false);
       private:
         QuantLib::Real elapsed_;
     }; 
@@ -33,6 +33,9 @@
 #include <ql/math/interpolations/backwardflatinterpolation.hpp>
 #include <ql/math/interpolations/loginterpolation.hpp>
 #include <ql/pricingengines/credit/midpointcdsengine.hpp>
+#include <ql/termstructures/bootstraperror.hpp>
+#include <ql/math/solvers1d/brent.hpp>
+#include <ql/utilities/dataformatters.hpp>
 
 #include <ql/experimental/credit/riskybond.hpp>
 #include <ql/experimental/credit/syntheticcdo.hpp>
@@ -43,12 +46,182 @@
 #include <boost/algorithm/string/case_conv.hpp>
 #include <boost/make_shared.hpp>
 
+#include <algorithm>
+#include <cmath>
+
 #include <ql/settings.hpp>
 
 using boost::algorithm::to_upper_copy;
 
 namespace QuantLibAddin {
 
+    namespace {
+
+        /* Bootstrap re-solving only the pillars from the first helper
+           that no longer reprices within accuracy.  The accuracy is
+           that of the hazard rates; it is turned into a tolerance on
+           the quote error of each helper by the sensitivity of its
+           quote to its pillar, measured when the pillar is solved.
+           With a local
+           interpolation each helper depends on the pillars up to its
+           own, so when a single quote moves, the pillars before it are
+           verified with one repricing each instead of being solved
+           again; the curve from the previous calculation also provides
+           the guesses and brackets of the remaining ones, as in
+           QuantLib::IterativeBootstrap.  Helpers must be alive, and a
+           failure of the incremental pass is followed by a full one. */
+        template <class Curve>
+        class IncrementalBootstrap {
+            typedef typename Curve::traits_type Traits;
+            typedef typename Curve::interpolator_type Interpolator;
+          public:
+            explicit IncrementalBootstrap(
+                           QuantLib::Real accuracy = 1.0e-12)
+            : ts_(0), n_(0), accuracy_(accuracy),
+              initialized_(false), validCurve_(false) {}
+            void setup(Curve* ts) {
+                ts_ = ts;
+                n_ = ts_->instruments_.size();
+                QL_REQUIRE(n_+1 >= Interpolator::requiredPoints,
+                           "not enough instruments: " << n_ << " provided, "
+                           << Interpolator::requiredPoints-1 << " required");
+                QL_REQUIRE(!Interpolator::global,
+                           "incremental bootstrap requires "
+                           "a local interpolation");
+                for (QuantLib::Size i=0; i<n_; ++i)
+                    ts_->registerWith(ts_->instruments_[i]);
+                // instruments might not be valid yet
+            }
+            void calculate() const {
+                if (!initialized_ || ts_->moving_)
+                    initialize();
+                for (QuantLib::Size i=0; i<n_; ++i)
+                    ts_->instruments_[i]->setTermStructure(
+                                                const_cast<Curve*>(ts_));
+                QuantLib::Size first = 0;
+                if (validCurve_) {
+                    ts_->interpolation_.update();
+                    while (first < n_ &&
+                           std::fabs(ts_->instruments_[first]->quoteError())
+                           <= tolerances_[first])
+                        ++first;
+                }
+                try {
+                    solve(first);
+                } catch (QuantLib::Error&) {
+                    if (!validCurve_)
+                        throw;
+                    validCurve_ = false;
+                    solve(0);
+                }
+                validCurve_ = true;
+            }
+          private:
+            void initialize() const {
+                std::sort(ts_->instruments_.begin(), ts_->instruments_.end(),
+                          QuantLib::detail::BootstrapHelperSorter());
+                QuantLib::Date firstDate = Traits::initialDate(ts_);
+                std::vector<QuantLib::Date> dates(n_+1);
+                dates[0] = firstDate;
+                for (QuantLib::Size i=0; i<n_; ++i) {
+                    dates[i+1] = ts_->instruments_[i]->pillarDate();
+                    QL_REQUIRE(dates[i+1] > dates[i],
+                               QuantLib::io::ordinal(i+1) << " instrument "
+                               "(pillar: " << dates[i+1] << ") is expired "
+                               "or has the pillar of the previous one");
+                }
+                // the previous values are kept as guesses
+                if (ts_->data_.size() != n_+1) {
+                    ts_->data_ = std::vector<QuantLib::Real>(
+                                    n_+1, Traits::initialValue(ts_));
+                    validCurve_ = false;
+                }
+                tolerances_.resize(n_, 0.0);
+                ts_->dates_ = dates;
+                ts_->times_.resize(n_+1);
+                for (QuantLib::Size i=0; i<=n_; ++i)
+                    ts_->times_[i] = ts_->timeFromReference(dates[i]);
+                ts_->interpolation_ =
+                    ts_->interpolator_.interpolate(ts_->times_.begin(),
+                                                   ts_->times_.end(),
+                                                   ts_->data_.begin());
+                initialized_ = true;
+            }
+            void solve(QuantLib::Size first) const {
+                QuantLib::Brent solver;
+                for (QuantLib::Size i=first; i<n_; ++i) {
+                    QuantLib::Size segment = i+1;
+                    QuantLib::Real min =
+                        Traits::minValueAfter(segment, ts_, validCurve_, 0);
+                    QuantLib::Real max =
+                        Traits::maxValueAfter(segment, ts_, validCurve_, 0);
+                    QuantLib::Real guess =
+                        Traits::guess(segment, ts_, validCurve_, 0);
+                    if (guess <= min || guess >= max)
+                        guess = (min+max)/2.0;
+                    QuantLib::BootstrapError<Curve> error(
+                                    ts_, ts_->instruments_[i], segment);
+                    try {
+                        QuantLib::Real root =
+                            solver.solve(error, accuracy_, guess, min, max);
+                        // quote errors within the accuracy of the root,
+                        // or within the error left by the solver
+                        QuantLib::Real h =
+                            1.0e-4*std::max(std::fabs(root), 1.0e-4);
+                        if (root+h >= max)
+                            h = -h;
+                        QuantLib::Real bumped = error(root+h);
+                        QuantLib::Real residual = error(root);
+                        tolerances_[i] = std::max(
+                            std::fabs((bumped-residual)/h)*accuracy_,
+                            std::fabs(residual));
+                    } catch (std::exception& e) {
+                        QL_FAIL(QuantLib::io::ordinal(i+1) << " instrument "
+                                "(pillar: " << ts_->dates_[segment]
+                                << ") could not be bootstrapped: "
+                                << e.what());
+                    }
+                }
+            }
+            Curve* ts_;
+            QuantLib::Size n_;
+            QuantLib::Real accuracy_;
+            // tolerances on the quote errors, by helper
+            mutable std::vector<QuantLib::Real> tolerances_;
+            mutable bool initialized_, validCurve_;
+        };
+
+        typedef QuantLib::PiecewiseDefaultCurve<QuantLib::HazardRate,
+                                                QuantLib::Linear>
+            linear_curve;
+        typedef QuantLib::PiecewiseDefaultCurve<QuantLib::HazardRate,
+                                                QuantLib::BackwardFlat>
+            flat_curve;
+        typedef QuantLib::PiecewiseDefaultCurve<QuantLib::HazardRate,
+                                                QuantLib::Linear,
+                                                IncrementalBootstrap>
+            incremental_linear_curve;
+        typedef QuantLib::PiecewiseDefaultCurve<QuantLib::HazardRate,
+                                                QuantLib::BackwardFlat,
+                                                IncrementalBootstrap>
+            incremental_flat_curve;
+
+        template <class Curve>
+        bool piecewiseHazardRates(
+                    const boost::shared_ptr<QuantLib::Extrapolator>& curve,
+                    const std::vector<QuantLib::Date>** dates,
+                    const std::vector<QuantLib::Real>** data) {
+            boost::shared_ptr<Curve> c =
+                boost::dynamic_pointer_cast<Curve>(curve);
+            if (!c)
+                return false;
+            *dates = &c->dates();
+            *data = &c->data();
+            return true;
+        }
+
+    }
+
     Issuer::Issuer(
             const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
             const boost::shared_ptr<QuantLib::DefaultProbabilityTermStructure>& dfts,
@@ -260,10 +433,32 @@ namespace QuantLibAddin {
             const QuantLib::Calendar& calendar,
             const std::string& interpolator,
             QuantLib::Real accuracy,
+            bool incremental,
             bool permanent) 
         : DefaultProbabilityTermStructure(properties, permanent) {
 
-        if(interpolator == std::string("LINEAR")){
+        if (incremental) {
+            if (interpolator == std::string("LINEAR"))
+                libraryObject_ = boost::shared_ptr<QuantLib::Extrapolator>(new
+                    incremental_linear_curve(
+                        0, calendar, helpers, dayCounter,
+                        std::vector<QuantLib::Handle<QuantLib::Quote> >(),
+                        std::vector<QuantLib::Date>(),
+                        QuantLib::Linear(),
+                        IncrementalBootstrap<incremental_linear_curve>(
+                                                                accuracy)));
+            else if (interpolator == std::string("BACKWARDFLAT"))
+                libraryObject_ = boost::shared_ptr<QuantLib::Extrapolator>(new
+                    incremental_flat_curve(
+                        0, calendar, helpers, dayCounter,
+                        std::vector<QuantLib::Handle<QuantLib::Quote> >(),
+                        std::vector<QuantLib::Date>(),
+                        QuantLib::BackwardFlat(),
+                        IncrementalBootstrap<incremental_flat_curve>(
+                                                                accuracy)));
+            else
+                QL_FAIL("Unrecognised interpolator");
+        }else if(interpolator == std::string("LINEAR")){
             libraryObject_ = boost::shared_ptr<QuantLib::Extrapolator>(new
                    QuantLib::PiecewiseDefaultCurve<QuantLib::HazardRate,
                         QuantLib::Linear>(
@@ -289,28 +484,30 @@ namespace QuantLibAddin {
     // ptr type check here would correspond to template spez in the  
     //   subscribers factory solution.
     const std::vector<QuantLib::Date>& PiecewiseHazardRateCurve::dates() const {
-        typedef QuantLib::PiecewiseDefaultCurve<QuantLib::HazardRate, QuantLib::BackwardFlat> flat_curve;
-        typedef QuantLib::PiecewiseDefaultCurve<QuantLib::HazardRate, QuantLib::Linear> lin_curve;
-        boost::shared_ptr<flat_curve> ptrBF =
-            boost::dynamic_pointer_cast<flat_curve>(libraryObject_);
-        if(ptrBF) return ptrBF->dates();
-        boost::shared_ptr<lin_curve> ptrLIN =
-            boost::dynamic_pointer_cast<lin_curve>(libraryObject_);
-        if(ptrLIN) return ptrLIN->dates();
+        const std::vector<QuantLib::Date>* dates;
+        const std::vector<QuantLib::Real>* data;
+        if (piecewiseHazardRates<flat_curve>(libraryObject_, &dates, &data) ||
+            piecewiseHazardRates<linear_curve>(libraryObject_, &dates, &data) ||
+            piecewiseHazardRates<incremental_flat_curve>(libraryObject_,
+                                                         &dates, &data) ||
+            piecewiseHazardRates<incremental_linear_curve>(libraryObject_,
+                                                           &dates, &data))
+            return *dates;
         QL_FAIL("Unable to cast default probability term structure.");
     }
 
     const std::vector<QuantLib::Real>& PiecewiseHazardRateCurve::data() const {
-        typedef QuantLib::PiecewiseDefaultCurve<QuantLib::HazardRate, QuantLib::BackwardFlat> flat_curve;
-        typedef QuantLib::PiecewiseDefaultCurve<QuantLib::HazardRate, QuantLib::Linear> lin_curve;
-        boost::shared_ptr<flat_curve> ptrBF =
-            boost::dynamic_pointer_cast<flat_curve>(libraryObject_);
-        if(ptrBF) return ptrBF->data();
-        boost::shared_ptr<lin_curve> ptrLIN =
-            boost::dynamic_pointer_cast<lin_curve>(libraryObject_);
-        if(ptrLIN) return ptrLIN->data();
+        const std::vector<QuantLib::Date>* dates;
+        const std::vector<QuantLib::Real>* data;
+        if (piecewiseHazardRates<flat_curve>(libraryObject_, &dates, &data) ||
+            piecewiseHazardRates<linear_curve>(libraryObject_, &dates, &data) ||
+            piecewiseHazardRates<incremental_flat_curve>(libraryObject_,
+                                                         &dates, &data) ||
+            piecewiseHazardRates<incremental_linear_curve>(libraryObject_,
+                                                           &dates, &data))
+            return *data;
         QL_FAIL("Unable to cast default probability term structure.");
-        }        
+    }
 
 
     PiecewiseFlatForwardCurve::PiecewiseFlatForwardCurve(
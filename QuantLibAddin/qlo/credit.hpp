@@ -181,6 +181,8 @@ namespace QuantLibAddin {
 
     // Bootstrapped piecewise flat hazard rate curve 
     // traits = hazard rates
+    // When incremental, a recalculation only re-solves the pillars from
+    //   the first helper off its quote, e.g., after a single spread tick.
     // To do: add a Registry Manager factory once the number of options in 
     //   the combination of interpolation traits and algorithm grows.
     class PiecewiseHazardRateCurve : public DefaultProbabilityTermStructure {
@@ -192,6 +194,7 @@ namespace QuantLibAddin {
             const QuantLib::Calendar& calendar,
             const std::string& interpolator,
             QuantLib::Real accuracy,
+            bool incremental,
             bool permanent);
 
         const std::vector<QuantLib::Date>& dates() const;
@@ -21,9 +21,89 @@
 #include <qlo/creditdefaultswap.hpp>
 
 #include <ql/instruments/creditdefaultswap.hpp>
+#include <ql/pricingengines/credit/midpointcdsengine.hpp>
+#include <ql/termstructures/defaulttermstructure.hpp>
+#include <ql/termstructures/yieldtermstructure.hpp>
+
+#include <map>
 
 namespace QuantLibAddin {
 
+    namespace {
+
+        /* Survival probabilities of the given curve, kept by time. */
+        class CachedSurvivalCurve
+            : public QuantLib::DefaultProbabilityTermStructure {
+          public:
+            explicit CachedSurvivalCurve(
+              const QuantLib::Handle<QuantLib::DefaultProbabilityTermStructure>& curve)
+            : QuantLib::DefaultProbabilityTermStructure(curve->dayCounter()),
+              curve_(curve) {
+                if (curve_->allowsExtrapolation())
+                    enableExtrapolation();
+            }
+            QuantLib::Date maxDate() const { return curve_->maxDate(); }
+            const QuantLib::Date& referenceDate() const {
+                return curve_->referenceDate();
+            }
+            QuantLib::Calendar calendar() const { return curve_->calendar(); }
+            QuantLib::Natural settlementDays() const {
+                return curve_->settlementDays();
+            }
+          protected:
+            QuantLib::Probability
+            survivalProbabilityImpl(QuantLib::Time t) const {
+                std::map<QuantLib::Time, QuantLib::Probability>::const_iterator
+                    i = cache_.find(t);
+                if (i != cache_.end())
+                    return i->second;
+                QuantLib::Probability p = curve_->survivalProbability(t, true);
+                cache_[t] = p;
+                return p;
+            }
+            QuantLib::Real defaultDensityImpl(QuantLib::Time t) const {
+                return curve_->defaultDensity(t, true);
+            }
+          private:
+            QuantLib::Handle<QuantLib::DefaultProbabilityTermStructure> curve_;
+            mutable std::map<QuantLib::Time, QuantLib::Probability> cache_;
+        };
+
+        /* Discount factors of the given curve, kept by time. */
+        class CachedDiscountCurve : public QuantLib::YieldTermStructure {
+          public:
+            explicit CachedDiscountCurve(
+                  const QuantLib::Handle<QuantLib::YieldTermStructure>& curve)
+            : QuantLib::YieldTermStructure(curve->dayCounter()),
+              curve_(curve) {
+                if (curve_->allowsExtrapolation())
+                    enableExtrapolation();
+            }
+            QuantLib::Date maxDate() const { return curve_->maxDate(); }
+            const QuantLib::Date& referenceDate() const {
+                return curve_->referenceDate();
+            }
+            QuantLib::Calendar calendar() const { return curve_->calendar(); }
+            QuantLib::Natural settlementDays() const {
+                return curve_->settlementDays();
+            }
+          protected:
+            QuantLib::DiscountFactor discountImpl(QuantLib::Time t) const {
+                std::map<QuantLib::Time, QuantLib::DiscountFactor>::const_iterator
+                    i = cache_.find(t);
+                if (i != cache_.end())
+                    return i->second;
+                QuantLib::DiscountFactor d = curve_->discount(t, true);
+                cache_[t] = d;
+                return d;
+            }
+          private:
+            QuantLib::Handle<QuantLib::YieldTermStructure> curve_;
+            mutable std::map<QuantLib::Time, QuantLib::DiscountFactor> cache_;
+        };
+
+    }
+
     CreditDefaultSwap::CreditDefaultSwap(
         const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
         QuantLib::Protection::Side side,
@@ -71,4 +151,38 @@ namespace QuantLibAddin {
             }
     }
     
+    std::vector<QuantLib::Real> cdsBatchNPV(
+        const std::vector<boost::shared_ptr<QuantLib::CreditDefaultSwap> >& contracts,
+        const QuantLib::Handle<QuantLib::DefaultProbabilityTermStructure>& defaultCurve,
+        QuantLib::Real recoveryRate,
+        const QuantLib::Handle<QuantLib::YieldTermStructure>& discountCurve) {
+        QL_REQUIRE(!defaultCurve.empty(), "no default curve given");
+        QL_REQUIRE(!discountCurve.empty(), "no discount curve given");
+        QuantLib::Handle<QuantLib::DefaultProbabilityTermStructure> survival(
+            boost::shared_ptr<QuantLib::DefaultProbabilityTermStructure>(
+                new CachedSurvivalCurve(defaultCurve)));
+        QuantLib::Handle<QuantLib::YieldTermStructure> discount(
+            boost::shared_ptr<QuantLib::YieldTermStructure>(
+                new CachedDiscountCurve(discountCurve)));
+        QuantLib::MidPointCdsEngine engine(survival, recoveryRate, discount);
+
+        std::vector<QuantLib::Real> npvs(contracts.size(), 0.0);
+        for (QuantLib::Size k=0; k<contracts.size(); ++k) {
+            QL_REQUIRE(contracts[k], "null contract #" << k+1);
+            // as QuantLib::Instrument::calculate, without notifications
+            if (contracts[k]->isExpired())
+                continue;
+            engine.reset();
+            contracts[k]->setupArguments(engine.getArguments());
+            engine.getArguments()->validate();
+            engine.calculate();
+            const QuantLib::Instrument::results* results =
+                dynamic_cast<const QuantLib::Instrument::results*>(
+                                                        engine.getResults());
+            QL_REQUIRE(results, "wrong engine results");
+            npvs[k] = results->value;
+        }
+        return npvs;
+    }
+
 }
@@ -28,9 +28,15 @@
 #include <ql/time/schedule.hpp>
 #include <ql/time/businessdayconvention.hpp>
 #include <ql/time/daycounter.hpp>
+#include <ql/handle.hpp>
+
+#include <vector>
 
 namespace QuantLib {
     class Date;
+    class CreditDefaultSwap;
+    class DefaultProbabilityTermStructure;
+    class YieldTermStructure;
 }
 
 namespace QuantLibAddin {
@@ -53,6 +59,19 @@ namespace QuantLibAddin {
             bool permanent);
     };
 
+    //! NPVs of the given contracts by the mid-point engine
+    /*! The contracts are priced in a single pass by one engine, which
+        reads the curves through caches shared by the whole batch: the
+        survival probabilities and discount factors at the coupon and
+        default dates common to several contracts, e.g., those of
+        standard schedules, are evaluated once.
+    */
+    std::vector<QuantLib::Real> cdsBatchNPV(
+        const std::vector<boost::shared_ptr<QuantLib::CreditDefaultSwap> >& contracts,
+        const QuantLib::Handle<QuantLib::DefaultProbabilityTermStructure>& defaultCurve,
+        QuantLib::Real recoveryRate,
+        const QuantLib::Handle<QuantLib::YieldTermStructure>& discountCurve);
+
 }
 
 #endif
@@ -28,9 +28,228 @@
 #include <ql/models/marketmodels/curvestates/cmswapcurvestate.hpp>
 #include <ql/models/marketmodels/curvestates/coterminalswapcurvestate.hpp>
 #include <ql/models/marketmodels/curvestates/lmmcurvestate.hpp>
+#include <ql/models/marketmodels/utilities.hpp>
 
 namespace QuantLibAddin {
 
+    LMMCurveStateBatch::LMMCurveStateBatch(
+                            const std::vector<QuantLib::Time>& rateTimes,
+                            QuantLib::Size size)
+    : rateTimes_(rateTimes), rateTaus_(rateTimes.size()-1),
+      numberOfRates_(rateTimes.size()-1), size_(size), first_(0) {
+        QL_REQUIRE(rateTimes.size() > 1,
+                   "Rate times must contain at least two values");
+        QL_REQUIRE(size > 0, "empty curve state batch");
+        QuantLib::checkIncreasingTimesAndCalculateTaus(rateTimes_, rateTaus_);
+        forwards_.resize(numberOfRates_*size_);
+        discRatios_.resize((numberOfRates_+1)*size_, 1.0);
+        cotSwapRates_.resize(numberOfRates_*size_);
+        cotAnnuities_.resize(numberOfRates_*size_);
+    }
+
+    void LMMCurveStateBatch::setOnForwardRates(const QuantLib::Matrix& forwards,
+                                               QuantLib::Size firstValidIndex) {
+        QL_REQUIRE(forwards.rows() == size_,
+                   "forwards for " << forwards.rows() << " states given, "
+                   << size_ << " required");
+        QL_REQUIRE(forwards.columns() == numberOfRates_,
+                   "too many forward rates: " << numberOfRates_ <<
+                   " required, " << forwards.columns() << " provided");
+        QL_REQUIRE(firstValidIndex < numberOfRates_,
+                   "first valid index must be less than " <<
+                   numberOfRates_ << ": " << firstValidIndex << " not allowed");
+        first_ = firstValidIndex;
+        for (QuantLib::Size i=first_; i<numberOfRates_; ++i) {
+            QuantLib::Real* f = &forwards_[i*size_];
+            for (QuantLib::Size k=0; k<size_; ++k)
+                f[k] = forwards[k][i];
+        }
+        computeFromForwardRates(0, size_);
+    }
+
+    void LMMCurveStateBatch::setOnDiscountRatios(
+                                const QuantLib::Matrix& discountRatios,
+                                QuantLib::Size firstValidIndex) {
+        QL_REQUIRE(discountRatios.rows() == size_,
+                   "discount ratios for " << discountRatios.rows()
+                   << " states given, " << size_ << " required");
+        QL_REQUIRE(discountRatios.columns() == numberOfRates_+1,
+                   "too many discount ratios: " << numberOfRates_+1 <<
+                   " required, " << discountRatios.columns() << " provided");
+        QL_REQUIRE(firstValidIndex < numberOfRates_,
+                   "first valid index must be less than " <<
+                   numberOfRates_ << ": " << firstValidIndex << " not allowed");
+        first_ = firstValidIndex;
+        for (QuantLib::Size i=first_; i<=numberOfRates_; ++i) {
+            QuantLib::Real* d = &discRatios_[i*size_];
+            for (QuantLib::Size k=0; k<size_; ++k)
+                d[k] = discountRatios[k][i];
+        }
+        // as in forwardsFromDiscountRatios
+        for (QuantLib::Size i=first_; i<numberOfRates_; ++i) {
+            const QuantLib::Real* d = &discRatios_[i*size_];
+            const QuantLib::Real* dNext = d + size_;
+            QuantLib::Real* f = &forwards_[i*size_];
+            QuantLib::Time tau = rateTaus_[i];
+            for (QuantLib::Size k=0; k<size_; ++k)
+                f[k] = (d[k]-dNext[k])/(dNext[k]*tau);
+        }
+        computeCoterminalSwapRates(0, size_);
+    }
+
+    void LMMCurveStateBatch::setState(QuantLib::Size k,
+                                      const QuantLib::CurveState& cs) {
+        QL_REQUIRE(k < size_, "state index (" << k << ") out of range");
+        QL_REQUIRE(cs.rateTimes() == rateTimes_,
+                   "curve state rate times differ from the batch ones");
+        const std::vector<QuantLib::Rate>& forwards = cs.forwardRates();
+        // the rates before the first valid index of cs are not set; the
+        // batch keeps the rates valid for all of its states
+        bool renormalize = cs.firstValidIndex() > first_;
+        if (renormalize)
+            first_ = cs.firstValidIndex();
+        for (QuantLib::Size i=first_; i<numberOfRates_; ++i)
+            forwards_[i*size_+k] = forwards[i];
+        if (renormalize)
+            computeFromForwardRates(0, size_);
+        else
+            computeFromForwardRates(k, k+1);
+    }
+
+    void LMMCurveStateBatch::state(QuantLib::Size k,
+                                   QuantLib::LMMCurveState& cs) const {
+        QL_REQUIRE(k < size_, "state index (" << k << ") out of range");
+        std::vector<QuantLib::Rate> forwards(numberOfRates_);
+        for (QuantLib::Size i=first_; i<numberOfRates_; ++i)
+            forwards[i] = forwards_[i*size_+k];
+        cs.setOnForwardRates(forwards, first_);
+    }
+
+    void LMMCurveStateBatch::computeFromForwardRates(QuantLib::Size begin,
+                                                     QuantLib::Size end) {
+        // as in LMMCurveState::setOnForwardRates
+        QuantLib::Real* d = &discRatios_[first_*size_];
+        for (QuantLib::Size k=begin; k<end; ++k)
+            d[k] = 1.0;
+        for (QuantLib::Size i=first_; i<numberOfRates_; ++i, d += size_) {
+            const QuantLib::Real* f = &forwards_[i*size_];
+            QuantLib::Real* dNext = d + size_;
+            QuantLib::Time tau = rateTaus_[i];
+            for (QuantLib::Size k=begin; k<end; ++k)
+                dNext[k] = d[k]/(1.0+f[k]*tau);
+        }
+        computeCoterminalSwapRates(begin, end);
+    }
+
+    void LMMCurveStateBatch::computeCoterminalSwapRates(QuantLib::Size begin,
+                                                        QuantLib::Size end) {
+        // as in coterminalFromDiscountRatios
+        QuantLib::Size last = numberOfRates_-1;
+        const QuantLib::Real* dLast = &discRatios_[numberOfRates_*size_];
+        {
+            const QuantLib::Real* d = &discRatios_[last*size_];
+            QuantLib::Real* a = &cotAnnuities_[last*size_];
+            QuantLib::Real* r = &cotSwapRates_[last*size_];
+            QuantLib::Time tau = rateTaus_[last];
+            for (QuantLib::Size k=begin; k<end; ++k) {
+                a[k] = tau*dLast[k];
+                r[k] = d[k]/dLast[k] - 1.0;
+                r[k] /= tau;
+            }
+        }
+        for (QuantLib::Size i=last; i>first_; --i) {
+            const QuantLib::Real* d = &discRatios_[i*size_];
+            const QuantLib::Real* dPrevious = d - size_;
+            const QuantLib::Real* a = &cotAnnuities_[i*size_];
+            QuantLib::Real* aPrevious = &cotAnnuities_[(i-1)*size_];
+            QuantLib::Real* rPrevious = &cotSwapRates_[(i-1)*size_];
+            QuantLib::Time tau = rateTaus_[i-1];
+            for (QuantLib::Size k=begin; k<end; ++k) {
+                aPrevious[k] = a[k] + tau*d[k];
+                rPrevious[k] = (dPrevious[k]-dLast[k])/aPrevious[k];
+            }
+        }
+    }
+
+    CurveStateBatch::CurveStateBatch(
+            const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
+            const std::vector<QuantLib::Time>& rateTimes,
+            const QuantLib::Matrix& forwards,
+            QuantLib::Size firstValidIndex,
+            bool permanent)
+    : ObjectHandler::LibraryObject<LMMCurveStateBatch>(properties, permanent) {
+        libraryObject_ = boost::shared_ptr<LMMCurveStateBatch>(new
+            LMMCurveStateBatch(rateTimes, forwards.rows()));
+        libraryObject_->setOnForwardRates(forwards, firstValidIndex);
+    }
+
+    CurveStateBatch::CurveStateBatch(
+            const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
+            const std::vector<boost::shared_ptr<QuantLib::CurveState> >& states,
+            bool permanent)
+    : ObjectHandler::LibraryObject<LMMCurveStateBatch>(properties, permanent) {
+        QL_REQUIRE(!states.empty(), "no curve states given");
+        libraryObject_ = boost::shared_ptr<LMMCurveStateBatch>(new
+            LMMCurveStateBatch(states.front()->rateTimes(), states.size()));
+        for (QuantLib::Size k=0; k<states.size(); ++k)
+            libraryObject_->setState(k, *states[k]);
+    }
+
+    QuantLib::Matrix CurveStateBatch::forwardRates() const {
+        const LMMCurveStateBatch& batch = *libraryObject_;
+        QuantLib::Matrix result(batch.size(), batch.numberOfRates(), 0.0);
+        for (QuantLib::Size i=batch.firstValidIndex();
+             i<batch.numberOfRates(); ++i) {
+            const QuantLib::Rate* f = batch.forwardRates(i);
+            for (QuantLib::Size k=0; k<batch.size(); ++k)
+                result[k][i] = f[k];
+        }
+        return result;
+    }
+
+    QuantLib::Matrix CurveStateBatch::discountRatios() const {
+        const LMMCurveStateBatch& batch = *libraryObject_;
+        QuantLib::Matrix result(batch.size(), batch.numberOfRates()+1, 0.0);
+        for (QuantLib::Size i=batch.firstValidIndex();
+             i<=batch.numberOfRates(); ++i) {
+            const QuantLib::DiscountFactor* d = batch.discountRatios(i);
+            for (QuantLib::Size k=0; k<batch.size(); ++k)
+                result[k][i] = d[k];
+        }
+        return result;
+    }
+
+    QuantLib::Matrix CurveStateBatch::coterminalSwapRates() const {
+        const LMMCurveStateBatch& batch = *libraryObject_;
+        QuantLib::Matrix result(batch.size(), batch.numberOfRates(), 0.0);
+        for (QuantLib::Size i=batch.firstValidIndex();
+             i<batch.numberOfRates(); ++i) {
+            const QuantLib::Rate* r = batch.coterminalSwapRates(i);
+            for (QuantLib::Size k=0; k<batch.size(); ++k)
+                result[k][i] = r[k];
+        }
+        return result;
+    }
+
+    QuantLib::Matrix CurveStateBatch::coterminalSwapAnnuities(
+                                        QuantLib::Size numeraire) const {
+        const LMMCurveStateBatch& batch = *libraryObject_;
+        QL_REQUIRE(numeraire >= batch.firstValidIndex() &&
+                   numeraire <= batch.numberOfRates(),
+                   "invalid numeraire (" << numeraire << "): must be in ["
+                   << batch.firstValidIndex() << ", "
+                   << batch.numberOfRates() << "]");
+        QuantLib::Matrix result(batch.size(), batch.numberOfRates(), 0.0);
+        const QuantLib::DiscountFactor* d = batch.discountRatios(numeraire);
+        for (QuantLib::Size i=batch.firstValidIndex();
+             i<batch.numberOfRates(); ++i) {
+            const QuantLib::Real* a = batch.coterminalSwapAnnuities(i);
+            for (QuantLib::Size k=0; k<batch.size(); ++k)
+                result[k][i] = a[k]/d[k];
+        }
+        return result;
+    }
+
     CMSwapCurveState::CMSwapCurveState(
             const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
             const std::vector<QuantLib::Time>& rateTimes, 
@@ -56,6 +275,19 @@ namespace QuantLibAddin {
             QuantLib::LMMCurveState(rateTimes));
     }
 
+    LMMCurveState::LMMCurveState(
+            const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
+            const boost::shared_ptr<CurveStateBatch>& batch,
+            QuantLib::Size index,
+            bool permanent) : CurveState(properties, permanent) {
+        boost::shared_ptr<LMMCurveStateBatch> states;
+        batch->getLibraryObject(states);
+        boost::shared_ptr<QuantLib::LMMCurveState> cs(new
+            QuantLib::LMMCurveState(states->rateTimes()));
+        states->state(index, *cs);
+        libraryObject_ = cs;
+    }
+
     std::vector<QuantLib::Rate> qlForwardsFromDiscountRatios(
                             const QuantLib::Size firstValidIndex,
                             const std::vector<QuantLib::DiscountFactor>& ds,
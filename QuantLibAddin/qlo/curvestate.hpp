@@ -27,13 +27,110 @@
 #include <oh/libraryobject.hpp>
 
 #include <ql/types.hpp>
+#include <ql/math/matrix.hpp>
+
+#include <vector>
 
 namespace QuantLib {
     class CurveState;
+    class LMMCurveState;
 }
 
 namespace QuantLibAddin {
 
+    //! Set of LMM curve states on the same rate times
+    /*! Holds the states of many paths (e.g., at an exercise date in a
+        regression-based Bermudan pricing) in structure-of-arrays
+        layout: the values of a given rate for all states are
+        contiguous, so that forward rates, discount ratios and
+        coterminal swap rates and annuities are computed for all states
+        at once with inner loops running over the states.  Results are
+        the same as the ones of QuantLib::LMMCurveState.  All states
+        share the same first valid index.
+    */
+    class LMMCurveStateBatch {
+      public:
+        LMMCurveStateBatch(const std::vector<QuantLib::Time>& rateTimes,
+                           QuantLib::Size size);
+        //! \name Inspectors
+        //@{
+        QuantLib::Size size() const { return size_; }
+        QuantLib::Size numberOfRates() const { return numberOfRates_; }
+        QuantLib::Size firstValidIndex() const { return first_; }
+        const std::vector<QuantLib::Time>& rateTimes() const {
+            return rateTimes_;
+        }
+        //! forward rate i of all states
+        const QuantLib::Rate* forwardRates(QuantLib::Size i) const {
+            return &forwards_[i*size_];
+        }
+        //! discount ratio i of all states
+        /*! When set from forward rates, the ratios are normalized to
+            the first valid one; when set from discount ratios, they are
+            stored as given, as in QuantLib::LMMCurveState.
+        */
+        const QuantLib::DiscountFactor* discountRatios(QuantLib::Size i) const {
+            return &discRatios_[i*size_];
+        }
+        const QuantLib::Rate* coterminalSwapRates(QuantLib::Size i) const {
+            return &cotSwapRates_[i*size_];
+        }
+        //! coterminal annuity i of all states, in units of discount ratio i
+        const QuantLib::Real* coterminalSwapAnnuities(QuantLib::Size i) const {
+            return &cotAnnuities_[i*size_];
+        }
+        //! copies the k-th state into the given curve state
+        void state(QuantLib::Size k, QuantLib::LMMCurveState& cs) const;
+        //@}
+        //! \name Modifiers
+        //@{
+        //! sets the states on the rows of the given matrix
+        void setOnForwardRates(const QuantLib::Matrix& forwards,
+                               QuantLib::Size firstValidIndex = 0);
+        //! sets the states on the rows of the given matrix
+        void setOnDiscountRatios(const QuantLib::Matrix& discountRatios,
+                                 QuantLib::Size firstValidIndex = 0);
+        //! sets the k-th state on the forward rates of the given one
+        /*! If the first valid index of the given state is after the
+            one of the batch, it becomes the one of the batch and the
+            other states are normalized to it. */
+        void setState(QuantLib::Size k, const QuantLib::CurveState& cs);
+        //@}
+      private:
+        // derived quantities of the states in [begin, end)
+        void computeFromForwardRates(QuantLib::Size begin, QuantLib::Size end);
+        void computeCoterminalSwapRates(QuantLib::Size begin,
+                                        QuantLib::Size end);
+        std::vector<QuantLib::Time> rateTimes_, rateTaus_;
+        QuantLib::Size numberOfRates_, size_, first_;
+        // element (i,k) at position i*size_+k
+        std::vector<QuantLib::Real> forwards_, discRatios_;
+        std::vector<QuantLib::Real> cotSwapRates_, cotAnnuities_;
+    };
+
+    class CurveStateBatch :
+                public ObjectHandler::LibraryObject<LMMCurveStateBatch> {
+      public:
+        CurveStateBatch(
+            const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
+            const std::vector<QuantLib::Time>& rateTimes,
+            const QuantLib::Matrix& forwards,
+            QuantLib::Size firstValidIndex,
+            bool permanent);
+        CurveStateBatch(
+            const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
+            const std::vector<boost::shared_ptr<QuantLib::CurveState> >& states,
+            bool permanent);
+        QuantLib::Size size() const { return libraryObject_->size(); }
+        //! \name Values of all states, one row per state
+        //@{
+        QuantLib::Matrix forwardRates() const;
+        QuantLib::Matrix discountRatios() const;
+        QuantLib::Matrix coterminalSwapRates() const;
+        QuantLib::Matrix coterminalSwapAnnuities(QuantLib::Size numeraire) const;
+        //@}
+    };
+
     OH_LIB_CLASS(CurveState, QuantLib::CurveState);
 
     class CMSwapCurveState : public CurveState {
@@ -59,6 +156,12 @@ namespace QuantLibAddin {
             const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
             const std::vector<QuantLib::Time>& rateTimes,
             bool permanent);
+        //! copy of a state of the given batch
+        LMMCurveState(
+            const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
+            const boost::shared_ptr<CurveStateBatch>& batch,
+            QuantLib::Size index,
+            bool permanent);
     };
 
     std::vector<QuantLib::Rate> qlForwardsFromDiscountRatios(
@@ -0,0 +1,400 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+#if defined(HAVE_CONFIG_H)     // Dynamically created by configure
+    #include <qlo/config.hpp>
+#endif
+#include <qlo/decompositioncache.hpp>
+#include <ql/math/distributions/normaldistribution.hpp>
+#include <ql/math/randomnumbers/mt19937uniformrng.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using QuantLib::Matrix;
+using QuantLib::Real;
+using QuantLib::Size;
+
+namespace QuantLibAddin {
+
+    namespace {
+
+        class SchurFactory {
+          public:
+            explicit SchurFactory(const Matrix& s) : s_(s) {}
+            boost::shared_ptr<QuantLib::SymmetricSchurDecomposition>
+            operator()() const {
+                return boost::shared_ptr<QuantLib::SymmetricSchurDecomposition>(
+                            new QuantLib::SymmetricSchurDecomposition(s_));
+            }
+          private:
+            const Matrix& s_;
+        };
+
+        class CovarianceFactory {
+          public:
+            CovarianceFactory(const Matrix& covariance, Real tolerance)
+            : covariance_(covariance), tolerance_(tolerance) {}
+            boost::shared_ptr<QuantLib::CovarianceDecomposition>
+            operator()() const {
+                return boost::shared_ptr<QuantLib::CovarianceDecomposition>(
+                    new QuantLib::CovarianceDecomposition(covariance_,
+                                                          tolerance_));
+            }
+          private:
+            const Matrix& covariance_;
+            Real tolerance_;
+        };
+
+        class RankReducedSqrtFactory {
+          public:
+            RankReducedSqrtFactory(const Matrix& matrix,
+                                   Size maxRank,
+                                   Real componentRetainedPercentage,
+                                   QuantLib::SalvagingAlgorithm::Type sa)
+            : matrix_(matrix), maxRank_(maxRank),
+              percentage_(componentRetainedPercentage), sa_(sa) {}
+            boost::shared_ptr<Matrix> operator()() const {
+                return boost::shared_ptr<Matrix>(new Matrix(
+                    QuantLib::rankReducedSqrt(matrix_, maxRank_,
+                                              percentage_, sa_)));
+            }
+          private:
+            const Matrix& matrix_;
+            Size maxRank_;
+            Real percentage_;
+            QuantLib::SalvagingAlgorithm::Type sa_;
+        };
+
+        // Orthonormalizes the rows of m in place by modified Gram-Schmidt,
+        // applied twice for numerical orthogonality.  Rows which are
+        // linearly dependent on the previous ones are set to zero.
+        void orthonormalizeRows(Matrix& m) {
+            Size rows = m.rows(), n = m.columns();
+            for (Size i=0; i<rows; ++i) {
+                Real* v = m.row_begin(i);
+                Real initial = 0.0;
+                for (Size k=0; k<n; ++k)
+                    initial += v[k]*v[k];
+                for (Size pass=0; pass<2; ++pass) {
+                    for (Size j=0; j<i; ++j) {
+                        const Real* u = m.row_begin(j);
+                        Real dot = 0.0;
+                        for (Size k=0; k<n; ++k)
+                            dot += u[k]*v[k];
+                        for (Size k=0; k<n; ++k)
+                            v[k] -= dot*u[k];
+                    }
+                }
+                Real norm = 0.0;
+                for (Size k=0; k<n; ++k)
+                    norm += v[k]*v[k];
+                if (norm <= 1.0e-24*initial || norm == 0.0) {
+                    std::fill(v, v+n, 0.0);
+                } else {
+                    Real scale = 1.0/std::sqrt(norm);
+                    for (Size k=0; k<n; ++k)
+                        v[k] *= scale;
+                }
+            }
+        }
+
+        class TruncatedSqrtFactory {
+          public:
+            TruncatedSqrtFactory(const Matrix& matrix,
+                                 Size rank,
+                                 Real componentRetainedPercentage,
+                                 Size powerIterations,
+                                 QuantLib::BigNatural seed)
+            : matrix_(matrix), rank_(rank),
+              percentage_(componentRetainedPercentage),
+              powerIterations_(powerIterations), seed_(seed) {}
+            boost::shared_ptr<Matrix> operator()() const {
+                const Matrix& a = matrix_;
+                Size n = a.rows();
+                Size k = std::min(rank_, n);
+                Size l = std::min(k + 10, n);
+
+                // range finder: the rows of q span the dominant subspace
+                QuantLib::MersenneTwisterUniformRng rng(seed_);
+                QuantLib::InverseCumulativeNormal gaussian;
+                Matrix omega(l, n);
+                for (Matrix::iterator x = omega.begin(); x != omega.end(); ++x)
+                    *x = gaussian(rng.nextReal());
+                Matrix q = omega * a;
+                orthonormalizeRows(q);
+                for (Size i=0; i<powerIterations_; ++i) {
+                    q = q * a;
+                    orthonormalizeRows(q);
+                }
+
+                // eigenpairs of the projection, sorted by decreasing value
+                Matrix qa = q * a;
+                QuantLib::SymmetricSchurDecomposition jd(
+                                            qa * QuantLib::transpose(q));
+                std::vector<Real> eigenValues(jd.eigenvalues().begin(),
+                                              jd.eigenvalues().end());
+                for (Size i=0; i<l; ++i)
+                    eigenValues[i] = std::max<Real>(eigenValues[i], 0.0);
+
+                // factor reduction, as in QuantLib::rankReducedSqrt
+                Real trace = 0.0;
+                for (Size i=0; i<n; ++i)
+                    trace += a[i][i];
+                Real enough = percentage_ * trace;
+                if (percentage_ == 1.0)
+                    enough *= 1.1;
+                Real components = eigenValues[0];
+                Size retainedFactors = 1;
+                for (Size i=1; components<enough && i<l; ++i) {
+                    components += eigenValues[i];
+                    ++retainedFactors;
+                }
+                retainedFactors = std::min(retainedFactors, k);
+
+                const Matrix& v = jd.eigenvectors();
+                boost::shared_ptr<Matrix> result(
+                                    new Matrix(n, retainedFactors, 0.0));
+                for (Size j=0; j<retainedFactors; ++j) {
+                    Real sqrtLambda = std::sqrt(eigenValues[j]);
+                    for (Size r=0; r<l; ++r) {
+                        Real w = v[r][j] * sqrtLambda;
+                        if (w == 0.0)
+                            continue;
+                        const Real* qr = q.row_begin(r);
+                        for (Size i=0; i<n; ++i)
+                            (*result)[i][j] += qr[i] * w;
+                    }
+                }
+
+                // rows are rescaled so that the diagonal is reproduced
+                for (Size i=0; i<n; ++i) {
+                    Real norm = 0.0;
+                    for (Size j=0; j<retainedFactors; ++j)
+                        norm += (*result)[i][j] * (*result)[i][j];
+                    if (norm > 0.0) {
+                        Real adjustment = std::sqrt(a[i][i]/norm);
+                        for (Size j=0; j<retainedFactors; ++j)
+                            (*result)[i][j] *= adjustment;
+                    }
+                }
+                return result;
+            }
+          private:
+            const Matrix& matrix_;
+            Size rank_;
+            Real percentage_;
+            Size powerIterations_;
+            QuantLib::BigNatural seed_;
+        };
+
+    }
+
+    DecompositionCache::Key::Key(const std::string& kind)
+    : kind_(kind), hash_(14695981039346656037ULL) {
+        for (Size i=0; i<kind.size(); ++i) {
+            hash_ ^= static_cast<unsigned char>(kind[i]);
+            hash_ *= 1099511628211ULL;
+        }
+    }
+
+    DecompositionCache::Key& DecompositionCache::Key::operator<<(Real x) {
+        boost::uint64_t bits;
+        std::memcpy(&bits, &x, sizeof(bits));
+        return *this << bits;
+    }
+
+    DecompositionCache::Key& DecompositionCache::Key::operator<<(
+                                                        boost::uint64_t n) {
+        for (Size i=0; i<8; ++i) {
+            hash_ ^= (n >> (8*i)) & 0xff;
+            hash_ *= 1099511628211ULL;
+        }
+        data_.push_back(n);
+        return *this;
+    }
+
+    DecompositionCache::Key& DecompositionCache::Key::operator<<(
+                                            const std::vector<Real>& x) {
+        *this << boost::uint64_t(x.size());
+        for (Size i=0; i<x.size(); ++i)
+            *this << x[i];
+        return *this;
+    }
+
+    DecompositionCache::Key& DecompositionCache::Key::operator<<(
+                                                        const Matrix& m) {
+        *this << boost::uint64_t(m.rows()) << boost::uint64_t(m.columns());
+        for (Matrix::const_iterator x = m.begin(); x != m.end(); ++x)
+            *this << *x;
+        return *this;
+    }
+
+    bool DecompositionCache::Key::operator<(const Key& other) const {
+        if (hash_ != other.hash_)
+            return hash_ < other.hash_;
+        if (kind_ != other.kind_)
+            return kind_ < other.kind_;
+        return data_ < other.data_;
+    }
+
+    DecompositionCache::DecompositionCache()
+    : capacity_(32), hits_(0), misses_(0) {}
+
+    boost::shared_ptr<void> DecompositionCache::find(const Key& key) {
+        boost::mutex::scoped_lock lock(mutex_);
+        std::map<Key, entries::iterator>::iterator i = index_.find(key);
+        if (i == index_.end()) {
+            ++misses_;
+            return boost::shared_ptr<void>();
+        }
+        ++hits_;
+        entries_.splice(entries_.begin(), entries_, i->second);
+        return i->second->second;
+    }
+
+    boost::shared_ptr<void> DecompositionCache::insert(
+                                    const Key& key,
+                                    const boost::shared_ptr<void>& value) {
+        boost::mutex::scoped_lock lock(mutex_);
+        std::map<Key, entries::iterator>::iterator i = index_.find(key);
+        if (i != index_.end()) {
+            // stored by another thread in the meantime
+            entries_.splice(entries_.begin(), entries_, i->second);
+            return i->second->second;
+        }
+        entries_.push_front(std::make_pair(key, value));
+        index_[key] = entries_.begin();
+        trim();
+        return value;
+    }
+
+    void DecompositionCache::trim() {
+        while (entries_.size() > capacity_) {
+            index_.erase(entries_.back().first);
+            entries_.pop_back();
+        }
+    }
+
+    Size DecompositionCache::size() const {
+        boost::mutex::scoped_lock lock(mutex_);
+        return entries_.size();
+    }
+
+    Size DecompositionCache::capacity() const {
+        boost::mutex::scoped_lock lock(mutex_);
+        return capacity_;
+    }
+
+    Size DecompositionCache::hits() const {
+        boost::mutex::scoped_lock lock(mutex_);
+        return hits_;
+    }
+
+    Size DecompositionCache::misses() const {
+        boost::mutex::scoped_lock lock(mutex_);
+        return misses_;
+    }
+
+    void DecompositionCache::setCapacity(Size capacity) {
+        boost::mutex::scoped_lock lock(mutex_);
+        capacity_ = capacity;
+        trim();
+    }
+
+    Size DecompositionCache::clear() {
+        boost::mutex::scoped_lock lock(mutex_);
+        Size n = entries_.size();
+        index_.clear();
+        entries_.clear();
+        return n;
+    }
+
+    boost::shared_ptr<QuantLib::SymmetricSchurDecomposition>
+    cachedSymmetricSchurDecomposition(const Matrix& s) {
+        DecompositionCache::Key key("SymmetricSchur");
+        key << s;
+        return DecompositionCache::instance()
+            .retrieve<QuantLib::SymmetricSchurDecomposition>(
+                                                    key, SchurFactory(s));
+    }
+
+    boost::shared_ptr<QuantLib::CovarianceDecomposition>
+    cachedCovarianceDecomposition(const Matrix& covariance, Real tolerance) {
+        DecompositionCache::Key key("Covariance");
+        key << covariance << tolerance;
+        return DecompositionCache::instance()
+            .retrieve<QuantLib::CovarianceDecomposition>(
+                            key, CovarianceFactory(covariance, tolerance));
+    }
+
+    Matrix cachedRankReducedSqrt(const Matrix& matrix,
+                                 Size maxRank,
+                                 Real componentRetainedPercentage,
+                                 QuantLib::SalvagingAlgorithm::Type sa) {
+        DecompositionCache::Key key("RankReducedSqrt");
+        key << matrix << boost::uint64_t(maxRank)
+            << componentRetainedPercentage << boost::uint64_t(sa);
+        return *DecompositionCache::instance().retrieve<Matrix>(
+            key, RankReducedSqrtFactory(matrix, maxRank,
+                                        componentRetainedPercentage, sa));
+    }
+
+    Matrix truncatedPseudoSqrt(const Matrix& matrix,
+                               Size rank,
+                               Real componentRetainedPercentage,
+                               Size powerIterations,
+                               QuantLib::BigNatural seed) {
+        Size n = matrix.rows();
+        QL_REQUIRE(n > 0 && n == matrix.columns(),
+                   "non square matrix: " << n << " rows, "
+                   << matrix.columns() << " columns");
+        QL_REQUIRE(rank > 0, "the rank must be positive");
+        QL_REQUIRE(componentRetainedPercentage > 0.0,
+                   "no eigenvalues retained");
+        QL_REQUIRE(componentRetainedPercentage <= 1.0,
+                   "percentage to be retained > 100%");
+        for (Size i=0; i<n; ++i) {
+            QL_REQUIRE(matrix[i][i] >= 0.0,
+                       "negative diagonal element " << matrix[i][i]
+                       << " at row " << i);
+            for (Size j=0; j<i; ++j)
+                QL_REQUIRE(std::fabs(matrix[i][j]-matrix[j][i]) <= 1.0e-10,
+                           "non symmetric matrix: [" << i << "][" << j
+                           << "]=" << matrix[i][j] << ", [" << j << "]["
+                           << i << "]=" << matrix[j][i]);
+        }
+
+        DecompositionCache::Key key("TruncatedPseudoSqrt");
+        key << matrix << boost::uint64_t(rank) << componentRetainedPercentage
+            << boost::uint64_t(powerIterations) << boost::uint64_t(seed);
+        return *DecompositionCache::instance().retrieve<Matrix>(
+            key, TruncatedSqrtFactory(matrix, rank,
+                                      componentRetainedPercentage,
+                                      powerIterations, seed));
+    }
+
+    Size clearDecompositionCache() {
+        return DecompositionCache::instance().clear();
+    }
+
+    Size decompositionCacheSize() {
+        return DecompositionCache::instance().size();
+    }
+
+}
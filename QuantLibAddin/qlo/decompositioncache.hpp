@@ -0,0 +1,172 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*! \file
+    \brief Shared cache of matrix decompositions keyed by their inputs
+*/
+
+#ifndef qla_decompositioncache_hpp
+#define qla_decompositioncache_hpp
+
+#include <ql/errors.hpp>
+#include <ql/math/matrix.hpp>
+#include <ql/math/matrixutilities/pseudosqrt.hpp>
+#include <ql/math/matrixutilities/symmetricschurdecomposition.hpp>
+#include <ql/math/matrixutilities/getcovariance.hpp>
+#include <ql/patterns/singleton.hpp>
+
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace QuantLibAddin {
+
+    //! Process-wide cache of immutable results keyed by their inputs
+    /*! An entry is identified by a kind tag and by the exact values of
+        the inputs it was computed from.  A 64-bit FNV-1a hash of the
+        inputs makes lookups cheap; the inputs themselves are compared
+        when the hashes match, so that a collision can never return a
+        wrong result.  Beyond the capacity, the least recently used
+        entries are dropped.
+
+        Besides matrix decompositions, the cache holds the market models
+        built by qlFlatVol and qlAbcdVol, whose construction requires one
+        decomposition per evolution step; they share its capacity and
+        are dropped by clear() as well.
+
+        Cached objects are shared by all their users and must not be
+        modified.  The cache can be used concurrently; the result for a
+        missing key is computed outside the lock, so that two threads
+        may compute it at the same time, in which case the first one
+        stored is kept and returned to both.
+    */
+    class DecompositionCache
+        : public QuantLib::Singleton<DecompositionCache> {
+        friend class QuantLib::Singleton<DecompositionCache>;
+      public:
+        //! inputs identifying a cached result
+        class Key {
+          public:
+            explicit Key(const std::string& kind);
+            Key& operator<<(QuantLib::Real x);
+            //! exact for all integers, unlike a conversion to Real
+            Key& operator<<(boost::uint64_t n);
+            Key& operator<<(const std::vector<QuantLib::Real>& x);
+            Key& operator<<(const QuantLib::Matrix& m);
+            bool operator<(const Key& other) const;
+          private:
+            std::string kind_;
+            boost::uint64_t hash_;
+            // bit patterns, so that the ordering is strict for any value
+            std::vector<boost::uint64_t> data_;
+        };
+        //! cached result for the given key, computed by make() if missing
+        /*! Factory must provide boost::shared_ptr<T> operator()() const. */
+        template <class T, class Factory>
+        boost::shared_ptr<T> retrieve(const Key& key, const Factory& make) {
+            boost::shared_ptr<void> cached = find(key);
+            if (cached)
+                return boost::static_pointer_cast<T>(cached);
+            boost::shared_ptr<T> result = make();
+            QL_ENSURE(result, "null result for cached decomposition");
+            return boost::static_pointer_cast<T>(insert(key, result));
+        }
+        //! \name Inspectors
+        //@{
+        QuantLib::Size size() const;
+        QuantLib::Size capacity() const;
+        QuantLib::Size hits() const;
+        QuantLib::Size misses() const;
+        //@}
+        //! \name Modifiers
+        //@{
+        void setCapacity(QuantLib::Size capacity);
+        //! drops all entries and returns their number
+        QuantLib::Size clear();
+        //@}
+      private:
+        DecompositionCache();
+        typedef std::list<std::pair<Key, boost::shared_ptr<void> > > entries;
+        boost::shared_ptr<void> find(const Key& key);
+        boost::shared_ptr<void> insert(const Key& key,
+                                       const boost::shared_ptr<void>& value);
+        void trim();
+        mutable boost::mutex mutex_;
+        // most recently used first
+        entries entries_;
+        std::map<Key, entries::iterator> index_;
+        QuantLib::Size capacity_, hits_, misses_;
+    };
+
+    //! shared Schur decomposition of the given symmetric matrix
+    boost::shared_ptr<QuantLib::SymmetricSchurDecomposition>
+    cachedSymmetricSchurDecomposition(const QuantLib::Matrix& s);
+
+    //! shared decomposition of the given covariance matrix
+    boost::shared_ptr<QuantLib::CovarianceDecomposition>
+    cachedCovarianceDecomposition(const QuantLib::Matrix& covariance,
+                                  QuantLib::Real tolerance);
+
+    //! QuantLib::rankReducedSqrt, cached on its arguments
+    QuantLib::Matrix cachedRankReducedSqrt(
+                            const QuantLib::Matrix& matrix,
+                            QuantLib::Size maxRank,
+                            QuantLib::Real componentRetainedPercentage,
+                            QuantLib::SalvagingAlgorithm::Type sa);
+
+    //! rank-reduced pseudo square root by randomized subspace iteration
+    /*! Approximates the leading eigenpairs of the symmetric positive
+        semi-definite matrix with the randomized range finder of Halko,
+        Martinsson and Tropp ("Finding structure with randomness", SIAM
+        Review 53, 2011): a Gaussian test matrix with rank plus ten
+        columns is multiplied by the matrix, the product is refined by
+        the given number of power iterations with re-orthonormalization,
+        and the projected matrix is diagonalized.  The cost is of order
+        n^2 (rank + 10) per iteration instead of the n^3 per sweep of a
+        full Jacobi decomposition, and the result is accurate when the
+        spectrum decays beyond the requested rank, as is the case for
+        the correlation matrices of factor models.
+
+        As in QuantLib::rankReducedSqrt, the factors are retained until
+        the given fraction of the trace is explained, up to the given
+        rank; negative eigenvalues are floored at zero and the rows of
+        the result are rescaled so that the diagonal of the matrix is
+        reproduced exactly.  The test matrix is drawn from a Mersenne
+        twister with the given seed, so that results are reproducible;
+        they are also cached on all the arguments.
+    */
+    QuantLib::Matrix truncatedPseudoSqrt(
+                            const QuantLib::Matrix& matrix,
+                            QuantLib::Size rank,
+                            QuantLib::Real componentRetainedPercentage = 1.0,
+                            QuantLib::Size powerIterations = 2,
+                            QuantLib::BigNatural seed = 42);
+
+    //! drops all cached decompositions and returns their number
+    QuantLib::Size clearDecompositionCache();
+
+    //! number of cached decompositions
+    QuantLib::Size decompositionCacheSize();
+
+}
+
+#endif
@@ -29,8 +29,147 @@
 #include <ql/models/marketmodels/driftcomputation/cmsmmdriftcalculator.hpp>
 #include <ql/models/marketmodels/driftcomputation/lmmnormaldriftcalculator.hpp>
 #include <ql/models/marketmodels/driftcomputation/smmdriftcalculator.hpp>
+#include <ql/models/marketmodels/curvestates/lmmcurvestate.hpp>
+#include <ql/math/matrix.hpp>
+
+#include <algorithm>
 
 namespace QuantLibAddin {
+
+    PackedLMMDriftCalculator::PackedLMMDriftCalculator(
+                                const QuantLib::Matrix& pseudo,
+                                const std::vector<QuantLib::Spread>& displ,
+                                const std::vector<QuantLib::Time>& taus,
+                                QuantLib::Size numeraire,
+                                QuantLib::Size alive,
+                                bool normal)
+    : numberOfRates_(taus.size()), numberOfFactors_(pseudo.columns()),
+      isFullFactor_(numberOfFactors_ == numberOfRates_), normal_(normal),
+      numeraire_(numeraire), alive_(alive),
+      displacements_(normal ? std::vector<QuantLib::Spread>(taus.size(), 0.0)
+                            : displ),
+      oneOverTaus_(taus.size()),
+      pseudo_(pseudo.begin(), pseudo.end()),
+      downs_(taus.size()), ups_(taus.size()),
+      tmp_(taus.size()), e_(pseudo.columns()) {
+
+        QL_REQUIRE(numberOfRates_>0, "Dim out of range");
+        QL_REQUIRE(displacements_.size() == numberOfRates_,
+                   "Displacements out of range");
+        QL_REQUIRE(pseudo.rows()==numberOfRates_,
+                   "pseudo.rows() not consistent with dim");
+        QL_REQUIRE(pseudo.columns()>0 && pseudo.columns()<=numberOfRates_,
+                   "pseudo.rows() not consistent with pseudo.columns()");
+        QL_REQUIRE(alive<numberOfRates_,
+                   "Alive out of bounds");
+        QL_REQUIRE(numeraire_<=numberOfRates_,
+                   "Numeraire larger than dim");
+        QL_REQUIRE(numeraire_>=alive,
+                   "Numeraire smaller than alive");
+
+        for (QuantLib::Size i=0; i<numberOfRates_; ++i)
+            oneOverTaus_[i] = 1.0/taus[i];
+
+        // same product as pseudo*transpose(pseudo)
+        if (isFullFactor_) {
+            covariance_.resize(numberOfRates_*numberOfRates_);
+            for (QuantLib::Size i=0; i<numberOfRates_; ++i) {
+                const QuantLib::Real* a = &pseudo_[i*numberOfFactors_];
+                for (QuantLib::Size j=0; j<numberOfRates_; ++j) {
+                    const QuantLib::Real* b = &pseudo_[j*numberOfFactors_];
+                    QuantLib::Real sum = 0.0;
+                    for (QuantLib::Size k=0; k<numberOfFactors_; ++k)
+                        sum += a[k]*b[k];
+                    covariance_[i*numberOfRates_+j] = sum;
+                }
+            }
+        }
+
+        for (QuantLib::Size i=alive_; i<numberOfRates_; ++i) {
+            downs_[i] = std::min(i+1, numeraire_);
+            ups_[i] = std::max(i+1, numeraire_);
+        }
+    }
+
+    void PackedLMMDriftCalculator::setForwardFactors(
+                                    const QuantLib::Rate* forwards) const {
+        if (normal_) {
+            for (QuantLib::Size i=alive_; i<numberOfRates_; ++i)
+                tmp_[i] = 1.0/(oneOverTaus_[i]+forwards[i]);
+        } else {
+            for (QuantLib::Size i=alive_; i<numberOfRates_; ++i)
+                tmp_[i] = (forwards[i]+displacements_[i]) /
+                          (oneOverTaus_[i]+forwards[i]);
+        }
+    }
+
+    void PackedLMMDriftCalculator::compute(const QuantLib::Rate* forwards,
+                                           QuantLib::Real* drifts) const {
+        if (isFullFactor_)
+            computePlain(forwards, drifts);
+        else
+            computeReduced(forwards, drifts);
+    }
+
+    void PackedLMMDriftCalculator::compute(
+                                const QuantLib::LMMCurveState& cs,
+                                std::vector<QuantLib::Real>& drifts) const {
+        QL_REQUIRE(drifts.size() == numberOfRates_,
+                   "drifts size (" << drifts.size() << ") differs from "
+                   "number of rates (" << numberOfRates_ << ")");
+        compute(&cs.forwardRates()[0], &drifts[0]);
+    }
+
+    void PackedLMMDriftCalculator::computePlain(
+                                const QuantLib::Rate* forwards,
+                                QuantLib::Real* drifts) const {
+        setForwardFactors(forwards);
+        for (QuantLib::Size i=alive_; i<numberOfRates_; ++i) {
+            const QuantLib::Real* c = &covariance_[i*numberOfRates_];
+            QuantLib::Real drift = 0.0;
+            for (QuantLib::Size j=downs_[i]; j<ups_[i]; ++j)
+                drift += tmp_[j]*c[j];
+            drifts[i] = (numeraire_>i+1) ? -drift : drift;
+        }
+    }
+
+    void PackedLMMDriftCalculator::computeReduced(
+                                const QuantLib::Rate* forwards,
+                                QuantLib::Real* drifts) const {
+        setForwardFactors(forwards);
+        QuantLib::Size factors = numberOfFactors_;
+        QuantLib::Real* e = &e_[0];
+
+        // backward from the numeraire down to the first alive rate
+        if (numeraire_>0) {
+            drifts[numeraire_-1] = 0.0;
+            std::fill(e_.begin(), e_.end(), 0.0);
+            for (QuantLib::Size i=numeraire_-1; i-- > alive_; ) {
+                const QuantLib::Real* a = &pseudo_[i*factors];
+                const QuantLib::Real* next = a + factors;
+                QuantLib::Real t = tmp_[i+1];
+                for (QuantLib::Size r=0; r<factors; ++r)
+                    e[r] += t*next[r];
+                QuantLib::Real drift = 0.0;
+                for (QuantLib::Size r=0; r<factors; ++r)
+                    drift -= e[r]*a[r];
+                drifts[i] = drift;
+            }
+        }
+
+        // forward from the numeraire up to the last rate
+        std::fill(e_.begin(), e_.end(), 0.0);
+        for (QuantLib::Size i=numeraire_; i<numberOfRates_; ++i) {
+            const QuantLib::Real* a = &pseudo_[i*factors];
+            QuantLib::Real t = tmp_[i];
+            for (QuantLib::Size r=0; r<factors; ++r)
+                e[r] += t*a[r];
+            QuantLib::Real drift = 0.0;
+            for (QuantLib::Size r=0; r<factors; ++r)
+                drift += e[r]*a[r];
+            drifts[i] = drift;
+        }
+    }
         
   LMMDriftCalculator::LMMDriftCalculator(
                                     const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
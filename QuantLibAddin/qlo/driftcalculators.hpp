@@ -28,6 +28,8 @@
 
 #include <ql/types.hpp>
 
+#include <vector>
+
 namespace QuantLib {
     class LMMDriftCalculator;
     class LMMNormalDriftCalculator;
@@ -40,6 +42,47 @@ namespace QuantLib {
 }
 
 namespace QuantLibAddin {
+
+    //! LMM drifts computed on packed, contiguous arrays
+    /*! Same drifts as QuantLib::LMMDriftCalculator (displaced lognormal
+        forwards) or QuantLib::LMMNormalDriftCalculator (normal
+        forwards), with the same operations in the same order, so that
+        results are identical.  The pseudo-root is stored rate by rate
+        and the reduced-factor recursion keeps a single running vector
+        over the factors instead of a factors x rates matrix, so that
+        all inner loops run over contiguous memory.  Drifts can be
+        computed directly from an array of forwards, without setting up
+        a curve state.
+    */
+    class PackedLMMDriftCalculator {
+      public:
+        PackedLMMDriftCalculator(const QuantLib::Matrix& pseudo,
+                                 const std::vector<QuantLib::Spread>& displacements,
+                                 const std::vector<QuantLib::Time>& taus,
+                                 QuantLib::Size numeraire,
+                                 QuantLib::Size alive,
+                                 bool normal = false);
+        //! writes the drifts of the forwards from alive onwards
+        void compute(const QuantLib::Rate* forwards,
+                     QuantLib::Real* drifts) const;
+        void compute(const QuantLib::LMMCurveState& cs,
+                     std::vector<QuantLib::Real>& drifts) const;
+        void computePlain(const QuantLib::Rate* forwards,
+                          QuantLib::Real* drifts) const;
+        void computeReduced(const QuantLib::Rate* forwards,
+                            QuantLib::Real* drifts) const;
+      private:
+        void setForwardFactors(const QuantLib::Rate* forwards) const;
+        QuantLib::Size numberOfRates_, numberOfFactors_;
+        bool isFullFactor_, normal_;
+        QuantLib::Size numeraire_, alive_;
+        std::vector<QuantLib::Spread> displacements_;
+        std::vector<QuantLib::Real> oneOverTaus_;
+        // pseudo-root, rates x factors, and covariance, rates x rates
+        std::vector<QuantLib::Real> pseudo_, covariance_;
+        std::vector<QuantLib::Size> downs_, ups_;
+        mutable std::vector<QuantLib::Real> tmp_, e_;
+    };
    
     class LMMDriftCalculator : public ObjectHandler::LibraryObject<QuantLib::LMMDriftCalculator> {
       public:
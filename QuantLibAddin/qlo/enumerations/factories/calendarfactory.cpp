@@ -20,6 +20,7 @@
 #include <oh/ohdefines.hpp>
 #include <boost/regex.hpp>
 #include <qlo/enumerations/factories/calendarfactory.hpp>
+#include <qlo/businessdaycalendar.hpp>
 #include <set>
 
 namespace ObjectHandler {
@@ -46,9 +47,9 @@ namespace ObjectHandler {
                 return *(static_cast<QuantLib::Calendar*>(this->getType(idFull)));
             } else {
                 // It doesn't - create it, add it to the registry, and return it.
-                QuantLib::Calendar *jointCalendar = makeJointCalendar(calendarIDs.size());
-                registerType(idFull, jointCalendar);
-                return *jointCalendar;
+                // The registry may hold a copy of the calendar.
+                registerType(idFull, makeJointCalendar(calendarIDs.size()));
+                return *(static_cast<QuantLib::Calendar*>(this->getType(idFull)));
             }
         } else {
             // the ID is for a Calendar - return it
@@ -56,6 +57,26 @@ namespace ObjectHandler {
         }
     }
 
+    /*
+    Calendars are registered as QuantLibAddin::BusinessDayCalendar, which
+    caches their business days; this includes the joint calendars, built
+    from the registered calendars.  The given calendar is then deleted,
+    and the registered one must be retrieved with getType().  The null
+    Calendar() has no business days to cache and is registered as it is.
+    */
+    void Create<QuantLib::Calendar>::registerType(const std::string& id,
+                                                  void *type) {
+        QuantLib::Calendar *calendar = static_cast<QuantLib::Calendar*>(type);
+        if (!calendar->empty()) {
+            QuantLib::Calendar *cached =
+                new QuantLibAddin::BusinessDayCalendar(*calendar);
+            delete calendar;
+            calendar = cached;
+        }
+        RegistryManager<QuantLib::Calendar, EnumTypeRegistry>::registerType(
+            id, static_cast<void*>(calendar));
+    }
+
     /*
     Test whether the ID is that of a joint calendar.
     If it is, then later we'll parse it with a boost::regex, but that
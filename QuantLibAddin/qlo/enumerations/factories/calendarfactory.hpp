@@ -31,7 +31,8 @@ namespace ObjectHandler {
     public:
         QuantLib::Calendar operator()(const std::string& id);
         using RegistryManager<QuantLib::Calendar, EnumTypeRegistry>::checkType;
-        using RegistryManager<QuantLib::Calendar, EnumTypeRegistry>::registerType;
+        //! registers the given calendar with its business days cached
+        void registerType(const std::string& id, void *type);
         Create();
 
     private:
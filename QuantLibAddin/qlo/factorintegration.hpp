@@ -0,0 +1,161 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*! \file
+    \brief Integration over the systemic factor of one-factor latent models
+*/
+
+#ifndef qla_factorintegration_hpp
+#define qla_factorintegration_hpp
+
+#include <ql/experimental/credit/defaultprobabilitylatentmodel.hpp>
+
+#include <qlo/parallel.hpp>
+
+#include <vector>
+
+namespace QuantLibAddin {
+
+    //! midpoint rule on the systemic factor of a one-factor latent model
+    /*! The weights are those of the factor density at the nodes,
+        normalized over the truncated factor range.
+    */
+    struct FactorQuadrature {
+        std::vector<QuantLib::Real> nodes, weights;
+    };
+
+    template <class CP>
+    FactorQuadrature factorQuadrature(const QuantLib::LatentModel<CP>& model,
+                                      QuantLib::Real min,
+                                      QuantLib::Real max,
+                                      QuantLib::Size nSteps) {
+        QL_REQUIRE(model.numFactors() == 1,
+                   "one-factor latent model required");
+        QL_REQUIRE(nSteps > 0, "null number of nodes");
+        QL_REQUIRE(max > min, "empty factor range");
+        FactorQuadrature quadrature;
+        quadrature.nodes.resize(nSteps);
+        quadrature.weights.resize(nSteps);
+        QuantLib::Real delta = (max - min)/nSteps, total = 0.0;
+        std::vector<QuantLib::Real> factor(1);
+        for (QuantLib::Size k=0; k<nSteps; ++k) {
+            factor[0] = quadrature.nodes[k] = min + (k + 0.5)*delta;
+            total += quadrature.weights[k] = delta*model.density(factor);
+        }
+        QL_REQUIRE(total > 0.0, "null factor density over the nodes");
+        for (QuantLib::Size k=0; k<nSteps; ++k)
+            quadrature.weights[k] /= total;
+        return quadrature;
+    }
+
+    namespace detail {
+
+        template <class F>
+        class FactorNodeValues {
+          public:
+            FactorNodeValues(const F& f,
+                             const std::vector<QuantLib::Real>& nodes,
+                             QuantLib::Size groups,
+                             std::vector<QuantLib::Real>& values)
+            : f_(f), nodes_(nodes), groups_(groups), values_(values) {}
+            void operator()(QuantLib::Size g) {
+                for (QuantLib::Size k=g; k<nodes_.size(); k+=groups_)
+                    values_[k] = f_(nodes_[k]);
+            }
+          private:
+            const F& f_;
+            const std::vector<QuantLib::Real>& nodes_;
+            QuantLib::Size groups_;
+            std::vector<QuantLib::Real>& values_;
+        };
+
+        template <class CP>
+        class NodeConditionalProbabilities {
+          public:
+            NodeConditionalProbabilities(
+                    const QuantLib::DefaultLatentModel<CP>& model,
+                    const std::vector<QuantLib::Real>& invProbabilities,
+                    const std::vector<QuantLib::Real>& nodes,
+                    QuantLib::Size groups,
+                    std::vector<std::vector<QuantLib::Real> >& probabilities)
+            : model_(model), invProbabilities_(invProbabilities),
+              nodes_(nodes), groups_(groups), probabilities_(probabilities) {}
+            void operator()(QuantLib::Size g) {
+                std::vector<QuantLib::Real> factor(1);
+                for (QuantLib::Size k=g; k<nodes_.size(); k+=groups_) {
+                    factor[0] = nodes_[k];
+                    std::vector<QuantLib::Real>& p = probabilities_[k];
+                    p.resize(invProbabilities_.size());
+                    for (QuantLib::Size i=0; i<p.size(); ++i)
+                        p[i] = model_.conditionalDefaultProbabilityInvP(
+                                           invProbabilities_[i], i, factor);
+                }
+            }
+          private:
+            const QuantLib::DefaultLatentModel<CP>& model_;
+            const std::vector<QuantLib::Real>& invProbabilities_;
+            const std::vector<QuantLib::Real>& nodes_;
+            QuantLib::Size groups_;
+            std::vector<std::vector<QuantLib::Real> >& probabilities_;
+        };
+
+    }
+
+    //! integral of a function of the factor, evaluated over threads
+    /*! The function is called as f(factor) concurrently for groups of
+        interleaved nodes; it must not modify any shared object.  The
+        values are summed in node order, so that the result does not
+        depend on the number of threads.
+    */
+    template <class F>
+    QuantLib::Real integrateFactor(const FactorQuadrature& quadrature,
+                                   QuantLib::Size threads,
+                                   const F& f) {
+        QuantLib::Size n = quadrature.nodes.size();
+        std::vector<QuantLib::Real> values(n);
+        QuantLib::Size groups = workerThreads(threads, n);
+        detail::FactorNodeValues<F> task(f, quadrature.nodes, groups, values);
+        parallelFor(groups, groups, task);
+        QuantLib::Real sum = 0.0;
+        for (QuantLib::Size k=0; k<n; ++k)
+            sum += quadrature.weights[k]*values[k];
+        return sum;
+    }
+
+    //! default probabilities of the names conditional on each node
+    /*! The inverse cumulative latent variables of the unconditional
+        probabilities are given by name; the results are stored by node
+        and name.
+    */
+    template <class CP>
+    void conditionalDefaultProbabilities(
+                const QuantLib::DefaultLatentModel<CP>& model,
+                const std::vector<QuantLib::Real>& invProbabilities,
+                const FactorQuadrature& quadrature,
+                QuantLib::Size threads,
+                std::vector<std::vector<QuantLib::Real> >& probabilities) {
+        QuantLib::Size n = quadrature.nodes.size();
+        probabilities.resize(n);
+        QuantLib::Size groups = workerThreads(threads, n);
+        detail::NodeConditionalProbabilities<CP> task(
+            model, invProbabilities, quadrature.nodes, groups, probabilities);
+        parallelFor(groups, groups, task);
+    }
+
+}
+
+#endif
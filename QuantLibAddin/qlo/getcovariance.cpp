@@ -21,6 +21,7 @@
     #include <qlo/config.hpp>
 #endif
 #include <qlo/getcovariance.hpp>
+#include <qlo/decompositioncache.hpp>
 
 namespace QuantLibAddin {
 
@@ -31,9 +32,8 @@ namespace QuantLibAddin {
         bool permanent)
     : ObjectHandler::LibraryObject<QuantLib::CovarianceDecomposition>(properties, permanent)
     {
-        libraryObject_ =
-            boost::shared_ptr<QuantLib::CovarianceDecomposition>(new
-                QuantLib::CovarianceDecomposition(cov, tol));
+        // shared with any other object built on the same inputs
+        libraryObject_ = cachedCovarianceDecomposition(cov, tol);
     }
 
 }
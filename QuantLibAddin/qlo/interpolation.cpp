@@ -21,6 +21,7 @@
     #include <qlo/config.hpp>
 #endif
 #include <qlo/interpolation.hpp>
+#include <qlo/calibrationdiagnostics.hpp>
 #include <qlo/enumerations/factories/interpolationsfactory.hpp>
 
 #include <ql/math/interpolations/linearinterpolation.hpp>
@@ -204,12 +205,14 @@ namespace QuantLibAddin {
             bool permanent)
     : Interpolation(properties, x, yh, permanent)
     {
+        CalibrationDiagnostics::instance().clear(properties->objectId());
         libraryObject_ = shared_ptr<QuantLib::Extrapolator>(new
             QuantLib::AbcdInterpolation(x_.begin(), x_.end(), y_.begin(),
                                         a, b, c, d,
                                         aIsFixed, bIsFixed, cIsFixed, dIsFixed,
                                         vegaWeighted,
-                                        ec, om));
+                                        ec, recordingMethod(
+                                            properties->objectId(), om)));
         qlInterpolation_ = dynamic_pointer_cast<QuantLib::Interpolation>(
             libraryObject_);
         qlAbcdInterpolation_ = dynamic_pointer_cast<QuantLib::AbcdInterpolation>(
@@ -236,13 +239,15 @@ namespace QuantLibAddin {
                                     bool permanent)
     : Interpolation(p, x, yh, permanent), forwardh_(forwardh), forward_(0.01)
     {
+        CalibrationDiagnostics::instance().clear(p->objectId());
         libraryObject_ = shared_ptr<QuantLib::Extrapolator>(new
             QuantLib::SABRInterpolation(x_.begin(), x_.end(), y_.begin(),
                                         t, forward_, alpha, beta, nu, rho,
                                         isAlphaFixed, isBetaFixed,
                                         isNuFixed, isRhoFixed,
                                         vegaWeighted,
-                                        ec, om));
+                                        ec, recordingMethod(
+                                            p->objectId(), om)));
         qlInterpolation_ = dynamic_pointer_cast<QuantLib::Interpolation>(
             libraryObject_);
         qlSABRInterpolation_ = dynamic_pointer_cast<QuantLib::SABRInterpolation>(
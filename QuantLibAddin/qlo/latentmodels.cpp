@@ -19,23 +19,169 @@
 
 #include <boost/make_shared.hpp>
 #include <qlo/latentmodels.hpp>
+#include <qlo/factorintegration.hpp>
 
 #include <ql/experimental/credit/defaultprobabilitylatentmodel.hpp>
+#include <ql/experimental/credit/basket.hpp>
+
+#include <cmath>
 
 namespace QuantLibAddin {
 
+    namespace {
+
+        // factor range of the inhomogeneous pool loss models
+        const QuantLib::Real factorMax = 5.0, factorMin = -5.0;
+
+        // probability that both names default, conditional on the factor
+        template <class CP>
+        class ConditionalJointDefault {
+          public:
+            ConditionalJointDefault(
+                        const QuantLib::DefaultLatentModel<CP>& model,
+                        QuantLib::Real iInvProbability, QuantLib::Size iName,
+                        QuantLib::Real jInvProbability, QuantLib::Size jName)
+            : model_(model), iInvProbability_(iInvProbability),
+              jInvProbability_(jInvProbability), iName_(iName),
+              jName_(jName) {}
+            QuantLib::Real operator()(QuantLib::Real factor) const {
+                std::vector<QuantLib::Real> m(1, factor);
+                return model_.conditionalDefaultProbabilityInvP(
+                                            iInvProbability_, iName_, m)
+                     * model_.conditionalDefaultProbabilityInvP(
+                                            jInvProbability_, jName_, m);
+            }
+          private:
+            const QuantLib::DefaultLatentModel<CP>& model_;
+            QuantLib::Real iInvProbability_, jInvProbability_;
+            QuantLib::Size iName_, jName_;
+        };
+
+        /* probability of at least n defaults conditional on the factor,
+           with the probabilities of k < n defaults among the first names
+           updated name by name; unlike the enumeration of the default
+           events in QuantLib, the cost is linear in the number of names */
+        template <class CP>
+        class ConditionalProbAtLeastNEvents {
+          public:
+            ConditionalProbAtLeastNEvents(
+                    const QuantLib::DefaultLatentModel<CP>& model,
+                    const std::vector<QuantLib::Real>& invProbabilities,
+                    QuantLib::Size n)
+            : model_(model), invProbabilities_(invProbabilities), n_(n) {}
+            QuantLib::Real operator()(QuantLib::Real factor) const {
+                std::vector<QuantLib::Real> m(1, factor);
+                std::vector<QuantLib::Real> p(n_ + 1, 0.0);
+                p[0] = 1.0;
+                for (QuantLib::Size i=0; i<invProbabilities_.size(); ++i) {
+                    QuantLib::Real q =
+                        model_.conditionalDefaultProbabilityInvP(
+                                                invProbabilities_[i], i, m);
+                    p[n_] += p[n_-1]*q;
+                    for (QuantLib::Size k=n_-1; k>0; --k)
+                        p[k] = p[k]*(1.0 - q) + p[k-1]*q;
+                    p[0] *= 1.0 - q;
+                }
+                return p[n_];
+            }
+          private:
+            const QuantLib::DefaultLatentModel<CP>& model_;
+            const std::vector<QuantLib::Real>& invProbabilities_;
+            QuantLib::Size n_;
+        };
+
+        // as QuantLib::DefaultLatentModel::defaultCorrelation
+        template <class CP>
+        QuantLib::Real integratedDefaultCorrelation(
+                            const QuantLib::DefaultLatentModel<CP>& model,
+                            const QuantLib::Basket& basket,
+                            const FactorQuadrature& quadrature,
+                            QuantLib::Size threads,
+                            const QuantLib::Date& d,
+                            QuantLib::Size iName,
+                            QuantLib::Size jName) {
+            const boost::shared_ptr<QuantLib::Pool>& pool = basket.pool();
+            const std::vector<std::string>& names = basket.names();
+            std::vector<QuantLib::DefaultProbKey> keys = basket.defaultKeys();
+            QL_REQUIRE(iName < names.size() && jName < names.size(),
+                       "name index out of range");
+            QuantLib::Probability pi = pool->get(names[iName])
+                .defaultProbability(keys[iName])->defaultProbability(d);
+            QuantLib::Probability pj = pool->get(names[jName])
+                .defaultProbability(keys[jName])->defaultProbability(d);
+            QuantLib::Real joint = pi;
+            if (iName != jName) {
+                ConditionalJointDefault<CP> integrand(
+                    model, model.inverseCumulativeY(pi, iName), iName,
+                    model.inverseCumulativeY(pj, jName), jName);
+                joint = integrateFactor(quadrature, threads, integrand);
+            }
+            return (joint - pi*pj)/std::sqrt(pi*pj*(1.0-pi)*(1.0-pj));
+        }
+
+        // as QuantLib::DefaultLatentModel::probAtLeastNEvents
+        template <class CP>
+        QuantLib::Probability integratedProbAtLeastNEvents(
+                            const QuantLib::DefaultLatentModel<CP>& model,
+                            const QuantLib::Basket& basket,
+                            const FactorQuadrature& quadrature,
+                            QuantLib::Size threads,
+                            QuantLib::Size n,
+                            const QuantLib::Date& d) {
+            std::vector<QuantLib::Probability> probabilities =
+                basket.remainingProbabilities(d);
+            if (n == 0)
+                return 1.0;
+            if (n > probabilities.size())
+                return 0.0;
+            std::vector<QuantLib::Real> invProbabilities(probabilities.size());
+            for (QuantLib::Size i=0; i<invProbabilities.size(); ++i)
+                invProbabilities[i] =
+                    model.inverseCumulativeY(probabilities[i], i);
+            ConditionalProbAtLeastNEvents<CP> integrand(
+                                            model, invProbabilities, n);
+            return integrateFactor(quadrature, threads, integrand);
+        }
+
+    }
+
     GaussianDefProbLM::GaussianDefProbLM(
         const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
         const boost::shared_ptr<QuantLib::Basket>& basket,
         const std::vector<std::vector<QuantLib::Real> >& factorWeights,
+        QuantLib::Size nodes,
+        QuantLib::Size threads,
         bool permanent)
     : ObjectHandler::LibraryObject<QuantLib::GaussianDefProbLM>(properties, 
-      permanent) {
+      permanent), basket_(basket), threads_(threads) {
         libraryObject_ = boost::make_shared<QuantLib::GaussianDefProbLM>(
             //basket,
             factorWeights,
             QuantLib::LatentModelIntegrationType::GaussianQuadrature);
         libraryObject_->resetBasket(basket);
+        if (nodes > 0)
+            quadrature_ = boost::make_shared<FactorQuadrature>(
+                factorQuadrature(*libraryObject_, factorMin, factorMax, nodes));
+    }
+
+    QuantLib::Real GaussianDefProbLM::defaultCorrelation(
+                                        const QuantLib::Date& d,
+                                        QuantLib::Size iName,
+                                        QuantLib::Size jName) const {
+        if (!quadrature_)
+            return libraryObject_->defaultCorrelation(d, iName, jName);
+        return integratedDefaultCorrelation(*libraryObject_, *basket_,
+                                            *quadrature_, threads_,
+                                            d, iName, jName);
+    }
+
+    QuantLib::Probability GaussianDefProbLM::probAtLeastNEvents(
+                                        QuantLib::Size n,
+                                        const QuantLib::Date& d) const {
+        if (!quadrature_)
+            return libraryObject_->probAtLeastNEvents(n, d);
+        return integratedProbAtLeastNEvents(*libraryObject_, *basket_,
+                                            *quadrature_, threads_, n, d);
     }
 
     TDefProbLM::TDefProbLM(
@@ -43,9 +189,11 @@ namespace QuantLibAddin {
         const std::vector<QuantLib::Integer>& tOrders,
         const boost::shared_ptr<QuantLib::Basket>& basket,
         const std::vector<std::vector<QuantLib::Real> >& factorWeights,
+        QuantLib::Size nodes,
+        QuantLib::Size threads,
         bool permanent)
     : ObjectHandler::LibraryObject<QuantLib::TDefProbLM>(properties, 
-      permanent) {
+      permanent), basket_(basket), threads_(threads) {
         QuantLib::TCopulaPolicy::initTraits initsT;
         initsT.tOrders = tOrders;
         libraryObject_ = boost::make_shared<QuantLib::TDefProbLM>(
@@ -54,6 +202,29 @@ namespace QuantLibAddin {
             QuantLib::LatentModelIntegrationType::GaussianQuadrature,
             initsT);
         libraryObject_->resetBasket(basket);
+        if (nodes > 0)
+            quadrature_ = boost::make_shared<FactorQuadrature>(
+                factorQuadrature(*libraryObject_, factorMin, factorMax, nodes));
+    }
+
+    QuantLib::Real TDefProbLM::defaultCorrelation(
+                                        const QuantLib::Date& d,
+                                        QuantLib::Size iName,
+                                        QuantLib::Size jName) const {
+        if (!quadrature_)
+            return libraryObject_->defaultCorrelation(d, iName, jName);
+        return integratedDefaultCorrelation(*libraryObject_, *basket_,
+                                            *quadrature_, threads_,
+                                            d, iName, jName);
+    }
+
+    QuantLib::Probability TDefProbLM::probAtLeastNEvents(
+                                        QuantLib::Size n,
+                                        const QuantLib::Date& d) const {
+        if (!quadrature_)
+            return libraryObject_->probAtLeastNEvents(n, d);
+        return integratedProbAtLeastNEvents(*libraryObject_, *basket_,
+                                            *quadrature_, threads_, n, d);
     }
 
 }
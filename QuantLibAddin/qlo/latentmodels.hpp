@@ -33,10 +33,13 @@ namespace QuantLib {
     typedef DefaultLatentModel<TCopulaPolicy> TDefProbLM;
 
     class Basket;
+    class Date;
 }
 
 namespace QuantLibAddin {
 
+    struct FactorQuadrature;
+
     /* \todo: This needs to be turn into a factory with a common ancestor and
     all the available options (integration policy etc)
     */
@@ -47,7 +50,28 @@ namespace QuantLibAddin {
             const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
             const boost::shared_ptr<QuantLib::Basket>& basket,
             const std::vector<std::vector<QuantLib::Real> >& factorWeights,
+            //! 0 for the QuantLib quadrature
+            QuantLib::Size nodes,
+            QuantLib::Size threads,
             bool permanent);
+        //! \name Integration over the systemic factor
+        /*! With a number of nodes, the single factor is integrated with
+            a midpoint rule over a group of threads, and the defaults
+            conditional on each node are counted by recursion on the
+            names; otherwise, the QuantLib quadrature is used.
+        */
+        //@{
+        QuantLib::Real defaultCorrelation(const QuantLib::Date& d,
+                                          QuantLib::Size iName,
+                                          QuantLib::Size jName) const;
+        QuantLib::Probability probAtLeastNEvents(
+                                        QuantLib::Size n,
+                                        const QuantLib::Date& d) const;
+        //@}
+    private:
+        boost::shared_ptr<QuantLib::Basket> basket_;
+        boost::shared_ptr<FactorQuadrature> quadrature_;
+        QuantLib::Size threads_;
     };
 
     class TDefProbLM  : 
@@ -58,7 +82,24 @@ namespace QuantLibAddin {
             const std::vector<QuantLib::Integer>& tOrders,
             const boost::shared_ptr<QuantLib::Basket>& basket,
             const std::vector<std::vector<QuantLib::Real> >& factorWeights,
+            //! 0 for the QuantLib quadrature
+            QuantLib::Size nodes,
+            QuantLib::Size threads,
             bool permanent);
+        //! \name Integration over the systemic factor
+        /*! As for GaussianDefProbLM. */
+        //@{
+        QuantLib::Real defaultCorrelation(const QuantLib::Date& d,
+                                          QuantLib::Size iName,
+                                          QuantLib::Size jName) const;
+        QuantLib::Probability probAtLeastNEvents(
+                                        QuantLib::Size n,
+                                        const QuantLib::Date& d) const;
+        //@}
+    private:
+        boost::shared_ptr<QuantLib::Basket> basket_;
+        boost::shared_ptr<FactorQuadrature> quadrature_;
+        QuantLib::Size threads_;
     };
 
 }
@@ -28,10 +28,287 @@
 #include <ql/models/marketmodels/evolvers/lognormalfwdratepc.hpp>
 #include <ql/models/marketmodels/evolvers/lognormalfwdrateipc.hpp>
 #include <ql/models/marketmodels/evolvers/normalfwdratepc.hpp>
+#include <ql/models/marketmodels/marketmodel.hpp>
+#include <ql/models/marketmodels/evolutiondescription.hpp>
+#include <ql/models/marketmodels/browniangenerator.hpp>
 
+#include <algorithm>
+#include <cmath>
 
 namespace QuantLibAddin {
- 
+
+    PackedFwdRatePc::PackedFwdRatePc(
+                const boost::shared_ptr<QuantLib::MarketModel>& marketModel,
+                const QuantLib::BrownianGeneratorFactory& factory,
+                const std::vector<QuantLib::Size>& numeraires,
+                bool normal,
+                QuantLib::Size initialStep)
+    : marketModel_(marketModel), numeraires_(numeraires),
+      initialStep_(initialStep), normal_(normal),
+      numberOfRates_(marketModel->numberOfRates()),
+      numberOfFactors_(marketModel->numberOfFactors()),
+      curveState_(marketModel->evolution().rateTimes()),
+      forwards_(marketModel->initialRates()),
+      displacements_(marketModel->displacements()),
+      states_(numberOfRates_), initialStates_(numberOfRates_),
+      drifts1_(numberOfRates_), drifts2_(numberOfRates_),
+      initialDrifts_(numberOfRates_), brownians_(numberOfFactors_),
+      alive_(marketModel->evolution().firstAliveRate()) {
+
+        QuantLib::checkCompatibility(marketModel->evolution(), numeraires);
+        QL_REQUIRE(QuantLib::isInTerminalMeasure(marketModel->evolution(),
+                                                 numeraires) ||
+                   QuantLib::isInMoneyMarketPlusMeasure(
+                                         marketModel->evolution(), numeraires),
+                   "terminal or money-market-plus measure required for pc ");
+
+        QuantLib::Size steps = marketModel->evolution().numberOfSteps();
+        generator_ = factory.create(numberOfFactors_, steps-initialStep_);
+        currentStep_ = initialStep_;
+
+        calculators_.reserve(steps);
+        pseudoRoots_.resize(steps);
+        fixedDrifts_.resize(steps);
+        for (QuantLib::Size j=0; j<steps; ++j) {
+            const QuantLib::Matrix& A = marketModel_->pseudoRoot(j);
+            calculators_.push_back(
+                PackedLMMDriftCalculator(A, displacements_,
+                                         marketModel->evolution().rateTaus(),
+                                         numeraires[j], alive_[j], normal_));
+            pseudoRoots_[j].assign(A.row_begin(alive_[j]), A.end());
+            if (!normal_) {
+                const QuantLib::Matrix& C = marketModel_->covariance(j);
+                fixedDrifts_[j].resize(numberOfRates_);
+                for (QuantLib::Size k=0; k<numberOfRates_; ++k)
+                    fixedDrifts_[j][k] = -0.5*C[k][k];
+            }
+        }
+
+        setForwards(marketModel_->initialRates());
+    }
+
+    const std::vector<QuantLib::Size>& PackedFwdRatePc::numeraires() const {
+        return numeraires_;
+    }
+
+    void PackedFwdRatePc::setForwards(
+                            const std::vector<QuantLib::Real>& forwards) {
+        QL_REQUIRE(forwards.size()==numberOfRates_,
+                   "mismatch between forwards and rateTimes");
+        if (normal_) {
+            std::copy(forwards.begin(), forwards.end(),
+                      initialStates_.begin());
+        } else {
+            for (QuantLib::Size i=0; i<numberOfRates_; ++i)
+                initialStates_[i] = std::log(forwards[i] + displacements_[i]);
+        }
+        curveState_.setOnForwardRates(forwards);
+        calculators_[initialStep_].compute(&forwards[0], &initialDrifts_[0]);
+    }
+
+    void PackedFwdRatePc::setInitialState(const QuantLib::CurveState& cs) {
+        setForwards(cs.forwardRates());
+    }
+
+    QuantLib::Real PackedFwdRatePc::startNewPath() {
+        currentStep_ = initialStep_;
+        std::copy(initialStates_.begin(), initialStates_.end(),
+                  states_.begin());
+        if (normal_)
+            std::copy(initialStates_.begin(), initialStates_.end(),
+                      forwards_.begin());
+        return generator_->nextPath();
+    }
+
+    void PackedFwdRatePc::setRates(QuantLib::Size alive) {
+        if (normal_) {
+            std::copy(states_.begin()+alive, states_.end(),
+                      forwards_.begin()+alive);
+        } else {
+            for (QuantLib::Size i=alive; i<numberOfRates_; ++i)
+                forwards_[i] = std::exp(states_[i]) - displacements_[i];
+        }
+    }
+
+    QuantLib::Real PackedFwdRatePc::advanceStep() {
+        // we're going from T1 to T2
+
+        // a) compute drifts D1 at T1;
+        if (currentStep_ > initialStep_)
+            calculators_[currentStep_].compute(&forwards_[0], &drifts1_[0]);
+        else
+            std::copy(initialDrifts_.begin(), initialDrifts_.end(),
+                      drifts1_.begin());
+
+        // b) evolve forwards up to T2 using D1;
+        QuantLib::Real weight = generator_->nextStep(brownians_);
+        QuantLib::Size alive = alive_[currentStep_];
+        const QuantLib::Real* a = &pseudoRoots_[currentStep_][0];
+        const QuantLib::Real* z = &brownians_[0];
+        QuantLib::Real* x = &states_[0];
+        for (QuantLib::Size i=alive; i<numberOfRates_;
+                                     ++i, a += numberOfFactors_) {
+            if (normal_) {
+                x[i] += drifts1_[i];
+            } else {
+                x[i] += drifts1_[i] + fixedDrifts_[currentStep_][i];
+            }
+            QuantLib::Real diffusion = 0.0;
+            for (QuantLib::Size r=0; r<numberOfFactors_; ++r)
+                diffusion += a[r]*z[r];
+            x[i] += diffusion;
+        }
+        setRates(alive);
+
+        // c) recompute drifts D2 using the predicted forwards, without
+        //    setting them in the curve state;
+        calculators_[currentStep_].compute(&forwards_[0], &drifts2_[0]);
+
+        // d) correct forwards using both drifts
+        for (QuantLib::Size i=alive; i<numberOfRates_; ++i)
+            x[i] += (drifts2_[i]-drifts1_[i])/2.0;
+        setRates(alive);
+
+        // e) update curve state
+        curveState_.setOnForwardRates(forwards_);
+
+        ++currentStep_;
+
+        return weight;
+    }
+
+    QuantLib::Size PackedFwdRatePc::currentStep() const {
+        return currentStep_;
+    }
+
+    const QuantLib::CurveState& PackedFwdRatePc::currentState() const {
+        return curveState_;
+    }
+
+    PackedFwdRateIpc::PackedFwdRateIpc(
+                const boost::shared_ptr<QuantLib::MarketModel>& marketModel,
+                const QuantLib::BrownianGeneratorFactory& factory,
+                const std::vector<QuantLib::Size>& numeraires,
+                QuantLib::Size initialStep)
+    : marketModel_(marketModel), numeraires_(numeraires),
+      initialStep_(initialStep),
+      numberOfRates_(marketModel->numberOfRates()),
+      numberOfFactors_(marketModel->numberOfFactors()),
+      curveState_(marketModel->evolution().rateTimes()),
+      forwards_(marketModel->initialRates()),
+      displacements_(marketModel->displacements()),
+      rateTaus_(marketModel->evolution().rateTaus()),
+      logForwards_(numberOfRates_), initialLogForwards_(numberOfRates_),
+      drifts1_(numberOfRates_), initialDrifts_(numberOfRates_),
+      g_(numberOfRates_), brownians_(numberOfFactors_),
+      alive_(marketModel->evolution().firstAliveRate()) {
+
+        QuantLib::checkCompatibility(marketModel->evolution(), numeraires);
+        QL_REQUIRE(QuantLib::isInTerminalMeasure(marketModel->evolution(),
+                                                 numeraires),
+                   "terminal measure required for ipc ");
+
+        QuantLib::Size steps = marketModel->evolution().numberOfSteps();
+        generator_ = factory.create(numberOfFactors_, steps-initialStep_);
+        currentStep_ = initialStep_;
+
+        calculators_.reserve(steps);
+        pseudoRoots_.resize(steps);
+        covariances_.resize(steps);
+        fixedDrifts_.resize(steps);
+        for (QuantLib::Size j=0; j<steps; ++j) {
+            const QuantLib::Matrix& A = marketModel_->pseudoRoot(j);
+            calculators_.push_back(
+                PackedLMMDriftCalculator(A, displacements_, rateTaus_,
+                                         numeraires[j], alive_[j]));
+            pseudoRoots_[j].assign(A.row_begin(alive_[j]), A.end());
+            const QuantLib::Matrix& C = marketModel_->covariance(j);
+            covariances_[j].assign(C.row_begin(alive_[j]), C.end());
+            fixedDrifts_[j].resize(numberOfRates_);
+            for (QuantLib::Size k=0; k<numberOfRates_; ++k)
+                fixedDrifts_[j][k] = -0.5*C[k][k];
+        }
+
+        setForwards(marketModel_->initialRates());
+    }
+
+    const std::vector<QuantLib::Size>& PackedFwdRateIpc::numeraires() const {
+        return numeraires_;
+    }
+
+    void PackedFwdRateIpc::setForwards(
+                            const std::vector<QuantLib::Real>& forwards) {
+        QL_REQUIRE(forwards.size()==numberOfRates_,
+                   "mismatch between forwards and rateTimes");
+        for (QuantLib::Size i=0; i<numberOfRates_; ++i)
+            initialLogForwards_[i] = std::log(forwards[i] + displacements_[i]);
+        curveState_.setOnForwardRates(forwards);
+        calculators_[initialStep_].compute(&forwards[0], &initialDrifts_[0]);
+    }
+
+    void PackedFwdRateIpc::setInitialState(const QuantLib::CurveState& cs) {
+        setForwards(cs.forwardRates());
+    }
+
+    QuantLib::Real PackedFwdRateIpc::startNewPath() {
+        currentStep_ = initialStep_;
+        std::copy(initialLogForwards_.begin(), initialLogForwards_.end(),
+                  logForwards_.begin());
+        return generator_->nextPath();
+    }
+
+    QuantLib::Real PackedFwdRateIpc::advanceStep() {
+        // we're going from T1 to T2
+
+        // a) compute drifts D1 at T1;
+        if (currentStep_ > initialStep_)
+            calculators_[currentStep_].compute(&forwards_[0], &drifts1_[0]);
+        else
+            std::copy(initialDrifts_.begin(), initialDrifts_.end(),
+                      drifts1_.begin());
+
+        // b) evolve forwards up to T2 from the last one backwards,
+        //    correcting each drift with the rates already evolved
+        QuantLib::Real weight = generator_->nextStep(brownians_);
+        QuantLib::Size alive = alive_[currentStep_];
+        const QuantLib::Real* fixedDrift = &fixedDrifts_[currentStep_][0];
+        const QuantLib::Real* z = &brownians_[0];
+        const QuantLib::Real* g = &g_[0];
+        QuantLib::Real* x = &logForwards_[0];
+        for (QuantLib::Size i=numberOfRates_; i-- > alive; ) {
+            const QuantLib::Real* a = &pseudoRoots_[currentStep_][0] +
+                                      (i-alive)*numberOfFactors_;
+            const QuantLib::Real* c = &covariances_[currentStep_][0] +
+                                      (i-alive)*numberOfRates_;
+            QuantLib::Real drift2 = 0.0;
+            for (QuantLib::Size j=i+1; j<numberOfRates_; ++j)
+                drift2 -= g[j]*c[j];
+            x[i] += 0.5*(drifts1_[i]+drift2) + fixedDrift[i];
+            QuantLib::Real diffusion = 0.0;
+            for (QuantLib::Size r=0; r<numberOfFactors_; ++r)
+                diffusion += a[r]*z[r];
+            x[i] += diffusion;
+            forwards_[i] = std::exp(x[i]) - displacements_[i];
+            g_[i] = rateTaus_[i]*(forwards_[i]+displacements_[i]) /
+                (1.0+rateTaus_[i]*forwards_[i]);
+        }
+
+        // c) update curve state
+        curveState_.setOnForwardRates(forwards_);
+
+        ++currentStep_;
+
+        return weight;
+    }
+
+    QuantLib::Size PackedFwdRateIpc::currentStep() const {
+        return currentStep_;
+    }
+
+    const QuantLib::CurveState& PackedFwdRateIpc::currentState() const {
+        return curveState_;
+    }
+
     LogNormalFwdRatePc::LogNormalFwdRatePc(
         const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
         const boost::shared_ptr<QuantLib::MarketModel>& pseudoRoot,
@@ -71,5 +348,38 @@ namespace QuantLibAddin {
                                                 numeraires));
     }
 
-}
+    LogNormalFwdRatePcPacked::LogNormalFwdRatePcPacked(
+        const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
+        const boost::shared_ptr<QuantLib::MarketModel>& pseudoRoot,
+        const QuantLib::BrownianGeneratorFactory& generatorFactory,
+        const std::vector<QuantLib::Size>& numeraires,
+        bool permanent) : MarketModelEvolver(properties, permanent)
+    {
+        libraryObject_ = boost::shared_ptr<QuantLib::MarketModelEvolver>(
+            new PackedFwdRatePc(pseudoRoot, generatorFactory, numeraires));
+    }
+
+    LogNormalFwdRateIpcPacked::LogNormalFwdRateIpcPacked(
+        const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
+        const boost::shared_ptr<QuantLib::MarketModel>& pseudoRoot,
+        const QuantLib::BrownianGeneratorFactory& generatorFactory,
+        const std::vector<QuantLib::Size>& numeraires,
+        bool permanent) : MarketModelEvolver(properties, permanent)
+    {
+        libraryObject_ = boost::shared_ptr<QuantLib::MarketModelEvolver>(
+            new PackedFwdRateIpc(pseudoRoot, generatorFactory, numeraires));
+    }
 
+    NormalFwdRatePcPacked::NormalFwdRatePcPacked(
+        const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
+        const boost::shared_ptr<QuantLib::MarketModel>& pseudoRoot,
+        const QuantLib::BrownianGeneratorFactory& generatorFactory,
+        const std::vector<QuantLib::Size>& numeraires,
+        bool permanent) : MarketModelEvolver(properties, permanent)
+    {
+        libraryObject_ = boost::shared_ptr<QuantLib::MarketModelEvolver>(
+            new PackedFwdRatePc(pseudoRoot, generatorFactory, numeraires,
+                                true));
+    }
+
+}
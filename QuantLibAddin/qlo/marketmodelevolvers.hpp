@@ -25,17 +25,120 @@
 #define qla_marketmodelevolvers_hpp
 
 #include <oh/libraryobject.hpp>
+#include <qlo/driftcalculators.hpp>
 
 #include <ql/types.hpp>
+#include <ql/models/marketmodels/evolver.hpp>
+#include <ql/models/marketmodels/curvestates/lmmcurvestate.hpp>
+
+#include <vector>
 
 namespace QuantLib {
-    class MarketModelEvolver;
+    class BrownianGenerator;
     class BrownianGeneratorFactory;
     class MarketModel;
 }
 
 namespace QuantLibAddin {
-    
+
+    //! Predictor-corrector forward-rate evolver on packed arrays
+    /*! Same scheme, drifts and results as QuantLib::LogNormalFwdRatePc
+        or, if normal is true, QuantLib::NormalFwdRatePc, given the same
+        Brownian draws.  Drifts are computed by PackedLMMDriftCalculator
+        directly on the forward rates, so that the curve state is only
+        updated once per step instead of twice; pseudo-roots are copied
+        to contiguous arrays holding the rows of the alive rates only.
+    */
+    class PackedFwdRatePc : public QuantLib::MarketModelEvolver {
+      public:
+        PackedFwdRatePc(const boost::shared_ptr<QuantLib::MarketModel>&,
+                        const QuantLib::BrownianGeneratorFactory&,
+                        const std::vector<QuantLib::Size>& numeraires,
+                        bool normal = false,
+                        QuantLib::Size initialStep = 0);
+        //! \name MarketModelEvolver interface
+        //@{
+        const std::vector<QuantLib::Size>& numeraires() const;
+        QuantLib::Real startNewPath();
+        QuantLib::Real advanceStep();
+        QuantLib::Size currentStep() const;
+        const QuantLib::CurveState& currentState() const;
+        void setInitialState(const QuantLib::CurveState&);
+        //@}
+      private:
+        void setForwards(const std::vector<QuantLib::Real>& forwards);
+        // updates forwards_ from the evolved state variables
+        void setRates(QuantLib::Size alive);
+        boost::shared_ptr<QuantLib::MarketModel> marketModel_;
+        std::vector<QuantLib::Size> numeraires_;
+        QuantLib::Size initialStep_;
+        bool normal_;
+        boost::shared_ptr<QuantLib::BrownianGenerator> generator_;
+        QuantLib::Size numberOfRates_, numberOfFactors_;
+        QuantLib::LMMCurveState curveState_;
+        QuantLib::Size currentStep_;
+        std::vector<QuantLib::Rate> forwards_;
+        std::vector<QuantLib::Spread> displacements_;
+        // log(f+d) for lognormal forwards, f for normal ones
+        std::vector<QuantLib::Real> states_, initialStates_;
+        std::vector<QuantLib::Real> drifts1_, drifts2_, initialDrifts_;
+        std::vector<QuantLib::Real> brownians_;
+        std::vector<QuantLib::Size> alive_;
+        std::vector<PackedLMMDriftCalculator> calculators_;
+        // per step: pseudo-root rows of the alive rates, and fixed drifts
+        std::vector<std::vector<QuantLib::Real> > pseudoRoots_, fixedDrifts_;
+    };
+
+    //! Iterative predictor-corrector evolver on packed arrays
+    /*! Same scheme as QuantLib::LogNormalFwdRateIpc: the rates are
+        evolved from the last one backwards, the corrected drift of
+        each rate being computed in the terminal measure from the rates
+        already evolved in the step.  Predictor drifts are computed by
+        PackedLMMDriftCalculator; pseudo-roots and covariances are
+        copied to contiguous arrays holding the rows of the alive rates
+        only.
+    */
+    class PackedFwdRateIpc : public QuantLib::MarketModelEvolver {
+      public:
+        PackedFwdRateIpc(const boost::shared_ptr<QuantLib::MarketModel>&,
+                         const QuantLib::BrownianGeneratorFactory&,
+                         const std::vector<QuantLib::Size>& numeraires,
+                         QuantLib::Size initialStep = 0);
+        //! \name MarketModelEvolver interface
+        //@{
+        const std::vector<QuantLib::Size>& numeraires() const;
+        QuantLib::Real startNewPath();
+        QuantLib::Real advanceStep();
+        QuantLib::Size currentStep() const;
+        const QuantLib::CurveState& currentState() const;
+        void setInitialState(const QuantLib::CurveState&);
+        //@}
+      private:
+        void setForwards(const std::vector<QuantLib::Real>& forwards);
+        boost::shared_ptr<QuantLib::MarketModel> marketModel_;
+        std::vector<QuantLib::Size> numeraires_;
+        QuantLib::Size initialStep_;
+        boost::shared_ptr<QuantLib::BrownianGenerator> generator_;
+        QuantLib::Size numberOfRates_, numberOfFactors_;
+        QuantLib::LMMCurveState curveState_;
+        QuantLib::Size currentStep_;
+        std::vector<QuantLib::Rate> forwards_;
+        std::vector<QuantLib::Spread> displacements_;
+        std::vector<QuantLib::Time> rateTaus_;
+        // log(f+d)
+        std::vector<QuantLib::Real> logForwards_, initialLogForwards_;
+        std::vector<QuantLib::Real> drifts1_, initialDrifts_;
+        // tau(f+d)/(1+tau f) of the rates evolved in the current step
+        std::vector<QuantLib::Real> g_;
+        std::vector<QuantLib::Real> brownians_;
+        std::vector<QuantLib::Size> alive_;
+        std::vector<PackedLMMDriftCalculator> calculators_;
+        // per step: pseudo-root and covariance rows of the alive rates,
+        // and fixed drifts
+        std::vector<std::vector<QuantLib::Real> > pseudoRoots_,
+                                                  covariances_, fixedDrifts_;
+    };
+
     OH_LIB_CLASS(MarketModelEvolver, QuantLib::MarketModelEvolver);
 
     class LogNormalFwdRatePc : public MarketModelEvolver {
@@ -64,6 +167,36 @@ namespace QuantLibAddin {
                     bool permanent);
     };
 
+    class LogNormalFwdRatePcPacked : public MarketModelEvolver {
+      public:
+        LogNormalFwdRatePcPacked(
+                    const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
+                    const boost::shared_ptr<QuantLib::MarketModel>&,
+                    const QuantLib::BrownianGeneratorFactory&,
+                    const std::vector<QuantLib::Size>& numeraires,
+                    bool permanent);
+    };
+
+    class LogNormalFwdRateIpcPacked : public MarketModelEvolver {
+      public:
+        LogNormalFwdRateIpcPacked(
+                    const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
+                    const boost::shared_ptr<QuantLib::MarketModel>&,
+                    const QuantLib::BrownianGeneratorFactory&,
+                    const std::vector<QuantLib::Size>& numeraires,
+                    bool permanent);
+    };
+
+    class NormalFwdRatePcPacked : public MarketModelEvolver {
+      public:
+        NormalFwdRatePcPacked(
+                    const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
+                    const boost::shared_ptr<QuantLib::MarketModel>&,
+                    const QuantLib::BrownianGeneratorFactory&,
+                    const std::vector<QuantLib::Size>& numeraires,
+                    bool permanent);
+    };
+
 }
 
 #endif
@@ -25,6 +25,7 @@
     #include <qlo/config.hpp>
 #endif
 #include <qlo/marketmodels.hpp>
+#include <qlo/decompositioncache.hpp>
 #include <ql/models/marketmodels/models/fwdperiodadapter.hpp>
 #include <ql/models/marketmodels/models/fwdtocotswapadapter.hpp>
 #include <ql/models/marketmodels/models/pseudorootfacade.hpp>
@@ -36,6 +37,95 @@
 
 namespace QuantLibAddin {
 
+    namespace {
+
+        /* The volatility models compute the pseudo-roots of all the
+           evolution steps on construction, which requires one
+           eigendecomposition per step.  Models are immutable, so that
+           the library object can be shared by all the objects built on
+           the same inputs. */
+        void addModelInputs(
+                DecompositionCache::Key& key,
+                const boost::shared_ptr<QuantLib::PiecewiseConstantCorrelation>& corr,
+                const QuantLib::EvolutionDescription& evolution,
+                QuantLib::Size numberOfFactors,
+                const std::vector<QuantLib::Rate>& initialRates,
+                const std::vector<QuantLib::Rate>& displacements) {
+            QL_REQUIRE(corr, "null correlation");
+            key << corr->times() << corr->rateTimes();
+            const std::vector<QuantLib::Matrix>& correlations =
+                                                        corr->correlations();
+            for (QuantLib::Size i=0; i<correlations.size(); ++i)
+                key << correlations[i];
+            key << evolution.rateTimes() << evolution.evolutionTimes();
+            const std::vector<std::pair<QuantLib::Size,QuantLib::Size> >&
+                relevanceRates = evolution.relevanceRates();
+            for (QuantLib::Size i=0; i<relevanceRates.size(); ++i)
+                key << boost::uint64_t(relevanceRates[i].first)
+                    << boost::uint64_t(relevanceRates[i].second);
+            key << boost::uint64_t(numberOfFactors)
+                << initialRates << displacements;
+        }
+
+        class FlatVolFactory {
+          public:
+            FlatVolFactory(
+                const std::vector<QuantLib::Volatility>& volatilities,
+                const boost::shared_ptr<QuantLib::PiecewiseConstantCorrelation>& corr,
+                const QuantLib::EvolutionDescription& evolution,
+                QuantLib::Size numberOfFactors,
+                const std::vector<QuantLib::Rate>& initialRates,
+                const std::vector<QuantLib::Rate>& displacements)
+            : volatilities_(volatilities), corr_(corr), evolution_(evolution),
+              numberOfFactors_(numberOfFactors), initialRates_(initialRates),
+              displacements_(displacements) {}
+            boost::shared_ptr<QuantLib::MarketModel> operator()() const {
+                return boost::shared_ptr<QuantLib::MarketModel>(new
+                    QuantLib::FlatVol(volatilities_, corr_, evolution_,
+                                      numberOfFactors_, initialRates_,
+                                      displacements_));
+            }
+          private:
+            const std::vector<QuantLib::Volatility>& volatilities_;
+            const boost::shared_ptr<QuantLib::PiecewiseConstantCorrelation>& corr_;
+            const QuantLib::EvolutionDescription& evolution_;
+            QuantLib::Size numberOfFactors_;
+            const std::vector<QuantLib::Rate>& initialRates_;
+            const std::vector<QuantLib::Rate>& displacements_;
+        };
+
+        class AbcdVolFactory {
+          public:
+            AbcdVolFactory(
+                QuantLib::Real a, QuantLib::Real b,
+                QuantLib::Real c, QuantLib::Real d,
+                const std::vector<QuantLib::Real>& ks,
+                const boost::shared_ptr<QuantLib::PiecewiseConstantCorrelation>& corr,
+                const QuantLib::EvolutionDescription& evolution,
+                QuantLib::Size numberOfFactors,
+                const std::vector<QuantLib::Rate>& initialRates,
+                const std::vector<QuantLib::Rate>& displacements)
+            : a_(a), b_(b), c_(c), d_(d), ks_(ks), corr_(corr),
+              evolution_(evolution), numberOfFactors_(numberOfFactors),
+              initialRates_(initialRates), displacements_(displacements) {}
+            boost::shared_ptr<QuantLib::MarketModel> operator()() const {
+                return boost::shared_ptr<QuantLib::MarketModel>(new
+                    QuantLib::AbcdVol(a_, b_, c_, d_, ks_, corr_, evolution_,
+                                      numberOfFactors_, initialRates_,
+                                      displacements_));
+            }
+          private:
+            QuantLib::Real a_, b_, c_, d_;
+            const std::vector<QuantLib::Real>& ks_;
+            const boost::shared_ptr<QuantLib::PiecewiseConstantCorrelation>& corr_;
+            const QuantLib::EvolutionDescription& evolution_;
+            QuantLib::Size numberOfFactors_;
+            const std::vector<QuantLib::Rate>& initialRates_;
+            const std::vector<QuantLib::Rate>& displacements_;
+        };
+
+    }
+
     FlatVol::FlatVol(
             const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
             const std::vector<QuantLib::Volatility>& volatilities,
@@ -45,13 +135,15 @@ namespace QuantLibAddin {
             const std::vector<QuantLib::Rate>& initialRates,
             const std::vector<QuantLib::Rate>& displacements,
             bool permanent) : MarketModel(properties, permanent) {
-        libraryObject_ = boost::shared_ptr<QuantLib::MarketModel>(new
-            QuantLib::FlatVol(volatilities,
-                                     corr,
-                                     evolution,
-                                     numberOfFactors,
-                                     initialRates,
-                                     displacements));
+        DecompositionCache::Key key("FlatVol");
+        key << volatilities;
+        addModelInputs(key, corr, evolution, numberOfFactors,
+                       initialRates, displacements);
+        libraryObject_ =
+            DecompositionCache::instance().retrieve<QuantLib::MarketModel>(
+                key, FlatVolFactory(volatilities, corr, evolution,
+                                    numberOfFactors, initialRates,
+                                    displacements));
     }
 
     AbcdVol::AbcdVol(
@@ -67,13 +159,15 @@ namespace QuantLibAddin {
             const std::vector<QuantLib::Rate>& initialRates,
             const std::vector<QuantLib::Rate>& displacements,
             bool permanent) : MarketModel(properties, permanent) {
-        libraryObject_ = boost::shared_ptr<QuantLib::MarketModel>(new
-            QuantLib::AbcdVol(a, b, c, d, ks,
-                                     corr,
-                                     evolution,
-                                     numberOfFactors,
-                                     initialRates,
-                                     displacements));
+        DecompositionCache::Key key("AbcdVol");
+        key << a << b << c << d << ks;
+        addModelInputs(key, corr, evolution, numberOfFactors,
+                       initialRates, displacements);
+        libraryObject_ =
+            DecompositionCache::instance().retrieve<QuantLib::MarketModel>(
+                key, AbcdVolFactory(a, b, c, d, ks, corr, evolution,
+                                    numberOfFactors, initialRates,
+                                    displacements));
     }
 
     PseudoRootFacade::PseudoRootFacade(
@@ -22,13 +22,23 @@
 #endif
 
 #include <qlo/optimization.hpp>
+#include <qlo/parallel.hpp>
 
+#include <ql/math/matrix.hpp>
 #include <ql/math/optimization/armijo.hpp>
 #include <ql/math/optimization/constraint.hpp>
 #include <ql/math/optimization/conjugategradient.hpp>
 #include <ql/math/optimization/levenbergmarquardt.hpp>
 #include <ql/math/optimization/simplex.hpp>
 #include <ql/math/optimization/steepestdescent.hpp>
+#include <ql/math/optimization/problem.hpp>
+#include <ql/math/randomnumbers/mt19937uniformrng.hpp>
+#include <ql/math/randomnumbers/sobolrsg.hpp>
+#include <ql/utilities/null.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
 
 namespace QuantLibAddin {
 
@@ -69,10 +79,469 @@ namespace QuantLibAddin {
                                            QuantLib::Real epsfcn,
                                            QuantLib::Real xtol,
                                            QuantLib::Real gtol,
+                                           QuantLib::Size threads,
                                            bool permanent) : OptimizationMethod(properties, permanent)
+    {
+        if (threads == 1)
+            libraryObject_ = boost::shared_ptr<QuantLib::OptimizationMethod>(new
+                QuantLib::LevenbergMarquardt(epsfcn, xtol, gtol));
+        else
+            libraryObject_ = boost::shared_ptr<QuantLib::OptimizationMethod>(new
+                ConcurrentLevenbergMarquardt(epsfcn, xtol, gtol, threads));
+    }
+
+    namespace {
+
+        // QuantLib::Problem only counts its own evaluations; its counters
+        // are protected, and are reached through pointers to members
+        // formed in a derived class, which is never instantiated
+        class ProblemCounters : public QuantLib::Problem {
+          public:
+            typedef QuantLib::Integer QuantLib::Problem::* Counter;
+            static Counter functionEvaluations() {
+                return &ProblemCounters::functionEvaluation_;
+            }
+            static Counter gradientEvaluations() {
+                return &ProblemCounters::gradientEvaluation_;
+            }
+          private:
+            ProblemCounters();
+        };
+
+        // forwards to the given cost function, except for the Jacobian,
+        // whose forward differences are evaluated over the copies
+        class ConcurrentJacobianFunction : public QuantLib::CostFunction {
+          public:
+            ConcurrentJacobianFunction(
+                const QuantLib::CostFunction& f,
+                const std::vector<boost::shared_ptr<CloneableCostFunction> >& copies,
+                QuantLib::Real epsfcn)
+            : f_(f), copies_(copies), evaluations_(0),
+              // as in MINPACK's fdjac2
+              eps_(std::sqrt(std::max(epsfcn, QL_EPSILON))) {}
+            QuantLib::Real value(const QuantLib::Array& x) const {
+                return f_.value(x);
+            }
+            QuantLib::Disposable<QuantLib::Array>
+            values(const QuantLib::Array& x) const {
+                return f_.values(x);
+            }
+            void jacobian(QuantLib::Matrix& jac,
+                          const QuantLib::Array& x) const {
+                QuantLib::Size n = x.size();
+                // the last point is the unperturbed one
+                std::vector<QuantLib::Array> points(n+1, x), values(n+1);
+                std::vector<QuantLib::Real> steps(n);
+                for (QuantLib::Size j=0; j<n; ++j) {
+                    steps[j] = eps_*std::fabs(x[j]);
+                    if (steps[j] == 0.0)
+                        steps[j] = eps_;
+                    points[j][j] += steps[j];
+                }
+                Columns task(copies_, points, values);
+                parallelFor(copies_.size(), copies_.size(), task);
+                evaluations_ += n+1;
+                const QuantLib::Array& v = values[n];
+                for (QuantLib::Size j=0; j<n; ++j)
+                    for (QuantLib::Size i=0; i<v.size(); ++i)
+                        jac[i][j] = (values[j][i] - v[i])/steps[j];
+            }
+            QuantLib::Integer evaluations() const { return evaluations_; }
+          private:
+            // each copy evaluates an interleaved group of points
+            class Columns {
+              public:
+                Columns(
+                    const std::vector<boost::shared_ptr<CloneableCostFunction> >& copies,
+                    const std::vector<QuantLib::Array>& points,
+                    std::vector<QuantLib::Array>& values)
+                : copies_(copies), points_(points), values_(values) {}
+                void operator()(QuantLib::Size g) {
+                    for (QuantLib::Size k=g; k<points_.size();
+                         k+=copies_.size())
+                        values_[k] = copies_[g]->values(points_[k]);
+                }
+              private:
+                const std::vector<boost::shared_ptr<CloneableCostFunction> >& copies_;
+                const std::vector<QuantLib::Array>& points_;
+                std::vector<QuantLib::Array>& values_;
+            };
+            const QuantLib::CostFunction& f_;
+            const std::vector<boost::shared_ptr<CloneableCostFunction> >& copies_;
+            mutable QuantLib::Integer evaluations_;
+            QuantLib::Real eps_;
+        };
+
+        typedef MultiStartOptimizationMethod::Start Start;
+
+        void runStart(QuantLib::OptimizationMethod& method,
+                      QuantLib::CostFunction& costFunction,
+                      QuantLib::Constraint& constraint,
+                      const QuantLib::Array& initialValue,
+                      const QuantLib::EndCriteria& endCriteria,
+                      Start& start) {
+            start.initialValue = initialValue;
+            start.functionValue = QuantLib::Null<QuantLib::Real>();
+            start.endCriteria = QuantLib::EndCriteria::None;
+            QuantLib::Problem problem(costFunction, constraint, initialValue);
+            try {
+                start.endCriteria = method.minimize(problem, endCriteria);
+                start.currentValue = problem.currentValue();
+                start.functionValue = problem.functionValue();
+            } catch (std::exception& e) {
+                start.error = e.what();
+                if (start.error.empty())
+                    start.error = "unknown error";
+            }
+            start.functionEvaluations = problem.functionEvaluation();
+            start.gradientEvaluations = problem.gradientEvaluation();
+        }
+
+        // serializes the calls to a constraint shared by concurrent
+        // starts, as constraints may keep mutable state, e.g., the
+        // projection of a QuantLib::ProjectedConstraint
+        class SerializedConstraint : public QuantLib::Constraint {
+          private:
+            class Impl : public QuantLib::Constraint::Impl {
+              public:
+                Impl(const QuantLib::Constraint& constraint,
+                     boost::mutex& mutex)
+                : constraint_(constraint), mutex_(mutex) {}
+                bool test(const QuantLib::Array& params) const {
+                    boost::mutex::scoped_lock lock(mutex_);
+                    return constraint_.test(params);
+                }
+                QuantLib::Array upperBound(
+                                  const QuantLib::Array& params) const {
+                    boost::mutex::scoped_lock lock(mutex_);
+                    return constraint_.upperBound(params);
+                }
+                QuantLib::Array lowerBound(
+                                  const QuantLib::Array& params) const {
+                    boost::mutex::scoped_lock lock(mutex_);
+                    return constraint_.lowerBound(params);
+                }
+              private:
+                QuantLib::Constraint constraint_;
+                boost::mutex& mutex_;
+            };
+          public:
+            SerializedConstraint(const QuantLib::Constraint& constraint,
+                                 boost::mutex& mutex)
+            : QuantLib::Constraint(boost::shared_ptr<QuantLib::Constraint::Impl>(
+                                        new Impl(constraint, mutex))) {}
+        };
+
+        // runs each start on its own copies of the method and cost function
+        class MultiStartTask {
+          public:
+            MultiStartTask(
+                const std::vector<boost::shared_ptr<QuantLib::OptimizationMethod> >& methods,
+                const std::vector<boost::shared_ptr<CloneableCostFunction> >& costFunctions,
+                QuantLib::Constraint& constraint,
+                const std::vector<QuantLib::Array>& points,
+                const QuantLib::EndCriteria& endCriteria,
+                std::vector<Start>& results)
+            : methods_(methods), costFunctions_(costFunctions),
+              constraint_(constraint), points_(points),
+              endCriteria_(endCriteria), results_(results) {}
+            void operator()(QuantLib::Size k) {
+                runStart(*methods_[k], *costFunctions_[k], constraint_,
+                         points_[k], endCriteria_, results_[k]);
+            }
+          private:
+            const std::vector<boost::shared_ptr<QuantLib::OptimizationMethod> >& methods_;
+            const std::vector<boost::shared_ptr<CloneableCostFunction> >& costFunctions_;
+            QuantLib::Constraint& constraint_;
+            const std::vector<QuantLib::Array>& points_;
+            const QuantLib::EndCriteria& endCriteria_;
+            std::vector<Start>& results_;
+        };
+
+    }
+
+    boost::shared_ptr<QuantLib::OptimizationMethod> cloneOptimizationMethod(
+            const boost::shared_ptr<QuantLib::OptimizationMethod>& method) {
+        if (ConcurrentLevenbergMarquardt* lm =
+                dynamic_cast<ConcurrentLevenbergMarquardt*>(method.get()))
+            return boost::shared_ptr<QuantLib::OptimizationMethod>(new
+                QuantLib::LevenbergMarquardt(lm->epsfcn(), lm->xtol(),
+                                             lm->gtol()));
+        if (QuantLib::LevenbergMarquardt* lm =
+                dynamic_cast<QuantLib::LevenbergMarquardt*>(method.get()))
+            return boost::shared_ptr<QuantLib::OptimizationMethod>(new
+                QuantLib::LevenbergMarquardt(*lm));
+        if (QuantLib::Simplex* simplex =
+                dynamic_cast<QuantLib::Simplex*>(method.get()))
+            return boost::shared_ptr<QuantLib::OptimizationMethod>(new
+                QuantLib::Simplex(*simplex));
+        return boost::shared_ptr<QuantLib::OptimizationMethod>();
+    }
+
+    void addEvaluations(QuantLib::Problem& P,
+                        QuantLib::Integer functionEvaluations,
+                        QuantLib::Integer gradientEvaluations) {
+        P.*(ProblemCounters::functionEvaluations()) += functionEvaluations;
+        P.*(ProblemCounters::gradientEvaluations()) += gradientEvaluations;
+    }
+
+    ConcurrentLevenbergMarquardt::ConcurrentLevenbergMarquardt(
+                                                    QuantLib::Real epsfcn,
+                                                    QuantLib::Real xtol,
+                                                    QuantLib::Real gtol,
+                                                    QuantLib::Size threads)
+    : epsfcn_(epsfcn), xtol_(xtol), gtol_(gtol), threads_(threads) {}
+
+    QuantLib::EndCriteria::Type ConcurrentLevenbergMarquardt::minimize(
+                                    QuantLib::Problem& P,
+                                    const QuantLib::EndCriteria& endCriteria) {
+        const CloneableCostFunction* cloneable =
+            dynamic_cast<const CloneableCostFunction*>(&P.costFunction());
+        QuantLib::Size threads =
+            workerThreads(threads_, P.currentValue().size()+1);
+        std::vector<boost::shared_ptr<CloneableCostFunction> > copies;
+        if (cloneable != 0 && threads > 1) {
+            // the copies are made here, as they may copy the calibrated
+            // object
+            for (QuantLib::Size k=0; k<threads; ++k) {
+                boost::shared_ptr<CloneableCostFunction> f =
+                    cloneable->clone();
+                if (!f) {
+                    copies.clear();
+                    break;
+                }
+                copies.push_back(f);
+            }
+        }
+        if (copies.empty()) {
+            QuantLib::LevenbergMarquardt lm(epsfcn_, xtol_, gtol_);
+            return lm.minimize(P, endCriteria);
+        }
+
+        ConcurrentJacobianFunction f(P.costFunction(), copies, epsfcn_);
+        // QuantLib::Problem needs a modifiable reference, although the
+        // constraint is not modified by the methods
+        QuantLib::Problem problem(
+            f, const_cast<QuantLib::Constraint&>(P.constraint()),
+            P.currentValue());
+        QuantLib::LevenbergMarquardt lm(epsfcn_, xtol_, gtol_, true);
+        QuantLib::EndCriteria::Type result =
+            lm.minimize(problem, endCriteria);
+        addEvaluations(P, problem.functionEvaluation() + f.evaluations(),
+                       problem.gradientEvaluation());
+        P.setCurrentValue(problem.currentValue());
+        P.setFunctionValue(problem.functionValue());
+        P.setGradientNormValue(problem.gradientNormValue());
+        return result;
+    }
+
+    MultiStartOptimizationMethod::MultiStartOptimizationMethod(
+            const boost::shared_ptr<QuantLib::OptimizationMethod>& method,
+            QuantLib::Size starts,
+            QuantLib::Real spread,
+            QuantLib::BigNatural seed,
+            QuantLib::Size threads)
+    : method_(method), starts_(starts), spread_(spread), seed_(seed),
+      threads_(threads), best_(0) {
+        QL_REQUIRE(method_, "null optimization method");
+        QL_REQUIRE(starts_ > 0, "at least one start required");
+        QL_REQUIRE(spread_ > 0.0, "non-positive spread: " << spread_);
+    }
+
+    std::vector<QuantLib::Array>
+    MultiStartOptimizationMethod::startingPoints(
+                                        const QuantLib::Problem& P) const {
+        const QuantLib::Array& x0 = P.currentValue();
+        QuantLib::Size n = x0.size();
+        std::vector<QuantLib::Array> points(1, x0);
+        if (starts_ == 1 || n == 0)
+            return points;
+
+        // unbounded directions are given the spread around the initial
+        // value
+        QuantLib::Array lower = P.constraint().lowerBound(x0);
+        QuantLib::Array upper = P.constraint().upperBound(x0);
+        for (QuantLib::Size i=0; i<n; ++i) {
+            QuantLib::Real width =
+                spread_*std::max<QuantLib::Real>(std::fabs(x0[i]), 1.0);
+            lower[i] = std::max(lower[i], x0[i] - width);
+            upper[i] = std::min(upper[i], x0[i] + width);
+        }
+
+        QuantLib::MersenneTwisterUniformRng rng(seed_);
+        std::vector<QuantLib::Real> shift(n);
+        for (QuantLib::Size i=0; i<n; ++i)
+            shift[i] = rng.nextReal();
+        QuantLib::SobolRsg sobol(n, seed_);
+        while (points.size() < starts_) {
+            const std::vector<QuantLib::Real>& u = sobol.nextSequence().value;
+            QuantLib::Array x(n);
+            for (QuantLib::Size i=0; i<n; ++i) {
+                QuantLib::Real v = u[i] + shift[i];
+                v -= std::floor(v);
+                x[i] = lower[i] + v*(upper[i]-lower[i]);
+            }
+            for (QuantLib::Size k=0; k<20 && !P.constraint().test(x); ++k)
+                x = x0 + 0.5*(x - x0);
+            points.push_back(P.constraint().test(x) ? x : x0);
+        }
+        return points;
+    }
+
+    QuantLib::EndCriteria::Type MultiStartOptimizationMethod::minimize(
+                                    QuantLib::Problem& P,
+                                    const QuantLib::EndCriteria& endCriteria) {
+        std::vector<QuantLib::Array> points = startingPoints(P);
+        // QuantLib::Problem needs modifiable references, although the
+        // cost function and constraint are not modified by the methods
+        QuantLib::CostFunction& costFunction =
+            const_cast<QuantLib::CostFunction&>(P.costFunction());
+        QuantLib::Constraint& constraint =
+            const_cast<QuantLib::Constraint&>(P.constraint());
+
+        std::vector<Start> results(points.size());
+        CloneableCostFunction* cloneable =
+            dynamic_cast<CloneableCostFunction*>(&costFunction);
+        std::vector<boost::shared_ptr<QuantLib::OptimizationMethod> >
+            methods;
+        std::vector<boost::shared_ptr<CloneableCostFunction> >
+            costFunctions;
+        if (cloneable != 0 && workerThreads(threads_, points.size()) > 1 &&
+            cloneOptimizationMethod(method_)) {
+            // the copies are made here, as they may copy the calibrated
+            // object
+            for (QuantLib::Size k=0; k<points.size(); ++k) {
+                boost::shared_ptr<CloneableCostFunction> f =
+                    cloneable->clone();
+                if (!f) {
+                    methods.clear();
+                    costFunctions.clear();
+                    break;
+                }
+                methods.push_back(cloneOptimizationMethod(method_));
+                costFunctions.push_back(f);
+            }
+        }
+        if (!methods.empty()) {
+            boost::mutex constraintMutex;
+            SerializedConstraint serialized(constraint, constraintMutex);
+            MultiStartTask task(methods, costFunctions, serialized, points,
+                                endCriteria, results);
+            parallelFor(points.size(), threads_, task);
+        } else {
+            for (QuantLib::Size k=0; k<points.size(); ++k)
+                runStart(*method_, costFunction, constraint, points[k],
+                         endCriteria, results[k]);
+        }
+
+        QuantLib::Size best = points.size();
+        QuantLib::Integer functionEvaluations = 0, gradientEvaluations = 0;
+        for (QuantLib::Size k=0; k<points.size(); ++k) {
+            if (results[k].error.empty() &&
+                (best == points.size() ||
+                 results[k].functionValue < results[best].functionValue))
+                best = k;
+            functionEvaluations += results[k].functionEvaluations;
+            gradientEvaluations += results[k].gradientEvaluations;
+        }
+        addEvaluations(P, functionEvaluations, gradientEvaluations);
+
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            results_ = results;
+            best_ = best;
+        }
+        QL_REQUIRE(best < points.size(),
+                   "all " << points.size() << " starts failed: "
+                   << results.front().error);
+
+        const Start& result = results[best];
+        // leaves the calibrated object in the state of the best result
+        P.setFunctionValue(P.value(result.currentValue));
+        P.setCurrentValue(result.currentValue);
+        return result.endCriteria;
+    }
+
+    std::vector<MultiStartOptimizationMethod::Start>
+    MultiStartOptimizationMethod::starts() const {
+        boost::mutex::scoped_lock lock(mutex_);
+        return results_;
+    }
+
+    QuantLib::Size MultiStartOptimizationMethod::best() const {
+        boost::mutex::scoped_lock lock(mutex_);
+        return best_;
+    }
+
+    MultiStartOptimizer::MultiStartOptimizer(
+            const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
+            const boost::shared_ptr<QuantLib::OptimizationMethod>& method,
+            QuantLib::Size starts,
+            QuantLib::Real spread,
+            QuantLib::BigNatural seed,
+            QuantLib::Size threads,
+            bool permanent) : OptimizationMethod(properties, permanent)
     {
         libraryObject_ = boost::shared_ptr<QuantLib::OptimizationMethod>(new
-            QuantLib::LevenbergMarquardt(epsfcn, xtol, gtol));
+            MultiStartOptimizationMethod(method, starts, spread, seed,
+                                         threads));
+    }
+
+    std::vector<std::vector<ObjectHandler::property_t> >
+    MultiStartOptimizer::results() const {
+        boost::shared_ptr<MultiStartOptimizationMethod> method =
+            boost::dynamic_pointer_cast<MultiStartOptimizationMethod>(
+                                                            libraryObject_);
+        std::vector<MultiStartOptimizationMethod::Start> starts =
+            method->starts();
+        QuantLib::Size best = method->best();
+        QuantLib::Size n = starts.empty() ? 0 : starts.front().initialValue.size();
+
+        std::vector<std::vector<ObjectHandler::property_t> > result;
+        std::vector<ObjectHandler::property_t> headings;
+        headings.push_back(std::string("Start"));
+        headings.push_back(std::string("Best"));
+        headings.push_back(std::string("Cost"));
+        headings.push_back(std::string("End Criteria"));
+        headings.push_back(std::string("Evaluations"));
+        headings.push_back(std::string("Failure"));
+        for (QuantLib::Size i=0; i<n; ++i) {
+            std::ostringstream initial;
+            initial << "Initial " << i+1;
+            headings.push_back(initial.str());
+        }
+        for (QuantLib::Size i=0; i<n; ++i) {
+            std::ostringstream current;
+            current << "Final " << i+1;
+            headings.push_back(current.str());
+        }
+        result.push_back(headings);
+
+        for (QuantLib::Size k=0; k<starts.size(); ++k) {
+            const MultiStartOptimizationMethod::Start& start = starts[k];
+            std::vector<ObjectHandler::property_t> row;
+            row.push_back(static_cast<long>(k+1));
+            row.push_back(k == best);
+            std::ostringstream endCriteria;
+            endCriteria << start.endCriteria;
+            if (start.error.empty())
+                row.push_back(start.functionValue);
+            else
+                row.push_back(std::string("N/A"));
+            row.push_back(endCriteria.str());
+            row.push_back(static_cast<long>(start.functionEvaluations));
+            row.push_back(start.error);
+            for (QuantLib::Size i=0; i<n; ++i)
+                row.push_back(start.initialValue[i]);
+            for (QuantLib::Size i=0; i<n; ++i) {
+                if (start.error.empty())
+                    row.push_back(start.currentValue[i]);
+                else
+                    row.push_back(std::string("N/A"));
+            }
+            result.push_back(row);
+        }
+        return result;
     }
 
     ArmijoLineSearch::ArmijoLineSearch(const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
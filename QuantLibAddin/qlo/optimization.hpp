@@ -22,11 +22,18 @@
 
 #include <oh/libraryobject.hpp>
 
+#include <ql/math/array.hpp>
+#include <ql/math/optimization/costfunction.hpp>
+#include <ql/math/optimization/endcriteria.hpp>
+#include <ql/math/optimization/method.hpp>
 #include <ql/types.hpp>
 
+#include <boost/thread/mutex.hpp>
+
 namespace QuantLib {
     class EndCriteria;
     class OptimizationMethod;
+    class Problem;
     class LineSearch;
     class Constraint;
 }
@@ -82,9 +89,138 @@ namespace QuantLibAddin {
                            QuantLib::Real epsfcn,
                            QuantLib::Real xtol,
                            QuantLib::Real gtol,
+                           QuantLib::Size threads,
                            bool permanent);
     };
    
+    //! cost function which can be copied for concurrent minimizations
+    /*! Each copy must own whatever state its evaluations modify, e.g.,
+        the calibrated object, so that different copies can be
+        evaluated at the same time.  Copies are made in the calling
+        thread.  A null pointer is returned by functions which cannot
+        be copied after all, e.g., wrappers of other cost functions.
+    */
+    class CloneableCostFunction : public QuantLib::CostFunction {
+      public:
+        virtual boost::shared_ptr<CloneableCostFunction> clone() const = 0;
+    };
+
+    //! copy of an optimization method, if its type can be copied
+    /*! Levenberg-Marquardt and simplex methods are copied; a null
+        pointer is returned for other methods, as methods based on a
+        line search would share it with their copies.  Concurrent
+        Levenberg-Marquardt methods are copied as plain ones, since
+        their copies are already run concurrently.
+    */
+    boost::shared_ptr<QuantLib::OptimizationMethod> cloneOptimizationMethod(
+            const boost::shared_ptr<QuantLib::OptimizationMethod>& method);
+
+    //! adds evaluations made on another problem to the counts of a problem
+    void addEvaluations(QuantLib::Problem& P,
+                        QuantLib::Integer functionEvaluations,
+                        QuantLib::Integer gradientEvaluations);
+
+    //! Levenberg-Marquardt method with concurrent finite differences
+    /*! The columns of the finite-difference Jacobian, with the forward
+        steps of MINPACK, are evaluated over the given number of
+        threads, each on its own copy of the cost function; an
+        evaluation at the current point is added to each Jacobian.  If
+        the cost function of the problem is not a CloneableCostFunction
+        returning copies, the plain QuantLib::LevenbergMarquardt method
+        is used.
+    */
+    class ConcurrentLevenbergMarquardt : public QuantLib::OptimizationMethod {
+      public:
+        ConcurrentLevenbergMarquardt(QuantLib::Real epsfcn,
+                                     QuantLib::Real xtol,
+                                     QuantLib::Real gtol,
+                                     QuantLib::Size threads);
+        QuantLib::EndCriteria::Type minimize(
+                                    QuantLib::Problem& P,
+                                    const QuantLib::EndCriteria& endCriteria);
+        QuantLib::Real epsfcn() const { return epsfcn_; }
+        QuantLib::Real xtol() const { return xtol_; }
+        QuantLib::Real gtol() const { return gtol_; }
+      private:
+        QuantLib::Real epsfcn_, xtol_, gtol_;
+        QuantLib::Size threads_;
+    };
+
+    //! Multi-start wrapper of an optimization method
+    /*! The wrapped method is run from the initial value of the problem
+        and from further starting points, and the best of the results is
+        returned.  The further points come from a Sobol sequence shifted
+        modulo 1 by a random vector drawn from the given seed (a
+        Cranley-Patterson rotation), mapped onto the bounds of the
+        constraint; where the constraint is unbounded, they are drawn
+        within the given relative spread around the initial value.
+        Points rejected by the constraint are moved towards the initial
+        value until accepted.
+
+        If the cost function is a CloneableCostFunction returning
+        copies and the method can be copied, the starts are run over
+        the given number of threads, each on its own copies of both,
+        while the constraint is shared and called under a lock; this is
+        the case of AffineModel::calibrateConcurrently.
+        Otherwise, since
+        calibration cost functions hold the state of the calibrated
+        object, they are run one after the other on the cost function
+        of the problem.  Either way, the results do not depend on the
+        number of threads.  At the end, the cost function of the
+        problem is evaluated once more at the best point, so that the
+        calibrated object is left in the state of the best result.  The
+        evaluations of all starts are added to those of the problem.
+    */
+    class MultiStartOptimizationMethod : public QuantLib::OptimizationMethod {
+      public:
+        //! result of a single start
+        struct Start {
+            QuantLib::Array initialValue, currentValue;
+            QuantLib::Real functionValue;
+            QuantLib::EndCriteria::Type endCriteria;
+            QuantLib::Integer functionEvaluations, gradientEvaluations;
+            std::string error;
+        };
+        MultiStartOptimizationMethod(
+            const boost::shared_ptr<QuantLib::OptimizationMethod>& method,
+            QuantLib::Size starts,
+            QuantLib::Real spread,
+            QuantLib::BigNatural seed,
+            QuantLib::Size threads);
+        QuantLib::EndCriteria::Type minimize(
+                                    QuantLib::Problem& P,
+                                    const QuantLib::EndCriteria& endCriteria);
+        //! starts of the last minimization, in the order of their points
+        std::vector<Start> starts() const;
+        //! index of the best start of the last minimization
+        QuantLib::Size best() const;
+      private:
+        std::vector<QuantLib::Array> startingPoints(
+                                    const QuantLib::Problem& P) const;
+        boost::shared_ptr<QuantLib::OptimizationMethod> method_;
+        QuantLib::Size starts_;
+        QuantLib::Real spread_;
+        QuantLib::BigNatural seed_;
+        QuantLib::Size threads_;
+        mutable boost::mutex mutex_;
+        std::vector<Start> results_;
+        QuantLib::Size best_;
+    };
+
+    class MultiStartOptimizer : public OptimizationMethod {
+      public:
+        MultiStartOptimizer(
+            const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
+            const boost::shared_ptr<QuantLib::OptimizationMethod>& method,
+            QuantLib::Size starts,
+            QuantLib::Real spread,
+            QuantLib::BigNatural seed,
+            QuantLib::Size threads,
+            bool permanent);
+        //! one row per start of the last minimization, after a heading
+        std::vector<std::vector<ObjectHandler::property_t> > results() const;
+    };
+
     OH_LIB_CLASS(LineSearch, QuantLib::LineSearch);
 
     class ArmijoLineSearch : public LineSearch {
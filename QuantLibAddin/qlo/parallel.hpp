@@ -0,0 +1,129 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*! \file
+    \brief Distribution of independent tasks over a group of threads
+*/
+
+#ifndef qla_parallel_hpp
+#define qla_parallel_hpp
+
+#include <ql/errors.hpp>
+#include <ql/types.hpp>
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <algorithm>
+#include <string>
+
+namespace QuantLibAddin {
+
+    //! number of threads to be used for the given number of tasks
+    /*! A request for zero threads selects the number of hardware
+        threads available.
+    */
+    inline QuantLib::Size workerThreads(QuantLib::Size requested,
+                                        QuantLib::Size tasks) {
+        QuantLib::Size n = requested;
+        if (n == 0)
+            n = std::max<QuantLib::Size>(boost::thread::hardware_concurrency(),
+                                         1);
+        return std::min(n, tasks);
+    }
+
+    namespace detail {
+
+        template <class Task>
+        class ParallelForWorker {
+          public:
+            ParallelForWorker(Task& task,
+                              QuantLib::Size tasks,
+                              QuantLib::Size& next,
+                              boost::mutex& mutex,
+                              std::string& error)
+            : task_(task), tasks_(tasks), next_(next),
+              mutex_(mutex), error_(error) {}
+            void operator()() {
+                for (;;) {
+                    QuantLib::Size i;
+                    {
+                        boost::mutex::scoped_lock lock(mutex_);
+                        if (next_ >= tasks_ || !error_.empty())
+                            return;
+                        i = next_++;
+                    }
+                    try {
+                        task_(i);
+                    } catch (std::exception& e) {
+                        fail(e.what());
+                    } catch (...) {
+                        fail("unknown error");
+                    }
+                }
+            }
+          private:
+            void fail(const std::string& message) {
+                boost::mutex::scoped_lock lock(mutex_);
+                if (error_.empty())
+                    error_ = message;
+            }
+            Task& task_;
+            QuantLib::Size tasks_;
+            QuantLib::Size& next_;
+            boost::mutex& mutex_;
+            std::string& error_;
+        };
+
+    }
+
+    //! runs task(i) for i = 0,...,n-1 over at most nThreads threads
+    /*! Indices are handed out one at a time, so that threads which
+        happen to get cheap tasks keep pulling work.  The task object
+        is shared by all threads: it must only write to the state owned
+        by the index it is given, and it must not trigger the creation,
+        notification or lazy recalculation of shared QuantLib objects.
+        Any such object must be prepared in the calling thread first.
+
+        The first exception thrown by a task stops the distribution of
+        further indices and is rethrown in the calling thread once all
+        threads have finished.  With a single thread the tasks are run
+        in order in the calling thread.
+    */
+    template <class Task>
+    void parallelFor(QuantLib::Size n, QuantLib::Size nThreads, Task& task) {
+        QuantLib::Size threads = workerThreads(nThreads, n);
+        if (threads <= 1) {
+            for (QuantLib::Size i=0; i<n; ++i)
+                task(i);
+            return;
+        }
+
+        QuantLib::Size next = 0;
+        boost::mutex mutex;
+        std::string error;
+        boost::thread_group group;
+        for (QuantLib::Size k=0; k<threads; ++k)
+            group.create_thread(
+                detail::ParallelForWorker<Task>(task, n, next, mutex, error));
+        group.join_all();
+        QL_REQUIRE(error.empty(), error);
+    }
+
+}
+
+#endif
@@ -0,0 +1,653 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+#if defined(HAVE_CONFIG_H)     // Dynamically created by configure
+    #include <qlo/config.hpp>
+#endif
+
+#include <qlo/portfolio.hpp>
+#include <qlo/baseinstruments.hpp>
+#include <qlo/parallel.hpp>
+#include <qlo/pricingengines.hpp>
+#include <qlo/termstructures.hpp>
+#include <ql/cashflows/floatingratecoupon.hpp>
+#include <ql/instrument.hpp>
+#include <ql/instruments/bond.hpp>
+#include <ql/instruments/swap.hpp>
+#include <ql/termstructure.hpp>
+#include <ql/patterns/lazyobject.hpp>
+#include <ql/patterns/observable.hpp>
+#include <oh/conversions/convert2.hpp>
+#include <oh/ohdefines.hpp>
+#include <oh/repository.hpp>
+#include <oh/serializationfactory.hpp>
+
+#include <boost/algorithm/string/case_conv.hpp>
+
+#include <map>
+#include <set>
+#include <sstream>
+
+using ObjectHandler::property_t;
+using QuantLib::Real;
+using QuantLib::Size;
+using QuantLib::Null;
+using std::string;
+using std::vector;
+
+namespace QuantLibAddin {
+
+    namespace {
+
+        // ID of the pricing engine of the instrument, as recorded by
+        // Instrument::setPricingEngine or by the instrument constructor;
+        // empty if unknown.
+        string pricingEngineId(const boost::shared_ptr<Instrument>& instrument) {
+            std::set<string> names = instrument->propertyNames();
+            for (std::set<string>::const_iterator i = names.begin();
+                 i != names.end(); ++i) {
+                string name = boost::algorithm::to_upper_copy(*i);
+                if (name == "ENGINEID" || name == "PRICINGENGINEID"
+                                       || name == "PRICINGENGINE") {
+                    property_t value = instrument->propertyValue(*i);
+                    if (value.type() == typeid(string))
+                        return ObjectHandler::convert2<string>(value);
+                }
+            }
+            return string();
+        }
+
+        // candidate object IDs held by a property value
+        void collectIds(const ObjectHandler::property_base& value,
+                        vector<string>& ids) {
+            if (const string* id = boost::get<string>(&value)) {
+                ids.push_back(*id);
+            } else if (const property_t::vector* values =
+                                  boost::get<property_t::vector>(&value)) {
+                for (Size i=0; i<values->size(); ++i)
+                    collectIds((*values)[i], ids);
+            }
+        }
+
+        // LazyObject::calculate is protected; it is reached through a
+        // pointer to member formed in a derived class, which must not
+        // declare a calculate of its own.  Unlike recalculate(), this
+        // doesn't notify the observers of an already calculated object.
+        class LazyCalculation : public QuantLib::LazyObject {
+          public:
+            static void ensureCalculated(const QuantLib::LazyObject& object) {
+                void (QuantLib::LazyObject::*calculate)() const =
+                    &LazyCalculation::calculate;
+                (object.*calculate)();
+            }
+          private:
+            LazyCalculation();
+        };
+
+        string objectId(const boost::shared_ptr<ObjectHandler::Object>& o) {
+            return ObjectHandler::convert2<string>(
+                                            o->propertyValue("OBJECTID"));
+        }
+
+        // Calculates once the term structures reachable from the
+        // instruments, so that lazy curves and volatilities are
+        // bootstrapped or calibrated in the calling thread.  Instruments
+        // depending on a term structure which fails get its error.
+        void calculateTermStructures(
+                    const vector<boost::shared_ptr<Instrument> >& instruments,
+                    vector<string>& errors) {
+            // objects visited, with the IDs of their dependencies
+            std::map<string, vector<string> > dependencies;
+            std::set<string> notObjects;
+            std::map<string, string> failures;
+            vector<boost::shared_ptr<ObjectHandler::Object> > pending;
+            for (Size i=0; i<instruments.size(); ++i) {
+                string id = objectId(instruments[i]);
+                if (dependencies.insert(
+                        std::make_pair(id, vector<string>())).second)
+                    pending.push_back(instruments[i]);
+            }
+
+            while (!pending.empty()) {
+                boost::shared_ptr<ObjectHandler::Object> object =
+                                                                pending.back();
+                pending.pop_back();
+                string id = objectId(object);
+
+                boost::shared_ptr<TermStructure> ts =
+                    boost::dynamic_pointer_cast<TermStructure>(object);
+                if (ts) {
+                    try {
+                        boost::shared_ptr<QuantLib::TermStructure> qlts;
+                        ts->getLibraryObject(qlts);
+                        const QuantLib::LazyObject* lazy =
+                            dynamic_cast<const QuantLib::LazyObject*>(
+                                                                qlts.get());
+                        if (lazy)
+                            LazyCalculation::ensureCalculated(*lazy);
+                    } catch (std::exception& e) {
+                        failures[id] = e.what();
+                    }
+                }
+
+                vector<string> ids;
+                std::set<string> names = object->propertyNames();
+                for (std::set<string>::const_iterator n = names.begin();
+                     n != names.end(); ++n)
+                    collectIds(object->propertyValue(*n), ids);
+                for (Size i=0; i<ids.size(); ++i) {
+                    if (ids[i].empty() || ids[i] == id ||
+                        notObjects.find(ids[i]) != notObjects.end())
+                        continue;
+                    if (dependencies.find(ids[i]) == dependencies.end()) {
+                        // most string properties are not object IDs
+                        try {
+                            boost::shared_ptr<ObjectHandler::Object> dependency;
+                            ObjectHandler::Repository::instance().retrieveObject(
+                                                            dependency, ids[i]);
+                            dependencies[ids[i]];
+                            pending.push_back(dependency);
+                        } catch (std::exception&) {
+                            notObjects.insert(ids[i]);
+                            continue;
+                        }
+                    }
+                    dependencies[id].push_back(ids[i]);
+                }
+            }
+
+            errors.assign(instruments.size(), string());
+            if (failures.empty())
+                return;
+            for (Size i=0; i<instruments.size(); ++i) {
+                std::set<string> reached;
+                vector<string> next(1, objectId(instruments[i]));
+                while (!next.empty() && errors[i].empty()) {
+                    string id = next.back();
+                    next.pop_back();
+                    if (!reached.insert(id).second)
+                        continue;
+                    std::map<string, string>::const_iterator f =
+                        failures.find(id);
+                    if (f != failures.end()) {
+                        errors[i] = "term structure " + id + ": " + f->second;
+                    } else {
+                        const vector<string>& ids = dependencies[id];
+                        next.insert(next.end(), ids.begin(), ids.end());
+                    }
+                }
+            }
+        }
+
+        // copy of the engine with the given ID, recreated from its
+        // properties; null if the engine is unknown or can't be copied
+        boost::shared_ptr<QuantLib::PricingEngine> cloneEngine(
+                                                    const string& engineId) {
+            boost::shared_ptr<QuantLib::PricingEngine> engine;
+            if (engineId.empty())
+                return engine;
+            try {
+                boost::shared_ptr<ObjectHandler::Object> object;
+                ObjectHandler::Repository::instance().retrieveObject(
+                                                        object, engineId);
+                boost::shared_ptr<PricingEngine> copy =
+                    boost::dynamic_pointer_cast<PricingEngine>(
+                        ObjectHandler::SerializationFactory::instance()
+                            .recreateObject(object->properties()));
+                if (copy)
+                    copy->getLibraryObject(engine);
+            } catch (std::exception&) {
+                engine.reset();
+            }
+            return engine;
+        }
+
+        // prices the instrument on the given engine, as
+        // QuantLib::Instrument does on its own, without modifying it
+        Real engineNPV(const QuantLib::Instrument& instrument,
+                       QuantLib::PricingEngine& engine) {
+            if (instrument.isExpired())
+                return 0.0;
+            engine.reset();
+            instrument.setupArguments(engine.getArguments());
+            engine.getArguments()->validate();
+            engine.calculate();
+            const QuantLib::Instrument::results* results =
+                dynamic_cast<const QuantLib::Instrument::results*>(
+                                                    engine.getResults());
+            QL_REQUIRE(results != 0, "wrong engine type");
+            QL_REQUIRE(results->value != Null<Real>(), "NPV not provided");
+            return results->value;
+        }
+
+        // on the given engine, or on the instrument's own if null
+        void priceInstrument(
+                const QuantLib::Instrument& instrument,
+                const boost::shared_ptr<QuantLib::PricingEngine>& engine,
+                Real& npv, string& error) {
+            try {
+                npv = engine ? engineNPV(instrument, *engine)
+                             : instrument.NPV();
+                error.clear();
+            } catch (std::exception& e) {
+                npv = Null<Real>();
+                error = e.what();
+                if (error.empty())
+                    error = "unknown error";
+            } catch (...) {
+                npv = Null<Real>();
+                error = "unknown error";
+            }
+        }
+
+        /* Instruments sharing state modified while they are priced,
+           joined into components by union-find; any object can be
+           used as the key of the state. */
+        class SharedState {
+          public:
+            explicit SharedState(Size n) : parent_(n) {
+                for (Size i=0; i<n; ++i)
+                    parent_[i] = i;
+            }
+            void share(Size i, const void* state) {
+                std::map<const void*, Size>::const_iterator k =
+                    owners_.find(state);
+                if (k == owners_.end())
+                    owners_[state] = i;
+                else
+                    parent_[root(i)] = root(k->second);
+            }
+            Size root(Size i) {
+                while (parent_[i] != i) {
+                    parent_[i] = parent_[parent_[i]];
+                    i = parent_[i];
+                }
+                return i;
+            }
+          private:
+            vector<Size> parent_;
+            std::map<const void*, Size> owners_;
+        };
+
+        // legs of swaps and bonds; none for other instruments
+        vector<const QuantLib::Leg*> instrumentLegs(
+                                    const QuantLib::Instrument& instrument) {
+            vector<const QuantLib::Leg*> legs;
+            if (const QuantLib::Swap* swap =
+                    dynamic_cast<const QuantLib::Swap*>(&instrument)) {
+                for (Size j=0; j<swap->numberOfLegs(); ++j)
+                    legs.push_back(&swap->leg(j));
+            } else if (const QuantLib::Bond* bond =
+                           dynamic_cast<const QuantLib::Bond*>(&instrument)) {
+                legs.push_back(&bond->cashflows());
+            }
+            return legs;
+        }
+
+        // coupons and coupon pricers of swaps and bonds, which keep
+        // the state of the coupon last priced
+        void shareCoupons(const QuantLib::Instrument& instrument,
+                          Size i, SharedState& state) {
+            vector<const QuantLib::Leg*> legs = instrumentLegs(instrument);
+            for (Size j=0; j<legs.size(); ++j) {
+                const QuantLib::Leg& leg = *legs[j];
+                for (Size k=0; k<leg.size(); ++k) {
+                    state.share(i, leg[k].get());
+                    boost::shared_ptr<QuantLib::FloatingRateCoupon> coupon =
+                        boost::dynamic_pointer_cast<
+                            QuantLib::FloatingRateCoupon>(leg[k]);
+                    if (coupon && coupon->pricer())
+                        state.share(i, coupon->pricer().get());
+                }
+            }
+        }
+
+        class ChunkPricer {
+          public:
+            ChunkPricer(
+                const vector<boost::shared_ptr<QuantLib::Instrument> >& instruments,
+                const vector<vector<Size> >& chunks,
+                const vector<vector<boost::shared_ptr<QuantLib::PricingEngine> > >& engines,
+                vector<Real>& npvs,
+                vector<string>& errors)
+            : instruments_(instruments), chunks_(chunks), engines_(engines),
+              npvs_(npvs), errors_(errors) {}
+            void operator()(Size c) {
+                const vector<Size>& chunk = chunks_[c];
+                for (Size k=0; k<chunk.size(); ++k) {
+                    Size i = chunk[k];
+                    priceInstrument(*instruments_[i], engines_[c][k],
+                                    npvs_[i], errors_[i]);
+                }
+            }
+          private:
+            const vector<boost::shared_ptr<QuantLib::Instrument> >& instruments_;
+            const vector<vector<Size> >& chunks_;
+            const vector<vector<boost::shared_ptr<QuantLib::PricingEngine> > >& engines_;
+            vector<Real>& npvs_;
+            vector<string>& errors_;
+        };
+
+    }
+
+    void priceInstruments(
+            const vector<boost::shared_ptr<Instrument> >& instruments,
+            Size threads,
+            vector<Real>& npvs,
+            vector<string>& errors) {
+        Size n = instruments.size();
+        npvs.assign(n, Null<Real>());
+        errors.assign(n, string());
+
+        vector<boost::shared_ptr<QuantLib::Instrument> > qlInstruments(n);
+        vector<string> engineIds(n);
+        for (Size i=0; i<n; ++i) {
+            QL_REQUIRE(instruments[i], "null instrument at position " << i);
+            instruments[i]->getLibraryObject(qlInstruments[i]);
+            engineIds[i] = pricingEngineId(instruments[i]);
+        }
+
+        // shared term structures are calculated single-threaded;
+        // instruments depending on failed ones are not priced
+        calculateTermStructures(instruments, errors);
+
+        if (workerThreads(threads, n) <= 1) {
+            for (Size i=0; i<n; ++i)
+                if (errors[i].empty())
+                    priceInstrument(
+                                *qlInstruments[i],
+                                boost::shared_ptr<QuantLib::PricingEngine>(),
+                                npvs[i], errors[i]);
+            return;
+        }
+
+        // Engines are copied for each chunk of instruments; those that
+        // can't be copied are shared state, as are those of instruments
+        // whose engine is unknown, which are joined under the empty ID.
+        // The first copy of each engine is kept for the first chunk
+        // using it.
+        SharedState state(n);
+        std::map<string, boost::shared_ptr<QuantLib::PricingEngine> >
+            firstCopies;
+        std::set<string> sharedEngines;
+        for (Size i=0; i<n; ++i) {
+            if (!errors[i].empty())
+                continue;
+            const string& id = engineIds[i];
+            if (firstCopies.find(id) == firstCopies.end() &&
+                sharedEngines.find(id) == sharedEngines.end()) {
+                boost::shared_ptr<QuantLib::PricingEngine> copy =
+                    cloneEngine(id);
+                if (copy)
+                    firstCopies[id] = copy;
+                else
+                    sharedEngines.insert(id);
+            }
+            std::set<string>::const_iterator shared = sharedEngines.find(id);
+            if (shared != sharedEngines.end())
+                state.share(i, &*shared);
+            shareCoupons(*qlInstruments[i], i, state);
+        }
+
+        // components are assigned to chunks, largest first, each going
+        // to the chunk with the fewest instruments so far
+        std::map<Size, vector<Size> > components;
+        for (Size i=0; i<n; ++i)
+            if (errors[i].empty())
+                components[state.root(i)].push_back(i);
+        std::multimap<Size, const vector<Size>*> bySize;
+        for (std::map<Size, vector<Size> >::const_iterator c =
+                 components.begin(); c != components.end(); ++c)
+            bySize.insert(std::make_pair(c->second.size(), &c->second));
+        vector<vector<Size> > chunks(
+                            workerThreads(threads, components.size()));
+        for (std::multimap<Size, const vector<Size>*>::reverse_iterator c =
+                 bySize.rbegin(); c != bySize.rend(); ++c) {
+            Size smallest = 0;
+            for (Size k=1; k<chunks.size(); ++k)
+                if (chunks[k].size() < chunks[smallest].size())
+                    smallest = k;
+            chunks[smallest].insert(chunks[smallest].end(),
+                                    c->second->begin(), c->second->end());
+        }
+
+        // each chunk gets its own copy of the engines it uses; they are
+        // made here, as they register with the shared term structures
+        vector<vector<boost::shared_ptr<QuantLib::PricingEngine> > >
+            engines(chunks.size());
+        for (Size c=0; c<chunks.size(); ++c) {
+            std::map<string, boost::shared_ptr<QuantLib::PricingEngine> >
+                copies;
+            for (Size k=0; k<chunks[c].size(); ++k) {
+                const string& id = engineIds[chunks[c][k]];
+                boost::shared_ptr<QuantLib::PricingEngine> engine;
+                if (sharedEngines.find(id) == sharedEngines.end()) {
+                    boost::shared_ptr<QuantLib::PricingEngine>& copy =
+                        copies[id];
+                    if (!copy) {
+                        copy = firstCopies[id];
+                        if (copy)
+                            firstCopies[id].reset();
+                        else
+                            copy = cloneEngine(id);
+                    }
+                    engine = copy;
+                }
+                engines[c].push_back(engine);
+            }
+        }
+
+        ChunkPricer pricer(qlInstruments, chunks, engines, npvs, errors);
+        parallelFor(chunks.size(), chunks.size(), pricer);
+    }
+
+    vector<vector<property_t> > instrumentNPVBatch(
+            const vector<boost::shared_ptr<Instrument> >& instruments,
+            Size threads) {
+        vector<Real> npvs;
+        vector<string> errors;
+        priceInstruments(instruments, threads, npvs, errors);
+
+        vector<vector<property_t> > result(instruments.size());
+        for (Size i=0; i<instruments.size(); ++i) {
+            if (errors[i].empty()) {
+                result[i].push_back(property_t(npvs[i]));
+            } else {
+                // an empty value is returned as #N/A
+                result[i].push_back(property_t());
+                OH_LOG_ERROR("instrument "
+                             << objectId(instruments[i])
+                             << ": " << errors[i]);
+            }
+            result[i].push_back(property_t(errors[i]));
+        }
+        return result;
+    }
+
+    /* Instruments priced on copies of their engines are not
+       calculated themselves, and a lazy object only forwards the
+       notifications received after a calculation.  Besides the
+       instrument, each trade observes directly its engine, which
+       forwards the notifications of the term structures and quotes
+       it uses, and the coupons of its legs, which forward those of
+       their indexes. */
+    class Portfolio::Trade : public QuantLib::Observer {
+      public:
+        Trade(const boost::shared_ptr<Instrument>& instrument,
+              Real weight, Size bucket)
+        : instrument(instrument), weight(weight), bucket(bucket),
+          npv(0.0), dirty(true) {
+            boost::shared_ptr<QuantLib::Instrument> qlInstrument;
+            instrument->getLibraryObject(qlInstrument);
+            registerWith(qlInstrument);
+            vector<const QuantLib::Leg*> legs = instrumentLegs(*qlInstrument);
+            for (Size j=0; j<legs.size(); ++j)
+                for (Size k=0; k<legs[j]->size(); ++k)
+                    registerWith((*legs[j])[k]);
+            observeEngine();
+        }
+        void update() { dirty = true; }
+        // follows the engine currently set on the instrument; a new
+        // engine makes the trade dirty
+        void observeEngine() {
+            string id = pricingEngineId(instrument);
+            if (id == engineId_)
+                return;
+            unregisterWith(engine_);
+            engine_.reset();
+            engineId_ = id;
+            dirty = true;
+            if (id.empty())
+                return;
+            try {
+                boost::shared_ptr<PricingEngine> engine;
+                ObjectHandler::Repository::instance().retrieveObject(
+                                                                engine, id);
+                engine->getLibraryObject(engine_);
+                registerWith(engine_);
+            } catch (std::exception&) {
+                engine_.reset();
+            }
+        }
+        boost::shared_ptr<Instrument> instrument;
+        Real weight;
+        Size bucket;
+        // weighted contribution included in the running totals
+        Real npv;
+        bool dirty;
+      private:
+        string engineId_;
+        boost::shared_ptr<QuantLib::PricingEngine> engine_;
+    };
+
+    Portfolio::Portfolio(
+            const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
+            const vector<boost::shared_ptr<Instrument> >& instruments,
+            const vector<Real>& weights,
+            const vector<string>& buckets,
+            Size threads,
+            bool permanent)
+    : ObjectHandler::Object(properties, permanent),
+      threads_(threads), total_(0.0) {
+        Size n = instruments.size();
+        QL_REQUIRE(n > 0, "no instruments given");
+        QL_REQUIRE(weights.empty() || weights.size() == n,
+                   "wrong number of weights (" << weights.size()
+                   << ") for " << n << " instruments");
+        QL_REQUIRE(buckets.empty() || buckets.size() == n,
+                   "wrong number of buckets (" << buckets.size()
+                   << ") for " << n << " instruments");
+
+        std::map<string, Size> bucketIndex;
+        trades_.reserve(n);
+        for (Size i=0; i<n; ++i) {
+            QL_REQUIRE(instruments[i], "null instrument at position " << i);
+            string key = buckets.empty() ? string() : buckets[i];
+            std::map<string, Size>::const_iterator b = bucketIndex.find(key);
+            Size bucket;
+            if (b == bucketIndex.end()) {
+                bucket = bucketKeys_.size();
+                bucketIndex[key] = bucket;
+                bucketKeys_.push_back(key);
+            } else {
+                bucket = b->second;
+            }
+            Real weight = weights.empty() ? 1.0 : weights[i];
+            trades_.push_back(boost::shared_ptr<Trade>(
+                                         new Trade(instruments[i], weight, bucket)));
+        }
+        bucketTotals_.assign(bucketKeys_.size(), 0.0);
+    }
+
+    void Portfolio::refresh() const {
+        vector<Size> dirty;
+        vector<boost::shared_ptr<Instrument> > instruments;
+        for (Size i=0; i<trades_.size(); ++i) {
+            trades_[i]->observeEngine();
+            if (trades_[i]->dirty) {
+                dirty.push_back(i);
+                instruments.push_back(trades_[i]->instrument);
+            }
+        }
+        if (dirty.empty())
+            return;
+
+        // flags are cleared before pricing, so that notifications
+        // raised meanwhile are not lost; they are set again if pricing
+        // fails as a whole
+        for (Size k=0; k<dirty.size(); ++k)
+            trades_[dirty[k]]->dirty = false;
+
+        vector<Real> npvs;
+        vector<string> errors;
+        try {
+            priceInstruments(instruments, threads_, npvs, errors);
+        } catch (...) {
+            for (Size k=0; k<dirty.size(); ++k)
+                trades_[dirty[k]]->dirty = true;
+            throw;
+        }
+
+        std::ostringstream failures;
+        Size failed = 0;
+        for (Size k=0; k<dirty.size(); ++k) {
+            Trade& trade = *trades_[dirty[k]];
+            if (!errors[k].empty()) {
+                trade.dirty = true;
+                if (failed++ == 0)
+                    failures << "instrument "
+                             << ObjectHandler::convert2<string>(
+                                    trade.instrument->propertyValue("OBJECTID"))
+                             << ": " << errors[k];
+                continue;
+            }
+            Real npv = trade.weight * npvs[k];
+            bucketTotals_[trade.bucket] += npv - trade.npv;
+            total_ += npv - trade.npv;
+            trade.npv = npv;
+        }
+        if (failed > 1)
+            failures << " (and " << failed-1 << " more failures)";
+        QL_REQUIRE(failed == 0, failures.str());
+    }
+
+    Real Portfolio::NPV() const {
+        refresh();
+        return total_;
+    }
+
+    vector<vector<property_t> > Portfolio::breakdown() const {
+        refresh();
+        vector<vector<property_t> > result(bucketKeys_.size());
+        for (Size b=0; b<bucketKeys_.size(); ++b) {
+            result[b].push_back(property_t(bucketKeys_[b]));
+            result[b].push_back(property_t(bucketTotals_[b]));
+        }
+        return result;
+    }
+
+    Size Portfolio::dirtyCount() const {
+        Size count = 0;
+        for (Size i=0; i<trades_.size(); ++i) {
+            trades_[i]->observeEngine();
+            if (trades_[i]->dirty)
+                ++count;
+        }
+        return count;
+    }
+
+}
@@ -0,0 +1,106 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+#ifndef qla_portfolio_hpp
+#define qla_portfolio_hpp
+
+#include <oh/object.hpp>
+#include <ql/types.hpp>
+
+#include <string>
+#include <vector>
+
+namespace QuantLibAddin {
+
+    class Instrument;
+
+    //! Prices the given instruments over a group of threads
+    /*! Pricing engines keep their arguments and results as state, so
+        each thread prices on its own copies of the engines, recreated
+        from their value objects; engines are identified through the
+        instrument properties set by qlInstrumentSetPricingEngine or by
+        the instrument constructor.  Instruments whose engine can't be
+        identified or copied are priced in sequence by one thread for
+        each engine, as are instruments sharing coupons or coupon
+        pricers, which also keep state while priced.
+
+        Lazy objects are not safe for concurrent recalculation, so the
+        shared dependencies are calculated in the calling thread before
+        the work is distributed: the term structures reachable from the
+        instruments through the object IDs in their properties (engines,
+        indexes, handles and so on) are queried once, which triggers
+        their bootstrap or calibration.  Term structures, quotes and
+        indexes are then only read by the threads.
+
+        Errors are reported per instrument: a failing instrument gets
+        a null NPV and a non-empty error string.  Instruments depending
+        on a term structure which fails to calculate are not priced and
+        get its error.
+    */
+    void priceInstruments(
+        const std::vector<boost::shared_ptr<Instrument> >& instruments,
+        QuantLib::Size threads,
+        std::vector<QuantLib::Real>& npvs,
+        std::vector<std::string>& errors);
+
+    //! NPVs of the given instruments, priced over the given number of threads
+    /*! Returns one row per instrument holding its NPV and an error
+        string, which is empty unless pricing failed; the NPV of a
+        failed instrument is left empty, i.e., #N/A, and the error is
+        logged.  The call itself does not fail because of a single
+        instrument.
+    */
+    std::vector<std::vector<ObjectHandler::property_t> > instrumentNPVBatch(
+        const std::vector<boost::shared_ptr<Instrument> >& instruments,
+        QuantLib::Size threads);
+
+    //! Weighted collection of instruments with incremental NPV aggregation
+    /*! Each instrument is observed individually, together with its
+        engine and coupons, and its NPV is cached.  On refresh only the instruments notified as changed since the
+        previous refresh are repriced, using priceInstruments(), and the
+        running totals by bucket are updated with the weighted changes.
+        Instruments failing to price keep their previous NPV and are
+        retried on the next refresh; the error is then reported.
+    */
+    class Portfolio : public ObjectHandler::Object {
+      public:
+        Portfolio(
+            const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
+            const std::vector<boost::shared_ptr<Instrument> >& instruments,
+            const std::vector<QuantLib::Real>& weights,
+            const std::vector<std::string>& buckets,
+            QuantLib::Size threads,
+            bool permanent);
+        //! weighted NPV of the whole portfolio
+        QuantLib::Real NPV() const;
+        //! bucket keys with the corresponding weighted NPVs
+        std::vector<std::vector<ObjectHandler::property_t> > breakdown() const;
+        //! number of instruments to be repriced at the next refresh
+        QuantLib::Size dirtyCount() const;
+      private:
+        class Trade;
+        void refresh() const;
+        std::vector<boost::shared_ptr<Trade> > trades_;
+        std::vector<std::string> bucketKeys_;
+        QuantLib::Size threads_;
+        mutable std::vector<QuantLib::Real> bucketTotals_;
+        mutable QuantLib::Real total_;
+    };
+
+}
+
+#endif
@@ -26,6 +26,8 @@
 #include <qlo/barrieroption.hpp>
 #include <qlo/baseinstruments.hpp>
 #include <qlo/bonds.hpp>
+#include <qlo/businessdaycalendar.hpp>
+#include <qlo/calibrationdiagnostics.hpp>
 #include <qlo/capfloor.hpp>
 #include <qlo/capletvolstructure.hpp>
 #include <qlo/cliquetoption.hpp>
@@ -34,6 +36,7 @@
 #include <qlo/couponvectors.hpp>
 #include <qlo/curvestate.hpp>
 #include <qlo/date.hpp>
+#include <qlo/decompositioncache.hpp>
 #include <qlo/dividendvanillaoption.hpp>
 #include <qlo/driftcalculators.hpp>
 #include <qlo/europeanoption.hpp>
@@ -52,6 +55,7 @@
 #include <qlo/optimization.hpp>
 #include <qlo/options.hpp>
 #include <qlo/payoffs.hpp>
+#include <qlo/portfolio.hpp>
 #include <qlo/pricingengines.hpp>
 #include <qlo/processes.hpp>
 #include <qlo/products.hpp>
@@ -79,6 +83,7 @@
 #include <qlo/vanillaswap.hpp>
 #include <qlo/vcconfig.hpp>
 #include <qlo/volatilities.hpp>
+#include <qlo/warmstart.hpp>
 #include <qlo/credit.hpp>
 
 #include <qlo/valueobjects/vo_all.hpp>
@@ -21,26 +21,132 @@
     #include <qlo/config.hpp>
 #endif
 #include <qlo/randomsequencegenerator.hpp>
+#include <ql/math/distributions/normaldistribution.hpp>
+
+#include <boost/algorithm/string/case_conv.hpp>
+#include <boost/thread/mutex.hpp>
 
 namespace QuantLibAddin {
 
+    namespace {
+
+        /* Inverse cumulative normal of a block of uniforms, in place.
+           The central region uses the rational approximation of
+           QuantLib::InverseCumulativeNormal with the same coefficients
+           and evaluation order, in a branch-free loop; the few points
+           in the tails are delegated to the library class afterwards.
+           Results are identical to the point-wise transform. */
+        void inverseCumulativeNormal(QuantLib::Real* begin,
+                                     QuantLib::Real* end) {
+            static const QuantLib::Real a1 = -3.969683028665376e+01;
+            static const QuantLib::Real a2 =  2.209460984245205e+02;
+            static const QuantLib::Real a3 = -2.759285104469687e+02;
+            static const QuantLib::Real a4 =  1.383577518672690e+02;
+            static const QuantLib::Real a5 = -3.066479806614716e+01;
+            static const QuantLib::Real a6 =  2.506628277459239e+00;
+            static const QuantLib::Real b1 = -5.447609879822406e+01;
+            static const QuantLib::Real b2 =  1.615858368580409e+02;
+            static const QuantLib::Real b3 = -1.556989798598866e+02;
+            static const QuantLib::Real b4 =  6.680131188771972e+01;
+            static const QuantLib::Real b5 = -1.328068155288572e+01;
+            static const QuantLib::Real xLow = 0.02425;
+            static const QuantLib::Real xHigh = 1.0 - xLow;
+
+            std::vector<std::pair<QuantLib::Real*, QuantLib::Real> > tails;
+            for (QuantLib::Real* x = begin; x != end; ++x)
+                if (*x < xLow || *x > xHigh)
+                    tails.push_back(std::make_pair(x, *x));
+
+            for (QuantLib::Real* x = begin; x != end; ++x) {
+                QuantLib::Real z = *x - 0.5;
+                QuantLib::Real r = z*z;
+                *x = (((((a1*r+a2)*r+a3)*r+a4)*r+a5)*r+a6)*z /
+                     (((((b1*r+b2)*r+b3)*r+b4)*r+b5)*r+1.0);
+            }
+
+            QuantLib::InverseCumulativeNormal icn;
+            for (QuantLib::Size i=0; i<tails.size(); ++i)
+                *tails[i].first = icn(tails[i].second);
+        }
+
+    }
+
     static QuantLib::MersenneTwisterUniformRng rng_;
+    static boost::mutex rngMutex_;
 
     QuantLib::Real rand() {
+        boost::mutex::scoped_lock lock(rngMutex_);
         return rng_.next().value;
     }
 
     void randomize(QuantLib::BigNatural seed) {
+        boost::mutex::scoped_lock lock(rngMutex_);
         rng_ = QuantLib::MersenneTwisterUniformRng(seed);
     }
 
-    std::vector<std::vector<double> >
-    RandomSequenceGenerator::variates(long samples)
+    PhiloxUniformRng::PhiloxUniformRng(QuantLib::BigNatural seed,
+                                       QuantLib::BigNatural stream)
+    : index_(4) {
+        boost::uint64_t k = seed, s = stream;
+        key_[0] = boost::uint32_t(k);
+        key_[1] = boost::uint32_t(k >> 32);
+        counter_[0] = counter_[1] = 0;
+        counter_[2] = boost::uint32_t(s);
+        counter_[3] = boost::uint32_t(s >> 32);
+    }
+
+    void PhiloxUniformRng::generate() const {
+        static const boost::uint32_t m0 = 0xD2511F53, m1 = 0xCD9E8D57;
+        static const boost::uint32_t w0 = 0x9E3779B9, w1 = 0xBB67AE85;
+        boost::uint32_t c0 = counter_[0], c1 = counter_[1],
+                        c2 = counter_[2], c3 = counter_[3];
+        boost::uint32_t k0 = key_[0], k1 = key_[1];
+        for (QuantLib::Size round=0; round<10; ++round) {
+            boost::uint64_t p0 = boost::uint64_t(m0) * c0;
+            boost::uint64_t p1 = boost::uint64_t(m1) * c2;
+            c0 = boost::uint32_t(p1 >> 32) ^ c1 ^ k0;
+            c1 = boost::uint32_t(p1);
+            c2 = boost::uint32_t(p0 >> 32) ^ c3 ^ k1;
+            c3 = boost::uint32_t(p0);
+            k0 += w0;
+            k1 += w1;
+        }
+        block_[0] = c0;
+        block_[1] = c1;
+        block_[2] = c2;
+        block_[3] = c3;
+        index_ = 0;
+        if (++counter_[0] == 0)
+            ++counter_[1];
+    }
+
+    void PhiloxUniformRng::discard(boost::uint64_t n) {
+        // draws left in the current block
+        boost::uint64_t available = 4 - index_;
+        if (n < available) {
+            index_ += QuantLib::Size(n);
+            return;
+        }
+        n -= available;
+        boost::uint64_t position =
+            ((boost::uint64_t(counter_[1]) << 32) | counter_[0]) + n/4;
+        counter_[0] = boost::uint32_t(position);
+        counter_[1] = boost::uint32_t(position >> 32);
+        index_ = 4;
+        if (n % 4 != 0) {
+            generate();
+            index_ = QuantLib::Size(n % 4);
+        }
+    }
+
+    QuantLib::Matrix
+    RandomSequenceGenerator::variates(long samples, bool gaussian) const
     {
-        std::vector<std::vector<double> > rtn;
-        rtn.reserve(samples);
-        for (long i=0 ; i < samples ; ++i)
-            rtn.push_back(nextSequence());
+        QL_REQUIRE(samples >= 0, "negative number of samples: " << samples);
+        QuantLib::Matrix rtn(samples, dimension());
+        nextSequences(samples, rtn.begin());
+        if (gaussian)
+            inverseCumulativeNormal(rtn.begin(), rtn.end());
         return rtn;
     }
 
@@ -51,6 +157,14 @@ namespace QuantLibAddin {
             bool permanent)
     : PseudoRandomSequenceGenerator<urng_type>(properties, dimension, urng_type(seed), permanent) {}
 
+    PhiloxRsg::PhiloxRsg(
+            const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
+            long dimension,
+            long seed,
+            long stream,
+            bool permanent)
+    : PseudoRandomSequenceGenerator<urng_type>(properties, dimension, urng_type(seed, stream), permanent) {}
+
     // QuantLib::FaureRsg does not work for dimension = 0
     FaureRsg::FaureRsg(
             const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
@@ -72,5 +186,65 @@ namespace QuantLibAddin {
             bool permanent)
     : LowDiscrepancySequenceGenerator<rsg_type>(properties, rsg_type(dimension, seed), permanent) {}
 
-}
+    RandomStreamFactory::RandomStreamFactory(
+            const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
+            const std::string& generatorType,
+            long dimension,
+            long seed,
+            long streamLength,
+            bool permanent)
+    : ObjectHandler::Object(properties, permanent),
+      dimension_(dimension), seed_(seed), streamLength_(streamLength) {
+        std::string type = boost::algorithm::to_upper_copy(generatorType);
+        QL_REQUIRE(type == "PHILOX" || type == "SOBOL",
+                   "unknown generator type: " << generatorType
+                   << " (Philox or Sobol expected)");
+        sobol_ = (type == "SOBOL");
+        QL_REQUIRE(dimension > 0, "non-positive dimension: " << dimension);
+        QL_REQUIRE(seed >= 0, "negative seed: " << seed);
+        QL_REQUIRE(streamLength >= 0,
+                   "negative stream length: " << streamLength);
+        QL_REQUIRE(!sobol_ || streamLength > 0,
+                   "null stream length for Sobol streams");
+    }
+
+    PhiloxUniformRng RandomStreamFactory::uniformStream(QuantLib::Size i) const {
+        return PhiloxUniformRng(seed_, i);
+    }
+
+    QuantLib::SobolRsg RandomStreamFactory::sobolStream(QuantLib::Size i) const {
+        QL_REQUIRE(streamLength_ > 0, "null stream length");
+        // Sobol sequences are limited to 2^32 points
+        QL_REQUIRE(i < 4294967296.0/streamLength_ - 1.0,
+                   "stream " << i << " beyond the end of the Sobol sequence");
+        QuantLib::SobolRsg rsg(dimension_, seed_);
+        if (i > 0)
+            rsg.skipTo(boost::uint32_t(i*streamLength_));
+        return rsg;
+    }
 
+    QuantLib::Matrix RandomStreamFactory::variates(QuantLib::Size stream,
+                                                   QuantLib::Size samples,
+                                                   bool gaussian) const {
+        QuantLib::Matrix rtn(samples, dimension_);
+        if (sobol_) {
+            QL_REQUIRE(samples <= streamLength_,
+                       samples << " samples requested from streams of "
+                       << streamLength_ << " points");
+            QuantLib::SobolRsg rsg = sobolStream(stream);
+            for (QuantLib::Size i=0; i<samples; ++i) {
+                const std::vector<QuantLib::Real>& sequence =
+                    rsg.nextSequence().value;
+                std::copy(sequence.begin(), sequence.end(), rtn.row_begin(i));
+            }
+        } else {
+            PhiloxUniformRng rng = uniformStream(stream);
+            for (QuantLib::Matrix::iterator x = rtn.begin(); x != rtn.end(); ++x)
+                *x = rng.nextReal();
+        }
+        if (gaussian)
+            inverseCumulativeNormal(rtn.begin(), rtn.end());
+        return rtn;
+    }
+
+}
@@ -28,6 +28,12 @@
 #include <ql/math/randomnumbers/mt19937uniformrng.hpp>
 #include <ql/math/randomnumbers/sobolrsg.hpp>
 #include <ql/math/randomnumbers/haltonrsg.hpp>
+#include <ql/math/matrix.hpp>
+
+#include <boost/cstdint.hpp>
+
+#include <algorithm>
+#include <string>
 
 #include <vector>
 
@@ -37,10 +43,59 @@ namespace QuantLibAddin {
     QuantLib::Real rand();
     void randomize(QuantLib::BigNatural seed);
 
+    //! Counter-based uniform random number generator
+    /*! Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy
+        as 1, 2, 3", SC11).  The n-th draw of a stream is a function of
+        the seed, the stream number and n only, so that any number of
+        non-overlapping streams can be generated concurrently and any
+        draw can be reached in constant time.  Each stream has 2^66
+        draws.
+
+        The interface is the one of QuantLib::MersenneTwisterUniformRng,
+        so that the class can be used with the QuantLib sequence
+        generators.
+    */
+    class PhiloxUniformRng {
+      public:
+        typedef QuantLib::Sample<QuantLib::Real> sample_type;
+        explicit PhiloxUniformRng(QuantLib::BigNatural seed = 0,
+                                  QuantLib::BigNatural stream = 0);
+        //! returns a sample with weight 1.0 containing a random number in (0,1)
+        sample_type next() const { return sample_type(nextReal(), 1.0); }
+        //! return a random number in the (0.0, 1.0)-interval
+        QuantLib::Real nextReal() const {
+            return (QuantLib::Real(nextInt32()) + 0.5)/4294967296.0;
+        }
+        //! return a random integer in the [0,0xffffffff]-interval
+        QuantLib::BigNatural nextInt32() const {
+            if (index_ == 4)
+                generate();
+            return block_[index_++];
+        }
+        //! skips the given number of draws
+        void discard(boost::uint64_t n);
+      private:
+        void generate() const;
+        boost::uint32_t key_[2];
+        // position within the stream in words 0-1, stream in words 2-3
+        mutable boost::uint32_t counter_[4];
+        mutable boost::uint32_t block_[4];
+        mutable QuantLib::Size index_;
+    };
+
     class RandomSequenceGenerator : public ObjectHandler::Object {
       public:
-        std::vector<std::vector<double> > variates(long samples);
+        //! next samples, one per row
+        /*! The variates are generated in a single contiguous buffer;
+            if gaussian is true, they are mapped through the inverse
+            cumulative normal in one pass over the whole block.
+        */
+        QuantLib::Matrix variates(long samples, bool gaussian = false) const;
         virtual std::vector<double> nextSequence() const = 0;
+        //! writes the next samples to out, one after the other
+        virtual void nextSequences(QuantLib::Size samples,
+                                   QuantLib::Real* out) const = 0;
+        virtual QuantLib::Size dimension() const = 0;
       protected:
         OH_OBJ_CTOR(RandomSequenceGenerator, ObjectHandler::Object);
     };
@@ -62,6 +117,20 @@ namespace QuantLibAddin {
             return ursg_.nextSequence().value;
         }
 
+        virtual void nextSequences(QuantLib::Size samples,
+                                   QuantLib::Real* out) const {
+            QuantLib::Size n = ursg_.dimension();
+            for (QuantLib::Size i=0; i<samples; ++i, out += n) {
+                const std::vector<QuantLib::Real>& sequence =
+                    ursg_.nextSequence().value;
+                std::copy(sequence.begin(), sequence.end(), out);
+            }
+        }
+
+        virtual QuantLib::Size dimension() const {
+            return ursg_.dimension();
+        }
+
       private:
         typename QuantLib::GenericPseudoRandom<URNG, QuantLib::InverseCumulativeNormal>::ursg_type ursg_;
     };
@@ -77,6 +146,18 @@ namespace QuantLibAddin {
             bool permanent);
     };
 
+    class PhiloxRsg : public PseudoRandomSequenceGenerator<PhiloxUniformRng> {
+      public:
+        typedef PhiloxUniformRng urng_type;
+
+        PhiloxRsg(
+            const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
+            long dimension,
+            long seed,
+            long stream,
+            bool permanent);
+    };
+
     // Low Discrepancy Sequences
 
     template <class URSG>
@@ -92,6 +173,20 @@ namespace QuantLibAddin {
             return ursg_.nextSequence().value;
         }
 
+        virtual void nextSequences(QuantLib::Size samples,
+                                   QuantLib::Real* out) const {
+            QuantLib::Size n = ursg_.dimension();
+            for (QuantLib::Size i=0; i<samples; ++i, out += n) {
+                const std::vector<QuantLib::Real>& sequence =
+                    ursg_.nextSequence().value;
+                std::copy(sequence.begin(), sequence.end(), out);
+            }
+        }
+
+        virtual QuantLib::Size dimension() const {
+            return ursg_.dimension();
+        }
+
       private:
         typename QuantLib::GenericLowDiscrepancy<URSG, QuantLib::InverseCumulativeNormal>::ursg_type ursg_;
     };
@@ -125,6 +220,47 @@ namespace QuantLibAddin {
             bool permanent);
     };
 
+    // Independent streams
+
+    //! Factory of independent, reproducible random sequence streams
+    /*! Stream i is fully determined by the factory parameters and by i,
+        so that a Monte Carlo simulation whose paths are split into
+        streams by path index (rather than by thread) gives the same
+        results with any number of threads.
+
+        Pseudo-random streams use PhiloxUniformRng with stream number i
+        and do not overlap.  Sobol streams are consecutive blocks of
+        streamLength points of the same sequence, the i-th one starting
+        at point i*streamLength; using streams 0,...,n-1 is therefore
+        equivalent to drawing the first n*streamLength points.
+    */
+    class RandomStreamFactory : public ObjectHandler::Object {
+      public:
+        RandomStreamFactory(
+            const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
+            const std::string& generatorType,
+            long dimension,
+            long seed,
+            long streamLength,
+            bool permanent);
+        bool lowDiscrepancy() const { return sobol_; }
+        QuantLib::Size dimension() const { return dimension_; }
+        QuantLib::Size streamLength() const { return streamLength_; }
+        //! uniform generator of the i-th pseudo-random stream
+        PhiloxUniformRng uniformStream(QuantLib::Size i) const;
+        //! Sobol generator positioned at the start of the i-th stream
+        QuantLib::SobolRsg sobolStream(QuantLib::Size i) const;
+        //! first samples of the i-th stream, one per row
+        QuantLib::Matrix variates(QuantLib::Size stream,
+                                  QuantLib::Size samples,
+                                  bool gaussian = false) const;
+      private:
+        bool sobol_;
+        QuantLib::Size dimension_;
+        QuantLib::BigNatural seed_;
+        QuantLib::Size streamLength_;
+    };
+
 }
 
 #endif
@@ -22,17 +22,115 @@
     #include <qlo/config.hpp>
 #endif
 #include <qlo/sequencestatistics.hpp>
+#include <qlo/parallel.hpp>
 #include <ql/math/statistics/sequencestatistics.hpp>
 
+#include <algorithm>
+#include <cmath>
+
 namespace QuantLibAddin {
 
+    namespace {
+
+        // square tiles of the second-order sums; 64x64 accumulators
+        // fit in the L1 cache together with a few rows of samples
+        const QuantLib::Size tileSize = 64;
+
+        class QuadraticSumTiles {
+          public:
+            QuadraticSumTiles(const QuantLib::Matrix& values,
+                              const std::vector<QuantLib::Real>& weights,
+                              QuantLib::Matrix& quadraticSum)
+            : values_(values), weights_(weights), sum_(quadraticSum),
+              tiles_((values.columns()+tileSize-1)/tileSize) {}
+            // number of tiles in the upper triangle
+            QuantLib::Size size() const { return tiles_*(tiles_+1)/2; }
+            void operator()(QuantLib::Size t) {
+                // tile t is (ti,tj), ti <= tj, in row-major order
+                QuantLib::Size ti = 0, rowLength = tiles_;
+                while (t >= rowLength) {
+                    t -= rowLength;
+                    --rowLength;
+                    ++ti;
+                }
+                QuantLib::Size tj = ti + t;
+                QuantLib::Size n = values_.columns();
+                QuantLib::Size i0 = ti*tileSize,
+                               i1 = std::min(i0+tileSize, n);
+                QuantLib::Size j0 = tj*tileSize,
+                               j1 = std::min(j0+tileSize, n);
+                QuantLib::Size width = j1-j0;
+
+                // symmetric rank-k update of the tile, one sample at a
+                // time; the inner loop runs over contiguous memory
+                std::vector<QuantLib::Real> acc((i1-i0)*width, 0.0);
+                for (QuantLib::Size k=0; k<values_.rows(); ++k) {
+                    QuantLib::Real w = weights_.empty() ? 1.0 : weights_[k];
+                    const QuantLib::Real* x = values_.row_begin(k);
+                    const QuantLib::Real* xj = x + j0;
+                    for (QuantLib::Size i=i0; i<i1; ++i) {
+                        QuantLib::Real a = w*x[i];
+                        QuantLib::Real* row = &acc[(i-i0)*width];
+                        for (QuantLib::Size j=0; j<width; ++j)
+                            row[j] += a*xj[j];
+                    }
+                }
+
+                for (QuantLib::Size i=i0; i<i1; ++i) {
+                    const QuantLib::Real* row = &acc[(i-i0)*width];
+                    for (QuantLib::Size j=j0; j<j1; ++j) {
+                        sum_[i][j] += row[j-j0];
+                        if (ti != tj)
+                            sum_[j][i] += row[j-j0];
+                    }
+                }
+            }
+          private:
+            const QuantLib::Matrix& values_;
+            const std::vector<QuantLib::Real>& weights_;
+            QuantLib::Matrix& sum_;
+            QuantLib::Size tiles_;
+        };
+
+    }
+
+    void BlockSequenceStatistics::addBlock(
+                                    const QuantLib::Matrix& values,
+                                    const std::vector<QuantLib::Real>& weights,
+                                    QuantLib::Size threads) {
+        QL_REQUIRE(weights.empty() || values.rows()==weights.size(),
+                   "Mismatch between number of samples (" <<
+                   values.rows() << ") and number of weights (" <<
+                   weights.size() << ")");
+        if (values.rows() == 0)
+            return;
+        if (dimension_ == 0)
+            reset(values.columns());
+        QL_REQUIRE(values.columns() == dimension_,
+                   "sample size mismatch: " << dimension_ <<
+                   " required, " << values.columns() << " provided");
+
+        for (QuantLib::Size i=0; i<dimension_; ++i) {
+            if (weights.empty()) {
+                for (QuantLib::Size k=0; k<values.rows(); ++k)
+                    stats_[i].add(values[k][i]);
+            } else {
+                for (QuantLib::Size k=0; k<values.rows(); ++k)
+                    stats_[i].add(values[k][i], weights[k]);
+            }
+        }
+
+        QuadraticSumTiles tiles(values, weights, quadraticSum_);
+        parallelFor(tiles.size(), threads, tiles);
+    }
+
     SequenceStatistics::SequenceStatistics(
             const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
             QuantLib::Size dimension,
             bool permanent)
     : ObjectHandler::LibraryObject<QuantLib::SequenceStatistics>(properties, permanent) {
         libraryObject_ = boost::shared_ptr<QuantLib::SequenceStatistics>(new
-            QuantLib::SequenceStatistics(dimension));
+            BlockSequenceStatistics(dimension));
     }
 
     SequenceStatistics::SequenceStatistics(
@@ -40,30 +138,14 @@ namespace QuantLibAddin {
             QuantLib::Size dimension,
             const QuantLib::Matrix& values, 
             const std::vector<QuantLib::Real>& w,
+            QuantLib::Size threads,
             bool permanent)
     : ObjectHandler::LibraryObject<QuantLib::SequenceStatistics>(properties, permanent)
     {
-        libraryObject_ = boost::shared_ptr<QuantLib::SequenceStatistics>(new
-            QuantLib::SequenceStatistics(dimension));
-
-        QL_REQUIRE(w.empty() || values.rows()==w.size(),
-                   "Mismatch between number of samples (" <<
-                   values.rows() << ") and number of weights (" <<
-                   w.size() << ")");
-
-        if (values.rows()>0) {
-            if (!w.empty()) {
-                for (QuantLib::Size i=0; i<values.rows(); ++i)
-                    libraryObject_->add(values.row_begin(i),
-                                        values.row_end(i),
-                                        w[i]);
-            } else {
-                for (QuantLib::Size i=0; i<values.rows(); ++i)
-                    libraryObject_->add(values.row_begin(i),
-                                        values.row_end(i));
-            }
-        }
-
+        boost::shared_ptr<BlockSequenceStatistics> stats(new
+            BlockSequenceStatistics(dimension));
+        stats->addBlock(values, w, threads);
+        libraryObject_ = stats;
     }
 
     SequenceStatisticsInc::SequenceStatisticsInc(
@@ -106,4 +188,233 @@ namespace QuantLibAddin {
 
     }
 
+    SequenceMoments::SequenceMoments(QuantLib::Size dimension)
+    : samples_(0), weightSum_(0.0), mean_(dimension, 0.0),
+      min_(dimension, QL_MAX_REAL), max_(dimension, QL_MIN_REAL),
+      m2_(dimension, dimension, 0.0) {}
+
+    template <class S>
+    void SequenceMoments::setSequenceMoments(const S& stats) {
+        samples_ = stats.samples();
+        weightSum_ = stats.weightSum();
+        mean_ = std::vector<QuantLib::Real>(stats.size(), 0.0);
+        min_ = std::vector<QuantLib::Real>(stats.size(), QL_MAX_REAL);
+        max_ = std::vector<QuantLib::Real>(stats.size(), QL_MIN_REAL);
+        m2_ = QuantLib::Matrix(stats.size(), stats.size(), 0.0);
+        if (samples_ == 0)
+            return;
+        min_ = stats.min();
+        max_ = stats.max();
+        if (weightSum_ > 0.0) {
+            mean_ = stats.mean();
+            // the covariance carries the n/(n-1) correction
+            if (samples_ > 1)
+                m2_ = stats.covariance() *
+                    (weightSum_ * (samples_-1.0)/samples_);
+        }
+    }
+
+    template <class S>
+    void SequenceMoments::setMoments(const S& stats) {
+        samples_ = stats.samples();
+        weightSum_ = stats.weightSum();
+        mean_ = std::vector<QuantLib::Real>(1, 0.0);
+        min_ = std::vector<QuantLib::Real>(1, QL_MAX_REAL);
+        max_ = std::vector<QuantLib::Real>(1, QL_MIN_REAL);
+        m2_ = QuantLib::Matrix(1, 1, 0.0);
+        if (samples_ == 0)
+            return;
+        min_[0] = stats.min();
+        max_[0] = stats.max();
+        if (weightSum_ > 0.0) {
+            mean_[0] = stats.mean();
+            if (samples_ > 1)
+                m2_[0][0] = stats.variance() *
+                    (weightSum_ * (samples_-1.0)/samples_);
+        }
+    }
+
+    SequenceMoments::SequenceMoments(const QuantLib::SequenceStatistics& stats) {
+        setSequenceMoments(stats);
+    }
+
+    SequenceMoments::SequenceMoments(
+                                const QuantLib::SequenceStatisticsInc& stats) {
+        setSequenceMoments(stats);
+    }
+
+    SequenceMoments::SequenceMoments(const QuantLib::Statistics& stats) {
+        setMoments(stats);
+    }
+
+    SequenceMoments::SequenceMoments(
+                                const QuantLib::IncrementalStatistics& stats) {
+        setMoments(stats);
+    }
+
+    std::vector<QuantLib::Real> SequenceMoments::mean() const {
+        QL_REQUIRE(weightSum_ > 0.0,
+                   "sampleWeight_= 0, unsufficient");
+        return mean_;
+    }
+
+    std::vector<QuantLib::Real> SequenceMoments::variance() const {
+        QL_REQUIRE(weightSum_ > 0.0,
+                   "sampleWeight_= 0, unsufficient");
+        QL_REQUIRE(samples_ > 1,
+                   "sample number <= 1, unsufficient");
+        std::vector<QuantLib::Real> result(size());
+        for (QuantLib::Size i=0; i<size(); ++i)
+            result[i] = m2_[i][i]/weightSum_ * samples_/(samples_-1.0);
+        return result;
+    }
+
+    std::vector<QuantLib::Real> SequenceMoments::standardDeviation() const {
+        std::vector<QuantLib::Real> result = variance();
+        for (QuantLib::Size i=0; i<result.size(); ++i)
+            result[i] = std::sqrt(result[i]);
+        return result;
+    }
+
+    std::vector<QuantLib::Real> SequenceMoments::errorEstimate() const {
+        std::vector<QuantLib::Real> result = variance();
+        for (QuantLib::Size i=0; i<result.size(); ++i)
+            result[i] = std::sqrt(result[i]/samples_);
+        return result;
+    }
+
+    std::vector<QuantLib::Real> SequenceMoments::min() const {
+        QL_REQUIRE(samples_ > 0, "empty sample set");
+        return min_;
+    }
+
+    std::vector<QuantLib::Real> SequenceMoments::max() const {
+        QL_REQUIRE(samples_ > 0, "empty sample set");
+        return max_;
+    }
+
+    QuantLib::Matrix SequenceMoments::covariance() const {
+        QL_REQUIRE(weightSum_ > 0.0,
+                   "sampleWeight_= 0, unsufficient");
+        QL_REQUIRE(samples_ > 1,
+                   "sample number <= 1, unsufficient");
+        return m2_ * (samples_/((samples_-1.0)*weightSum_));
+    }
+
+    QuantLib::Matrix SequenceMoments::correlation() const {
+        // same conventions as QuantLib::SequenceStatistics
+        QuantLib::Matrix correlation = covariance();
+        std::vector<QuantLib::Real> variances(size());
+        for (QuantLib::Size i=0; i<size(); ++i)
+            variances[i] = correlation[i][i];
+        for (QuantLib::Size i=0; i<size(); ++i) {
+            for (QuantLib::Size j=0; j<size(); ++j) {
+                if (variances[i] == 0.0 && variances[j] == 0.0)
+                    correlation[i][j] = 1.0;
+                else if (variances[i] == 0.0 || variances[j] == 0.0)
+                    correlation[i][j] = 0.0;
+                else
+                    correlation[i][j] /=
+                        std::sqrt(variances[i]*variances[j]);
+            }
+        }
+        return correlation;
+    }
+
+    void SequenceMoments::merge(const SequenceMoments& other) {
+        if (other.samples_ == 0)
+            return;
+        if (samples_ == 0 && size() != other.size()) {
+            *this = other;
+            return;
+        }
+        QL_REQUIRE(size() == other.size(),
+                   "Mismatch between dimensions (" << size()
+                   << " and " << other.size() << ")");
+
+        QuantLib::Real weightSum = weightSum_ + other.weightSum_;
+        if (weightSum > 0.0) {
+            // deviations are taken before updating, as other could be
+            // *this; the cross term vanishes if either weight is null
+            std::vector<QuantLib::Real> delta(size());
+            for (QuantLib::Size i=0; i<size(); ++i)
+                delta[i] = other.mean_[i] - mean_[i];
+            QuantLib::Real f = weightSum_*other.weightSum_/weightSum;
+            QuantLib::Real r = other.weightSum_/weightSum;
+            for (QuantLib::Size i=0; i<size(); ++i)
+                for (QuantLib::Size j=0; j<size(); ++j)
+                    m2_[i][j] += other.m2_[i][j] + f*delta[i]*delta[j];
+            for (QuantLib::Size i=0; i<size(); ++i)
+                mean_[i] += r*delta[i];
+        }
+        for (QuantLib::Size i=0; i<size(); ++i) {
+            min_[i] = std::min(min_[i], other.min_[i]);
+            max_[i] = std::max(max_[i], other.max_[i]);
+        }
+        weightSum_ = weightSum;
+        samples_ += other.samples_;
+    }
+
+    MomentStatistics::MomentStatistics(
+            const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
+            const std::vector<boost::shared_ptr<QuantLib::SequenceStatistics> >&
+                                                                   statistics,
+            bool permanent)
+    : ObjectHandler::LibraryObject<SequenceMoments>(properties, permanent) {
+        libraryObject_ = boost::shared_ptr<SequenceMoments>(
+                                                        new SequenceMoments);
+        for (QuantLib::Size i=0; i<statistics.size(); ++i)
+            libraryObject_->merge(SequenceMoments(*statistics[i]));
+    }
+
+    MomentStatistics::MomentStatistics(
+            const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
+            const std::vector<boost::shared_ptr<QuantLib::SequenceStatisticsInc> >&
+                                                                   statistics,
+            bool permanent)
+    : ObjectHandler::LibraryObject<SequenceMoments>(properties, permanent) {
+        libraryObject_ = boost::shared_ptr<SequenceMoments>(
+                                                        new SequenceMoments);
+        for (QuantLib::Size i=0; i<statistics.size(); ++i)
+            libraryObject_->merge(SequenceMoments(*statistics[i]));
+    }
+
+    MomentStatistics::MomentStatistics(
+            const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
+            const std::vector<boost::shared_ptr<QuantLib::IncrementalStatistics> >&
+                                                                   statistics,
+            bool permanent)
+    : ObjectHandler::LibraryObject<SequenceMoments>(properties, permanent) {
+        libraryObject_ = boost::shared_ptr<SequenceMoments>(
+                                                        new SequenceMoments);
+        for (QuantLib::Size i=0; i<statistics.size(); ++i)
+            libraryObject_->merge(SequenceMoments(*statistics[i]));
+    }
+
+    MomentStatistics::MomentStatistics(
+            const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
+            const std::vector<boost::shared_ptr<QuantLib::Statistics> >&
+                                                                   statistics,
+            bool permanent)
+    : ObjectHandler::LibraryObject<SequenceMoments>(properties, permanent) {
+        libraryObject_ = boost::shared_ptr<SequenceMoments>(
+                                                        new SequenceMoments);
+        for (QuantLib::Size i=0; i<statistics.size(); ++i)
+            libraryObject_->merge(SequenceMoments(*statistics[i]));
+    }
+
+    MomentStatistics::MomentStatistics(
+            const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
+            const std::vector<boost::shared_ptr<MomentStatistics> >& moments,
+            bool permanent)
+    : ObjectHandler::LibraryObject<SequenceMoments>(properties, permanent) {
+        libraryObject_ = boost::shared_ptr<SequenceMoments>(
+                                                        new SequenceMoments);
+        for (QuantLib::Size i=0; i<moments.size(); ++i) {
+            boost::shared_ptr<SequenceMoments> m;
+            moments[i]->getLibraryObject(m);
+            libraryObject_->merge(*m);
+        }
+    }
+
 }
@@ -23,34 +23,30 @@
 
 #include <oh/libraryobject.hpp>
 #include <ql/types.hpp>
-
-namespace QuantLib {
-    class Matrix;
-
-    class GeneralStatistics;
-
-    template<class Stat>
-    class GenericGaussianStatistics;
-
-    typedef GenericGaussianStatistics<GeneralStatistics> GaussianStatistics;
-
-    template <class S>
-    class GenericRiskStatistics;
-
-    typedef GenericRiskStatistics<GaussianStatistics> RiskStatistics;
-
-    typedef RiskStatistics Statistics;
-    class IncrementalStatistics;
-
-    template <class StatisticsType>
-    class GenericSequenceStatistics;
-
-    typedef GenericSequenceStatistics<Statistics> SequenceStatistics;
-    typedef GenericSequenceStatistics<IncrementalStatistics> SequenceStatisticsInc;
-}
+#include <ql/math/statistics/sequencestatistics.hpp>
 
 namespace QuantLibAddin {
 
+    //! sequence statistics which can add blocks of samples
+    class BlockSequenceStatistics : public QuantLib::SequenceStatistics {
+      public:
+        explicit BlockSequenceStatistics(QuantLib::Size dimension = 0)
+        : QuantLib::SequenceStatistics(dimension) {}
+        //! adds the samples held in the rows of the given matrix
+        /*! Equivalent to adding the rows one at a time, up to rounding.
+            The second-order sums are updated with one symmetric rank-k
+            update per block of samples, computed by square tiles small
+            enough to stay in cache; the tiles are distributed over the
+            given number of threads.  Each element is always summed in
+            sample order, so that the results do not depend on the
+            number of threads.
+        */
+        void addBlock(const QuantLib::Matrix& values,
+                      const std::vector<QuantLib::Real>& weights =
+                                               std::vector<QuantLib::Real>(),
+                      QuantLib::Size threads = 1);
+    };
+
     class SequenceStatistics : 
         public ObjectHandler::LibraryObject<QuantLib::SequenceStatistics> {
     public:
@@ -63,6 +59,7 @@ namespace QuantLibAddin {
             QuantLib::Size dimension,
             const QuantLib::Matrix& values, 
             const std::vector<QuantLib::Real>& weights,
+            QuantLib::Size threads,
             bool permanent);
     };
 
@@ -81,6 +78,118 @@ namespace QuantLibAddin {
             bool permanent);
     };
 
+    //! Moments of sequence data, kept as sums which can be merged
+    /*! Holds the number of samples, the weight sum and the weighted
+        mean of each component, the weighted sums of the products of
+        the deviations from the means, and the minimum and maximum of
+        each component.  Two sets of sums are combined as in Chan,
+        Golub and LeVeque, "Algorithms for computing the sample
+        variance", in time independent of the number of samples behind
+        them.  The samples are not kept, so that no percentiles are
+        available; the estimators are those of
+        QuantLib::SequenceStatistics.  Moments can be taken from both
+        the sample-keeping and the incremental QuantLib statistics.
+    */
+    class SequenceMoments {
+      public:
+        explicit SequenceMoments(QuantLib::Size dimension = 0);
+        //! moments of the samples held by the given statistics
+        explicit SequenceMoments(const QuantLib::SequenceStatistics& stats);
+        //! moments of the samples summarized by the given statistics
+        explicit SequenceMoments(const QuantLib::SequenceStatisticsInc& stats);
+        //! moments of the samples held by the given statistics
+        explicit SequenceMoments(const QuantLib::Statistics& stats);
+        //! moments of the samples summarized by the given statistics
+        explicit SequenceMoments(const QuantLib::IncrementalStatistics& stats);
+        //! \name Inspectors
+        //@{
+        QuantLib::Size size() const { return mean_.size(); }
+        QuantLib::Size samples() const { return samples_; }
+        QuantLib::Real weightSum() const { return weightSum_; }
+        std::vector<QuantLib::Real> mean() const;
+        std::vector<QuantLib::Real> variance() const;
+        std::vector<QuantLib::Real> standardDeviation() const;
+        std::vector<QuantLib::Real> errorEstimate() const;
+        std::vector<QuantLib::Real> min() const;
+        std::vector<QuantLib::Real> max() const;
+        QuantLib::Matrix covariance() const;
+        QuantLib::Matrix correlation() const;
+        //@}
+        //! adds the moments of another set of samples
+        void merge(const SequenceMoments& other);
+      private:
+        template <class S>
+        void setSequenceMoments(const S& stats);
+        template <class S>
+        void setMoments(const S& stats);
+        QuantLib::Size samples_;
+        QuantLib::Real weightSum_;
+        std::vector<QuantLib::Real> mean_, min_, max_;
+        QuantLib::Matrix m2_;
+    };
+
+    class MomentStatistics :
+        public ObjectHandler::LibraryObject<SequenceMoments> {
+    public:
+        //! moments of the union of the samples of the given objects
+        MomentStatistics(
+            const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
+            const std::vector<boost::shared_ptr<QuantLib::SequenceStatistics> >&
+                                                                   statistics,
+            bool permanent);
+        //! moments of the union of the samples of the given objects
+        MomentStatistics(
+            const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
+            const std::vector<boost::shared_ptr<QuantLib::SequenceStatisticsInc> >&
+                                                                   statistics,
+            bool permanent);
+        //! moments of the union of the samples of the given objects
+        MomentStatistics(
+            const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
+            const std::vector<boost::shared_ptr<QuantLib::Statistics> >&
+                                                                   statistics,
+            bool permanent);
+        //! moments of the union of the samples of the given objects
+        MomentStatistics(
+            const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
+            const std::vector<boost::shared_ptr<QuantLib::IncrementalStatistics> >&
+                                                                   statistics,
+            bool permanent);
+        //! moments of the union of the samples behind the given objects
+        MomentStatistics(
+            const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
+            const std::vector<boost::shared_ptr<MomentStatistics> >& moments,
+            bool permanent);
+        QuantLib::Size samples() const { return libraryObject_->samples(); }
+        QuantLib::Real weightSum() const {
+            return libraryObject_->weightSum();
+        }
+        std::vector<QuantLib::Real> mean() const {
+            return libraryObject_->mean();
+        }
+        std::vector<QuantLib::Real> variance() const {
+            return libraryObject_->variance();
+        }
+        std::vector<QuantLib::Real> standardDeviation() const {
+            return libraryObject_->standardDeviation();
+        }
+        std::vector<QuantLib::Real> errorEstimate() const {
+            return libraryObject_->errorEstimate();
+        }
+        std::vector<QuantLib::Real> min() const {
+            return libraryObject_->min();
+        }
+        std::vector<QuantLib::Real> max() const {
+            return libraryObject_->max();
+        }
+        QuantLib::Matrix covariance() const {
+            return libraryObject_->covariance();
+        }
+        QuantLib::Matrix correlation() const {
+            return libraryObject_->correlation();
+        }
+    };
+
 }
 
 #endif
@@ -23,10 +23,31 @@
 #endif
 
 #include <qlo/shortratemodels.hpp>
+#include <qlo/calibrationdiagnostics.hpp>
+#include <qlo/optimization.hpp>
+#include <qlo/parallel.hpp>
+#include <qlo/warmstart.hpp>
 
+#include <ql/math/optimization/constraint.hpp>
+#include <ql/math/optimization/costfunction.hpp>
+#include <ql/math/optimization/endcriteria.hpp>
+#include <ql/math/optimization/problem.hpp>
+#include <ql/math/optimization/projectedconstraint.hpp>
+#include <ql/math/optimization/projection.hpp>
+#include <ql/models/calibrationhelper.hpp>
+#include <ql/models/shortrate/calibrationhelpers/swaptionhelper.hpp>
 #include <ql/models/shortrate/onefactormodels/vasicek.hpp>
 #include <ql/models/shortrate/onefactormodels/hullwhite.hpp>
 #include <ql/models/shortrate/twofactormodels/g2.hpp>
+#include <ql/pricingengines/swaption/g2swaptionengine.hpp>
+#include <ql/pricingengines/swaption/jamshidianswaptionengine.hpp>
+#include <ql/pricingengines/swaption/treeswaptionengine.hpp>
+#include <ql/timegrid.hpp>
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <algorithm>
+#include <cmath>
+#include <list>
 
 namespace QuantLibAddin {
 
@@ -48,6 +69,339 @@ namespace QuantLibAddin {
     //           bool permanent) 
     //: OneFactorModel(properties, permanent){}
 
+    namespace {
+
+        const std::string affineModelNode = "Model";
+
+        /* Weighted calibration error of the helpers, as minimized by
+           QuantLib::CalibratedModel::calibrate. */
+        QuantLib::Real calibrationError(
+                const std::vector<boost::shared_ptr<QuantLib::CalibrationHelper> >& helpers,
+                const std::vector<QuantLib::Real>& weights) {
+            QuantLib::Real error = 0.0;
+            for (QuantLib::Size k=0; k<helpers.size(); ++k) {
+                QuantLib::Real e = helpers[k]->calibrationError();
+                error += (weights.empty() ? 1.0 : weights[k])*e*e;
+            }
+            return std::sqrt(error);
+        }
+
+        /* Calibrates the model from its current parameters, returning
+           the time taken. */
+        QuantLib::Real timedCalibration(
+                const boost::shared_ptr<QuantLib::CalibratedModel>& model,
+                const std::vector<boost::shared_ptr<QuantLib::CalibrationHelper> >& helpers,
+                QuantLib::OptimizationMethod& method,
+                const QuantLib::EndCriteria& endCriteria,
+                const QuantLib::Constraint& constraint,
+                const std::vector<QuantLib::Real>& weights,
+                const std::vector<bool>& fixParameters) {
+            boost::posix_time::ptime start =
+                boost::posix_time::microsec_clock::universal_time();
+            model->calibrate(helpers, method, endCriteria, constraint,
+                             weights, fixParameters);
+            return (boost::posix_time::microsec_clock::universal_time()
+                    - start).total_microseconds()/1.0e6;
+        }
+
+        /* Relative price errors of swaption helpers, which are split
+           into interleaved groups, each priced by its own copy of the
+           model and its own engine.  Market values and swaption
+           arguments are prepared in the calling thread, together with
+           the model copies and engines, which are kept across
+           evaluations; a group sets its model parameters only when
+           they changed since its last evaluation, so that a tree
+           engine rebuilds its lattice, common to the helpers of the
+           group, once per parameter set. */
+        class SwaptionHelperErrors {
+          public:
+            SwaptionHelperErrors(
+                const boost::shared_ptr<QuantLib::CalibratedModel>& model,
+                const std::vector<boost::shared_ptr<QuantLib::SwaptionHelper> >& helpers,
+                QuantLib::Size threads,
+                QuantLib::Size timeSteps,
+                QuantLib::Real range,
+                QuantLib::Size intervals)
+            : model_(model), timeSteps_(timeSteps), range_(range),
+              intervals_(intervals), marketValues_(helpers.size()),
+              arguments_(helpers.size()), errors_(helpers.size()) {
+                for (QuantLib::Size k=0; k<helpers.size(); ++k) {
+                    marketValues_[k] = helpers[k]->marketValue();
+                    QL_REQUIRE(marketValues_[k] != 0.0,
+                               "null market value for swaption helper #"
+                               << k+1);
+                    helpers[k]->swaption()->setupArguments(&arguments_[k]);
+                }
+
+                if (timeSteps > 0) {
+                    std::list<QuantLib::Time> times;
+                    for (QuantLib::Size k=0; k<helpers.size(); ++k)
+                        helpers[k]->addTimesTo(times);
+                    grid_ = QuantLib::TimeGrid(times.begin(), times.end(),
+                                               timeSteps);
+                }
+
+                addGroups(workerThreads(threads, helpers.size()));
+            }
+            /* A copy pricing all the helpers in a single group, with
+               its own model and engine; it is meant to be evaluated
+               in a thread of its own, e.g., by a multi-start method. */
+            boost::shared_ptr<SwaptionHelperErrors> clone() const {
+                boost::shared_ptr<SwaptionHelperErrors> copy(new
+                    SwaptionHelperErrors(*this));
+                copy->models_.clear();
+                copy->engines_.clear();
+                copy->lastParams_.clear();
+                copy->addGroups(1);
+                return copy;
+            }
+            QuantLib::Size groups() const { return models_.size(); }
+            void setParams(const QuantLib::Array& params) {
+                params_ = params;
+            }
+            void operator()(QuantLib::Size g) {
+                if (lastParams_[g].size() != params_.size() ||
+                    !std::equal(params_.begin(), params_.end(),
+                                lastParams_[g].begin())) {
+                    models_[g]->setParams(params_);
+                    lastParams_[g] = params_;
+                }
+                QuantLib::PricingEngine& engine = *engines_[g];
+                for (QuantLib::Size k=g; k<errors_.size(); k+=groups()) {
+                    engine.reset();
+                    QuantLib::Swaption::arguments* arguments =
+                        dynamic_cast<QuantLib::Swaption::arguments*>(
+                                                    engine.getArguments());
+                    QL_REQUIRE(arguments, "wrong engine arguments");
+                    *arguments = arguments_[k];
+                    arguments->validate();
+                    engine.calculate();
+                    const QuantLib::Instrument::results* results =
+                        dynamic_cast<const QuantLib::Instrument::results*>(
+                                                    engine.getResults());
+                    QL_REQUIRE(results, "wrong engine results");
+                    // as QuantLib::CalibrationHelper::RelativePriceError,
+                    // the only error type of the addin swaption helpers
+                    errors_[k] = std::fabs(marketValues_[k]-results->value)
+                                 / marketValues_[k];
+                }
+            }
+            const std::vector<QuantLib::Real>& errors() const {
+                return errors_;
+            }
+          private:
+            void addGroups(QuantLib::Size groups) {
+                QuantLib::Array params = model_->params();
+                for (QuantLib::Size g=0; g<groups; ++g) {
+                    boost::shared_ptr<QuantLib::CalibratedModel> copy;
+                    boost::shared_ptr<QuantLib::PricingEngine> engine;
+                    if (boost::shared_ptr<QuantLib::HullWhite> hw =
+                            boost::dynamic_pointer_cast<QuantLib::HullWhite>(
+                                                                    model_)) {
+                        boost::shared_ptr<QuantLib::HullWhite> m(new
+                            QuantLib::HullWhite(hw->termStructure()));
+                        if (timeSteps_ > 0)
+                            engine = boost::shared_ptr<QuantLib::PricingEngine>(
+                                new QuantLib::TreeSwaptionEngine(m, grid_));
+                        else
+                            engine = boost::shared_ptr<QuantLib::PricingEngine>(
+                                new QuantLib::JamshidianSwaptionEngine(m));
+                        copy = m;
+                    } else if (boost::shared_ptr<QuantLib::G2> g2 =
+                                boost::dynamic_pointer_cast<QuantLib::G2>(
+                                                                    model_)) {
+                        boost::shared_ptr<QuantLib::G2> m(new
+                            QuantLib::G2(g2->termStructure()));
+                        engine = boost::shared_ptr<QuantLib::PricingEngine>(new
+                            QuantLib::G2SwaptionEngine(m, range_, intervals_));
+                        copy = m;
+                    } else {
+                        QL_FAIL("concurrent calibration is only available "
+                                "for Hull-White and G2 models");
+                    }
+                    copy->setParams(params);
+                    models_.push_back(copy);
+                    engines_.push_back(engine);
+                    lastParams_.push_back(params);
+                }
+            }
+            boost::shared_ptr<QuantLib::CalibratedModel> model_;
+            QuantLib::Size timeSteps_;
+            QuantLib::TimeGrid grid_;
+            QuantLib::Real range_;
+            QuantLib::Size intervals_;
+            std::vector<QuantLib::Real> marketValues_;
+            std::vector<QuantLib::Swaption::arguments> arguments_;
+            std::vector<QuantLib::Real> errors_;
+            std::vector<boost::shared_ptr<QuantLib::CalibratedModel> > models_;
+            std::vector<boost::shared_ptr<QuantLib::PricingEngine> > engines_;
+            std::vector<QuantLib::Array> lastParams_;
+            QuantLib::Array params_;
+        };
+
+        /* As the calibration function of QuantLib::CalibratedModel,
+           with the helpers priced concurrently.  Its copies price the
+           helpers in a single thread, so that a multi-start method
+           can run its starts concurrently instead. */
+        class ConcurrentCalibrationFunction : public CloneableCostFunction {
+          public:
+            ConcurrentCalibrationFunction(
+                    const boost::shared_ptr<SwaptionHelperErrors>& errors,
+                    const std::vector<QuantLib::Real>& weights,
+                    const QuantLib::Projection& projection)
+            : errors_(errors), weights_(weights), projection_(projection) {}
+            boost::shared_ptr<CloneableCostFunction> clone() const {
+                return boost::shared_ptr<CloneableCostFunction>(new
+                    ConcurrentCalibrationFunction(errors_->clone(),
+                                                  weights_, projection_));
+            }
+            QuantLib::Real value(const QuantLib::Array& params) const {
+                QuantLib::Array v = values(params);
+                return std::sqrt(QuantLib::DotProduct(v, v));
+            }
+            QuantLib::Disposable<QuantLib::Array>
+            values(const QuantLib::Array& params) const {
+                errors_->setParams(projection_.include(params));
+                parallelFor(errors_->groups(), errors_->groups(), *errors_);
+                QuantLib::Array v(weights_.size());
+                for (QuantLib::Size k=0; k<v.size(); ++k)
+                    v[k] = std::sqrt(weights_[k])*errors_->errors()[k];
+                return v;
+            }
+          private:
+            boost::shared_ptr<SwaptionHelperErrors> errors_;
+            std::vector<QuantLib::Real> weights_;
+            QuantLib::Projection projection_;
+        };
+
+    }
+
+    void AffineModel::calibrate(
+            const std::vector<boost::shared_ptr<QuantLib::BlackCalibrationHelper> >& helpers,
+            QuantLib::OptimizationMethod& method,
+            const QuantLib::EndCriteria& endCriteria,
+            const QuantLib::Constraint& constraint,
+            const std::vector<QuantLib::Real>& weights,
+            const std::vector<bool>& fixParameters,
+            bool warmStart) {
+        boost::shared_ptr<QuantLib::CalibratedModel> model =
+            boost::dynamic_pointer_cast<QuantLib::CalibratedModel>(
+                                                            libraryObject_);
+        std::string objectId = properties()->objectId();
+        QL_REQUIRE(model, "model " << objectId << " cannot be calibrated");
+        std::vector<boost::shared_ptr<QuantLib::CalibrationHelper> >
+            instruments(helpers.begin(), helpers.end());
+        // the method is owned by its object; the pointer doesn't own it
+        boost::shared_ptr<QuantLib::OptimizationMethod> recorded =
+            recordingMethod(objectId,
+                            boost::shared_ptr<QuantLib::OptimizationMethod>(
+                                boost::shared_ptr<QuantLib::OptimizationMethod>(),
+                                &method));
+        if (!warmStart) {
+            model->calibrate(instruments, *recorded, endCriteria, constraint,
+                             weights, fixParameters);
+            return;
+        }
+
+        // the current parameters are the guess of a cold fit, and are
+        // kept for the fixed ones by a warm fit
+        CalibrationWarmStart& store = CalibrationWarmStart::instance();
+        QuantLib::Array guess = model->params();
+        std::vector<QuantLib::Real> last;
+        if (store.lastParameters(objectId, affineModelNode, last)
+            && last.size() == guess.size()) {
+            QuantLib::Array warmGuess = guess;
+            for (QuantLib::Size i=0; i<guess.size(); ++i)
+                if (fixParameters.empty() || !fixParameters[i])
+                    warmGuess[i] = last[i];
+            model->setParams(warmGuess);
+            QuantLib::Real seconds =
+                timedCalibration(model, instruments, *recorded, endCriteria,
+                                 constraint, weights, fixParameters);
+            QuantLib::Real error = calibrationError(instruments, weights);
+            if (!store.degraded(objectId, affineModelNode, error)) {
+                QuantLib::Array params = model->params();
+                store.warmFit(objectId, affineModelNode,
+                              std::vector<QuantLib::Real>(params.begin(),
+                                                          params.end()),
+                              error, seconds);
+                return;
+            }
+            store.fallback(objectId, affineModelNode);
+            model->setParams(guess);
+        }
+        QuantLib::Real seconds =
+            timedCalibration(model, instruments, *recorded, endCriteria,
+                             constraint, weights, fixParameters);
+        QuantLib::Array params = model->params();
+        store.coldFit(objectId, affineModelNode,
+                      std::vector<QuantLib::Real>(params.begin(),
+                                                  params.end()),
+                      calibrationError(instruments, weights), seconds);
+    }
+
+    void AffineModel::calibrateConcurrently(
+            const std::vector<boost::shared_ptr<QuantLib::BlackCalibrationHelper> >& helpers,
+            const boost::shared_ptr<QuantLib::OptimizationMethod>& method,
+            const boost::shared_ptr<QuantLib::EndCriteria>& endCriteria,
+            const boost::shared_ptr<QuantLib::Constraint>& constraint,
+            const std::vector<QuantLib::Real>& weights,
+            const std::vector<bool>& fixParameters,
+            QuantLib::Size threads,
+            QuantLib::Size timeSteps,
+            QuantLib::Real range,
+            QuantLib::Size intervals) {
+        boost::shared_ptr<QuantLib::CalibratedModel> model =
+            boost::dynamic_pointer_cast<QuantLib::CalibratedModel>(
+                                                            libraryObject_);
+        QL_REQUIRE(model, "model " << properties()->objectId()
+                   << " cannot be calibrated");
+        QL_REQUIRE(endCriteria, "null end criteria");
+        QL_REQUIRE(constraint, "null constraint");
+        QL_REQUIRE(!helpers.empty(), "no helpers given");
+        QL_REQUIRE(weights.empty() || weights.size() == helpers.size(),
+                   "mismatch between number of helpers (" << helpers.size()
+                   << ") and weights (" << weights.size() << ")");
+        QuantLib::Array params = model->params();
+        QL_REQUIRE(fixParameters.empty() ||
+                   fixParameters.size() == params.size(),
+                   "mismatch between number of parameters (" << params.size()
+                   << ") and fixed-parameter specs ("
+                   << fixParameters.size() << ")");
+
+        std::vector<boost::shared_ptr<QuantLib::SwaptionHelper> >
+            swaptionHelpers(helpers.size());
+        for (QuantLib::Size k=0; k<helpers.size(); ++k) {
+            swaptionHelpers[k] =
+                boost::dynamic_pointer_cast<QuantLib::SwaptionHelper>(
+                                                                helpers[k]);
+            QL_REQUIRE(swaptionHelpers[k],
+                       "calibration helper #" << k+1
+                       << " is not a swaption helper");
+        }
+        boost::shared_ptr<SwaptionHelperErrors> errors(new
+            SwaptionHelperErrors(model, swaptionHelpers, threads,
+                                 timeSteps, range, intervals));
+
+        QuantLib::Constraint c = model->constraint();
+        if (!constraint->empty())
+            c = QuantLib::CompositeConstraint(c, *constraint);
+        std::vector<QuantLib::Real> w =
+            weights.empty() ? std::vector<QuantLib::Real>(helpers.size(), 1.0)
+                            : weights;
+        QuantLib::Projection projection(
+            params,
+            fixParameters.empty() ? std::vector<bool>(params.size(), false)
+                                  : fixParameters);
+        ConcurrentCalibrationFunction f(errors, w, projection);
+        QuantLib::ProjectedConstraint pc(c, projection);
+        QuantLib::Problem problem(f, pc, projection.project(params));
+        boost::shared_ptr<QuantLib::OptimizationMethod> recorded =
+            recordingMethod(properties()->objectId(), method);
+        recorded->minimize(problem, *endCriteria);
+        model->setParams(projection.include(problem.currentValue()));
+    }
+
     OneFactorAffineModel::OneFactorAffineModel(
                 const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
                 //QuantLib::Size nArguments,
@@ -32,12 +32,60 @@ namespace QuantLib {
 
     class AffineModel;
     class OneFactorAffineModel;
+    class BlackCalibrationHelper;
+    class EndCriteria;
+    class OptimizationMethod;
+    class Constraint;
 
 }
 
 namespace QuantLibAddin {
 
-    OH_LIB_CLASS(AffineModel, QuantLib::AffineModel);
+    class AffineModel : public ObjectHandler::LibraryObject<QuantLib::AffineModel> {
+      public:
+        //! calibrates the model, recording the diagnostics of the run
+        /*! With warm start, the parameters not fixed start from those
+            last calibrated for the same object ID, if any, rather than
+            from the current ones; see CalibrationWarmStart.
+        */
+        void calibrate(
+            const std::vector<boost::shared_ptr<QuantLib::BlackCalibrationHelper> >& helpers,
+            QuantLib::OptimizationMethod& method,
+            const QuantLib::EndCriteria& endCriteria,
+            const QuantLib::Constraint& constraint,
+            const std::vector<QuantLib::Real>& weights,
+            const std::vector<bool>& fixParameters,
+            bool warmStart);
+        //! calibrates the model, pricing the helpers concurrently
+        /*! Only Hull-White and G2 models against swaption helpers are
+            supported.  The helpers are split among the given number of
+            threads, each pricing its share with its own copy of the
+            model and its own engine: for Hull-White, the Jamshidian
+            engine or, given a number of time steps, a tree engine whose
+            lattice spans the times of all helpers; for G2, the
+            G2SwaptionEngine with the given range and intervals.
+            Pricing engines set on the helpers are not used, and the
+            end criteria of the model are not updated.
+
+            The cost function can be copied: with a multi-start method
+            wrapping a Levenberg-Marquardt or simplex method, the starts
+            run concurrently instead, each pricing all the helpers on
+            its own model copy and engine.
+        */
+        void calibrateConcurrently(
+            const std::vector<boost::shared_ptr<QuantLib::BlackCalibrationHelper> >& helpers,
+            const boost::shared_ptr<QuantLib::OptimizationMethod>& method,
+            const boost::shared_ptr<QuantLib::EndCriteria>& endCriteria,
+            const boost::shared_ptr<QuantLib::Constraint>& constraint,
+            const std::vector<QuantLib::Real>& weights,
+            const std::vector<bool>& fixParameters,
+            QuantLib::Size threads,
+            QuantLib::Size timeSteps,
+            QuantLib::Real range,
+            QuantLib::Size intervals);
+      protected:
+        OH_LIB_CTOR(AffineModel, QuantLib::AffineModel)
+    };
 
     //class ShortRateModel : public CalibratedModel {
     //public:
@@ -24,6 +24,8 @@
 #endif
 
 #include <qlo/smilesection.hpp>
+#include <qlo/calibrationdiagnostics.hpp>
+#include <qlo/warmstart.hpp>
 
 #include <ql/termstructures/volatility/interpolatedsmilesection.hpp>
 #include <ql/termstructures/volatility/sabrinterpolatedsmilesection.hpp>
@@ -32,8 +34,130 @@
 #include <ql/termstructures/volatility/flatsmilesection.hpp>
 #include <ql/quotes/simplequote.hpp>
 
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
 namespace QuantLibAddin {
 
+    namespace {
+
+        const std::string sabrNode = "SABR";
+
+        /* SABR section built from the given guess; the QuantLib
+           constructors taking rates and quotes are both covered. */
+        template <class Forward, class Atm, class Vols>
+        boost::shared_ptr<QuantLib::SabrInterpolatedSmileSection>
+        sabrSection(const QuantLib::Date& optionDate,
+                    const Forward& forward,
+                    const std::vector<QuantLib::Rate>& strikes,
+                    bool hasFloatingStrikes,
+                    const Atm& atmVolatility,
+                    const Vols& vols,
+                    const std::vector<QuantLib::Real>& guess,
+                    bool isAlphaFixed,
+                    bool isBetaFixed,
+                    bool isNuFixed,
+                    bool isRhoFixed,
+                    bool vegaWeighted,
+                    const boost::shared_ptr<QuantLib::EndCriteria>& endCriteria,
+                    const boost::shared_ptr<QuantLib::OptimizationMethod>& method,
+                    const QuantLib::DayCounter& dc) {
+            return boost::shared_ptr<QuantLib::SabrInterpolatedSmileSection>(
+                new QuantLib::SabrInterpolatedSmileSection(optionDate,
+                                                           forward,
+                                                           strikes,
+                                                           hasFloatingStrikes,
+                                                           atmVolatility,
+                                                           vols,
+                                                           guess[0],
+                                                           guess[1],
+                                                           guess[2],
+                                                           guess[3],
+                                                           isAlphaFixed,
+                                                           isBetaFixed,
+                                                           isNuFixed,
+                                                           isRhoFixed,
+                                                           vegaWeighted,
+                                                           endCriteria,
+                                                           method,
+                                                           dc));
+        }
+
+        /* Calibrates the section right away, timing the fit, and
+           returns its parameters. */
+        std::vector<QuantLib::Real> sabrFit(
+                const boost::shared_ptr<QuantLib::SabrInterpolatedSmileSection>& s,
+                QuantLib::Real& seconds) {
+            boost::posix_time::ptime start =
+                boost::posix_time::microsec_clock::universal_time();
+            std::vector<QuantLib::Real> parameters(4);
+            parameters[0] = s->alpha();
+            parameters[1] = s->beta();
+            parameters[2] = s->nu();
+            parameters[3] = s->rho();
+            seconds = (boost::posix_time::microsec_clock::universal_time()
+                       - start).total_microseconds()/1.0e6;
+            return parameters;
+        }
+
+        /* SABR section started from the last converged parameters of
+           the given object, if any, for the parameters that are not
+           fixed; the fit is repeated from the given guess if it
+           degrades. */
+        template <class Forward, class Atm, class Vols>
+        boost::shared_ptr<QuantLib::SabrInterpolatedSmileSection>
+        warmSabrSection(const std::string& objectId,
+                        const QuantLib::Date& optionDate,
+                        const Forward& forward,
+                        const std::vector<QuantLib::Rate>& strikes,
+                        bool hasFloatingStrikes,
+                        const Atm& atmVolatility,
+                        const Vols& vols,
+                        const std::vector<QuantLib::Real>& guess,
+                        bool isAlphaFixed,
+                        bool isBetaFixed,
+                        bool isNuFixed,
+                        bool isRhoFixed,
+                        bool vegaWeighted,
+                        const boost::shared_ptr<QuantLib::EndCriteria>& endCriteria,
+                        const boost::shared_ptr<QuantLib::OptimizationMethod>& method,
+                        const QuantLib::DayCounter& dc) {
+            CalibrationWarmStart& store = CalibrationWarmStart::instance();
+            QuantLib::Real seconds;
+            std::vector<QuantLib::Real> last;
+            if (store.lastParameters(objectId, sabrNode, last)) {
+                bool isFixed[] = { isAlphaFixed, isBetaFixed,
+                                   isNuFixed, isRhoFixed };
+                std::vector<QuantLib::Real> warmGuess(guess);
+                for (QuantLib::Size i=0; i<4; ++i)
+                    if (!isFixed[i])
+                        warmGuess[i] = last[i];
+                boost::shared_ptr<QuantLib::SabrInterpolatedSmileSection> s =
+                    sabrSection(optionDate, forward, strikes,
+                                hasFloatingStrikes, atmVolatility, vols,
+                                warmGuess, isAlphaFixed, isBetaFixed,
+                                isNuFixed, isRhoFixed, vegaWeighted,
+                                endCriteria, method, dc);
+                std::vector<QuantLib::Real> parameters = sabrFit(s, seconds);
+                if (!store.degraded(objectId, sabrNode, s->rmsError())) {
+                    store.warmFit(objectId, sabrNode, parameters,
+                                  s->rmsError(), seconds);
+                    return s;
+                }
+                store.fallback(objectId, sabrNode);
+            }
+            boost::shared_ptr<QuantLib::SabrInterpolatedSmileSection> s =
+                sabrSection(optionDate, forward, strikes, hasFloatingStrikes,
+                            atmVolatility, vols, guess, isAlphaFixed,
+                            isBetaFixed, isNuFixed, isRhoFixed, vegaWeighted,
+                            endCriteria, method, dc);
+            std::vector<QuantLib::Real> parameters = sabrFit(s, seconds);
+            store.coldFit(objectId, sabrNode, parameters, s->rmsError(),
+                          seconds);
+            return s;
+        }
+
+    }
+
     FlatSmileSection::FlatSmileSection(
                                 const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
                                 const QuantLib::Date& optionDate,
@@ -97,10 +221,13 @@ namespace QuantLibAddin {
         if (!endCriteria)
             QuantLib::EndCriteria endCriteria(60000, 100, 1e-8, 1e-8, 1e-8);
 
+        CalibrationDiagnostics::instance().clear(properties->objectId());
         QuantLib::SABR sabr(
                                 expiry, forward->value(), alpha, beta,
                                 nu, rho, isAlphaFixed, isBetaFixed, isNuFixed, 
-                                isRhoFixed, vegaWeighted, endCriteria, method);
+                                isRhoFixed, vegaWeighted, endCriteria,
+                                recordingMethod(properties->objectId(),
+                                                method));
         
         std::vector<QuantLib::Handle<QuantLib::Quote> > temp(stdDevs.size());
         for(QuantLib::Size i = 0; i<temp.size(); ++i)
@@ -136,8 +263,28 @@ namespace QuantLibAddin {
                            const boost::shared_ptr<QuantLib::EndCriteria> endCriteria,
                            const boost::shared_ptr<QuantLib::OptimizationMethod> method,
                            const QuantLib::DayCounter& dc,
+                           bool warmStart,
                            bool permanent): SmileSection(properties, permanent)
     {
+           CalibrationDiagnostics::instance().clear(properties->objectId());
+           boost::shared_ptr<QuantLib::OptimizationMethod> recorded =
+               recordingMethod(properties->objectId(), method);
+           if (warmStart) {
+               std::vector<QuantLib::Real> guess(4);
+               guess[0] = alpha;
+               guess[1] = beta;
+               guess[2] = nu;
+               guess[3] = rho;
+               libraryObject_ = warmSabrSection(properties->objectId(),
+                                                optionDate, forward, strikes,
+                                                hasFloatingStrikes,
+                                                atmVolatility, vols, guess,
+                                                isAlphaFixed, isBetaFixed,
+                                                isNuFixed, isRhoFixed,
+                                                vegaWeighted, endCriteria,
+                                                recorded, dc);
+               return;
+           }
            libraryObject_ = 
            boost::shared_ptr<QuantLib::SabrInterpolatedSmileSection>(
             new QuantLib::SabrInterpolatedSmileSection(optionDate,
@@ -156,7 +303,7 @@ namespace QuantLibAddin {
                                                    isRhoFixed,
                                                    vegaWeighted,
                                                    endCriteria,
-                                                   method,
+                                                   recorded,
                                                    dc));
     }
 
@@ -180,12 +327,33 @@ namespace QuantLibAddin {
             const boost::shared_ptr<QuantLib::EndCriteria> endCriteria,
             const boost::shared_ptr<QuantLib::OptimizationMethod> method,
             const QuantLib::DayCounter& dc,
+            bool warmStart,
             bool permanent): SmileSection(properties, permanent) {
 
            std::vector<QuantLib::Handle<QuantLib::Quote> > temp(volHandles.size());
            for(QuantLib::Size i = 0; i<temp.size(); ++i)
                 temp[i] = volHandles[i];
 
+           CalibrationDiagnostics::instance().clear(properties->objectId());
+           boost::shared_ptr<QuantLib::OptimizationMethod> recorded =
+               recordingMethod(properties->objectId(), method);
+           if (warmStart) {
+               std::vector<QuantLib::Real> guess(4);
+               guess[0] = alpha;
+               guess[1] = beta;
+               guess[2] = nu;
+               guess[3] = rho;
+               libraryObject_ = warmSabrSection(properties->objectId(),
+                                                optionDate, forward, strikes,
+                                                hasFloatingStrikes,
+                                                atmVolatility, temp, guess,
+                                                isAlphaFixed, isBetaFixed,
+                                                isNuFixed, isRhoFixed,
+                                                vegaWeighted, endCriteria,
+                                                recorded, dc);
+               return;
+           }
+
            libraryObject_ = 
            boost::shared_ptr<QuantLib::SabrInterpolatedSmileSection>(
             new QuantLib::SabrInterpolatedSmileSection(optionDate,
@@ -204,7 +372,7 @@ namespace QuantLibAddin {
                                                    isRhoFixed,
                                                    vegaWeighted,
                                                    endCriteria,
-                                                   method,
+                                                   recorded,
                                                    dc));    
     }
 
@@ -95,6 +95,10 @@ namespace QuantLibAddin {
         
     };
 
+    /*! With warm start, the section is calibrated on construction,
+        starting from the parameters last fitted under the same object
+        ID; see CalibrationWarmStart.
+    */
     class SabrInterpolatedSmileSection : public SmileSection {
       public:
         SabrInterpolatedSmileSection(
@@ -117,6 +121,7 @@ namespace QuantLibAddin {
             const boost::shared_ptr<QuantLib::EndCriteria> endCriteria,
             const boost::shared_ptr<QuantLib::OptimizationMethod> method,
             const QuantLib::DayCounter& dc,
+            bool warmStart,
             bool permanent);
 
         SabrInterpolatedSmileSection(
@@ -139,6 +144,7 @@ namespace QuantLibAddin {
             const boost::shared_ptr<QuantLib::EndCriteria> endCriteria,
             const boost::shared_ptr<QuantLib::OptimizationMethod> method,
             const QuantLib::DayCounter& dc,
+            bool warmStart,
             bool permanent);
     };
     
@@ -23,6 +23,11 @@
 #include <qlo/statistics.hpp>
 #include <ql/math/statistics/statistics.hpp>
 #include <ql/math/statistics/incrementalstatistics.hpp>
+#include <ql/mathconstants.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
 
 namespace QuantLibAddin {
 
@@ -78,6 +83,438 @@ namespace QuantLibAddin {
         }
     }
 
+    namespace {
+
+        // largest quantile which the t-digest centroid starting at q
+        // may reach, for the scale function k(q) = d/(2 pi) asin(2q-1)
+        QuantLib::Real centroidLimit(QuantLib::Real q,
+                                     QuantLib::Real compression) {
+            QuantLib::Real k = compression/(2.0*M_PI)*
+                std::asin(std::max(-1.0, std::min(1.0, 2.0*q-1.0))) + 1.0;
+            if (k >= 0.25*compression)
+                return 1.0;
+            return 0.5*(std::sin(2.0*M_PI*k/compression) + 1.0);
+        }
+
+    }
+
+    TDigestStatistics::TDigestStatistics(QuantLib::Real compression,
+                                         QuantLib::Size tailSize)
+    : compression_(compression), tailSize_(tailSize) {
+        QL_REQUIRE(compression >= 10.0,
+                   "compression (" << compression << ") must be at least 10");
+        reset();
+    }
+
+    void TDigestStatistics::reset() {
+        samples_ = 0;
+        weightSum_ = mean_ = m2_ = 0.0;
+        min_ = QL_MAX_REAL;
+        max_ = QL_MIN_REAL;
+        centroids_.clear();
+        buffer_.clear();
+        lower_.clear();
+        upper_.clear();
+    }
+
+    QuantLib::Real TDigestStatistics::mean() const {
+        QL_REQUIRE(weightSum_ > 0.0,
+                   "sampleWeight_= 0, unsufficient");
+        return mean_;
+    }
+
+    QuantLib::Real TDigestStatistics::variance() const {
+        QL_REQUIRE(weightSum_ > 0.0,
+                   "sampleWeight_= 0, unsufficient");
+        QL_REQUIRE(samples_ > 1,
+                   "sample number <= 1, unsufficient");
+        return m2_/weightSum_ * samples_/(samples_-1.0);
+    }
+
+    QuantLib::Real TDigestStatistics::standardDeviation() const {
+        return std::sqrt(variance());
+    }
+
+    QuantLib::Real TDigestStatistics::errorEstimate() const {
+        return std::sqrt(variance()/samples_);
+    }
+
+    QuantLib::Real TDigestStatistics::min() const {
+        QL_REQUIRE(samples_ > 0, "empty sample set");
+        return min_;
+    }
+
+    QuantLib::Real TDigestStatistics::max() const {
+        QL_REQUIRE(samples_ > 0, "empty sample set");
+        return max_;
+    }
+
+    void TDigestStatistics::add(QuantLib::Real value, QuantLib::Real weight) {
+        QL_REQUIRE(weight >= 0.0, "negative weight not allowed");
+        ++samples_;
+        min_ = std::min(min_, value);
+        max_ = std::max(max_, value);
+        addToTails(Sample(value, weight));
+        if (weight == 0.0)
+            return;
+
+        // weighted incremental update (West, 1979)
+        QuantLib::Real w = weightSum_ + weight;
+        QuantLib::Real delta = value - mean_;
+        QuantLib::Real r = delta*weight/w;
+        mean_ += r;
+        m2_ += weightSum_*delta*r;
+        weightSum_ = w;
+
+        buffer_.push_back(Sample(value, weight));
+        if (buffer_.size() >= 5*QuantLib::Size(compression_))
+            compress();
+    }
+
+    void TDigestStatistics::addToTails(const Sample& sample) {
+        if (tailSize_ == 0)
+            return;
+        if (lower_.size() < tailSize_) {
+            lower_.push_back(sample);
+            std::push_heap(lower_.begin(), lower_.end());
+            upper_.push_back(sample);
+            std::push_heap(upper_.begin(), upper_.end(),
+                           std::greater<Sample>());
+            return;
+        }
+        if (sample < lower_.front()) {
+            std::pop_heap(lower_.begin(), lower_.end());
+            lower_.back() = sample;
+            std::push_heap(lower_.begin(), lower_.end());
+        }
+        if (upper_.front() < sample) {
+            std::pop_heap(upper_.begin(), upper_.end(),
+                          std::greater<Sample>());
+            upper_.back() = sample;
+            std::push_heap(upper_.begin(), upper_.end(),
+                           std::greater<Sample>());
+        }
+    }
+
+    void TDigestStatistics::merge(const TDigestStatistics& other) {
+        if (&other == this) {
+            TDigestStatistics copy(other);
+            merge(copy);
+            return;
+        }
+        if (other.samples_ == 0)
+            return;
+
+        // pairwise combination of the moments (Chan et al., 1979)
+        if (other.weightSum_ > 0.0) {
+            QuantLib::Real w = weightSum_ + other.weightSum_;
+            QuantLib::Real delta = other.mean_ - mean_;
+            mean_ += delta*other.weightSum_/w;
+            m2_ += other.m2_ + delta*delta*weightSum_*other.weightSum_/w;
+            weightSum_ = w;
+        }
+        samples_ += other.samples_;
+        min_ = std::min(min_, other.min_);
+        max_ = std::max(max_, other.max_);
+
+        // the tails of the other object overlap when it holds less
+        // than twice tailSize samples; the common ones are added once
+        for (QuantLib::Size i=0; i<other.lower_.size(); ++i)
+            addToTails(other.lower_[i]);
+        std::vector<Sample> upper = other.sortedTail(false);
+        QuantLib::Size overlap =
+            other.lower_.size() + upper.size() > other.samples_ ?
+            other.lower_.size() + upper.size() - other.samples_ : 0;
+        for (QuantLib::Size i=0; i+overlap<upper.size(); ++i)
+            addToTails(upper[i]);
+
+        other.compress();
+        buffer_.insert(buffer_.end(),
+                       other.centroids_.begin(), other.centroids_.end());
+        compress();
+    }
+
+    void TDigestStatistics::compress() const {
+        if (buffer_.empty())
+            return;
+        std::vector<Sample> points;
+        points.reserve(centroids_.size() + buffer_.size());
+        points.insert(points.end(), centroids_.begin(), centroids_.end());
+        points.insert(points.end(), buffer_.begin(), buffer_.end());
+        buffer_.clear();
+        std::sort(points.begin(), points.end());
+
+        QuantLib::Real total = 0.0;
+        for (QuantLib::Size i=0; i<points.size(); ++i)
+            total += points[i].second;
+
+        centroids_.clear();
+        Sample current = points.front();
+        QuantLib::Real before = 0.0;
+        QuantLib::Real limit = total*centroidLimit(0.0, compression_);
+        for (QuantLib::Size i=1; i<points.size(); ++i) {
+            QuantLib::Real w = current.second + points[i].second;
+            if (before + w <= limit) {
+                current.first +=
+                    (points[i].first - current.first)*points[i].second/w;
+                current.second = w;
+            } else {
+                centroids_.push_back(current);
+                before += current.second;
+                limit = total*centroidLimit(before/total, compression_);
+                current = points[i];
+            }
+        }
+        centroids_.push_back(current);
+    }
+
+    QuantLib::Real TDigestStatistics::digestQuantile(QuantLib::Real q) const {
+        compress();
+        QL_REQUIRE(!centroids_.empty(), "empty sample set");
+        if (centroids_.size() == 1)
+            return centroids_.front().first;
+
+        // piecewise-linear interpolation between the centroid means,
+        // each centroid being centered on its share of the total weight
+        QuantLib::Real target = q*weightSum_;
+        const Sample& first = centroids_.front();
+        if (target < 0.5*first.second)
+            return min_ + (first.first - min_)*target/(0.5*first.second);
+        QuantLib::Real position = 0.5*first.second;
+        for (QuantLib::Size i=0; i+1<centroids_.size(); ++i) {
+            QuantLib::Real next = position +
+                0.5*(centroids_[i].second + centroids_[i+1].second);
+            if (target <= next)
+                return centroids_[i].first +
+                    (centroids_[i+1].first - centroids_[i].first)*
+                    (target - position)/(next - position);
+            position = next;
+        }
+        const Sample& last = centroids_.back();
+        return std::min(max_, last.first + (max_ - last.first)*
+                                   (target - position)/(0.5*last.second));
+    }
+
+    std::vector<TDigestStatistics::Sample>
+    TDigestStatistics::sortedTail(bool lower) const {
+        std::vector<Sample> tail = lower ? lower_ : upper_;
+        if (lower)
+            std::sort(tail.begin(), tail.end());
+        else
+            std::sort(tail.begin(), tail.end(), std::greater<Sample>());
+        return tail;
+    }
+
+    QuantLib::Real TDigestStatistics::percentile(QuantLib::Real y) const {
+        QL_REQUIRE(y > 0.0 && y <= 1.0,
+                   "percentile (" << y << ") must be in (0.0, 1.0]");
+        QL_REQUIRE(weightSum_ > 0.0, "empty sample set");
+        QuantLib::Real target = y*weightSum_;
+        bool complete = (samples_ <= tailSize_);
+
+        // smallest sample such that the weight up to it reaches the target
+        std::vector<Sample> lower = sortedTail(true);
+        QuantLib::Real integral = 0.0;
+        for (QuantLib::Size i=0; i<lower.size(); ++i) {
+            integral += lower[i].second;
+            if (integral >= target)
+                return lower[i].first;
+        }
+        if (complete)
+            return lower.back().first;
+
+        std::vector<Sample> upper = sortedTail(false);
+        QuantLib::Real above = 0.0;
+        for (QuantLib::Size i=0; i<upper.size(); ++i) {
+            above += upper[i].second;
+            if (weightSum_ - above < target)
+                return upper[i].first;
+        }
+
+        return digestQuantile(y);
+    }
+
+    QuantLib::Real TDigestStatistics::topPercentile(QuantLib::Real y) const {
+        QL_REQUIRE(y > 0.0 && y <= 1.0,
+                   "percentile (" << y << ") must be in (0.0, 1.0]");
+        QL_REQUIRE(weightSum_ > 0.0, "empty sample set");
+        QuantLib::Real target = y*weightSum_;
+        bool complete = (samples_ <= tailSize_);
+
+        std::vector<Sample> upper = sortedTail(false);
+        QuantLib::Real integral = 0.0;
+        for (QuantLib::Size i=0; i<upper.size(); ++i) {
+            integral += upper[i].second;
+            if (integral >= target)
+                return upper[i].first;
+        }
+        if (complete)
+            return upper.back().first;
+
+        std::vector<Sample> lower = sortedTail(true);
+        QuantLib::Real below = 0.0;
+        for (QuantLib::Size i=0; i<lower.size(); ++i) {
+            below += lower[i].second;
+            if (weightSum_ - below < target)
+                return lower[i].first;
+        }
+
+        return digestQuantile(1.0-y);
+    }
+
+    void TDigestStatistics::below(QuantLib::Real t,
+                                  QuantLib::Real& weight,
+                                  QuantLib::Size& count,
+                                  QuantLib::Real& shortfall,
+                                  QuantLib::Real& shortfall2) const {
+        weight = shortfall = shortfall2 = 0.0;
+        count = 0;
+        // the lower tail holds every sample below its largest one
+        if (samples_ <= tailSize_ ||
+            (!lower_.empty() && t <= lower_.front().first)) {
+            for (QuantLib::Size i=0; i<lower_.size(); ++i) {
+                const Sample& p = lower_[i];
+                if (p.first < t) {
+                    QuantLib::Real d = t - p.first;
+                    weight += p.second;
+                    shortfall += p.second*d;
+                    shortfall2 += p.second*d*d;
+                    ++count;
+                }
+            }
+            return;
+        }
+
+        // otherwise, integrate the piecewise-linear quantile function
+        // used by digestQuantile up to t
+        compress();
+        std::vector<Sample> nodes;
+        nodes.reserve(centroids_.size() + 2);
+        nodes.push_back(Sample(0.0, min_));
+        QuantLib::Real position = 0.0;
+        for (QuantLib::Size i=0; i<centroids_.size(); ++i) {
+            position += 0.5*centroids_[i].second;
+            nodes.push_back(Sample(position, centroids_[i].first));
+            position += 0.5*centroids_[i].second;
+        }
+        nodes.push_back(Sample(weightSum_, max_));
+        for (QuantLib::Size i=0; i+1<nodes.size(); ++i) {
+            QuantLib::Real x0 = nodes[i].second, x1 = nodes[i+1].second;
+            if (x0 >= t)
+                break;
+            QuantLib::Real length = nodes[i+1].first - nodes[i].first;
+            if (x1 > t) {
+                length *= (t - x0)/(x1 - x0);
+                x1 = t;
+            }
+            QuantLib::Real d0 = t - x0, d1 = t - x1;
+            weight += length;
+            shortfall += length*(d0 + d1)/2.0;
+            shortfall2 += length*(d0*d0 + d0*d1 + d1*d1)/3.0;
+        }
+        count = QuantLib::Size(std::ceil(weight/weightSum_*samples_));
+    }
+
+    QuantLib::Real TDigestStatistics::potentialUpside(
+                                            QuantLib::Real centile) const {
+        QL_REQUIRE(centile >= 0.9 && centile < 1.0,
+                   "percentile (" << centile << ") out of range [0.9, 1.0)");
+        return std::max<QuantLib::Real>(percentile(centile), 0.0);
+    }
+
+    QuantLib::Real TDigestStatistics::valueAtRisk(
+                                            QuantLib::Real centile) const {
+        QL_REQUIRE(centile >= 0.9 && centile < 1.0,
+                   "percentile (" << centile << ") out of range [0.9, 1.0)");
+        return -std::min<QuantLib::Real>(percentile(1.0-centile), 0.0);
+    }
+
+    QuantLib::Real TDigestStatistics::expectedShortfall(
+                                            QuantLib::Real centile) const {
+        QL_REQUIRE(centile >= 0.9 && centile < 1.0,
+                   "percentile (" << centile << ") out of range [0.9, 1.0)");
+        QuantLib::Real target = -valueAtRisk(centile);
+        QuantLib::Real weight, shortfall, shortfall2;
+        QuantLib::Size count;
+        below(target, weight, count, shortfall, shortfall2);
+        QL_ENSURE(count != 0 && weight > 0.0, "no data below the target");
+        // E[x | x < target] = target - E[target - x | x < target]
+        QuantLib::Real x = target - shortfall/weight;
+        return -std::min<QuantLib::Real>(x, 0.0);
+    }
+
+    QuantLib::Real TDigestStatistics::shortfall(QuantLib::Real target) const {
+        QL_REQUIRE(weightSum_ > 0.0, "empty sample set");
+        QuantLib::Real weight, shortfall, shortfall2;
+        QuantLib::Size count;
+        below(target, weight, count, shortfall, shortfall2);
+        return weight/weightSum_;
+    }
+
+    QuantLib::Real TDigestStatistics::averageShortfall(
+                                            QuantLib::Real target) const {
+        QuantLib::Real weight, shortfall, shortfall2;
+        QuantLib::Size count;
+        below(target, weight, count, shortfall, shortfall2);
+        QL_ENSURE(count != 0 && weight > 0.0, "no data below the target");
+        return shortfall/weight;
+    }
+
+    QuantLib::Real TDigestStatistics::regret(QuantLib::Real target) const {
+        QuantLib::Real weight, shortfall, shortfall2;
+        QuantLib::Size count;
+        below(target, weight, count, shortfall, shortfall2);
+        QL_REQUIRE(count > 1 && weight > 0.0,
+                   "samples under target <= 1, unsufficient");
+        return shortfall2/weight * count/(count-1.0);
+    }
+
+    SketchStatistics::SketchStatistics(
+        const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
+        const std::vector<QuantLib::Real>& values,
+        const std::vector<QuantLib::Real>& w,
+        QuantLib::Real compression,
+        QuantLib::Size tailSize,
+        bool permanent)
+    : ObjectHandler::LibraryObject<TDigestStatistics>(properties, permanent)
+    {
+        libraryObject_ = boost::shared_ptr<TDigestStatistics>(new
+            TDigestStatistics(compression, tailSize));
+
+        QL_REQUIRE(w.empty() || values.size()==w.size(),
+                   "Mismatch between number of samples (" <<
+                   values.size() << ") and number of weights (" <<
+                   w.size() << ")");
+
+        if (!values.empty()) {
+            if (!w.empty())
+                libraryObject_->addSequence(values.begin(),
+                                            values.end(),
+                                            w.begin());
+            else
+                libraryObject_->addSequence(values.begin(),
+                                            values.end());
+        }
+    }
+
+    SketchStatistics::SketchStatistics(
+        const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
+        const std::vector<boost::shared_ptr<SketchStatistics> >& statistics,
+        bool permanent)
+    : ObjectHandler::LibraryObject<TDigestStatistics>(properties, permanent)
+    {
+        QL_REQUIRE(!statistics.empty(), "no statistics given");
+        for (QuantLib::Size i=0; i<statistics.size(); ++i) {
+            boost::shared_ptr<TDigestStatistics> s;
+            statistics[i]->getLibraryObject(s);
+            if (i == 0)
+                libraryObject_ = boost::shared_ptr<TDigestStatistics>(new
+                    TDigestStatistics(*s));
+            else
+                libraryObject_->merge(*s);
+        }
+    }
+
     #define TYPICAL_GAUSSIAN_2DOUBLE_STAT_FUNCTION(NAME) \
     QuantLib::Real NAME(QuantLib::Real mean, QuantLib::Real stdDev) { \
         QuantLib::StatsHolder h(mean, stdDev); \
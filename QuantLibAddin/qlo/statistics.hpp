@@ -22,8 +22,12 @@
 #define qla_riskstatistics_hpp
 
 #include <oh/libraryobject.hpp>
+#include <ql/errors.hpp>
 #include <ql/types.hpp>
 
+#include <utility>
+#include <vector>
+
 namespace QuantLib {
     class GeneralStatistics;
 
@@ -63,6 +67,132 @@ namespace QuantLibAddin {
                    bool permanent);
     };
 
+    //! Bounded-memory statistics with sketched quantiles
+    /*! Moments are accumulated exactly in one pass.  Quantiles are
+        estimated by a merging t-digest (Dunning and Ertl, "Computing
+        extremely accurate quantiles using t-digests") whose rank error
+        is roughly q(1-q)/compression, i.e., smallest in the tails.
+
+        The tailSize lowest and highest samples are also kept exactly.
+        Percentiles, value-at-risk, expected shortfall and the shortfall
+        measures only involving those samples (which is always the case
+        when no more than tailSize samples were added) are the same as
+        returned by QuantLib::Statistics; the others are estimated from
+        the digest.  Memory is O(compression + tailSize) regardless of
+        the number of samples.
+    */
+    class TDigestStatistics {
+      public:
+        typedef QuantLib::Real value_type;
+        explicit TDigestStatistics(QuantLib::Real compression = 200.0,
+                                   QuantLib::Size tailSize = 10000);
+        //! \name Inspectors
+        //@{
+        QuantLib::Size samples() const { return samples_; }
+        QuantLib::Real weightSum() const { return weightSum_; }
+        QuantLib::Real mean() const;
+        QuantLib::Real variance() const;
+        QuantLib::Real standardDeviation() const;
+        QuantLib::Real errorEstimate() const;
+        QuantLib::Real min() const;
+        QuantLib::Real max() const;
+        QuantLib::Real percentile(QuantLib::Real y) const;
+        QuantLib::Real topPercentile(QuantLib::Real y) const;
+        //@}
+        //! \name Risk measures
+        /*! Same definitions and argument ranges as in
+            QuantLib::RiskStatistics. */
+        //@{
+        QuantLib::Real potentialUpside(QuantLib::Real percentile) const;
+        QuantLib::Real valueAtRisk(QuantLib::Real percentile) const;
+        QuantLib::Real expectedShortfall(QuantLib::Real percentile) const;
+        QuantLib::Real shortfall(QuantLib::Real target) const;
+        QuantLib::Real averageShortfall(QuantLib::Real target) const;
+        QuantLib::Real regret(QuantLib::Real target) const;
+        //@}
+        //! \name Modifiers
+        //@{
+        void add(QuantLib::Real value, QuantLib::Real weight = 1.0);
+        template <class DataIterator>
+        void addSequence(DataIterator begin, DataIterator end) {
+            for (; begin != end; ++begin)
+                add(*begin);
+        }
+        template <class DataIterator, class WeightIterator>
+        void addSequence(DataIterator begin, DataIterator end,
+                         WeightIterator wbegin) {
+            for (; begin != end; ++begin, ++wbegin)
+                add(*begin, *wbegin);
+        }
+        //! adds the samples of another object, e.g. filled by another thread
+        void merge(const TDigestStatistics& other);
+        void reset();
+        //@}
+      private:
+        typedef std::pair<QuantLib::Real, QuantLib::Real> Sample;
+        void addToTails(const Sample& sample);
+        void compress() const;
+        QuantLib::Real digestQuantile(QuantLib::Real q) const;
+        // weight, count and weighted sums of t-x and (t-x)^2 over x<t
+        void below(QuantLib::Real t, QuantLib::Real& weight,
+                   QuantLib::Size& count, QuantLib::Real& shortfall,
+                   QuantLib::Real& shortfall2) const;
+        std::vector<Sample> sortedTail(bool lower) const;
+        QuantLib::Real compression_;
+        QuantLib::Size tailSize_;
+        QuantLib::Size samples_;
+        QuantLib::Real weightSum_, mean_, m2_, min_, max_;
+        // centroids sorted by mean, plus the samples not yet merged
+        mutable std::vector<Sample> centroids_, buffer_;
+        // max-heap of the lowest samples, min-heap of the highest ones
+        std::vector<Sample> lower_, upper_;
+    };
+
+    class SketchStatistics :
+                public ObjectHandler::LibraryObject<TDigestStatistics> {
+      public:
+        SketchStatistics(
+                   const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
+                   const std::vector<QuantLib::Real>& values,
+                   const std::vector<QuantLib::Real>& weights,
+                   QuantLib::Real compression,
+                   QuantLib::Size tailSize,
+                   bool permanent);
+        //! statistics of the union of the samples of the given objects
+        /*! The digests are merged into a copy of the first one, whose
+            compression and tail size are kept; the given objects are
+            not modified. */
+        SketchStatistics(
+                   const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
+                   const std::vector<boost::shared_ptr<SketchStatistics> >& statistics,
+                   bool permanent);
+        QuantLib::Size samples() const { return libraryObject_->samples(); }
+        QuantLib::Real mean() const { return libraryObject_->mean(); }
+        QuantLib::Real standardDeviation() const {
+            return libraryObject_->standardDeviation();
+        }
+        QuantLib::Real min() const { return libraryObject_->min(); }
+        QuantLib::Real max() const { return libraryObject_->max(); }
+        QuantLib::Real percentile(QuantLib::Real y) const {
+            return libraryObject_->percentile(y);
+        }
+        QuantLib::Real topPercentile(QuantLib::Real y) const {
+            return libraryObject_->topPercentile(y);
+        }
+        QuantLib::Real valueAtRisk(QuantLib::Real y) const {
+            return libraryObject_->valueAtRisk(y);
+        }
+        QuantLib::Real expectedShortfall(QuantLib::Real y) const {
+            return libraryObject_->expectedShortfall(y);
+        }
+        QuantLib::Real shortfall(QuantLib::Real target) const {
+            return libraryObject_->shortfall(target);
+        }
+        QuantLib::Real averageShortfall(QuantLib::Real target) const {
+            return libraryObject_->averageShortfall(target);
+        }
+    };
+
 
     #define DECLARE_TYPICAL_GAUSSIAN_2DOUBLE_STAT_FUNCTION(NAME) \
     QuantLib::Real NAME(QuantLib::Real, QuantLib::Real);
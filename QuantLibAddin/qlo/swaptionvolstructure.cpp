@@ -32,10 +32,421 @@
 #include <ql/termstructures/volatility/swaption/swaptionvolmatrix.hpp>
 #include <ql/termstructures/volatility/swaption/spreadedswaptionvol.hpp>
 #include <ql/math/optimization/endcriteria.hpp>
+#include <ql/math/interpolations/sabrinterpolation.hpp>
+#include <ql/quotes/simplequote.hpp>
 #include <ql/time/calendars/nullcalendar.hpp>
 
+#include <qlo/calibrationdiagnostics.hpp>
+#include <qlo/optimization.hpp>
+#include <qlo/parallel.hpp>
+#include <qlo/warmstart.hpp>
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
 namespace QuantLibAddin {
 
+    namespace {
+
+        // shifted strikes below this level are dropped from the smile
+        // fits, as with the default cutoff of QuantLib::SwaptionVolCube1
+        const QuantLib::Rate cutoffStrike = 0.0001;
+
+        /* SABR fits of the cube nodes, one per task.  Each fit uses its
+           own interpolation and a copy of the given optimization method,
+           and the inputs are gathered beforehand in the calling thread.
+           Methods which cannot be copied are shared, and the fits are
+           then to be run serially. */
+        class SabrNodeFits {
+          public:
+            SabrNodeFits(
+                const std::vector<QuantLib::Time>& optionTimes,
+                const std::vector<QuantLib::Rate>& forwards,
+                const std::vector<QuantLib::Real>& shifts,
+                const std::vector<std::vector<QuantLib::Rate> >& strikes,
+                const std::vector<std::vector<QuantLib::Volatility> >& vols,
+                const std::vector<std::vector<QuantLib::Real> >& guesses,
+                const std::vector<bool>& isParameterFixed,
+                bool vegaWeighted,
+                QuantLib::VolatilityType volatilityType,
+                const boost::shared_ptr<QuantLib::EndCriteria>& endCriteria,
+                const boost::shared_ptr<QuantLib::OptimizationMethod>& method,
+                const std::string& objectId)
+            : optionTimes_(optionTimes), forwards_(forwards), shifts_(shifts),
+              strikes_(strikes), vols_(vols), guesses_(guesses),
+              isParameterFixed_(isParameterFixed),
+              vegaWeighted_(vegaWeighted), volatilityType_(volatilityType),
+              endCriteria_(endCriteria), method_(method), objectId_(objectId),
+              parameters(guesses), rmsErrors(guesses.size(), 0.0),
+              maxErrors(guesses.size(), 0.0),
+              endCriteriaTypes(guesses.size(), QuantLib::EndCriteria::None),
+              milliseconds(guesses.size(), 0.0),
+              errors(guesses.size()) {}
+            void operator()(QuantLib::Size node) {
+                boost::posix_time::ptime start =
+                    boost::posix_time::microsec_clock::universal_time();
+                try {
+                    QL_REQUIRE(strikes_[node].size() > 1,
+                               "not enough strikes above the cutoff");
+                    const std::vector<QuantLib::Real>& g = guesses_[node];
+                    boost::shared_ptr<QuantLib::OptimizationMethod> method =
+                        cloneOptimizationMethod(method_);
+                    if (!method)
+                        method = method_;
+                    QuantLib::SABRInterpolation sabr(
+                        strikes_[node].begin(), strikes_[node].end(),
+                        vols_[node].begin(),
+                        optionTimes_[node], forwards_[node],
+                        g[0], g[1], g[2], g[3],
+                        isParameterFixed_[0], isParameterFixed_[1],
+                        isParameterFixed_[2], isParameterFixed_[3],
+                        vegaWeighted_, endCriteria_,
+                        recordingMethod(objectId_, method),
+                        // default restarts, then the node's shift and
+                        // volatility type as in QuantLib::SwaptionVolCube1
+                        0.0020, false, 50,
+                        shifts_[node], volatilityType_);
+                    sabr.update();
+                    parameters[node][0] = sabr.alpha();
+                    parameters[node][1] = sabr.beta();
+                    parameters[node][2] = sabr.nu();
+                    parameters[node][3] = sabr.rho();
+                    rmsErrors[node] = sabr.rmsError();
+                    maxErrors[node] = sabr.maxError();
+                    endCriteriaTypes[node] = sabr.endCriteria();
+                } catch (std::exception& e) {
+                    errors[node] = e.what();
+                    if (errors[node].empty())
+                        errors[node] = "unknown error";
+                }
+                milliseconds[node] = (boost::posix_time::microsec_clock::universal_time()
+                                      - start).total_microseconds()/1000.0;
+            }
+          private:
+            const std::vector<QuantLib::Time>& optionTimes_;
+            const std::vector<QuantLib::Rate>& forwards_;
+            const std::vector<QuantLib::Real>& shifts_;
+            const std::vector<std::vector<QuantLib::Rate> >& strikes_;
+            const std::vector<std::vector<QuantLib::Volatility> >& vols_;
+            const std::vector<std::vector<QuantLib::Real> >& guesses_;
+            const std::vector<bool>& isParameterFixed_;
+            bool vegaWeighted_;
+            QuantLib::VolatilityType volatilityType_;
+            boost::shared_ptr<QuantLib::EndCriteria> endCriteria_;
+            boost::shared_ptr<QuantLib::OptimizationMethod> method_;
+            std::string objectId_;
+          public:
+            // results, by node; failed fits keep the initial guess
+            std::vector<std::vector<QuantLib::Real> > parameters;
+            std::vector<QuantLib::Real> rmsErrors, maxErrors;
+            std::vector<QuantLib::EndCriteria::Type> endCriteriaTypes;
+            std::vector<QuantLib::Real> milliseconds;
+            std::vector<std::string> errors;
+        };
+
+        // the given nodes only, as a parallelFor task
+        class SabrNodeRefits {
+          public:
+            SabrNodeRefits(SabrNodeFits& fits,
+                           const std::vector<QuantLib::Size>& nodes)
+            : fits_(fits), nodes_(nodes) {}
+            void operator()(QuantLib::Size i) { fits_(nodes_[i]); }
+          private:
+            SabrNodeFits& fits_;
+            const std::vector<QuantLib::Size>& nodes_;
+        };
+
+        // guesses of the QuantLib cube, set to the node fits; they are
+        // made before the cube, which is built on them
+        class SabrSeeds {
+          protected:
+            SabrSeeds(const std::vector<std::vector<
+                          QuantLib::Handle<QuantLib::Quote> > >& guesses,
+                      QuantLib::Size nodes) {
+                QL_REQUIRE(guesses.size() == nodes,
+                           "wrong number of parameter guesses ("
+                           << guesses.size() << ") for " << nodes
+                           << " nodes");
+                seeds_.resize(nodes);
+                seedHandles_.resize(nodes);
+                for (QuantLib::Size n=0; n<nodes; ++n) {
+                    QL_REQUIRE(guesses[n].size() == 4,
+                               "wrong number of guesses (" << guesses[n].size()
+                               << ") for node " << n << ", 4 required");
+                    for (QuantLib::Size p=0; p<4; ++p) {
+                        seeds_[n].push_back(
+                            boost::shared_ptr<QuantLib::SimpleQuote>(new
+                                QuantLib::SimpleQuote(guesses[n][p]->value())));
+                        seedHandles_[n].push_back(
+                            QuantLib::Handle<QuantLib::Quote>(seeds_[n][p]));
+                    }
+                }
+            }
+            std::vector<std::vector<boost::shared_ptr<QuantLib::SimpleQuote> > >
+                seeds_;
+            std::vector<std::vector<QuantLib::Handle<QuantLib::Quote> > >
+                seedHandles_;
+        };
+
+        /* SwaptionVolCube1 whose calibration starts from node fits run
+           concurrently.  At each calculation, the nodes are fitted over
+           the given number of threads from the given guesses (or, with
+           warm start, from the parameters last fitted under the same
+           object ID); the fits are then set as the guesses of the
+           QuantLib cube, which calibrates itself from them with the
+           given parameters still free.  The cube observes the given
+           guesses instead of its own, so that setting the latter during
+           the calculation doesn't notify it. */
+        class ConcurrentSwaptionVolCube1 : private SabrSeeds,
+                                           public QuantLib::SwaptionVolCube1 {
+          public:
+            ConcurrentSwaptionVolCube1(
+                const QuantLib::Handle<QuantLib::SwaptionVolatilityStructure>& atmVol,
+                const std::vector<QuantLib::Period>& optionTenors,
+                const std::vector<QuantLib::Period>& swapTenors,
+                const std::vector<QuantLib::Spread>& strikeSpreads,
+                const std::vector<std::vector<QuantLib::Handle<QuantLib::Quote> > >& volSpreads,
+                const boost::shared_ptr<QuantLib::SwapIndex>& swapIndexBase,
+                const boost::shared_ptr<QuantLib::SwapIndex>& shortSwapIndexBase,
+                bool vegaWeightedSmileFit,
+                const std::vector<std::vector<QuantLib::Handle<QuantLib::Quote> > >& parametersGuess,
+                const std::vector<bool>& isParameterFixed,
+                bool isAtmCalibrated,
+                const boost::shared_ptr<QuantLib::EndCriteria>& endCriteria,
+                QuantLib::Real maxErrorTolerance,
+                const boost::shared_ptr<QuantLib::OptimizationMethod>& optMethod,
+                const boost::shared_ptr<QuantLib::OptimizationMethod>& recorded,
+                QuantLib::Size threads,
+                bool warmStart,
+                const std::string& objectId)
+            : SabrSeeds(parametersGuess, optionTenors.size()*swapTenors.size()),
+              QuantLib::SwaptionVolCube1(atmVol, optionTenors, swapTenors,
+                                         strikeSpreads, volSpreads,
+                                         swapIndexBase, shortSwapIndexBase,
+                                         vegaWeightedSmileFit, seedHandles_,
+                                         isParameterFixed, isAtmCalibrated,
+                                         endCriteria, maxErrorTolerance,
+                                         recorded),
+              atmVolatility_(atmVol), volSpreadQuotes_(volSpreads),
+              guessQuotes_(parametersGuess),
+              parameterFixed_(isParameterFixed),
+              vegaWeighted_(vegaWeightedSmileFit), endCriteria_(endCriteria),
+              errorTolerance_(maxErrorTolerance), method_(optMethod),
+              threads_(threads), warmStart_(warmStart), objectId_(objectId) {
+                QL_REQUIRE(isParameterFixed.size() == 4,
+                           "wrong number of fixed parameter flags ("
+                           << isParameterFixed.size() << "), 4 required");
+                // methods which cannot be copied are shared by the fits
+                if (optMethod && !cloneOptimizationMethod(optMethod))
+                    threads_ = 1;
+                for (QuantLib::Size n=0; n<seeds_.size(); ++n) {
+                    for (QuantLib::Size p=0; p<4; ++p) {
+                        unregisterWith(seedHandles_[n][p]);
+                        registerWith(guessQuotes_[n][p]);
+                    }
+                }
+            }
+            void performCalculations() const;
+            //! outcome, timing and failures of the last node fits
+            const std::vector<std::vector<ObjectHandler::property_t> >&
+            nodeCalibrationReport() const {
+                calculate();
+                return report_;
+            }
+          private:
+            void fitNodes() const;
+            QuantLib::Handle<QuantLib::SwaptionVolatilityStructure> atmVolatility_;
+            std::vector<std::vector<QuantLib::Handle<QuantLib::Quote> > >
+                volSpreadQuotes_, guessQuotes_;
+            std::vector<bool> parameterFixed_;
+            bool vegaWeighted_;
+            boost::shared_ptr<QuantLib::EndCriteria> endCriteria_;
+            QuantLib::Real errorTolerance_;
+            boost::shared_ptr<QuantLib::OptimizationMethod> method_;
+            QuantLib::Size threads_;
+            bool warmStart_;
+            std::string objectId_;
+            mutable std::vector<std::vector<ObjectHandler::property_t> > report_;
+        };
+
+        void ConcurrentSwaptionVolCube1::performCalculations() const {
+            fitNodes();
+            QuantLib::SwaptionVolCube1::performCalculations();
+        }
+
+        void ConcurrentSwaptionVolCube1::fitNodes() const {
+            const std::vector<QuantLib::Period>& options = optionTenors();
+            const std::vector<QuantLib::Period>& swaps = swapTenors();
+            const std::vector<QuantLib::Spread>& spreads = strikeSpreads();
+            QuantLib::Size nOptions = options.size();
+            QuantLib::Size nSwaps = swaps.size();
+            QuantLib::Size nodes = nOptions*nSwaps;
+
+            // inputs are gathered node by node in the calling thread, as
+            // the QuantLib cube does, so that curves and volatilities are
+            // calculated here
+            std::vector<QuantLib::Time> optionTimes(nodes);
+            std::vector<QuantLib::Rate> forwards(nodes);
+            std::vector<QuantLib::Real> shifts(nodes);
+            std::vector<std::vector<QuantLib::Rate> > strikes(nodes);
+            std::vector<std::vector<QuantLib::Volatility> > vols(nodes);
+            std::vector<std::vector<QuantLib::Real> > guesses(nodes);
+            std::vector<std::string> labels(nodes);
+            for (QuantLib::Size j=0; j<nOptions; ++j) {
+                QuantLib::Date optionDate = optionDateFromTenor(options[j]);
+                for (QuantLib::Size k=0; k<nSwaps; ++k) {
+                    QuantLib::Size node = j*nSwaps+k;
+                    optionTimes[node] = timeFromReference(optionDate);
+                    forwards[node] = atmStrike(optionDate, swaps[k]);
+                    shifts[node] = atmVolatility_->shift(optionTimes[node],
+                                                         swapLength(swaps[k]));
+                    QuantLib::Volatility atmVolatility =
+                        atmVolatility_->volatility(optionDate, swaps[k],
+                                                   forwards[node]);
+                    for (QuantLib::Size i=0; i<spreads.size(); ++i) {
+                        QuantLib::Rate strike = forwards[node] + spreads[i];
+                        if (strike + shifts[node] >= cutoffStrike) {
+                            strikes[node].push_back(strike);
+                            vols[node].push_back(atmVolatility +
+                                                 volSpreadQuotes_[node][i]->value());
+                        }
+                    }
+                    // guesses are laid out by swap tenor first, as read
+                    // by QuantLib::SwaptionVolCube1
+                    const std::vector<QuantLib::Handle<QuantLib::Quote> >& g =
+                        guessQuotes_[j+k*nOptions];
+                    for (QuantLib::Size p=0; p<4; ++p)
+                        guesses[node].push_back(g[p]->value());
+                    std::ostringstream label;
+                    label << options[j] << "/" << swaps[k];
+                    labels[node] = label.str();
+                }
+            }
+
+            std::vector<std::vector<QuantLib::Real> > startingPoints(guesses);
+            std::vector<bool> warm(nodes, false);
+            CalibrationWarmStart& store = CalibrationWarmStart::instance();
+            if (warmStart_) {
+                std::vector<QuantLib::Real> last;
+                for (QuantLib::Size node=0; node<nodes; ++node) {
+                    if (store.lastParameters(objectId_, labels[node], last)) {
+                        for (QuantLib::Size p=0; p<4; ++p)
+                            if (!parameterFixed_[p])
+                                startingPoints[node][p] = last[p];
+                        warm[node] = true;
+                    }
+                }
+            }
+
+            QuantLib::VolatilityType type = volatilityType();
+            SabrNodeFits fits(optionTimes, forwards, shifts, strikes, vols,
+                              startingPoints, parameterFixed_, vegaWeighted_,
+                              type, endCriteria_, method_, objectId_);
+            parallelFor(nodes, threads_, fits);
+
+            if (warmStart_) {
+                // degraded or failed warm starts are fitted again from the
+                // given guess
+                std::vector<QuantLib::Size> retries;
+                for (QuantLib::Size node=0; node<nodes; ++node)
+                    if (warm[node] && (!fits.errors[node].empty() ||
+                                       store.degraded(objectId_, labels[node],
+                                                      fits.rmsErrors[node])))
+                        retries.push_back(node);
+                SabrNodeFits coldFits(optionTimes, forwards, shifts, strikes,
+                                      vols, guesses, parameterFixed_,
+                                      vegaWeighted_, type, endCriteria_,
+                                      method_, objectId_);
+                SabrNodeRefits refits(coldFits, retries);
+                parallelFor(retries.size(), threads_, refits);
+                // time of the fits from the given guess, by node
+                std::vector<QuantLib::Real> coldMilliseconds(fits.milliseconds);
+                for (QuantLib::Size i=0; i<retries.size(); ++i) {
+                    QuantLib::Size node = retries[i];
+                    store.fallback(objectId_, labels[node]);
+                    warm[node] = false;
+                    fits.parameters[node] = coldFits.parameters[node];
+                    fits.rmsErrors[node] = coldFits.rmsErrors[node];
+                    fits.maxErrors[node] = coldFits.maxErrors[node];
+                    fits.endCriteriaTypes[node] = coldFits.endCriteriaTypes[node];
+                    fits.errors[node] = coldFits.errors[node];
+                    coldMilliseconds[node] = coldFits.milliseconds[node];
+                    // the report shows the time spent on both fits
+                    fits.milliseconds[node] += coldFits.milliseconds[node];
+                }
+                for (QuantLib::Size node=0; node<nodes; ++node) {
+                    if (!fits.errors[node].empty())
+                        continue;
+                    if (warm[node])
+                        store.warmFit(objectId_, labels[node],
+                                      fits.parameters[node], fits.rmsErrors[node],
+                                      fits.milliseconds[node]/1000.0);
+                    else
+                        store.coldFit(objectId_, labels[node],
+                                      fits.parameters[node], fits.rmsErrors[node],
+                                      coldMilliseconds[node]/1000.0);
+                }
+            }
+
+            report_.clear();
+            std::vector<ObjectHandler::property_t> headings;
+            headings.push_back(std::string("Option Tenor"));
+            headings.push_back(std::string("Swap Tenor"));
+            headings.push_back(std::string("Alpha"));
+            headings.push_back(std::string("Beta"));
+            headings.push_back(std::string("Nu"));
+            headings.push_back(std::string("Rho"));
+            headings.push_back(std::string("Forward"));
+            headings.push_back(std::string("Error"));
+            headings.push_back(std::string("Max Error"));
+            headings.push_back(std::string("End Criteria"));
+            headings.push_back(std::string("Milliseconds"));
+            headings.push_back(std::string("Failure"));
+            report_.push_back(headings);
+            for (QuantLib::Size j=0; j<nOptions; ++j) {
+                for (QuantLib::Size k=0; k<nSwaps; ++k) {
+                    QuantLib::Size node = j*nSwaps+k;
+                    // failed fits leave the cube their starting point
+                    for (QuantLib::Size p=0; p<4; ++p)
+                        seeds_[j+k*nOptions][p]->setValue(
+                                                fits.parameters[node][p]);
+
+                    std::ostringstream optionTenor, swapTenor, endCriteriaType;
+                    optionTenor << options[j];
+                    swapTenor << swaps[k];
+                    std::vector<ObjectHandler::property_t> row;
+                    row.push_back(optionTenor.str());
+                    row.push_back(swapTenor.str());
+                    std::string failure = fits.errors[node];
+                    if (failure.empty() &&
+                        errorTolerance_ != QuantLib::Null<QuantLib::Real>() &&
+                        fits.rmsErrors[node] >= errorTolerance_) {
+                        // as checked by the cube on its own fits
+                        std::ostringstream message;
+                        message << "error " << fits.rmsErrors[node]
+                                << " above the tolerance " << errorTolerance_;
+                        failure = message.str();
+                    }
+                    if (fits.errors[node].empty()) {
+                        for (QuantLib::Size p=0; p<4; ++p)
+                            row.push_back(fits.parameters[node][p]);
+                        row.push_back(forwards[node]);
+                        row.push_back(fits.rmsErrors[node]);
+                        row.push_back(fits.maxErrors[node]);
+                        endCriteriaType << fits.endCriteriaTypes[node];
+                        row.push_back(endCriteriaType.str());
+                    } else {
+                        for (QuantLib::Size c=0; c<8; ++c)
+                            row.push_back(std::string("N/A"));
+                    }
+                    row.push_back(fits.milliseconds[node]);
+                    row.push_back(failure);
+                    report_.push_back(row);
+                }
+            }
+        }
+
+    }
+
     ConstantSwaptionVolatility::ConstantSwaptionVolatility(
         const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
         QuantLib::Natural settlementDays,
@@ -137,11 +548,37 @@ namespace QuantLibAddin {
         const boost::shared_ptr<QuantLib::EndCriteria>& endCriteria,
         QuantLib::Real maxErrorTolerance,
         const boost::shared_ptr<QuantLib::OptimizationMethod>& optMethod,
-        bool permanent) : SwaptionVolatilityCube(properties, permanent)
+        QuantLib::Size threads,
+        bool warmStart,
+        bool permanent)
+    : SwaptionVolatilityCube(properties, permanent)
     {
         QL_REQUIRE(!atmVol.empty(), "atm vol handle not linked to anything");
+        std::string objectId = properties->objectId();
+        CalibrationDiagnostics::instance().clear(objectId);
+        boost::shared_ptr<QuantLib::OptimizationMethod> recorded =
+            recordingMethod(objectId, optMethod);
+        if (threads == 1 && !warmStart) {
+            libraryObject_ = boost::shared_ptr<QuantLib::Extrapolator>(new
+                QuantLib::SwaptionVolCube1(atmVol,
+                                           optionTenors,
+                                           swapTenors,
+                                           strikeSpreads,
+                                           volSpreads,
+                                           swapIndexBase,
+                                           shortSwapIndexBase,
+                                           vegaWeightedSmileFit,
+                                           parametersGuess,
+                                           isParameterFixed,
+                                           isAtmCalibrated,
+                                           endCriteria,
+                                           maxErrorTolerance,
+                                           recorded));
+            return;
+        }
+
         libraryObject_ = boost::shared_ptr<QuantLib::Extrapolator>(new
-            QuantLib::SwaptionVolCube1(atmVol,
+            ConcurrentSwaptionVolCube1(atmVol,
                                        optionTenors,
                                        swapTenors,
                                        strikeSpreads,
@@ -154,7 +591,11 @@ namespace QuantLibAddin {
                                        isAtmCalibrated,
                                        endCriteria,
                                        maxErrorTolerance,
-                                       optMethod ));
+                                       optMethod,
+                                       recorded,
+                                       threads,
+                                       warmStart,
+                                       objectId));
     }
 
     std::vector<std::vector<ObjectHandler::property_t> >
@@ -189,6 +630,17 @@ namespace QuantLibAddin {
         return getVolCube(volCube->volCubeAtmCalibrated());
     }
 
+    std::vector<std::vector<ObjectHandler::property_t> >
+    SwaptionVolCube1::getNodeCalibrationReport() {
+        const boost::shared_ptr<ConcurrentSwaptionVolCube1>&
+            volCube = boost::dynamic_pointer_cast<
+                    ConcurrentSwaptionVolCube1>(libraryObject_);
+        QL_REQUIRE(volCube,
+                   "no node calibration report: the cube was built "
+                   "with a single thread");
+        return volCube->nodeCalibrationReport();
+    }
+
     std::vector<std::vector<ObjectHandler::property_t> > getSabrParameters(QuantLib::Matrix sabrParameters)
     {
         std::vector<std::vector<ObjectHandler::property_t> > sparseSabrParameters;
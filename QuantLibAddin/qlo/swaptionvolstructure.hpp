@@ -111,11 +111,18 @@ namespace QuantLibAddin {
             const boost::shared_ptr<QuantLib::EndCriteria>& endCriteria,
             QuantLib::Real maxErrorTolerance,
             const boost::shared_ptr<QuantLib::OptimizationMethod>& optMethod,
+            QuantLib::Size threads,
+            bool warmStart,
             bool permanent);
         std::vector<std::vector<ObjectHandler::property_t> > getSparseSabrParameters();
         std::vector<std::vector<ObjectHandler::property_t> > getDenseSabrParameters();
         std::vector<std::vector<ObjectHandler::property_t> > getMarketVolCube();
         std::vector<std::vector<ObjectHandler::property_t> > getVolCubeAtmCalibrated();
+        //! outcome, timing and failures of the concurrent node fits
+        /*! The fits are those of the last calculation of the cube,
+            which calibrates itself starting from them.
+        */
+        std::vector<std::vector<ObjectHandler::property_t> > getNodeCalibrationReport();
     };
 
     class SmileSectionByCube : public SmileSection {
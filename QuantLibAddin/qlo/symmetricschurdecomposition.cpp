@@ -22,6 +22,7 @@
 #endif
 
 #include <qlo/symmetricschurdecomposition.hpp>
+#include <qlo/decompositioncache.hpp>
 
 namespace QuantLibAddin {
 
@@ -31,9 +32,8 @@ namespace QuantLibAddin {
             bool permanent) : 
         ObjectHandler::LibraryObject<QuantLib::SymmetricSchurDecomposition>(properties, permanent)
     {
-        libraryObject_ = boost::shared_ptr<
-                            QuantLib::SymmetricSchurDecomposition>(
-                                new QuantLib::SymmetricSchurDecomposition(s));
+        // shared with any other object built on the same matrix
+        libraryObject_ = cachedSymmetricSchurDecomposition(s);
     }
 
 }
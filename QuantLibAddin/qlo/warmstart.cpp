@@ -0,0 +1,154 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+#if defined(HAVE_CONFIG_H)     // Dynamically created by configure
+    #include <qlo/config.hpp>
+#endif
+#include <qlo/warmstart.hpp>
+
+using ObjectHandler::property_t;
+using QuantLib::Real;
+using QuantLib::Size;
+using std::string;
+using std::vector;
+
+namespace QuantLibAddin {
+
+    namespace {
+
+        const Real degradationFactor = 2.0;
+        const Real degradationTolerance = 1.0e-8;
+
+    }
+
+    bool CalibrationWarmStart::lastParameters(const string& objectId,
+                                              const string& node,
+                                              vector<Real>& parameters) const {
+        boost::mutex::scoped_lock lock(mutex_);
+        entries::const_iterator i =
+            entries_.find(std::make_pair(objectId, node));
+        if (i == entries_.end() || i->second.parameters.empty())
+            return false;
+        parameters = i->second.parameters;
+        return true;
+    }
+
+    bool CalibrationWarmStart::degraded(const string& objectId,
+                                        const string& node,
+                                        Real error) const {
+        boost::mutex::scoped_lock lock(mutex_);
+        entries::const_iterator i =
+            entries_.find(std::make_pair(objectId, node));
+        if (i == entries_.end() || i->second.coldFits == 0)
+            return false;
+        return !(error <= degradationFactor*i->second.coldError
+                          + degradationTolerance);
+    }
+
+    void CalibrationWarmStart::coldFit(const string& objectId,
+                                       const string& node,
+                                       const vector<Real>& parameters,
+                                       Real error,
+                                       Real seconds) {
+        boost::mutex::scoped_lock lock(mutex_);
+        Entry& entry = entries_[std::make_pair(objectId, node)];
+        entry.parameters = parameters;
+        entry.error = entry.coldError = error;
+        entry.coldSeconds = entry.lastSeconds = seconds;
+        ++entry.coldFits;
+    }
+
+    void CalibrationWarmStart::warmFit(const string& objectId,
+                                       const string& node,
+                                       const vector<Real>& parameters,
+                                       Real error,
+                                       Real seconds) {
+        boost::mutex::scoped_lock lock(mutex_);
+        Entry& entry = entries_[std::make_pair(objectId, node)];
+        entry.parameters = parameters;
+        entry.error = error;
+        entry.lastSeconds = seconds;
+        entry.savedSeconds += entry.coldSeconds - seconds;
+        ++entry.warmFits;
+    }
+
+    void CalibrationWarmStart::fallback(const string& objectId,
+                                        const string& node) {
+        boost::mutex::scoped_lock lock(mutex_);
+        ++entries_[std::make_pair(objectId, node)].fallbacks;
+    }
+
+    Size CalibrationWarmStart::clear(const string& objectId) {
+        boost::mutex::scoped_lock lock(mutex_);
+        Size n = 0;
+        if (objectId.empty()) {
+            n = entries_.size();
+            entries_.clear();
+            return n;
+        }
+        entries::iterator i =
+            entries_.lower_bound(std::make_pair(objectId, string()));
+        while (i != entries_.end() && i->first.first == objectId) {
+            entries_.erase(i++);
+            ++n;
+        }
+        return n;
+    }
+
+    vector<vector<property_t> > CalibrationWarmStart::report() const {
+        boost::mutex::scoped_lock lock(mutex_);
+        vector<vector<property_t> > result;
+        vector<property_t> headings;
+        headings.push_back(string("Object"));
+        headings.push_back(string("Node"));
+        headings.push_back(string("Error"));
+        headings.push_back(string("Cold Error"));
+        headings.push_back(string("Cold Fits"));
+        headings.push_back(string("Warm Fits"));
+        headings.push_back(string("Fallbacks"));
+        headings.push_back(string("Cold Seconds"));
+        headings.push_back(string("Last Seconds"));
+        headings.push_back(string("Saved Seconds"));
+        result.push_back(headings);
+        for (entries::const_iterator i = entries_.begin();
+             i != entries_.end(); ++i) {
+            const Entry& entry = i->second;
+            vector<property_t> row;
+            row.push_back(i->first.first);
+            row.push_back(i->first.second);
+            row.push_back(entry.error);
+            row.push_back(entry.coldError);
+            row.push_back(static_cast<long>(entry.coldFits));
+            row.push_back(static_cast<long>(entry.warmFits));
+            row.push_back(static_cast<long>(entry.fallbacks));
+            row.push_back(entry.coldSeconds);
+            row.push_back(entry.lastSeconds);
+            row.push_back(entry.savedSeconds);
+            result.push_back(row);
+        }
+        return result;
+    }
+
+    Size clearCalibrationWarmStart(const string& objectId) {
+        return CalibrationWarmStart::instance().clear(objectId);
+    }
+
+    vector<vector<property_t> > calibrationWarmStartReport() {
+        return CalibrationWarmStart::instance().report();
+    }
+
+}
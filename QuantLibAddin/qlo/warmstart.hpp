@@ -0,0 +1,112 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*! \file
+    \brief Warm starts of calibrations from their last converged parameters
+*/
+
+#ifndef qla_warmstart_hpp
+#define qla_warmstart_hpp
+
+#include <oh/property.hpp>
+#include <ql/patterns/singleton.hpp>
+#include <ql/types.hpp>
+
+#include <boost/thread/mutex.hpp>
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace QuantLibAddin {
+
+    //! Last converged calibration parameters, by object ID and node
+    /*! Calibrated objects recreated with warm start enabled look up the
+        parameters of their last converged fit, stored under their
+        object ID and under a node label identifying the fit within the
+        object (e.g., the option and swap tenors of a cube node), and
+        start the optimizer from them instead of the given guess.
+
+        A warm-started fit whose error exceeds twice the error of the
+        last cold fit of its node (plus a small absolute tolerance) is
+        deemed degraded: the caller is then expected to repeat the fit
+        from the given guess.  Comparing against the cold fit keeps a
+        chain of warm fits from drifting away from it a little at a
+        time.  Fits from the given guess are cold fits; the time
+        they take is the reference against which warm fits are timed.
+        QuantLib does not expose the iteration counts of the calibrations
+        involved, so savings are reported as elapsed time.
+
+        The store can be used concurrently.
+    */
+    class CalibrationWarmStart
+        : public QuantLib::Singleton<CalibrationWarmStart> {
+        friend class QuantLib::Singleton<CalibrationWarmStart>;
+      public:
+        //! parameters of the last converged fit, if any
+        bool lastParameters(const std::string& objectId,
+                            const std::string& node,
+                            std::vector<QuantLib::Real>& parameters) const;
+        //! whether a warm-started fit with the given error is degraded
+        bool degraded(const std::string& objectId,
+                      const std::string& node,
+                      QuantLib::Real error) const;
+        //! records a fit started from the given guess
+        void coldFit(const std::string& objectId,
+                     const std::string& node,
+                     const std::vector<QuantLib::Real>& parameters,
+                     QuantLib::Real error,
+                     QuantLib::Real seconds);
+        //! records a fit started from the last converged parameters
+        void warmFit(const std::string& objectId,
+                     const std::string& node,
+                     const std::vector<QuantLib::Real>& parameters,
+                     QuantLib::Real error,
+                     QuantLib::Real seconds);
+        //! records a warm start discarded because the fit degraded
+        void fallback(const std::string& objectId,
+                      const std::string& node);
+        //! drops the entries of the given object, or all if the ID is empty
+        QuantLib::Size clear(const std::string& objectId);
+        //! one row per entry, with fit counts and timing, after a heading
+        std::vector<std::vector<ObjectHandler::property_t> > report() const;
+      private:
+        CalibrationWarmStart() {}
+        struct Entry {
+            Entry()
+            : error(0.0), coldError(0.0), coldSeconds(0.0), lastSeconds(0.0),
+              savedSeconds(0.0), coldFits(0), warmFits(0), fallbacks(0) {}
+            std::vector<QuantLib::Real> parameters;
+            QuantLib::Real error, coldError;
+            QuantLib::Real coldSeconds, lastSeconds, savedSeconds;
+            QuantLib::Size coldFits, warmFits, fallbacks;
+        };
+        typedef std::map<std::pair<std::string, std::string>, Entry> entries;
+        mutable boost::mutex mutex_;
+        entries entries_;
+    };
+
+    //! drops the warm starts of the given object, or all if the ID is empty
+    QuantLib::Size clearCalibrationWarmStart(const std::string& objectId);
+
+    //! warm-start entries with their fit counts and timing
+    std::vector<std::vector<ObjectHandler::property_t> >
+    calibrationWarmStartReport();
+
+}
+
+#endif
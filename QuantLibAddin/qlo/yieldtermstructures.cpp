@@ -42,6 +42,8 @@
 
 #include <boost/algorithm/string/case_conv.hpp>
 
+#include <algorithm>
+
 using boost::algorithm::to_upper_copy;
 using boost::shared_ptr;
 
@@ -671,6 +673,321 @@ namespace QuantLibAddin {
     {
     }
 
+    GridCachedTermStructure::GridCachedTermStructure(
+            const QuantLib::Handle<QuantLib::YieldTermStructure>& source,
+            QuantLib::Time horizon,
+            QuantLib::Size gridIntervals,
+            QuantLib::Real tolerance)
+    : source_(source), horizon_(horizon), n_(gridIntervals),
+      tolerance_(tolerance), maxError_(0.0)
+    {
+        QL_REQUIRE(n_ > 0, "at least one grid interval required");
+        QL_REQUIRE(horizon_ >= 0.0, "negative horizon (" << horizon_ << ")");
+        registerWith(source_);
+    }
+
+    QuantLib::DayCounter GridCachedTermStructure::dayCounter() const {
+        return source_->dayCounter();
+    }
+
+    QuantLib::Calendar GridCachedTermStructure::calendar() const {
+        return source_->calendar();
+    }
+
+    QuantLib::Natural GridCachedTermStructure::settlementDays() const {
+        return source_->settlementDays();
+    }
+
+    const QuantLib::Date& GridCachedTermStructure::referenceDate() const {
+        return source_->referenceDate();
+    }
+
+    QuantLib::Date GridCachedTermStructure::maxDate() const {
+        return source_->maxDate();
+    }
+
+    QuantLib::Time GridCachedTermStructure::maxTime() const {
+        return source_->maxTime();
+    }
+
+    void GridCachedTermStructure::update() {
+        // the reference date is forwarded to the source curve, so
+        // there is no TermStructure state to refresh here
+        QuantLib::LazyObject::update();
+    }
+
+    const std::vector<QuantLib::Time>& GridCachedTermStructure::gridTimes() const {
+        calculate();
+        return times_;
+    }
+
+    QuantLib::Real GridCachedTermStructure::maxError() const {
+        calculate();
+        return maxError_;
+    }
+
+    void GridCachedTermStructure::performCalculations() const {
+        QL_REQUIRE(!source_.empty(), "null source term structure");
+        gridEnd_ = source_->maxTime();
+        if (horizon_ > 0.0 && horizon_ < gridEnd_)
+            gridEnd_ = horizon_;
+        QL_REQUIRE(gridEnd_ > 0.0, "empty grid range");
+
+        h_ = gridEnd_/n_;
+        invH_ = 1.0/h_;
+        times_.resize(n_+1);
+        logDiscounts_.resize(n_+1);
+        slopes_.resize(n_);
+        for (QuantLib::Size i=0; i<n_; ++i) {
+            times_[i] = i*h_;
+            logDiscounts_[i] = std::log(source_->discount(times_[i], true));
+        }
+        times_[n_] = gridEnd_;
+        logDiscounts_[n_] = std::log(source_->discount(gridEnd_, true));
+        for (QuantLib::Size i=0; i<n_; ++i)
+            slopes_[i] = logDiscounts_[i+1] - logDiscounts_[i];
+
+        // validate against the source curve where the linear
+        // interpolation of the log-discounts is least accurate
+        maxError_ = 0.0;
+        for (QuantLib::Size i=0; i<n_; ++i) {
+            QuantLib::DiscountFactor cached =
+                std::exp(logDiscounts_[i] + 0.5*slopes_[i]);
+            QuantLib::DiscountFactor exact =
+                source_->discount(times_[i] + 0.5*h_, true);
+            maxError_ = std::max(maxError_, std::fabs(cached - exact));
+        }
+        QL_REQUIRE(tolerance_ <= 0.0 || maxError_ <= tolerance_,
+                   "grid discount error (" << maxError_ <<
+                   ") exceeds tolerance (" << tolerance_ <<
+                   "): increase the number of grid intervals (" << n_ << ")");
+    }
+
+    QuantLib::DiscountFactor GridCachedTermStructure::discountImpl(
+                                                    QuantLib::Time t) const {
+        calculate();
+        if (t > gridEnd_)
+            return source_->discount(t, true);
+        QuantLib::Real x = t*invH_;
+        QuantLib::Size i = std::min(static_cast<QuantLib::Size>(x), n_-1);
+        return std::exp(logDiscounts_[i] + (x-i)*slopes_[i]);
+    }
+
+    void GridCachedTermStructure::discounts(
+                    const std::vector<QuantLib::Time>& times,
+                    std::vector<QuantLib::DiscountFactor>& result) const {
+        calculate();
+        QuantLib::Size n = times.size();
+        result.resize(n);
+        // the first two loops are branch-free so that they vectorize
+        for (QuantLib::Size k=0; k<n; ++k) {
+            QuantLib::Real x = std::min(times[k], gridEnd_)*invH_;
+            QuantLib::Size i = std::min(static_cast<QuantLib::Size>(x), n_-1);
+            result[k] = logDiscounts_[i] + (x-i)*slopes_[i];
+        }
+        for (QuantLib::Size k=0; k<n; ++k)
+            result[k] = std::exp(result[k]);
+        for (QuantLib::Size k=0; k<n; ++k) {
+            if (times[k] > gridEnd_)
+                result[k] = source_->discount(times[k], true);
+        }
+    }
+
+    GridCachedYieldCurve::GridCachedYieldCurve(
+            const shared_ptr<ValueObject>& prop,
+            const QuantLib::Handle<QuantLib::YieldTermStructure>& source,
+            QuantLib::Time horizon,
+            QuantLib::Size gridIntervals,
+            QuantLib::Real tolerance,
+            bool perm)
+    : YieldTermStructure(prop, perm)
+    {
+        shared_ptr<GridCachedTermStructure> grid(new
+            GridCachedTermStructure(source, horizon, gridIntervals, tolerance));
+        // a grid failing its tolerance is reported when the object is
+        // built rather than on its first query
+        if (tolerance > 0.0)
+            grid->maxError();
+        libraryObject_ = grid;
+    }
+
+    const std::vector<QuantLib::Time>& GridCachedYieldCurve::gridTimes() const {
+        return boost::dynamic_pointer_cast<GridCachedTermStructure>(
+                                                libraryObject_)->gridTimes();
+    }
+
+    QuantLib::Real GridCachedYieldCurve::maxError() const {
+        return boost::dynamic_pointer_cast<GridCachedTermStructure>(
+                                                libraryObject_)->maxError();
+    }
+
+    namespace {
+
+        typedef std::pair<QuantLib::Date, QuantLib::Size> IndexedDate;
+
+        // discount factors at sorted, distinct times
+        void sortedDiscounts(
+                    const shared_ptr<QuantLib::YieldTermStructure>& curve,
+                    const std::vector<QuantLib::Time>& times,
+                    std::vector<QuantLib::DiscountFactor>& result) {
+            if (times.empty()) {
+                result.clear();
+                return;
+            }
+
+            shared_ptr<GridCachedTermStructure> grid =
+                boost::dynamic_pointer_cast<GridCachedTermStructure>(curve);
+            if (grid) {
+                grid->discounts(times, result);
+                return;
+            }
+
+            result.resize(times.size());
+            shared_ptr<InterpolatedDiscountCurve<QuantLib::LogLinear> > logLinear =
+                boost::dynamic_pointer_cast<
+                    InterpolatedDiscountCurve<QuantLib::LogLinear> >(curve);
+            if (!logLinear || !curve->jumpDates().empty()) {
+                for (QuantLib::Size k=0; k<times.size(); ++k)
+                    result[k] = curve->discount(times[k], true);
+                return;
+            }
+
+            // the first query triggers any pending bootstrap
+            result[0] = curve->discount(times[0], true);
+            const std::vector<QuantLib::Time>& nodes = logLinear->times();
+            const std::vector<QuantLib::Real>& data = logLinear->data();
+            QuantLib::Size m = nodes.size();
+            std::vector<QuantLib::Real> logData(m), slopes(m-1);
+            for (QuantLib::Size j=0; j<m; ++j)
+                logData[j] = std::log(data[j]);
+            for (QuantLib::Size j=0; j<m-1; ++j)
+                slopes[j] = (logData[j+1]-logData[j])/(nodes[j+1]-nodes[j]);
+
+            // walk the nodes with a monotone cursor; times past the last
+            // node are left to the curve's own extrapolation
+            QuantLib::Size k = 0, j = 0;
+            for (; k<times.size() && times[k]<=nodes.back(); ++k) {
+                while (j+2 < m && nodes[j+1] <= times[k])
+                    ++j;
+                result[k] = logData[j] + (times[k]-nodes[j])*slopes[j];
+            }
+            QuantLib::Size inRange = k;
+            for (k=0; k<inRange; ++k)
+                result[k] = std::exp(result[k]);
+            for (k=inRange; k<times.size(); ++k)
+                result[k] = curve->discount(times[k], true);
+        }
+
+    }
+
+    std::vector<QuantLib::DiscountFactor> yieldTSDiscounts(
+            const shared_ptr<QuantLib::YieldTermStructure>& curve,
+            const std::vector<QuantLib::Date>& dates,
+            bool allowExtrapolation) {
+
+        QuantLib::Size n = dates.size();
+        std::vector<IndexedDate> order(n);
+        for (QuantLib::Size i=0; i<n; ++i)
+            order[i] = IndexedDate(dates[i], i);
+        std::sort(order.begin(), order.end());
+
+        QuantLib::Date referenceDate = curve->referenceDate();
+        QuantLib::Date maxDate = curve->maxDate();
+        QuantLib::DayCounter dayCounter = curve->dayCounter();
+        bool extrapolate = allowExtrapolation || curve->allowsExtrapolation();
+
+        std::vector<QuantLib::Time> times;
+        times.reserve(n);
+        std::vector<QuantLib::Size> slot(n);
+        for (QuantLib::Size i=0; i<n; ++i) {
+            const QuantLib::Date& d = order[i].first;
+            if (i == 0 || d != order[i-1].first) {
+                QL_REQUIRE(d >= referenceDate,
+                           "date (" << d << ") before reference date (" <<
+                           referenceDate << ")");
+                QL_REQUIRE(extrapolate || d <= maxDate,
+                           "date (" << d << ") is past max curve date (" <<
+                           maxDate << ")");
+                times.push_back(dayCounter.yearFraction(referenceDate, d));
+            }
+            slot[i] = times.size()-1;
+        }
+
+        std::vector<QuantLib::DiscountFactor> discounts;
+        sortedDiscounts(curve, times, discounts);
+
+        std::vector<QuantLib::DiscountFactor> result(n);
+        for (QuantLib::Size i=0; i<n; ++i)
+            result[order[i].second] = discounts[slot[i]];
+        return result;
+    }
+
+    std::vector<QuantLib::Rate> yieldTSZeroRates(
+            const shared_ptr<QuantLib::YieldTermStructure>& curve,
+            const std::vector<QuantLib::Date>& dates,
+            const QuantLib::DayCounter& resultDayCounter,
+            QuantLib::Compounding compounding,
+            QuantLib::Frequency frequency,
+            bool allowExtrapolation) {
+
+        std::vector<QuantLib::DiscountFactor> discounts =
+            yieldTSDiscounts(curve, dates, allowExtrapolation);
+        QuantLib::Date referenceDate = curve->referenceDate();
+
+        std::vector<QuantLib::Rate> result(dates.size());
+        for (QuantLib::Size i=0; i<dates.size(); ++i) {
+            if (dates[i] == referenceDate)
+                result[i] = curve->zeroRate(dates[i], resultDayCounter,
+                                            compounding, frequency,
+                                            allowExtrapolation).rate();
+            else
+                result[i] = QuantLib::InterestRate::impliedRate(
+                                1.0/discounts[i], resultDayCounter,
+                                compounding, frequency,
+                                referenceDate, dates[i]).rate();
+        }
+        return result;
+    }
+
+    std::vector<QuantLib::Rate> yieldTSForwardRates(
+            const shared_ptr<QuantLib::YieldTermStructure>& curve,
+            const std::vector<QuantLib::Date>& startDates,
+            const std::vector<QuantLib::Date>& endDates,
+            const QuantLib::DayCounter& resultDayCounter,
+            QuantLib::Compounding compounding,
+            QuantLib::Frequency frequency,
+            bool allowExtrapolation) {
+
+        QuantLib::Size n = startDates.size();
+        QL_REQUIRE(endDates.size() == n,
+                   "mismatch between start dates (" << n <<
+                   ") and end dates (" << endDates.size() << ")");
+
+        // a single sorted pass over both sets of dates
+        std::vector<QuantLib::Date> dates(startDates);
+        dates.insert(dates.end(), endDates.begin(), endDates.end());
+        std::vector<QuantLib::DiscountFactor> discounts =
+            yieldTSDiscounts(curve, dates, allowExtrapolation);
+
+        std::vector<QuantLib::Rate> result(n);
+        for (QuantLib::Size i=0; i<n; ++i) {
+            if (startDates[i] == endDates[i]) {
+                result[i] = curve->forwardRate(startDates[i], endDates[i],
+                                               resultDayCounter,
+                                               compounding, frequency,
+                                               allowExtrapolation).rate();
+            } else {
+                QL_REQUIRE(startDates[i] < endDates[i],
+                           startDates[i] << " later than " << endDates[i]);
+                result[i] = QuantLib::InterestRate::impliedRate(
+                                discounts[i]/discounts[n+i], resultDayCounter,
+                                compounding, frequency,
+                                startDates[i], endDates[i]).rate();
+            }
+        }
+        return result;
+    }
+
     // Stream operator to write a InterpolatedYieldCurvePair to a stream - for logging / error handling.
     std::ostream &operator<<(std::ostream &out,
                              InterpolatedYieldCurvePair tokenPair)
@@ -30,6 +30,8 @@
 #include <ql/compounding.hpp>
 #include <ql/types.hpp>
 #include <ql/math/interpolations/mixedinterpolation.hpp>
+#include <ql/termstructures/yieldtermstructure.hpp>
+#include <ql/patterns/lazyobject.hpp>
 
 namespace QuantLib {
     class Calendar;
@@ -163,6 +165,109 @@ namespace QuantLibAddin {
         std::string traitsID_, interpolatorID_;
     };
 
+    //! Yield curve sampled once on a dense uniform time grid
+    /*! The source curve is sampled on t_i = i*h, i = 0..n, and
+        discount factors are returned by index arithmetic plus linear
+        interpolation of the log-discounts, i.e. with flat forwards
+        between grid nodes.  Times beyond the grid are delegated to the
+        source curve.
+
+        Sampling is lazy and is repeated whenever the source curve
+        notifies a change.  After sampling, the interpolation error is
+        measured at the mid-point of each grid interval; this samples
+        the error and is not a bound on it, e.g., near forward jumps at
+        the pillars of a bootstrapped curve, where the error is of the
+        order of the jump times the grid spacing.  If a positive
+        tolerance is given, the measured error is checked against it
+        and sampling fails when it is exceeded; by default no check is
+        made.  A zero horizon samples the whole source curve.
+    */
+    class GridCachedTermStructure : public QuantLib::YieldTermStructure,
+                                    public QuantLib::LazyObject {
+      public:
+        GridCachedTermStructure(
+            const QuantLib::Handle<QuantLib::YieldTermStructure>& source,
+            QuantLib::Time horizon,
+            QuantLib::Size gridIntervals,
+            QuantLib::Real tolerance);
+        //! \name TermStructure interface
+        //@{
+        QuantLib::DayCounter dayCounter() const;
+        QuantLib::Calendar calendar() const;
+        QuantLib::Natural settlementDays() const;
+        const QuantLib::Date& referenceDate() const;
+        QuantLib::Date maxDate() const;
+        QuantLib::Time maxTime() const;
+        //@}
+        //! \name Observer interface
+        //@{
+        void update();
+        //@}
+        //! \name Inspectors
+        //@{
+        const std::vector<QuantLib::Time>& gridTimes() const;
+        //! max absolute discount error sampled at the interval mid-points
+        QuantLib::Real maxError() const;
+        //@}
+        //! discount factors at the given times, evaluated in one pass
+        void discounts(const std::vector<QuantLib::Time>& times,
+                       std::vector<QuantLib::DiscountFactor>& result) const;
+      protected:
+        QuantLib::DiscountFactor discountImpl(QuantLib::Time t) const;
+        void performCalculations() const;
+      private:
+        QuantLib::Handle<QuantLib::YieldTermStructure> source_;
+        QuantLib::Time horizon_;
+        QuantLib::Size n_;
+        QuantLib::Real tolerance_;
+        mutable QuantLib::Time h_, invH_, gridEnd_;
+        mutable std::vector<QuantLib::Time> times_;
+        mutable std::vector<QuantLib::Real> logDiscounts_, slopes_;
+        mutable QuantLib::Real maxError_;
+    };
+
+    class GridCachedYieldCurve : public YieldTermStructure {
+      public:
+        GridCachedYieldCurve(
+            const boost::shared_ptr<ObjectHandler::ValueObject>& properties,
+            const QuantLib::Handle<QuantLib::YieldTermStructure>& source,
+            QuantLib::Time horizon,
+            QuantLib::Size gridIntervals,
+            QuantLib::Real tolerance,
+            bool permanent);
+        const std::vector<QuantLib::Time>& gridTimes() const;
+        QuantLib::Real maxError() const;
+    };
+
+
+    /*! Batch versions of the YieldTermStructure inspectors.  The dates
+        are sorted internally so that each distinct date is converted to
+        a time only once and, for log-linear discount curves and
+        GridCachedTermStructure, the curve nodes are walked with a
+        monotone cursor instead of being searched for each point.
+        Results are returned in the order of the input dates.
+    */
+    std::vector<QuantLib::DiscountFactor> yieldTSDiscounts(
+        const boost::shared_ptr<QuantLib::YieldTermStructure>& curve,
+        const std::vector<QuantLib::Date>& dates,
+        bool allowExtrapolation);
+
+    std::vector<QuantLib::Rate> yieldTSZeroRates(
+        const boost::shared_ptr<QuantLib::YieldTermStructure>& curve,
+        const std::vector<QuantLib::Date>& dates,
+        const QuantLib::DayCounter& resultDayCounter,
+        QuantLib::Compounding compounding,
+        QuantLib::Frequency frequency,
+        bool allowExtrapolation);
+
+    std::vector<QuantLib::Rate> yieldTSForwardRates(
+        const boost::shared_ptr<QuantLib::YieldTermStructure>& curve,
+        const std::vector<QuantLib::Date>& startDates,
+        const std::vector<QuantLib::Date>& endDates,
+        const QuantLib::DayCounter& resultDayCounter,
+        QuantLib::Compounding compounding,
+        QuantLib::Frequency frequency,
+        bool allowExtrapolation);
 
     // A pair indicating a combination of Traits / Interpolator.
     typedef std::pair<InterpolatedYieldCurve::Traits, InterpolatedYieldCurve::Interpolator> InterpolatedYieldCurvePair;